@@ -0,0 +1,97 @@
+#include <WiFi.h>
+#include <ESP32OtaMqtt.h>
+
+// The updater in its own task on core 0, while loop() runs a 1 kHz control
+// step on core 1 and reports its worst lateness. The sketch only talks to the
+// updater through commands (Serial: p = pause, r = resume, b = background,
+// u = urgent, f = force the test update, x = reset); callbacks run in loop().
+
+const char* ssid = "your_wifi_ssid";
+const char* password = "your_wifi_password";
+const char* mqtt_server = "your_mqtt_broker.com";
+
+const char* test_version = "1.0.1";
+const char* test_url = "https://your_server.com/firmware.bin";
+const char* test_checksum = "0000000000000000000000000000000000000000000000000000000000000000";
+
+const unsigned long CONTROL_PERIOD_US = 1000;
+
+ESP32OtaMqtt otaUpdater("device/esp32_001/ota");
+
+unsigned long nextControl = 0;
+unsigned long worstLateness = 0;
+unsigned long lastReport = 0;
+
+void onOtaEvent(const OtaEvent& event, void* context) {
+    if (event.type == OtaEventType::PROGRESS) {
+        Serial.printf("[APP] %u/%u bytes\n", (unsigned)event.bytesDone, (unsigned)event.bytesTotal);
+    } else {
+        Serial.printf("[APP] %s\n", OtaEventQueue::statusName(event.status));
+    }
+}
+
+void onOtaError(const String& error, int errorCode) {
+    Serial.printf("[APP] Error: %s (%d)\n", error.c_str(), errorCode);
+}
+
+void controlStep() {
+    // Stand-in for real-time work
+}
+
+void handleSerial() {
+    switch (Serial.read()) {
+        case 'p': otaUpdater.pause(); break;
+        case 'r': otaUpdater.resume(); break;
+        case 'b': otaUpdater.setPriority(OtaPriority::BACKGROUND); break;
+        case 'u': otaUpdater.setPriority(OtaPriority::URGENT); break;
+        case 'f': otaUpdater.forceUpdate(test_version, test_url, test_checksum); break;
+        case 'x': otaUpdater.reset(); break;
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+    WiFi.begin(ssid, password);
+    while (WiFi.status() != WL_CONNECTED) {
+        delay(500);
+    }
+
+    // All configuration before begin(): afterwards the updater task owns it
+    OtaConfig config;
+    config.currentVersion = "1.0.0";
+    config.runInTask = true;
+    config.taskCore = 0;            // loop() runs on core 1
+    config.taskPriority = 1;
+    config.taskStackSize = 8192;
+    otaUpdater.setConfig(config);
+    otaUpdater.setMqttServer(mqtt_server, 8883);
+    otaUpdater.setInsecure();       // Testing only
+    otaUpdater.onEvent(onOtaEvent);
+    otaUpdater.onError(onOtaError);
+
+    if (!otaUpdater.begin()) {
+        Serial.println("[APP] OTA updater failed to start");
+    }
+    nextControl = micros();
+}
+
+void loop() {
+    unsigned long now = micros();
+    if ((long)(now - nextControl) >= 0) {
+        worstLateness = max(worstLateness, now - nextControl);
+        nextControl += CONTROL_PERIOD_US;
+        controlStep();
+    }
+
+    // Delivers the updater's events; the update itself runs on core 0
+    otaUpdater.loop();
+    handleSerial();
+
+    if (millis() - lastReport >= 5000) {
+        lastReport = millis();
+        Serial.printf("[APP] Worst control lateness: %lu us, OTA %s%s, %u commands dropped\n",
+                      worstLateness, otaUpdater.getStatusString().c_str(), otaUpdater.isPaused() ? " (paused)" : "",
+                      (unsigned)otaUpdater.getDroppedCommands());
+        worstLateness = 0;
+    }
+}
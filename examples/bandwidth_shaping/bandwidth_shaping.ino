@@ -0,0 +1,79 @@
+#include <ESP32OtaMqtt.h>
+
+// Achieved rate of the download rate limiter against its configuration.
+// A simulated reader asks OtaRateLimiter for up to 1 KB every millisecond,
+// as the download does in loop(), for a few seconds per setting. Over a run
+// of T seconds the bytes moved must stay within rate * T + burst and come
+// within 2% of rate * T. No WiFi needed.
+
+const unsigned long RUN_MS = 5000;
+const size_t READ_SIZE = 1024;
+
+struct Setting {
+    uint32_t rate;
+    size_t burst;
+};
+
+const Setting SETTINGS[] = {
+    {4096, 1024},
+    {32768, 16384},
+    {100000, 4096},
+    {400000, 65536},
+};
+const size_t SETTING_COUNT = sizeof(SETTINGS) / sizeof(SETTINGS[0]);
+
+// Bytes moved in durationMs, starting from a full bucket
+uint64_t run(OtaRateLimiter& limiter, unsigned long durationMs) {
+    uint64_t moved = 0;
+    unsigned long start = millis();
+    limiter.reset(micros());
+    while (millis() - start < durationMs) {
+        size_t allowed = limiter.allowance(micros(), READ_SIZE);
+        limiter.consume(allowed);
+        moved += allowed;
+        delay(1);
+    }
+    return moved;
+}
+
+bool check(uint32_t rate, size_t burst, unsigned long durationMs, uint64_t moved) {
+    uint64_t expected = (uint64_t)rate * durationMs / 1000;
+    return moved <= expected + burst && moved * 100 >= expected * 98;
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    Serial.printf("\nRate limiter, %lu ms per setting, reads of up to %u bytes per ms\n", RUN_MS, (unsigned)READ_SIZE);
+    Serial.println("  limit B/s    burst    moved B   achieved B/s  result");
+
+    bool allPassed = true;
+    OtaRateLimiter limiter;
+    for (size_t i = 0; i < SETTING_COUNT; i++) {
+        limiter.configure(SETTINGS[i].rate, SETTINGS[i].burst);
+        uint64_t moved = run(limiter, RUN_MS);
+        bool passed = check(SETTINGS[i].rate, SETTINGS[i].burst, RUN_MS, moved);
+        allPassed &= passed;
+        Serial.printf("%11lu %8u %10llu %14llu  %s\n", (unsigned long)SETTINGS[i].rate, (unsigned)SETTINGS[i].burst,
+                      moved, moved * 1000 / RUN_MS, passed ? "ok" : "FAIL");
+    }
+
+    // Switching modes mid-run: BACKGROUND, then URGENT (unlimited), then a paused claim
+    limiter.configure(8192, 2048);
+    uint64_t background = run(limiter, 2000);
+    limiter.configure(OtaRateLimiter::UNLIMITED, 2048);
+    uint64_t urgent = run(limiter, 1000);
+    limiter.configure(0, 2048);
+    uint64_t paused = run(limiter, 1000);
+    bool switched = check(8192, 2048, 2000, background) && urgent > 8192 && paused <= 2048;
+    allPassed &= switched;
+    Serial.printf("Mode switch: %llu B at 8192 B/s, %llu B unlimited, %llu B paused  %s\n",
+                  background, urgent, paused, switched ? "ok" : "FAIL");
+
+    Serial.println(allPassed ? "All settings within limits" : "Some settings out of limits");
+}
+
+void loop() {
+    delay(1000);
+}
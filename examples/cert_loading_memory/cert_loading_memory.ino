@@ -0,0 +1,136 @@
+#include <SPIFFS.h>
+#include <esp_heap_caps.h>
+#include <esp_idf_version.h>
+#include <mbedtls/x509_crt.h>
+#include <ESP32OtaMqtt.h>
+
+// Peak and retained heap while loading CA certificates from SPIFFS:
+//   readString   the previous setCACertFromFile(): whole file into a String,
+//                copied once more, then parsed from PEM
+//   streaming    OtaPemDecoder into an OtaTrustStore, one DER block at a time
+//   bundle       OtaCertBundle: index lookup and one CA decoded, as done per
+//                connection when setCABundle() is used
+// Upload a PEM file with several CAs (e.g. a CA store) as /certs/ca.crt and
+// the bundle made from it as /certs/ca.bundle:
+//   python3 tools/gen_ca_bundle.py -o data/certs/ca.bundle data/certs/ca.crt
+//   pio run -t uploadfs
+// Peak use needs ESP-IDF 5.1 or later (Arduino core 3.x); otherwise only the
+// retained heap is shown.
+
+const char* CA_PATH = "/certs/ca.crt";
+const char* BUNDLE_PATH = "/certs/ca.bundle";
+const size_t PEM_BLOCK_SIZE = 4096;
+
+uint8_t subject[256];       // Subject of the first CA in the file, looked up in the bundle
+size_t subjectLength = 0;
+
+struct Measurement {
+    size_t before;
+    size_t low;
+};
+
+Measurement beginMeasurement() {
+    Measurement m;
+    m.before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    heap_caps_monitor_local_minimum_free_size_start();
+#endif
+    return m;
+}
+
+// retained: heap still held by what was loaded, measured before it is freed
+void endMeasurement(const char* label, Measurement& m, size_t retained) {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    m.low = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_stop();
+    Serial.printf("%-12s  peak %6u bytes  retained %6u bytes\n", label, (unsigned)(m.before - m.low), (unsigned)retained);
+#else
+    Serial.printf("%-12s  peak    n/a        retained %6u bytes\n", label, (unsigned)retained);
+#endif
+}
+
+void measureReadString() {
+    Measurement m = beginMeasurement();
+    File file = SPIFFS.open(CA_PATH, "r");
+    String cert = file.readString();
+    file.close();
+    String stored = String(cert.c_str());   // this->caCert
+    mbedtls_x509_crt chain;
+    mbedtls_x509_crt_init(&chain);
+    int ret = mbedtls_x509_crt_parse(&chain, (const unsigned char*)stored.c_str(), stored.length() + 1);
+    size_t retained = m.before - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    if (ret < 0) Serial.printf("readString: parse failed (-0x%04x)\n", -ret);
+    mbedtls_x509_crt_free(&chain);
+    cert = String();
+    stored = String();
+    endMeasurement("readString", m, retained);
+}
+
+void measureStreaming() {
+    Measurement m = beginMeasurement();
+    OtaTrustStore* store = new OtaTrustStore();
+    File file = SPIFFS.open(CA_PATH, "r");
+    uint8_t* der = new uint8_t[PEM_BLOCK_SIZE];
+    OtaPemDecoder pem(file, der, PEM_BLOCK_SIZE);
+    int count = 0;
+    while (pem.next() == OtaPemDecoder::Result::BLOCK) {
+        if (count == 0 && pem.size() > 0) {
+            // Remember the first subject for the bundle lookup below
+            mbedtls_x509_crt crt;
+            mbedtls_x509_crt_init(&crt);
+            if (mbedtls_x509_crt_parse_der(&crt, pem.data(), pem.size()) == 0 && crt.subject_raw.len <= sizeof(subject)) {
+                memcpy(subject, crt.subject_raw.p, crt.subject_raw.len);
+                subjectLength = crt.subject_raw.len;
+            }
+            mbedtls_x509_crt_free(&crt);
+        }
+        if (store->addCA(pem.data(), pem.size())) count++;
+    }
+    delete[] der;
+    file.close();
+    size_t retained = m.before - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    delete store;
+    endMeasurement("streaming", m, retained);
+    Serial.printf("              %d certificates\n", count);
+}
+
+void measureBundle() {
+    if (subjectLength == 0) return;
+    Measurement m = beginMeasurement();
+    OtaCertBundle* bundle = new OtaCertBundle();
+    mbedtls_x509_crt chain;
+    mbedtls_x509_crt_init(&chain);
+    size_t found = 0;
+    if (bundle->open(SPIFFS, BUNDLE_PATH)) {
+        found = bundle->load(subject, subjectLength, &chain);
+    }
+    size_t retained = m.before - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    mbedtls_x509_crt_free(&chain);
+    size_t count = bundle->getCount();
+    delete bundle;
+    endMeasurement("bundle", m, retained);
+    Serial.printf("              %u of %u certificates decoded\n", (unsigned)found, (unsigned)count);
+}
+
+void setup() {
+    Serial.begin(115200);
+    if (!SPIFFS.begin(true)) {
+        Serial.println("SPIFFS mount failed");
+        return;
+    }
+    File file = SPIFFS.open(CA_PATH, "r");
+    if (!file) {
+        Serial.printf("%s not found\n", CA_PATH);
+        return;
+    }
+    Serial.printf("CA loading heap use, %s (%u bytes)\n", CA_PATH, (unsigned)file.size());
+    file.close();
+
+    measureReadString();
+    measureStreaming();
+    measureBundle();
+}
+
+void loop() {
+    delay(1000);
+}
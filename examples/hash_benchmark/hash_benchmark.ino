@@ -0,0 +1,66 @@
+#include <ESP32OtaMqtt.h>
+
+// Measures SHA256 throughput of each hash backend, using the same slice
+// sizes the download path hands to the hasher. No WiFi or MQTT needed.
+
+const size_t TOTAL_BYTES = 1024 * 1024;           // Data hashed per run
+const size_t SLICE_SIZES[] = {512, 1024, 4096};   // chunkSize default, serial buffer, pipeline slice
+
+const OtaHashBackend BACKENDS[] = {
+    OtaHashBackend::SOFTWARE,
+    OtaHashBackend::HARDWARE,
+    OtaHashBackend::OFFLOAD
+};
+
+uint8_t buffer[4096];
+
+void runBenchmark(OtaHashBackend backend, size_t sliceSize) {
+    OtaSha256 hash;
+    hash.begin(backend);
+    if (hash.getBackend() != backend) {
+        Serial.printf("%-9s  %5u  unavailable\n", OtaSha256::backendName(backend), (unsigned)sliceSize);
+        hash.end();
+        return;
+    }
+
+    // Time spent in update() is what processDownloadChunk() pays per slice
+    unsigned long updateMicros = 0;
+    unsigned long start = micros();
+    for (size_t done = 0; done < TOTAL_BYTES; done += sliceSize) {
+        unsigned long sliceStart = micros();
+        hash.update(buffer, sliceSize);
+        updateMicros += micros() - sliceStart;
+    }
+    uint8_t digest[OtaSha256::DIGEST_SIZE];
+    hash.finish(digest);
+    unsigned long totalMicros = micros() - start;
+
+    size_t slices = TOTAL_BYTES / sliceSize;
+    Serial.printf("%-9s  %5u  %8.2f MB/s  %8.2f MB/s  %7.1f us/slice\n",
+                  OtaSha256::backendName(backend), (unsigned)sliceSize,
+                  (float)TOTAL_BYTES / totalMicros,
+                  (float)TOTAL_BYTES / updateMicros,
+                  (float)updateMicros / slices);
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = (uint8_t)(i * 31 + 7);
+    }
+
+    Serial.println("SHA256 backend benchmark (1 MB per run)");
+    Serial.println("backend    slice    end-to-end     caller-side    caller cost");
+    for (OtaHashBackend backend : BACKENDS) {
+        for (size_t sliceSize : SLICE_SIZES) {
+            runBenchmark(backend, sliceSize);
+        }
+    }
+    Serial.println("Caller-side is the rate loop() sees; for offload it is the ring copy.");
+}
+
+void loop() {
+    delay(1000);
+}
@@ -0,0 +1,75 @@
+#include <ESP32OtaMqtt.h>
+
+// Cycles per call for three ways of logging the same progress line:
+//   string:   the previous OTA_LOG macro (String concatenation + Serial.println)
+//   deferred: OTA_LOGI, a binary record appended to the log ring
+//   disabled: OTA_LOGD with the default OTA_LOG_LEVEL (INFO), compiled out
+// The ring is drained between batches so no record is dropped; draining is
+// not counted, just as it is deferred to idle loop() calls in the library.
+
+const int CALLS = 200;
+const int BATCH = 16;   // Records per batch, fits the 2 KB ring
+
+volatile uint32_t sink;
+
+void drain() {
+    char line[OtaLog::LINE_SIZE];
+    size_t length;
+    while ((length = OtaLog::peekLine(line, sizeof(line))) > 0) {
+        Serial.write((const uint8_t*)line, length);
+        Serial.write((const uint8_t*)"\r\n", 2);
+        OtaLog::pop();
+    }
+    Serial.flush();
+}
+
+void report(const char* name, uint64_t cycles) {
+    Serial.printf("%-10s %8u cycles/call\n", name, (unsigned)(cycles / CALLS));
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+    OtaLog::begin(2048);
+
+    size_t downloaded = 123456;
+    size_t total = 987654;
+
+    // Previous macro
+    uint64_t stringCycles = 0;
+    for (int i = 0; i < CALLS; i++) {
+        uint32_t start = ESP.getCycleCount();
+        Serial.println(String("[OTA] ") + "Resuming download at byte " + String(downloaded + i) + "/" +
+                       String(total));
+        stringCycles += ESP.getCycleCount() - start;
+    }
+    Serial.flush();
+
+    uint64_t deferredCycles = 0;
+    for (int i = 0; i < CALLS; i += BATCH) {
+        for (int j = i; j < i + BATCH && j < CALLS; j++) {
+            uint32_t start = ESP.getCycleCount();
+            OTA_LOGI("Resuming download at byte %u/%u", (unsigned)(downloaded + j), (unsigned)total);
+            deferredCycles += ESP.getCycleCount() - start;
+        }
+        drain();
+    }
+
+    uint64_t disabledCycles = 0;
+    for (int i = 0; i < CALLS; i++) {
+        uint32_t start = ESP.getCycleCount();
+        OTA_LOGD("Resuming download at byte %u/%u", (unsigned)(downloaded + i), (unsigned)total);
+        disabledCycles += ESP.getCycleCount() - start;
+        sink = i;
+    }
+
+    Serial.printf("\nLog benchmark, %d calls each\n", CALLS);
+    report("string", stringCycles);
+    report("deferred", deferredCycles);
+    report("disabled", disabledCycles);
+    Serial.printf("dropped records: %u\n", (unsigned)OtaLog::getDropped());
+}
+
+void loop() {
+    delay(1000);
+}
@@ -0,0 +1,143 @@
+#include <ESP32OtaMqtt.h>
+
+// Time to extract the manifest fields from update messages of growing size:
+//   string:    the previous parser (payload copied into a String one char at
+//              a time, then one indexOf scan and substring per field)
+//   tokenizer: OtaJson, one in-place pass over the payload
+// The messages carry the usual fields plus release notes and a nested
+// metadata object, as richer manifests do; "version" comes last, after the
+// nested one the previous parser picks up instead. No WiFi or MQTT needed.
+
+const int RUNS = 20;
+const size_t NOTE_COUNTS[] = {4, 32, 128};    // Release note entries per message
+
+const char* const KEYS[] = {
+    "version", "firmware_url", "checksum", "command", "patch_url", "base_version", "compression",
+    "compression_window", "compression_lookahead", "checksum_scope", "image_size"
+};
+const size_t KEY_COUNT = sizeof(KEYS) / sizeof(KEYS[0]);
+
+String message;
+char* payload;      // Message bytes as they arrive from the MQTT client
+char* work;         // Copy parsed in place by the tokenizer
+
+// Previous extractJsonValue()
+String extractJsonValue(const String& json, const String& key) {
+    int keyIndex = json.indexOf("\"" + key + "\"");
+    if (keyIndex == -1) return "";
+    int colonIndex = json.indexOf(":", keyIndex);
+    if (colonIndex == -1) return "";
+    int startIndex = colonIndex + 1;
+    while (startIndex < (int)json.length() && isspace(json.charAt(startIndex))) startIndex++;
+    if (startIndex >= (int)json.length()) return "";
+    if (json.charAt(startIndex) != '"') {
+        int endIndex = startIndex;
+        while (endIndex < (int)json.length() && json.charAt(endIndex) != ',' &&
+               json.charAt(endIndex) != '}' && !isspace(json.charAt(endIndex))) {
+            endIndex++;
+        }
+        return json.substring(startIndex, endIndex);
+    }
+    startIndex++;
+    int endIndex = json.indexOf("\"", startIndex);
+    if (endIndex == -1) return "";
+    return json.substring(startIndex, endIndex);
+}
+
+struct Fields {
+    OtaJsonView values[KEY_COUNT];
+};
+
+bool onValue(void* context, const OtaJsonEvent& event) {
+    if (event.depth != 1 || event.type == OtaJsonType::OBJECT || event.type == OtaJsonType::ARRAY ||
+        event.type == OtaJsonType::END) {
+        return true;
+    }
+    Fields& fields = *static_cast<Fields*>(context);
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        if (event.key() == KEYS[i]) {
+            fields.values[i] = event.value;
+            break;
+        }
+    }
+    return true;
+}
+
+void buildMessage(size_t notes) {
+    message = "{\"command\":\"update\",\"release_notes\":[";
+    for (size_t i = 0; i < notes; i++) {
+        if (i > 0) message += ",";
+        message += "{\"id\":" + String(i) + ",\"text\":\"Fixed \\\"version\\\" handling in module " +
+                   String(i) + "\",\"tags\":[\"fix\",\"core\"]}";
+    }
+    message += "],\"metadata\":{\"build\":{\"version\":\"ignored\",\"host\":\"ci-7\"},\"size\":1048576},"
+               "\"firmware_url\":\"https://releases.example.com/firmware-1.4.0.bin\","
+               "\"mirrors\":[\"https://cdn1.example.com/fw.bin\",\"https://cdn2.example.com/fw.bin\"],"
+               "\"checksum\":\"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855\","
+               "\"compression\":\"gzip\",\"image_size\":1048576,\"version\":\"1.4.0\"}";
+    free(payload);
+    free(work);
+    payload = (char*)malloc(message.length());
+    work = (char*)malloc(message.length());
+    memcpy(payload, message.c_str(), message.length());
+}
+
+void runBenchmark(size_t notes) {
+    buildMessage(notes);
+    size_t length = message.length();
+
+    unsigned long stringMicros = 0;
+    size_t stringFound = 0;
+    String stringVersion;
+    for (int run = 0; run < RUNS; run++) {
+        unsigned long start = micros();
+        String copy;
+        for (size_t i = 0; i < length; i++) {
+            copy += payload[i];
+        }
+        stringFound = 0;
+        for (size_t i = 0; i < KEY_COUNT; i++) {
+            if (!extractJsonValue(copy, KEYS[i]).isEmpty()) stringFound++;
+        }
+        stringMicros += micros() - start;
+        stringVersion = extractJsonValue(copy, "version");
+    }
+
+    // The copy stands in for a fresh MQTT payload and is not timed
+    unsigned long tokenizerMicros = 0;
+    size_t tokenizerFound = 0;
+    bool valid = true;
+    String tokenizerVersion;
+    for (int run = 0; run < RUNS; run++) {
+        memcpy(work, payload, length);
+        Fields fields;
+        OtaJson json;
+        unsigned long start = micros();
+        valid = json.parse(work, length, onValue, &fields);
+        tokenizerMicros += micros() - start;
+        tokenizerFound = 0;
+        for (size_t i = 0; i < KEY_COUNT; i++) {
+            if (!fields.values[i].isEmpty()) tokenizerFound++;
+        }
+        tokenizerVersion = String(fields.values[0].data);
+    }
+
+    Serial.printf("%6u  %9lu us  %9lu us  %2u/%2u  %s/%s%s\n", (unsigned)length, stringMicros / RUNS,
+                  tokenizerMicros / RUNS, (unsigned)stringFound, (unsigned)tokenizerFound,
+                  stringVersion.c_str(), tokenizerVersion.c_str(), valid ? "" : "  (parse error)");
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    Serial.printf("\nManifest parsing, %d runs each\n", RUNS);
+    Serial.println(" bytes     string   tokenizer  fields  version (string/tokenizer)");
+    for (size_t notes : NOTE_COUNTS) {
+        runBenchmark(notes);
+    }
+}
+
+void loop() {
+    delay(1000);
+}
@@ -0,0 +1,185 @@
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <ESP32OtaMqtt.h>
+
+// Worst-case time the sketch loses to MQTT while connecting: PubSubClient's
+// blocking connect() against OtaMqttEngine's loop(). A slow broker stand-in
+// runs in its own task on 127.0.0.1: it holds CONNACK back and sends every
+// reply one byte at a time, as a broker behind a bad link would. Both clients
+// connect, subscribe and wait for one message from it.
+
+const char* ssid = "your_wifi_ssid";
+const char* password = "your_wifi_password";
+
+const uint16_t BROKER_PORT = 1883;
+const unsigned long CONNACK_DELAY_MS = 2000;   // Broker "thinking" before CONNACK
+const unsigned long FRAGMENT_GAP_MS = 20;      // Between bytes of a reply
+const char* TOPIC = "bench/data";
+const size_t PAYLOAD_SIZE = 100;
+const unsigned long RUN_TIMEOUT_MS = 30000;
+
+WiFiServer broker(BROKER_PORT);
+volatile bool messageReceived = false;
+
+// ---- Broker stand-in ----
+
+static bool readByte(WiFiClient& peer, uint8_t& value) {
+    unsigned long start = millis();
+    while (!peer.available()) {
+        if (!peer.connected() || millis() - start > RUN_TIMEOUT_MS) return false;
+        vTaskDelay(1);
+    }
+    value = (uint8_t)peer.read();
+    return true;
+}
+
+static void sendSlowly(WiFiClient& peer, const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        peer.write(data[i]);
+        vTaskDelay(pdMS_TO_TICKS(FRAGMENT_GAP_MS));
+    }
+}
+
+// Answers CONNECT, SUBSCRIBE (with one PUBLISH on TOPIC) and PINGREQ until the client leaves
+static void serve(WiFiClient& peer) {
+    uint8_t body[128];
+    while (true) {
+        uint8_t header, digit;
+        uint32_t length = 0, multiplier = 1;
+        if (!readByte(peer, header)) return;
+        do {
+            if (!readByte(peer, digit)) return;
+            length += (digit & 0x7F) * multiplier;
+            multiplier *= 128;
+        } while (digit & 0x80);
+        for (uint32_t i = 0; i < length; i++) {
+            uint8_t value;
+            if (!readByte(peer, value)) return;
+            if (i < sizeof(body)) body[i] = value;
+        }
+
+        switch (header >> 4) {
+            case 1: {   // CONNECT
+                vTaskDelay(pdMS_TO_TICKS(CONNACK_DELAY_MS));
+                const uint8_t connack[] = {0x20, 0x02, 0x00, 0x00};
+                sendSlowly(peer, connack, sizeof(connack));
+                break;
+            }
+            case 8: {   // SUBSCRIBE: SUBACK granting QoS 0, then a message
+                const uint8_t suback[] = {0x90, 0x03, body[0], body[1], 0x00};
+                sendSlowly(peer, suback, sizeof(suback));
+                uint8_t publish[4 + 16 + PAYLOAD_SIZE];
+                size_t topicLength = strlen(TOPIC);
+                size_t n = 0;
+                publish[n++] = 0x30;
+                publish[n++] = (uint8_t)(2 + topicLength + PAYLOAD_SIZE);
+                publish[n++] = 0;
+                publish[n++] = (uint8_t)topicLength;
+                memcpy(publish + n, TOPIC, topicLength);
+                n += topicLength;
+                memset(publish + n, 'x', PAYLOAD_SIZE);
+                n += PAYLOAD_SIZE;
+                sendSlowly(peer, publish, n);
+                break;
+            }
+            case 12: {  // PINGREQ
+                const uint8_t pingresp[] = {0xD0, 0x00};
+                sendSlowly(peer, pingresp, sizeof(pingresp));
+                break;
+            }
+            case 14:    // DISCONNECT
+                return;
+        }
+    }
+}
+
+static void brokerTask(void*) {
+    broker.begin();
+    while (true) {
+        WiFiClient peer = broker.available();
+        if (!peer) {
+            vTaskDelay(1);
+            continue;
+        }
+        peer.setNoDelay(true);
+        serve(peer);
+        peer.stop();
+    }
+}
+
+// ---- Clients ----
+
+void onMessage(char* topic, uint8_t* payload, unsigned int length) {
+    messageReceived = true;
+}
+
+void runPubSubClient() {
+    WiFiClient plain;
+    PubSubClient mqtt(plain);
+    mqtt.setServer("127.0.0.1", BROKER_PORT);
+    mqtt.setCallback(onMessage);
+    messageReceived = false;
+
+    unsigned long start = millis();
+    unsigned long worst = 0;
+    unsigned long before = micros();
+    bool connected = mqtt.connect("bench-pubsub");
+    worst = micros() - before;
+    if (connected) {
+        mqtt.subscribe(TOPIC);
+        while (!messageReceived && millis() - start < RUN_TIMEOUT_MS) {
+            before = micros();
+            mqtt.loop();
+            worst = max(worst, micros() - before);
+            delay(1);
+        }
+    }
+    Serial.printf("PubSubClient   %8lu us   %6lu ms   %s\n", worst, millis() - start,
+                  messageReceived ? "ok" : "no message");
+    mqtt.disconnect();
+}
+
+void runEngine() {
+    OtaMqttEngine mqtt;
+    mqtt.setServer("127.0.0.1", BROKER_PORT, false);
+    mqtt.setConnectTimeout(RUN_TIMEOUT_MS);
+    mqtt.setCallback(onMessage);
+    messageReceived = false;
+
+    unsigned long start = millis();
+    unsigned long worst = 0;
+    bool subscribed = false;
+    if (mqtt.connect("bench-engine")) {
+        while (!messageReceived && millis() - start < RUN_TIMEOUT_MS) {
+            unsigned long before = micros();
+            bool connected = mqtt.loop();
+            if (connected && !subscribed) subscribed = mqtt.subscribe(TOPIC);
+            worst = max(worst, micros() - before);
+            if (!connected && !mqtt.isConnecting()) break;
+            delay(1);
+        }
+    }
+    Serial.printf("OtaMqttEngine  %8lu us   %6lu ms   %s (state %d)\n", worst, millis() - start,
+                  messageReceived ? "ok" : "no message", mqtt.state());
+    mqtt.disconnect();
+}
+
+void setup() {
+    Serial.begin(115200);
+    WiFi.begin(ssid, password);
+    while (WiFi.status() != WL_CONNECTED) {
+        delay(500);
+    }
+    xTaskCreate(brokerTask, "broker", 4096, nullptr, 1, nullptr);
+    delay(100);
+
+    Serial.printf("\nSlow broker on 127.0.0.1:%u: CONNACK after %lu ms, %lu ms between reply bytes\n",
+                  BROKER_PORT, CONNACK_DELAY_MS, FRAGMENT_GAP_MS);
+    Serial.println("client         worst call   total    result");
+    runPubSubClient();
+    runEngine();
+}
+
+void loop() {
+    delay(1000);
+}
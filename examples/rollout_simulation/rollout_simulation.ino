@@ -0,0 +1,68 @@
+#include <ESP32OtaMqtt.h>
+
+// Simulates the download requests a fleet sends after one update message,
+// using the same cohort and delay functions as the updater. Devices get
+// consecutive MACs, the worst case for a weak hash. Prints the request rate
+// over the jitter window, then checks that raising the percentage only adds
+// devices. No WiFi or MQTT needed.
+
+const uint32_t DEVICES = 10000;
+const char* SEED = "1.4.0";          // The updater uses the version when rollout_seed is absent
+const uint8_t PERCENT = 25;          // rollout_percent
+const uint32_t JITTER_S = 600;       // rollout_jitter
+const uint32_t BUCKET_S = 30;        // Histogram resolution
+const uint32_t BUCKETS = JITTER_S / BUCKET_S;
+
+void deviceMac(uint32_t device, uint8_t* mac) {
+    const uint8_t base[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x00};
+    memcpy(mac, base, sizeof(base));
+    mac[3] = (uint8_t)(device >> 16);
+    mac[4] = (uint8_t)(device >> 8);
+    mac[5] = (uint8_t)device;
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    uint32_t requests[BUCKETS] = {0};
+    uint32_t included = 0;
+    uint32_t peak = 0;
+    for (uint32_t device = 0; device < DEVICES; device++) {
+        uint8_t mac[6];
+        deviceMac(device, mac);
+        uint8_t cohort = OtaRollout::cohort(mac, sizeof(mac), SEED, strlen(SEED));
+        if (!OtaRollout::isIncluded(cohort, PERCENT)) continue;
+        included++;
+        uint32_t delayMs = OtaRollout::startDelay(mac, sizeof(mac), SEED, strlen(SEED), JITTER_S * 1000);
+        uint32_t bucket = delayMs / (BUCKET_S * 1000);
+        requests[bucket]++;
+        peak = max(peak, requests[bucket]);
+    }
+
+    Serial.printf("\n%u devices, rollout %u%% (%u included), jitter %u s\n", (unsigned)DEVICES,
+                  (unsigned)PERCENT, (unsigned)included, (unsigned)JITTER_S);
+    Serial.printf("Without jitter: %u requests in the first second\n", (unsigned)included);
+    Serial.println("   start s   req/s");
+    for (uint32_t b = 0; b < BUCKETS; b++) {
+        char bar[41];
+        size_t width = peak ? requests[b] * 40 / peak : 0;
+        memset(bar, '#', width);
+        bar[width] = '\0';
+        Serial.printf("%10u  %6.2f  %s\n", (unsigned)(b * BUCKET_S), (double)requests[b] / BUCKET_S, bar);
+    }
+
+    // Every device in the 10% stage must also be in the 50% stage
+    uint32_t lost = 0;
+    for (uint32_t device = 0; device < DEVICES; device++) {
+        uint8_t mac[6];
+        deviceMac(device, mac);
+        uint8_t cohort = OtaRollout::cohort(mac, sizeof(mac), SEED, strlen(SEED));
+        if (OtaRollout::isIncluded(cohort, 10) && !OtaRollout::isIncluded(cohort, 50)) lost++;
+    }
+    Serial.printf("Devices dropped between the 10%% and 50%% stage: %u\n", (unsigned)lost);
+}
+
+void loop() {
+    delay(1000);
+}
@@ -0,0 +1,68 @@
+#include <WiFi.h>
+#include <ESP32OtaMqtt.h>
+
+// Measures download throughput of the segmented downloader for 1..8
+// connections. Point it at any HTTP server that supports Range requests;
+// to see the effect of link latency, put the server behind added delay
+// (e.g. "tc qdisc add dev eth0 root netem delay 150ms" on a Linux host).
+// Data is only read back in order, nothing is written to flash.
+
+const char* ssid = "your_wifi_ssid";
+const char* password = "your_wifi_password";
+
+const char* host = "192.168.1.10";       // Test server
+const uint16_t port = 8080;
+const char* path = "/firmware.bin";
+const size_t FILE_SIZE = 1024 * 1024;    // Exact size of the file at path
+const size_t MEMORY_CAP = 32768;         // Same meaning as OtaConfig::segmentMemory
+
+const size_t CONNECTIONS[] = {1, 2, 4, 8};
+
+void runBenchmark(size_t connections) {
+    OtaSegmentedDownload download;
+    size_t blockSize = OtaSegmentedDownload::blockSizeFor(connections, MEMORY_CAP);
+    if (!download.begin(host, port, path, false, 0, FILE_SIZE, blockSize, connections)) {
+        Serial.printf("%5u  failed: %s\n", (unsigned)connections, download.getError());
+        return;
+    }
+
+    unsigned long start = millis();
+    size_t received = 0;
+    while (!download.isComplete() && !download.hasError()) {
+        download.poll(SIZE_MAX);
+        size_t length = 0;
+        while (download.peek(length) != nullptr) {
+            download.consume(length);
+            received += length;
+        }
+        delay(1);
+    }
+    unsigned long elapsed = millis() - start;
+
+    if (download.hasError()) {
+        Serial.printf("%5u  failed after %u bytes: %s\n", (unsigned)connections, (unsigned)received, download.getError());
+        return;
+    }
+    Serial.printf("%5u  %6u  %8lu ms  %8.1f KB/s  %u reconnects\n",
+                  (unsigned)download.getLaneCount(), (unsigned)blockSize, elapsed,
+                  (float)received / elapsed * 1000 / 1024, (unsigned)download.getReconnects());
+}
+
+void setup() {
+    Serial.begin(115200);
+    WiFi.begin(ssid, password);
+    while (WiFi.status() != WL_CONNECTED) {
+        delay(500);
+    }
+
+    Serial.printf("Segmented download benchmark: %u bytes from %s:%u%s\n",
+                  (unsigned)FILE_SIZE, host, port, path);
+    Serial.println("lanes   block     elapsed     throughput");
+    for (size_t connections : CONNECTIONS) {
+        runBenchmark(connections);
+    }
+}
+
+void loop() {
+    delay(1000);
+}
@@ -0,0 +1,79 @@
+#include <WiFi.h>
+#include <ESP32OtaMqtt.h>
+
+// Connects to one HTTPS server repeatedly and prints each TLS handshake
+// time, first without and then with a shared OtaTrustStore. The first
+// connection through the store is a full handshake; later ones offer its
+// cached session and are abbreviated when the server supports session IDs
+// or tickets. Nothing is requested, each connection is closed right away.
+
+const char* ssid = "your_wifi_ssid";
+const char* password = "your_wifi_password";
+
+const char* host = "example.com";        // Any HTTPS server
+const uint16_t port = 443;
+const int CONNECTIONS = 5;
+
+// CA of the server above; leave empty to connect without verification
+const char* caCert = "";
+
+OtaTrustStore trustStore;
+
+unsigned long connectOnce(OtaTrustStore* store, bool& resumed) {
+    OtaAsyncClient* client = OtaAsyncClient::create();
+    if (!client) return 0;
+    if (store) {
+        client->setTrustStore(store);
+    } else if (caCert[0]) {
+        client->setCACert(caCert);      // Parsed again for every connection
+    }
+    if (!caCert[0]) client->setInsecure();
+
+    unsigned long start = millis();
+    client->begin(host, port, true);
+    while (client->poll() != OtaAsyncClient::State::CONNECTED &&
+           client->getState() != OtaAsyncClient::State::FAILED) {
+        delay(1);
+    }
+    unsigned long elapsed = millis() - start;
+    bool ok = client->getState() == OtaAsyncClient::State::CONNECTED;
+    if (!ok) Serial.printf("  failed: %s (%d)\n", client->getError(), client->getErrorCode());
+    resumed = client->isResumed();
+    OtaAsyncClient::destroy(client);
+    return ok ? elapsed : 0;
+}
+
+void runSeries(const char* label, OtaTrustStore* store) {
+    Serial.println(label);
+    for (int i = 0; i < CONNECTIONS; i++) {
+        bool resumed = false;
+        unsigned long elapsed = connectOnce(store, resumed);
+        Serial.printf("  %d  %5lu ms  %s\n", i + 1, elapsed, resumed ? "resumed" : "full");
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+    WiFi.begin(ssid, password);
+    while (WiFi.status() != WL_CONNECTED) {
+        delay(500);
+    }
+    if (caCert[0] && !trustStore.setCACert(caCert)) {
+        Serial.println("Invalid CA certificate");
+        return;
+    }
+
+    Serial.printf("TLS session resumption: %s:%u\n", host, port);
+    runSeries("Without trust store (connect time incl. DNS and TCP):", nullptr);
+    runSeries("With trust store:", &trustStore);
+
+    Serial.printf("Full handshakes:    %u, average %lu us\n",
+                  (unsigned)trustStore.getFullHandshakes(), trustStore.getFullHandshakeMicros());
+    Serial.printf("Resumed handshakes: %u, average %lu us\n",
+                  (unsigned)trustStore.getResumedHandshakes(), trustStore.getResumedHandshakeMicros());
+    Serial.printf("Handshake time saved: %lu ms\n", (unsigned long)(trustStore.getSavedMicros() / 1000));
+}
+
+void loop() {
+    delay(1000);
+}
@@ -0,0 +1,81 @@
+#include <ESP32OtaMqtt.h>
+
+// Cycles per version check for the previous String-based compareVersions()
+// and OtaVersion: parsing an incoming version, then comparing it against the
+// running version (parsed at compile time). No WiFi or MQTT needed.
+
+const int CALLS = 1000;
+
+static constexpr OtaVersion RUNNING = OTA_VERSION("2.4.1-rc.2+build.77");
+
+const char* const OFFERED[] = {"2.4.1", "2.4.1-rc.10", "2.4.0", "10.0.0-alpha.1"};
+const size_t OFFERED_COUNT = sizeof(OFFERED) / sizeof(OFFERED[0]);
+
+volatile int sink;
+
+// Previous compareVersions(): three numeric parts, pre-release ignored
+int compareVersions(const String& v1, const String& v2) {
+    if (v1 == v2) return 0;
+    int parts[2][3] = {{0, 0, 0}, {0, 0, 0}};
+    const String* versions[2] = {&v1, &v2};
+    for (int v = 0; v < 2; v++) {
+        int partIndex = 0;
+        String temp = "";
+        for (int i = 0; i < (int)versions[v]->length() && partIndex < 3; i++) {
+            char c = versions[v]->charAt(i);
+            if (c == '.') {
+                parts[v][partIndex++] = temp.toInt();
+                temp = "";
+            } else if (isDigit(c)) {
+                temp += c;
+            }
+        }
+        if (partIndex < 3 && temp.length() > 0) parts[v][partIndex] = temp.toInt();
+    }
+    for (int i = 0; i < 3; i++) {
+        if (parts[0][i] > parts[1][i]) return 1;
+        if (parts[0][i] < parts[1][i]) return -1;
+    }
+    return 0;
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    String running = RUNNING.c_str();
+    Serial.printf("\nVersion checks against %s, %d calls each\n", RUNNING.c_str(), CALLS);
+    Serial.println("offered              string    parse+compare   compare   newer (string/semver)");
+
+    for (size_t n = 0; n < OFFERED_COUNT; n++) {
+        String offered = OFFERED[n];
+        OtaVersion parsed = OtaVersion::parse(OFFERED[n]);
+
+        uint32_t start = ESP.getCycleCount();
+        for (int i = 0; i < CALLS; i++) {
+            sink = compareVersions(offered, running);
+        }
+        uint32_t stringCycles = ESP.getCycleCount() - start;
+        bool stringNewer = compareVersions(offered, running) > 0;
+
+        start = ESP.getCycleCount();
+        for (int i = 0; i < CALLS; i++) {
+            sink = OtaVersion::parse(OFFERED[n]).compare(RUNNING);
+        }
+        uint32_t parseCycles = ESP.getCycleCount() - start;
+
+        start = ESP.getCycleCount();
+        for (int i = 0; i < CALLS; i++) {
+            sink = parsed.compare(RUNNING);
+        }
+        uint32_t compareCycles = ESP.getCycleCount() - start;
+
+        Serial.printf("%-16s  %8u  %12u  %9u   %s/%s\n", OFFERED[n], (unsigned)(stringCycles / CALLS),
+                      (unsigned)(parseCycles / CALLS), (unsigned)(compareCycles / CALLS),
+                      stringNewer ? "yes" : "no", parsed > RUNNING ? "yes" : "no");
+    }
+}
+
+void loop() {
+    delay(1000);
+}
@@ -7,35 +7,40 @@
 #include <Update.h>
 #include <PubSubClient.h>
 #include <SPIFFS.h>
-#include <mbedtls/sha256.h>
-
-// Optional: disable logging to save ~7KB Flash
-// Uncomment the following line to disable all OTA debug logs:
-// #define OTA_DISABLE_LOGGING
-
-#ifdef OTA_DISABLE_LOGGING
-  #define OTA_LOG(msg)
-  #define OTA_LOG_F(fmt, ...)
-#else
-  #define OTA_LOG(msg) Serial.println(String("[OTA] ") + msg)
-  #define OTA_LOG_F(fmt, ...) Serial.printf("[OTA] " fmt "\n", ##__VA_ARGS__)
-#endif
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <esp_ota_ops.h>
+#include "OtaRingBuffer.h"
+#include "OtaDeltaPatcher.h"
+#include "OtaDecompressor.h"
+#include "OtaHttpParser.h"
+#include "OtaAsyncClient.h"
+#include "OtaLoopBudget.h"
+#include "OtaFlashWriter.h"
+#include "OtaSha256.h"
+#include "OtaMqttTransfer.h"
+#include "OtaMirrorSet.h"
+#include "OtaSegmentedDownload.h"
+#include "OtaEventQueue.h"
+#include "OtaLog.h"
+#include "OtaArena.h"
+#include "OtaFixedString.h"
+#include "OtaJson.h"
+#include "OtaVersion.h"
+#include "OtaTopicRouter.h"
+#include "OtaRollout.h"
+#include "OtaRetryPolicy.h"
+#include "OtaRateLimiter.h"
+#include "OtaSpscQueue.h"
+#include "OtaTrustStore.h"
+#include "OtaCertBundle.h"
+#include "OtaPemDecoder.h"
 
 // Callback function types
 typedef void (*OtaStatusCallback)(const String& status, int progress);
 typedef void (*OtaErrorCallback)(const String& error, int errorCode);
 
-// Update status enum
-enum class OtaStatus {
-    IDLE,
-    CHECKING,
-    DOWNLOADING,
-    INSTALLING,
-    SUCCESS,
-    ERROR,
-    ROLLBACK
-};
-
 // MQTT connection state for non-blocking connection
 enum class MqttConnState {
     DISCONNECTED,
@@ -47,24 +52,107 @@ enum class MqttConnState {
 // Download state for chunked non-blocking download
 enum class DownloadState {
     IDLE,
+    PROBING,
     CONNECTING,
+    RECEIVING_HEADERS,
     DOWNLOADING,
     VERIFYING,
     COMPLETE,
     FAILED
 };
 
+// How much of the link a download may take
+enum class OtaPriority {
+    BACKGROUND,     // config.backgroundRateLimit
+    NORMAL,         // config.downloadRateLimit
+    URGENT          // No limit
+};
+
+// Fields of an update message: views into the received payload, empty when
+// absent. Only members of the top-level object are taken.
+struct OtaManifest {
+    OtaJsonView version;
+    OtaJsonView firmwareUrl;
+    OtaJsonView checksum;
+    OtaJsonView command;
+    OtaJsonView patchUrl;
+    OtaJsonView baseVersion;
+    OtaJsonView compression;
+    OtaJsonView compressionWindow;
+    OtaJsonView compressionLookahead;
+    OtaJsonView checksumScope;
+    OtaJsonView imageSize;
+    OtaJsonView rolloutPercent;
+    OtaJsonView rolloutSeed;
+    OtaJsonView rolloutJitter;
+    OtaJsonView mirrors[OtaMirrorSet::MAX_MIRRORS - 1];
+    size_t mirrorCount;
+
+    OtaManifest() : mirrorCount(0) {}
+};
+
+// Memory use of one update cycle (from DOWNLOADING until the update ends)
+struct OtaMemoryStats {
+    uint32_t heapAllocations;   // Allocations the updater made from the heap
+    size_t heapHighWater;       // Peak heap in use, sampled once per loop() (bytes)
+    size_t largestFreeBlock;    // Largest free heap block when the cycle ended
+    size_t arenaUsed;           // Arena bytes handed out so far (0 without an arena)
+    size_t arenaSize;
+    uint32_t arenaFailures;     // Arena requests that did not fit, since boot
+};
+
 // Configuration structure
 struct OtaConfig {
     unsigned long checkInterval = 30000;    // 30 seconds default
     unsigned long downloadTimeout = 60000;  // 60 seconds default
     int maxRetries = 3;                     // 3 retries default
+    unsigned long retryBaseDelay = 1000;    // First download retry delay (ms), grows about 3x per failure
+    unsigned long retryMaxDelay = 60000;    // Longest download retry delay (ms)
+    int hostFailureThreshold = 3;           // Consecutive failures that block a download host (0 = never)
+    unsigned long hostCooldown = 60000;     // How long a blocked host gets no requests (ms)
     bool enableRollback = true;             // Enable automatic rollback
     bool verifyChecksum = true;             // Verify SHA256 checksum
     String currentVersion = "1.0.0";        // Current firmware version
     size_t chunkSize = 512;                 // Download chunk size (bytes per loop iteration)
+    bool directFlashWrites = false;         // esp_ota_* with 4 KB coalescing and erase-ahead (false = Update class)
+    OtaHashBackend hashBackend = OTA_DEFAULT_HASH_BACKEND; // SHA256 implementation for image verification
+    int hashOffloadCore = -1;               // Core for OFFLOAD hashing (-1 = the other core)
+    unsigned long loopBudgetMicros = 0;     // Time budget per loop() while downloading (us, 0 = use chunkSize)
     unsigned long yieldInterval = 50;       // Yield every N ms during operations
+    unsigned long progressInterval = 1000;  // Minimum time between progress events (ms)
+    int progressStep = 5;                   // Progress change that is reported right away (percent)
+    size_t logBufferSize = 2048;            // Deferred log records, drained when idle (bytes, 0 = print immediately)
+    String logTopic = "";                   // Publish log lines here instead of Serial (empty = Serial)
+    String rolloutId = "";                  // Identity hashed into rollout cohorts (empty = WiFi MAC)
     unsigned long mqttConnectTimeout = 15000; // MQTT connect timeout (ms)
+    bool asyncMqtt = false;                 // Built-in non-blocking MQTT client instead of PubSubClient
+    unsigned long mqttReconnectBaseDelay = 1000;  // First MQTT reconnect delay (ms)
+    unsigned long mqttReconnectMaxDelay = 120000; // Longest MQTT reconnect delay (ms)
+    bool pipelinedDownload = false;         // Overlap network receive with flash writes
+    uint32_t downloadRateLimit = 0;         // Download bytes per second at NORMAL priority (0 = unlimited)
+    uint32_t backgroundRateLimit = 32768;   // Download bytes per second at BACKGROUND priority (0 = unlimited)
+    size_t downloadBurst = 16384;           // Bytes a rate-limited download may take at once after a pause
+    OtaPriority priority = OtaPriority::NORMAL; // Download priority, also setPriority()
+    int segmentConnections = 1;             // Concurrent Range connections per download (1 = single stream, max 8)
+    size_t segmentMemory = 32768;           // Reorder buffer shared by the segment connections (bytes)
+    size_t pipelineBufferSize = 16384;      // Ring buffer between network reader and flash writer
+    int pipelineWriterCore = 0;             // Core the flash writer task is pinned to
+    bool acceptGzipEncoding = false;        // Send "Accept-Encoding: gzip" on downloads
+    unsigned long keepAliveTimeout = 10000; // Keep idle download connection open (ms, 0 = close)
+    unsigned long dnsTimeout = 5000;        // Download host name lookup timeout (ms)
+    unsigned long tcpConnectTimeout = 5000; // Download TCP connect timeout (ms)
+    unsigned long tlsHandshakeTimeout = 10000; // Download TLS handshake timeout (ms)
+    bool verifyDownloads = true;            // Check HTTPS download servers against the CA from setCACert()
+    size_t mqttChunkSize = 1024;            // Requested chunk size for mqtt:// firmware URLs (bytes)
+    size_t mqttChunkWindow = 8;             // Chunks in flight per request (max 32)
+    unsigned long mqttChunkTimeout = 3000;  // Re-request missing chunks after this long without progress (ms)
+    int mqttChunkRetries = 5;               // Consecutive re-requests before the transfer fails
+    unsigned long mirrorProbeTimeout = 2000; // TCP connect probe of unmeasured mirrors (ms, 0 = no probing)
+    bool persistMirrorStats = true;         // Keep per-host mirror stats in NVS across updates
+    bool runInTask = false;                 // Run the updater in its own task; loop() only delivers events (not with a shared router)
+    int taskCore = 0;                       // Core the updater task is pinned to
+    int taskPriority = 1;                   // FreeRTOS priority of the updater task
+    uint32_t taskStackSize = 8192;          // Stack of the updater task (bytes)
 };
 
 class ESP32OtaMqtt {
@@ -72,8 +160,13 @@ private:
     // Core components
     WiFiClientSecure* wifiClient;
     PubSubClient* mqttClient;
+    OtaMqttEngine* mqttEngine;  // Used instead of mqttClient when set
     bool ownsMqttClient;
+    bool ownsMqttEngine;
     bool ownsWifiClient;
+    OtaTopicRouter ownRouter;
+    OtaTopicRouter* router;     // ownRouter, or one shared with other updaters and the application
+    bool sharedConnection;      // The application connects the client and runs router->loop()
     
     // Configuration
     String updateTopic;
@@ -88,69 +181,340 @@ private:
     String clientCert;
     String clientKey;
     bool useInsecure;
+    OtaTrustStore trustStore;   // Parsed once, shared by every TLS connection with its session cache
+    OtaCertBundle caBundle;     // CAs looked up per connection, see setCABundle()
+
+    // What the blocks of a PEM file are loaded as
+    enum class PemTarget : uint8_t {
+        CA,
+        CERTIFICATE,
+        KEY
+    };
     
     // State management
     OtaStatus currentStatus;
     unsigned long lastCheck;
-    String pendingVersion;
-    String pendingUrl;
-    String pendingChecksum;
+    OtaFixedString<OTA_MAX_VERSION_LENGTH> pendingVersion;
+    OtaFixedString<OTA_MAX_VERSION_LENGTH> runningVersionText;  // Copy of config.currentVersion
+    OtaVersion runningVersion;  // Parsed from runningVersionText
+    OtaUrlString pendingUrl;
+    OtaFixedString<64> pendingChecksum;
+    OtaUrlString pendingPatchUrl; // Delta patch against the running image, if offered
+    OtaCompression pendingCompression;
+    uint8_t pendingWindowBits;
+    uint8_t pendingLookaheadBits;
+    bool pendingChecksumCompressed; // Checksum covers the downloaded (compressed) bytes
+    size_t pendingImageSize;    // Final image size from the manifest, 0 = unknown
+    uint8_t pendingCohort;      // This device's rollout cohort for the offered update (0..99)
+    uint8_t pendingRolloutPercent;
+    uint32_t pendingStartDelay; // Rollout jitter before the download starts (ms)
+    unsigned long scheduledStart; // millis() before which the pending download does not start
+    bool startScheduled;
     int retryCount;
-    String calculatedChecksum;
+    OtaFixedString<64> calculatedChecksum;
 
     // Non-blocking MQTT connection state
     MqttConnState mqttState;
     unsigned long mqttConnectStartTime;
-    unsigned long lastMqttAttempt;
+    OtaRetryPolicy mqttRetry;
+
+    // Download retries: backoff between attempts, blocked hosts skipped
+    OtaRetryPolicy downloadRetry;
+    OtaCircuitBreaker hostBreaker;
 
     // Non-blocking download state
     DownloadState downloadState;
-    WiFiClient* downloadClient;
+    OtaAsyncClient* downloadClient;
+    OtaHttpParser httpParser;
+    OtaUrlString downloadUrl;   // Current URL, updated by redirects
+    OtaHostString requestHost;  // Host header and path of the request being sent
+    OtaUrlString requestPath;
+    OtaFixedString<OTA_MAX_URL_LENGTH + OTA_MAX_HOST_LENGTH + 160> httpRequest; // Goes out as the socket takes it
+    size_t requestSent;
+    int redirectCount;
+    OtaHostString connectedHost; // Endpoint downloadClient is connected to
+    int connectedPort;
+    bool connectedSecure;
+    bool downloadClientReusable; // Last response ended cleanly on a keep-alive connection
+    unsigned long keepAliveSince;
     unsigned long downloadStartTime;
     unsigned long lastYield;
     size_t totalBytes;
     size_t downloadedBytes;
-    mbedtls_sha256_context sha256_ctx;
-    bool sha256Initialized;
+    std::atomic<size_t> consumedBytes;   // Download bytes fed into the image
+    OtaSha256 imageHash;
+
+    // Heap use of the current or last update cycle
+    OtaMemoryStats memoryStats;
+    bool memoryCycleActive;
+    uint32_t cycleStartAllocations;
+    size_t heapTotal;
+    size_t heapMinFree;
+
+    // Timing (microseconds)
+    unsigned long maxLoopMicros;        // Longest loop() call
+    unsigned long maxConnectStepMicros; // Longest single connect step (DNS/TCP/TLS)
+
+    // loop() time budget: reads sized from measured per-byte stage costs
+    OtaLoopBudget loopBudget;
+    bool measureStages;                 // Time hashing separately (serial mode, loop() only)
+    unsigned long stageHashMicros;
+
+    // Pipelined download: loop() fills the ring, a writer task hashes and flashes
+    OtaRingBuffer pipelineBuffer;
+    TaskHandle_t flashWriterTask;
+    std::atomic<bool> pipelineProducerDone;
+    std::atomic<bool> pipelineWriterRunning;
+    std::atomic<bool> pipelineAbort;
+    std::atomic<int> pipelineError;
+
+    // Resumable download (HTTP Range)
+    size_t resumeOffset;        // Flash write offset to continue from, 0 = fresh start
+    size_t resumeTotal;         // Image size seen before the interruption
+    bool rangesSupported;       // Cleared when the server sends "Accept-Ranges: none"
+    size_t resumeBytesSaved;    // Bytes not re-downloaded thanks to resumes
+
+    // Destination of the reconstructed image
+    OtaFlashWriter flashWriter;
+
+    // Firmware transfer over MQTT (mqtt:// URLs)
+    OtaMqttTransfer mqttTransfer;
+    OtaFixedString<OTA_MAX_TOPIC_LENGTH> mqttChunkTopic;
+    uint32_t mqttRequestedNext; // nextIndex when the last request was sent
+    int mqttTimeouts;           // Consecutive re-requests without progress
+    uint16_t mqttSavedBufferSize; // PubSubClient buffer size before the transfer grew it
+
+    // Segmented download over several connections
+    OtaSegmentedDownload segments;
+    bool segmentRangeRequested; // Last request asked for the first block only
+
+    // Download bandwidth: token bucket at the priority's rate, or lower while the application claims the link
+    OtaRateLimiter bandwidth;
+    bool bandwidthClaimed;
+    uint32_t claimRate;         // Download rate during the claim (bytes/s)
+    unsigned long claimStart;
+    unsigned long claimDuration; // 0 = until releaseBandwidth()
+
+    // Firmware mirrors: ranking, probing and failover
+    OtaMirrorSet mirrors;
+    bool mirrorActive;          // Current download comes from the mirror set
+    bool mirrorsRanked;
+    OtaAsyncClient* probeClients[OtaMirrorSet::MAX_MIRRORS];
+    unsigned long probeStartTime;
+    size_t transferStartBytes;  // downloadedBytes when the response body started
+
+    // Delta update: patch stream applied against the running partition
+    OtaDeltaPatcher deltaPatcher;
+    bool deltaActive;
+
+    // Decompression stage between the socket and the image writer
+    OtaDecompressor decompressor;
+    bool hashDownloadStream;    // Hash bytes as received instead of the decompressed image
     
+    // Background task mode: the state machine runs in engineTask, and the
+    // application reaches it only through the SPSC queues. Each queue has one
+    // producer: the application calls the updater from one task only.
+    struct TaskCommand {
+        enum Type : uint8_t {
+            CHECK,
+            FORCE_UPDATE,
+            RESET,
+            PAUSE,
+            RESUME,
+            SET_PRIORITY,
+            CLAIM_BANDWIDTH,
+            RELEASE_BANDWIDTH,
+            RESET_TIMING_STATS
+        };
+        Type type = CHECK;
+        uint32_t value = 0;         // Priority or claimed download rate
+        unsigned long duration = 0; // Claim duration (ms)
+        OtaFixedString<OTA_MAX_VERSION_LENGTH> version;
+        OtaUrlString url;
+        OtaFixedString<64> checksum;
+    };
+    struct TaskEvent {
+        OtaEvent event;
+        OtaFixedString<95> message; // ERROR events: the reportError() text
+    };
+    // Task state behind the application's getters, published after each iteration
+    struct TaskSnapshot {
+        OtaFixedString<OTA_MAX_VERSION_LENGTH> pendingVersion;
+        OtaUrlString activeMirror;
+        OtaMemoryStats memoryStats = {};
+        unsigned long lastCheck = 0;
+        unsigned long scheduledStart = 0;
+        unsigned long nextMqttAttempt = 0;
+        unsigned long maxLoopMicros = 0;
+        unsigned long maxConnectStepMicros = 0;
+        unsigned long budgetOverruns = 0;
+        unsigned long handshakeTimeSaved = 0;
+        size_t resumeBytesSaved = 0;
+        size_t bytesPerLoop = 0;
+        OtaPriority priority = OtaPriority::NORMAL;
+        bool bandwidthClaimed = false;
+        bool paused = false;
+    };
+    static const size_t TASK_COMMANDS = 4;
+    static const size_t TASK_EVENTS = 16;
+    static const size_t TASK_SNAPSHOTS = 2;
+    static const size_t TASK_CONFIGS = 2;
+    TaskHandle_t engineTask;
+    std::atomic<bool> engineTaskStop;
+    std::atomic<bool> engineTaskRunning;
+    OtaSpscQueue<TaskCommand, TASK_COMMANDS> taskCommands;  // Application -> task
+    OtaSpscQueue<TaskEvent, TASK_EVENTS> taskEvents;        // Task -> application
+    OtaSpscQueue<TaskSnapshot, TASK_SNAPSHOTS> taskSnapshots; // Task -> application
+    OtaSpscQueue<OtaConfig, TASK_CONFIGS> taskConfigs;      // Application -> task
+    TaskSnapshot snapshot;      // Latest received (application side)
+    OtaConfig taskConfig;       // Config as last set (application side)
+    OtaConfig receivedConfig;   // Last taken from taskConfigs (task side)
+    OtaStatus deliveredStatus;  // Status of the last delivered event (application side)
+    uint32_t droppedCommands;   // Application side
+    bool configPending;         // taskConfig changed but not queued yet (application side)
+    bool paused;
+    unsigned long pausedAt;
+
     // Callbacks
     OtaStatusCallback statusCallback;
     OtaErrorCallback errorCallback;
+    OtaEventCallback eventCallback;
+    void* eventContext;
+    OtaEventQueue events;
     
     // Internal methods
-    void mqttCallback(char* topic, byte* payload, unsigned int length);
-    static void staticMqttCallback(char* topic, byte* payload, unsigned int length);
-    bool parseUpdateMessage(const String& message);
-    String extractJsonValue(const String& json, const String& key);
-    bool isNewerVersion(const String& newVersion, const String& currentVersion);
-    int compareVersions(const String& v1, const String& v2);
+    static void onUpdateMessage(const char* topic, uint8_t* payload, unsigned int length, void* context);
+    static void onChunkMessage(const char* topic, uint8_t* payload, unsigned int length, void* context);
+    void handleUpdateMessage(uint8_t* payload, unsigned int length);
+    bool parseUpdateMessage(char* message, size_t length);
+    void planRollout(const OtaManifest& manifest);
+    static bool onManifestValue(void* context, const OtaJsonEvent& event);
+    static OtaCompression parseCompression(const OtaJsonView& name);
+    void parseCurrentVersion();
 
     // Non-blocking MQTT management
     void handleMqttConnection();
     bool attemptMqttConnect();
+    bool startMqttEngine();
+    void onMqttConnected();
+
+    // Every updater installs into the same next-OTA partition: the one that
+    // starts a download holds the claim until its update ends
+    static std::atomic<const ESP32OtaMqtt*> installingUpdater;
+    bool claimInstall();
+    void releaseInstall();
 
     // Non-blocking download management
     void handleDownload();
-    bool startDownload(const String& url);
+    bool startDownload(const char* url);
+    bool downloadHostAvailable();
+    void scheduleRetry();
+    void applyRetryConfig();
+    static bool parseUrl(const char* url, bool& secure, OtaHostString& host, int& port, OtaUrlString& path);
+    bool sendDownloadRequest();
+    void processConnect();
+    void writeDownloadRequest();
+    bool sendPendingRequest();
+    void processResponseHeaders();
+    void handleResponseHeaders();
+    void followRedirect();
+    void failResponse();
     bool processDownloadChunk();
-    bool finalizeDownload(const String& expectedChecksum);
+    bool consumeDownloadData(const uint8_t* data, size_t length);
+    bool writeImageData(const uint8_t* data, size_t length);
+    bool startDecompressor(OtaCompression compression);
+    static bool writeDecompressedData(void* context, const uint8_t* data, size_t length);
+    void reportWriteError(int errorCode);
+    bool finalizeDownload(const char* expectedChecksum);
     void cleanupDownload();
+    void closeDownloadClient();
+    bool verifyDownloadServer() const;
+    void releaseDownloadClient();
+    void closeIdleDownloadClient();
+    void eraseAheadWhileIdle();
+
+    // Firmware transfer over MQTT
+    bool startMqttTransfer(const char* topic);
+    void stopMqttTransfer();
+    size_t negotiateChunkSize();
+    void sendChunkRequest(bool selective);
+    bool processMqttTransfer();
+
+    // Segmented download
+    bool useSegments() const;
+    size_t segmentBlockSize() const;
+    bool startSegmentedDownload();
+    bool processSegmentedDownload();
+
+    // Background task mode
+    bool startEngineTask();
+    void stopEngineTask();
+    static void engineTaskEntry(void* arg);
+    void runEngineTask();
+    bool isTaskCaller() const;
+    bool postCommand(const TaskCommand& command);
+    bool postConfig();
+    bool rejectTaskCall(const char* method);
+    void runCommands();
+    void publishSnapshot();
+    void receiveSnapshots();
+    void forwardEvents();
+    bool forwardError(const String& error, int errorCode);
+    void deliverTaskEvents();
+    void runLoop();
+
+    // Bandwidth shaping
+    void applyBandwidthLimit();
+    void expireBandwidthClaim();
+
+    // Firmware mirrors
+    void setMirrors(const OtaManifest& manifest);
+    bool startProbes();
+    void processProbes();
+    void stopProbes();
+    void rankMirrors();
+    void recordMirrorTransfer();
+    void loadMirrorStats();
+    void saveMirrorStats();
+
+    // Resumable download (HTTP Range)
+    bool beginImage();
+    bool isDownloadInterrupted() const;
+    void suspendDownload();
+
+    // Delta update
+    static bool readRunningImage(void* context, size_t offset, uint8_t* buffer, size_t length);
+    static bool writePatchedImage(void* context, const uint8_t* data, size_t length);
+
+    // Pipelined download (network reader / flash writer)
+    bool startPipeline();
+    void stopPipeline();
+    bool pumpPipeline();
+    bool isPipelineActive() const;
+    bool isPipelineDrained() const;
+    static void flashWriterTaskEntry(void* arg);
+    void runFlashWriter();
 
     bool installFirmware();
-    bool verifyChecksum(const String& expectedChecksum);
+    bool verifyChecksum(const char* expectedChecksum);
     void performRollback();
     void updateStatus(OtaStatus status, int progress = 0);
     void reportError(const String& error, int errorCode = 0);
+    int loadPem(File& file, PemTarget target);
+    void queueEvent(OtaEventType type, int progress, int errorCode);
+    void dispatchEvents();
+    static const String& statusString(OtaStatus status);
+    void drainLog();
+    void trackMemory();
     void yieldIfNeeded();
     
-    // Static instance for callback
-    static ESP32OtaMqtt* instance;
-    
 public:
     // Constructors
     ESP32OtaMqtt(const String& topic);  // Simple constructor, creates own clients
     ESP32OtaMqtt(WiFiClientSecure& wifi, const String& topic);
     ESP32OtaMqtt(WiFiClientSecure& wifi, PubSubClient& mqtt, const String& topic);
+    // Shares the router's connection, which the application connects and services
+    ESP32OtaMqtt(OtaTopicRouter& sharedRouter, const String& topic);
     
     // Destructor
     ~ESP32OtaMqtt();
@@ -162,6 +526,7 @@ public:
     void setDownloadTimeout(unsigned long timeoutMs);
     void setMaxRetries(int retries);
     void setCurrentVersion(const String& version);
+    void setCurrentVersion(const OtaVersion& version); // e.g. OTA_VERSION("1.4.0"), checked at compile time
     
     // MQTT configuration methods
     void setMqttServer(const char* server, int port = 8883);
@@ -173,16 +538,44 @@ public:
     void setClientCert(const char* clientCert, const char* clientKey);
     void setClientCertFromFiles(const String& clientCertPath, const String& clientKeyPath);
     void setInsecure(bool insecure = true);
+    // Many CAs, of which only the one a server chains to is decoded, per
+    // connection (see tools/gen_ca_bundle.py). Not used by PubSubClient.
+    void setCABundle(const uint8_t* bundle, size_t size);   // In the firmware image, must stay valid
+    void setCABundleFromFile(const String& bundlePath);
+    
+    // Download bandwidth
+    void setPriority(OtaPriority priority);
+    OtaPriority getPriority() const;
+    // Holds the download to downloadRate bytes/s (0 = paused) for durationMs (0 = until released)
+    void claimBandwidth(unsigned long durationMs, uint32_t downloadRate = 0);
+    void releaseBandwidth();
+    bool isBandwidthClaimed() const;
     
     // Callback registration
     void onStatusUpdate(OtaStatusCallback callback);
     void onError(OtaErrorCallback callback);
+    void onEvent(OtaEventCallback callback, void* context = nullptr); // Typed, coalesced events
+
+    // Heap-free mode: buffers, tasks and download clients of later updates come
+    // from buffer (see OtaArena). The arena is shared by all updaters; false
+    // while any of them is downloading. buffer must stay valid until this
+    // updater is destroyed or the arena is replaced
+    bool setArena(uint8_t* buffer, size_t size);
+
+    // Topic router of the updater's connection, for application subscriptions
+    OtaTopicRouter& getRouter() { return *router; }
     
     // Control methods
     bool begin();
     void loop();
-    void checkForUpdates();
-    void forceUpdate(const String& version, const String& url, const String& checksum);
+    // False when the request was not taken: the updater is busy, or in task
+    // mode the command queue is full (see getDroppedCommands())
+    bool checkForUpdates();
+    bool forceUpdate(const String& version, const String& url, const String& checksum);
+    // Holds off update checks and download work; the MQTT connection is kept
+    void pause();
+    void resume();
+    bool isPaused() const;
     
     // Status methods
     OtaStatus getStatus() const;
@@ -190,6 +583,20 @@ public:
     String getCurrentVersion() const;
     String getPendingVersion() const;
     unsigned long getLastCheck() const;
+    size_t getResumeBytesSaved() const;     // Bytes skipped via Range resumes this update
+    unsigned long getMaxLoopTime() const;   // Longest loop() call (us)
+    unsigned long getMaxConnectStepTime() const; // Longest download connect step (us)
+    void resetTimingStats();
+    size_t getBytesPerLoop() const;         // Average download bytes per budgeted loop() call
+    unsigned long getBudgetOverruns() const; // loop() calls that exceeded loopBudgetMicros
+    String getActiveMirror() const;         // Firmware URL in use when the manifest lists mirrors
+    OtaMemoryStats getMemoryStats() const;  // Current or last update cycle
+    unsigned long getScheduledStart() const; // millis() when a delayed download (rollout, retry) starts, 0 = none
+    unsigned long getNextMqttAttempt() const; // millis() of the next MQTT reconnect, 0 = none pending
+    unsigned long getHostBlockedUntil(const char* host) const; // millis() a failing host is skipped until, 0 = not (or task mode)
+    uint32_t getDroppedCommands() const;    // Task mode: commands lost to a full queue or refused
+    const OtaTrustStore& getTrustStore() const; // TLS handshake counts and times (not in task mode)
+    unsigned long getHandshakeTimeSaved() const; // Estimated TLS time saved by resumed sessions (ms)
     
     // Utility methods
     void reset();
@@ -0,0 +1,79 @@
+#ifndef OTA_ARENA_H
+#define OTA_ARENA_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
+
+// Storage for the updaters' working buffers.
+// Without an arena every buffer comes from the heap, as before. After
+// install() each slot is carved out of the caller's buffer the first time it
+// is needed and handed out again on every later acquire() that fits, so once
+// an update has run the layout is fixed and no further memory is taken. A
+// request that does not fit fails (nullptr) rather than falling back to the
+// heap. Slots are exclusive: one owner at a time. The arena is process-wide
+// and shared by all updaters; the slots used during a download are kept apart
+// by the updaters' install claim, which lets one of them download at a time.
+// The bookkeeping is taken under a lock, since the updater task, the pipeline
+// writer and the application's loop all allocate.
+class OtaArena {
+public:
+    enum Slot : uint8_t {
+        HEAP,               // Never from the arena
+        FLASH_SECTOR,
+        PIPELINE_BUFFER,
+        PIPELINE_STACK,
+        PIPELINE_TASK,
+        HASH_BUFFER,
+        HASH_STACK,
+        HASH_TASK,
+        INFLATE_STATE,
+        INFLATE_WINDOW,
+        INFLATE_OUTPUT,
+        MQTT_CHUNKS,
+        SEGMENT_BLOCKS,
+        CLIENTS,
+        SLOT_COUNT
+    };
+
+    static const size_t ALIGNMENT = 8;
+
+    // buffer = nullptr goes back to the heap. Only call while no slot is in
+    // use. owner supplied the buffer, which it must keep until it replaces
+    // the arena or installs nullptr
+    static void install(uint8_t* buffer, size_t size, const void* owner);
+    static bool isInstalled() { return base.load() != nullptr; }
+    static bool isInstalledBy(const void* owner) { return isInstalled() && installer.load() == owner; }
+
+    static uint8_t* acquire(Slot slot, size_t size);
+    static void release(Slot slot, uint8_t* block);
+
+    // xTaskCreatePinnedToCore, or the static variant with stack and TCB from the arena
+    static bool createTask(TaskFunction_t entry, const char* name, uint32_t stackSize, void* arg,
+                           UBaseType_t priority, TaskHandle_t* handle, BaseType_t core,
+                           Slot stackSlot, Slot taskSlot);
+
+    static size_t getSize();
+    static size_t getUsed();
+    static uint32_t getHeapAllocations() { return heapAllocations.load(); } // Since boot
+    static uint32_t getFailures() { return failures.load(); }              // Requests that did not fit
+
+private:
+    struct Block {
+        uint8_t* data;
+        size_t size;
+    };
+
+    static std::atomic<const void*> installer;
+    static std::atomic<uint8_t*> base;
+    static size_t capacity;             // capacity, used and blocks under the lock
+    static size_t used;
+    static Block blocks[SLOT_COUNT];
+    static std::atomic<uint32_t> heapAllocations;
+    static std::atomic<uint32_t> failures;
+
+    static uint8_t* carve(Slot slot, size_t size);
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef OTA_ASYNC_CLIENT_H
+#define OTA_ASYNC_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include "OtaTrustStore.h"
+
+struct OtaTlsContext;
+
+// Client whose connect phase is a state machine instead of a blocking call.
+// begin() starts an asynchronous DNS lookup; every poll() then advances by at
+// most one bounded step (DNS completion check, non-blocking TCP connect
+// check, or a single TLS handshake step) until the client is CONNECTED or
+// FAILED. Each step has its own timeout. Once connected it behaves like any
+// Arduino Client over a non-blocking socket.
+class OtaAsyncClient : public Client {
+public:
+    enum class State {
+        IDLE,
+        RESOLVING,
+        CONNECTING,
+        HANDSHAKING,
+        CONNECTED,
+        FAILED
+    };
+
+    OtaAsyncClient();
+    virtual ~OtaAsyncClient();
+
+    OtaAsyncClient(const OtaAsyncClient&) = delete;
+    OtaAsyncClient& operator=(const OtaAsyncClient&) = delete;
+
+    // Clients that can exist at once while an OtaArena is installed
+    static const size_t POOL_SIZE = 8;
+
+    // Taken from the arena's client pool (TLS context included) when an arena
+    // is installed, else from the heap. Release with destroy(), not delete.
+    static OtaAsyncClient* create();
+    static void destroy(OtaAsyncClient* client);
+
+    // Configuration (before begin)
+    void setInsecure();
+    void setCACert(const char* pem);
+    void setCertificate(const char* certPem, const char* keyPem);  // Client certificate (mutual TLS)
+    // Parsed certificates and the session cache; replaces the PEM settings.
+    // setInsecure() still turns verification off. The store must outlive the client.
+    void setTrustStore(OtaTrustStore* store) { trustStore = store; }
+    void setTimeouts(unsigned long dnsMs, unsigned long tcpMs, unsigned long tlsMs);
+
+    // Asynchronous connect
+    bool begin(const char* host, uint16_t port, bool secure);
+    State poll();
+    State getState() const { return state; }
+    const char* getError() const { return error; }
+    int getErrorCode() const { return errorCode; }
+    unsigned long getMaxStepMicros() const { return maxStepMicros; }
+    unsigned long getConnectMillis() const { return connectMillis; }
+    bool isResumed() const { return resumed; }      // The TLS handshake resumed a cached session
+
+    // Client interface (connect() drives poll() until done, for compatibility)
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(uint8_t value) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+
+    // Writes what the socket takes right now, never waits. 0 = try again
+    // later (call again with the same bytes), -1 = connection failed.
+    int send(const uint8_t* buffer, size_t size);
+    operator bool() override { return connected(); }
+
+private:
+    static const size_t HOST_SIZE = 128;
+
+    State state;
+    const char* error;
+    int errorCode;
+
+    char host[HOST_SIZE];
+    uint16_t port;
+    bool secure;
+    bool insecure;
+    const char* caCert;
+    const char* clientCert;
+    const char* clientKey;
+    OtaTrustStore* trustStore;
+
+    unsigned long dnsTimeout;
+    unsigned long tcpTimeout;
+    unsigned long tlsTimeout;
+    unsigned long stepStart;
+    unsigned long connectStart;
+    unsigned long connectMillis;
+    unsigned long maxStepMicros;
+    unsigned long tlsStartMicros;
+    bool sessionOffered;
+    bool resumed;
+
+    uint32_t address;       // IPv4, network byte order
+    uint32_t dnsGeneration; // Lookup this client is waiting for
+    int fd;
+    bool peerClosed;
+    int peekByte;
+
+    OtaTlsContext* tls;
+    uint8_t* tlsStorage;    // Pool entry space for tls, nullptr = heap
+    int poolIndex;          // -1 = not from the pool
+
+    bool startDns();
+    void checkDns();
+    bool startTcp();
+    void checkTcp();
+    bool startTls();
+    void stepTls();
+    void setState(State next);
+    void fail(const char* message, int code = 0);
+    void releaseTls();
+    int rawRead(uint8_t* buffer, size_t size);
+};
+
+#endif
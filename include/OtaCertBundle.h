@@ -0,0 +1,53 @@
+#ifndef OTA_CERT_BUNDLE_H
+#define OTA_CERT_BUNDLE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <mbedtls/x509_crt.h>
+
+// Read-only set of CA certificates in DER, looked up by subject.
+// Layout (little-endian), written by tools/gen_ca_bundle.py:
+//   "OTCB", u8 version (1), u8 reserved, u16 count
+//   count x {u32 subject hash, u32 offset, u32 length}, sorted by hash
+//   DER certificates at the offsets, counted from the start of the bundle
+// The hash is FNV-1a over the DER subject name, so the CA that issued a
+// certificate is found from its issuer name with a binary search over the
+// index. Nothing is decoded up front: a bundle in the firmware image is
+// parsed in place, one on a file system is read entry by entry.
+class OtaCertBundle {
+public:
+    static const size_t HEADER_SIZE = 8;
+    static const size_t ENTRY_SIZE = 12;
+    static const size_t MAX_CERT_SIZE = 4096;
+
+    OtaCertBundle();
+    ~OtaCertBundle();
+
+    OtaCertBundle(const OtaCertBundle&) = delete;
+    OtaCertBundle& operator=(const OtaCertBundle&) = delete;
+
+    // Bundle in flash that stays mapped (a const array); false when malformed
+    bool attach(const uint8_t* data, size_t size);
+    // Bundle file, kept open until close()
+    bool open(fs::FS& fs, const char* path);
+    void close();
+    bool isAttached() const { return count > 0; }
+    size_t getCount() const { return count; }
+
+    static uint32_t hashName(const uint8_t* der, size_t length);
+
+    // Appends the CAs named subject (DER) to chain; number added
+    size_t load(const uint8_t* subject, size_t subjectLength, mbedtls_x509_crt* chain);
+
+private:
+    const uint8_t* data;
+    size_t size;
+    File file;
+    size_t count;
+
+    bool readHeader();
+    bool readAt(size_t offset, uint8_t* buffer, size_t length);
+    bool readEntry(size_t index, uint32_t& hash, uint32_t& offset, uint32_t& length);
+};
+
+#endif
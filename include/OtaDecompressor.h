@@ -0,0 +1,112 @@
+#ifndef OTA_DECOMPRESSOR_H
+#define OTA_DECOMPRESSOR_H
+
+#include <Arduino.h>
+
+// Compression applied to the firmware download stream
+enum class OtaCompression {
+    NONE,
+    GZIP,        // RFC 1952, inflated with the ROM tinfl decoder (32 KB window)
+    HEATSHRINK   // LZSS, window and lookahead sizes given by the manifest
+};
+
+typedef bool (*OtaDataSinkFn)(void* context, const uint8_t* data, size_t length);
+
+struct tinfl_decompressor_tag;
+
+// Streaming decompressor with a fixed, up-front allocated window.
+// Compressed data is pushed in arbitrary slices; decompressed output is
+// delivered to the sink in order, so RAM use is bounded by the window size.
+class OtaDecompressor {
+public:
+    OtaDecompressor();
+    ~OtaDecompressor();
+
+    OtaDecompressor(const OtaDecompressor&) = delete;
+    OtaDecompressor& operator=(const OtaDecompressor&) = delete;
+
+    bool begin(OtaCompression type, OtaDataSinkFn sink, void* context,
+               uint8_t windowBits = 8, uint8_t lookaheadBits = 4);
+    void end();
+    bool feed(const uint8_t* data, size_t length);
+
+    bool isComplete() const;
+    bool hasError() const { return error != nullptr; }
+    const char* getError() const { return error; }
+    size_t getOutputBytes() const { return outputBytes; }
+    size_t getMemoryUsage() const { return memoryUsage; }
+
+private:
+    enum class GzipState {
+        HEADER,
+        EXTRA_LENGTH,
+        EXTRA,
+        NAME,
+        COMMENT,
+        HEADER_CRC,
+        DEFLATE,
+        TRAILER,
+        DONE
+    };
+
+    enum class HsState {
+        TAG,
+        LITERAL,
+        BACKREF_INDEX,
+        BACKREF_COUNT,
+        BACKREF_COPY
+    };
+
+    static const size_t HS_OUTPUT_SIZE = 256;
+
+    OtaCompression type;
+    OtaDataSinkFn sink;
+    void* context;
+    const char* error;
+    size_t outputBytes;
+    size_t memoryUsage;
+
+    // Sliding window (gzip dictionary or heatshrink history)
+    uint8_t* window;
+    size_t windowMask;
+    size_t windowHead;
+
+    // gzip
+    tinfl_decompressor_tag* inflator;
+    GzipState gzState;
+    uint8_t gzFlags;
+    uint8_t gzField[10];
+    size_t gzFill;
+    size_t gzSkip;
+    uint32_t gzCrc;             // CRC32 of the output so far
+
+    // heatshrink
+    HsState hsState;
+    uint8_t hsWindowBits;
+    uint8_t hsLookaheadBits;
+    uint32_t bitBuffer;
+    uint8_t bitCount;
+    uint8_t symbolBits;         // Bits read of the symbol in progress
+    bool symbolNonZero;
+    uint16_t backrefOffset;
+    uint16_t backrefCount;
+    uint8_t* hsOutput;
+    size_t hsOutputFill;
+
+    const uint8_t* input;
+    size_t inputLength;
+
+    bool feedGzip(const uint8_t* data, size_t length);
+    size_t parseGzipHeader(const uint8_t* data, size_t length);
+    void advanceGzipHeader();
+    size_t inflate(const uint8_t* data, size_t length);
+    bool feedHeatshrink();
+    bool getBits(uint8_t count, uint16_t& value);
+    void endSymbol();
+    bool putByte(uint8_t value);
+    bool flushHeatshrink();
+    bool emit(const uint8_t* data, size_t length);
+    void fail(const char* message);
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef OTA_DELTA_PATCHER_H
+#define OTA_DELTA_PATCHER_H
+
+#include <Arduino.h>
+
+// Streaming binary patch applier (bsdiff-style, uncompressed, interleaved).
+//
+// Patch layout (all integers little endian):
+//   header:  "OTADIFF1" | newSize u32
+//   control: diffLen u32 | extraLen u32 | seek i32      (repeated)
+//            diffLen bytes  - added byte-wise to old[oldPos...]
+//            extraLen bytes - copied verbatim
+//            then oldPos += diffLen + seek
+// The patch is consumed in arbitrary slices as it arrives from the network;
+// old bytes are fetched on demand and the reconstructed image is emitted
+// through the write callback in the same order it will be flashed.
+
+typedef bool (*OtaPatchReadFn)(void* context, size_t offset, uint8_t* buffer, size_t length);
+typedef bool (*OtaPatchWriteFn)(void* context, const uint8_t* data, size_t length);
+
+class OtaDeltaPatcher {
+public:
+    enum class State {
+        HEADER,
+        CONTROL,
+        DIFF,
+        EXTRA,
+        DONE,
+        ERROR
+    };
+
+    OtaDeltaPatcher();
+
+    void begin(OtaPatchReadFn readOld, OtaPatchWriteFn writeNew, void* context, size_t oldSize);
+    bool feed(const uint8_t* data, size_t length);
+
+    bool isComplete() const { return state == State::DONE; }
+    bool hasError() const { return state == State::ERROR; }
+    const char* getError() const { return error; }
+    size_t getNewSize() const { return newSize; }
+    size_t getOutputBytes() const { return outputBytes; }
+
+private:
+    static const size_t FIELD_SIZE = 12;    // Header and control block are both 12 bytes
+    static const size_t SCRATCH_SIZE = 256; // Old bytes fetched per diff step
+
+    OtaPatchReadFn readOld;
+    OtaPatchWriteFn writeNew;
+    void* context;
+
+    State state;
+    const char* error;
+    uint8_t field[FIELD_SIZE];
+    size_t fieldFill;
+    uint8_t scratch[SCRATCH_SIZE];
+
+    size_t oldSize;
+    size_t oldPos;
+    size_t newSize;
+    size_t outputBytes;
+    uint32_t diffRemaining;
+    uint32_t extraRemaining;
+    int32_t seek;
+
+    size_t fillField(const uint8_t* data, size_t length);
+    bool parseHeader();
+    bool parseControl();
+    size_t applyDiff(const uint8_t* data, size_t length);
+    size_t applyExtra(const uint8_t* data, size_t length);
+    bool finishBlock();
+    bool emit(const uint8_t* data, size_t length);
+    void fail(const char* message);
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef OTA_EVENT_QUEUE_H
+#define OTA_EVENT_QUEUE_H
+
+#include <Arduino.h>
+
+// Update status enum
+enum class OtaStatus {
+    IDLE,
+    CHECKING,
+    DOWNLOADING,
+    INSTALLING,
+    SUCCESS,
+    ERROR,
+    ROLLBACK
+};
+
+enum class OtaEventType : uint8_t {
+    STATUS,     // Status changed
+    PROGRESS,   // Same status, progress advanced
+    ERROR       // reportError() was called; status is unchanged
+};
+
+struct OtaEvent {
+    OtaEventType type;
+    OtaStatus status;
+    int progress;           // Percent, 0 when unknown
+    int errorCode;          // ERROR events only
+    size_t bytesDone;
+    size_t bytesTotal;      // 0 when unknown
+};
+
+typedef void (*OtaEventCallback)(const OtaEvent& event, void* context);
+
+// Fixed-capacity queue between the code that changes the status and the
+// callbacks. Status changes and errors are always queued; progress events are
+// only queued once progress moved by stepPercent or intervalMs has passed,
+// and a progress event still waiting in the queue is overwritten by the next
+// one. A full queue gives up a waiting progress event, or the new one, before
+// any transition; transitions are lost only when CAPACITY of them are waiting.
+class OtaEventQueue {
+public:
+    static const size_t CAPACITY = 8;
+
+    OtaEventQueue();
+
+    void setProgressRate(unsigned long intervalMs, int stepPercent);
+    void push(const OtaEvent& event, unsigned long now);
+    bool pop(OtaEvent& event);
+    void clear();
+
+    size_t getDropped() const { return dropped; }
+
+    static const char* statusName(OtaStatus status);
+
+private:
+    OtaEvent events[CAPACITY];
+    size_t head;
+    size_t count;
+
+    unsigned long intervalMs;
+    int stepPercent;
+    int lastProgress;               // Progress of the last queued event
+    unsigned long lastProgressTime;
+    size_t dropped;
+
+    bool makeRoom(const OtaEvent& event);
+    OtaEvent& tail() { return events[(head + count - 1) % CAPACITY]; }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef OTA_FIXED_STRING_H
+#define OTA_FIXED_STRING_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+// Capacities of the updater's inline strings (characters, without the NUL)
+#ifndef OTA_MAX_URL_LENGTH
+  #define OTA_MAX_URL_LENGTH 255
+#endif
+#ifndef OTA_MAX_HOST_LENGTH
+  #define OTA_MAX_HOST_LENGTH 127
+#endif
+#ifndef OTA_MAX_TOPIC_LENGTH
+  #define OTA_MAX_TOPIC_LENGTH 127
+#endif
+#ifndef OTA_MAX_VERSION_LENGTH
+  #define OTA_MAX_VERSION_LENGTH 31
+#endif
+
+// String with inline storage for up to N characters.
+// Nothing is ever allocated: text that does not fit is cut and the string
+// remembers it (isTruncated()), so callers can reject it instead of using a
+// shortened URL or topic.
+template<size_t N>
+class OtaFixedString {
+public:
+    OtaFixedString() : len(0), truncated(false) { text[0] = '\0'; }
+    OtaFixedString(const char* value) : OtaFixedString() { assign(value); }
+
+    bool assign(const char* value, size_t length) {
+        clear();
+        return append(value, length);
+    }
+    bool assign(const char* value) { return assign(value, value ? strlen(value) : 0); }
+
+    bool append(const char* value, size_t length) {
+        size_t count = length < N - len ? length : N - len;
+        if (count > 0) memcpy(text + len, value, count);
+        len += count;
+        text[len] = '\0';
+        if (count < length) truncated = true;
+        return !truncated;
+    }
+    bool append(const char* value) { return append(value, value ? strlen(value) : 0); }
+    bool append(char c) { return append(&c, 1); }
+
+    bool appendf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(text + len, N + 1 - len, format, args);
+        va_end(args);
+        if (written < 0) written = 0;
+        if ((size_t)written > N - len) {
+            truncated = true;
+            written = N - len;
+        }
+        len += written;
+        return !truncated;
+    }
+
+    OtaFixedString& operator=(const char* value) {
+        assign(value);
+        return *this;
+    }
+    OtaFixedString& operator=(const String& value) {
+        assign(value.c_str(), value.length());
+        return *this;
+    }
+
+    void clear() {
+        len = 0;
+        truncated = false;
+        text[0] = '\0';
+    }
+
+    const char* c_str() const { return text; }
+    size_t length() const { return len; }
+    bool isEmpty() const { return len == 0; }
+    bool isTruncated() const { return truncated; }
+    static size_t capacity() { return N; }
+
+    bool equals(const char* value) const { return strcmp(text, value) == 0; }
+    bool operator==(const char* value) const { return equals(value); }
+    bool operator!=(const char* value) const { return !equals(value); }
+    bool startsWith(const char* prefix) const { return strncmp(text, prefix, strlen(prefix)) == 0; }
+
+    int indexOf(char c, size_t from = 0) const {
+        if (from >= len) return -1;
+        const char* found = strchr(text + from, c);
+        return found ? found - text : -1;
+    }
+    int lastIndexOf(char c) const {
+        const char* found = strrchr(text, c);
+        return found ? found - text : -1;
+    }
+
+private:
+    char text[N + 1];
+    size_t len;
+    bool truncated;
+};
+
+typedef OtaFixedString<OTA_MAX_URL_LENGTH> OtaUrlString;
+typedef OtaFixedString<OTA_MAX_HOST_LENGTH> OtaHostString;
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef OTA_FLASH_WRITER_H
+#define OTA_FLASH_WRITER_H
+
+#include <Arduino.h>
+#include <esp_ota_ops.h>
+
+// Backend that puts the firmware image into the OTA partition
+enum class OtaFlashBackend {
+    UPDATE,     // Arduino Update class (erases each sector inline when its buffer fills)
+    ESP_OTA     // OTA partition written directly, sector-aligned with erase-ahead
+};
+
+// Writes the firmware image to the next OTA partition.
+// The ESP_OTA backend gathers incoming data into a 4 KB sector buffer and
+// only ever writes whole, already-erased sectors. Erasing is decoupled from
+// writing: eraseAhead() erases sectors past the write cursor during idle
+// time, so a write normally costs a flash program and no erase. If a write
+// catches up with the erased area the sector is erased inline instead.
+// Sectors are programmed with esp_partition_write(); end() selects the
+// partition with esp_ota_set_boot_partition(), which verifies the image.
+class OtaFlashWriter {
+public:
+    static const size_t SECTOR_SIZE = 4096;
+    static const size_t ERASE_AHEAD_WINDOW = 64 * 1024; // Erased ahead when the image size is unknown
+
+    OtaFlashWriter();
+    ~OtaFlashWriter();
+
+    OtaFlashWriter(const OtaFlashWriter&) = delete;
+    OtaFlashWriter& operator=(const OtaFlashWriter&) = delete;
+
+    // Falls back to the Update backend if the ESP_OTA backend cannot start
+    bool begin(OtaFlashBackend preferred);
+    void setImageSize(size_t size);     // Known final size bounds the erase-ahead
+    bool write(const uint8_t* data, size_t length);
+    bool eraseAhead(size_t maxSectors = 1); // Idle work; returns true if a sector was erased
+    bool end();                         // Flush, validate and select as boot partition
+    void abort();
+
+    bool isActive() const { return active; }
+    OtaFlashBackend getBackend() const { return backend; }
+    int getError() const;
+    size_t getWrittenBytes() const { return writtenBytes; }
+    size_t getAheadErases() const { return aheadErases; }
+    size_t getInlineErases() const { return inlineErases; }
+
+private:
+    OtaFlashBackend backend;
+    bool active;
+    int lastError;
+
+    const esp_partition_t* partition;
+    uint8_t* sector;            // Coalescing buffer, one flash sector
+    size_t sectorFill;
+    size_t flushedBytes;        // Offset of the sector being filled
+    size_t erasedBytes;         // Partition is erased below this offset
+    size_t imageSize;           // 0 = unknown
+
+    size_t writtenBytes;
+    size_t aheadErases;
+    size_t inlineErases;
+
+    bool beginDirect();
+    bool flushSector(size_t length);
+    bool eraseSector(size_t offset);
+    size_t eraseLimit() const;
+    void releaseDirect();
+};
+
+#endif
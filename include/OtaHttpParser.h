@@ -0,0 +1,102 @@
+#ifndef OTA_HTTP_PARSER_H
+#define OTA_HTTP_PARSER_H
+
+#include <Arduino.h>
+
+// Incremental HTTP/1.1 response parser.
+// Headers are fed byte by byte (or in slices) and parsed in a fixed line
+// buffer, so no String is allocated per header line. The body is decoded in
+// place: chunked framing is stripped by compacting the caller's buffer, which
+// lets the download path read straight into its final destination.
+class OtaHttpParser {
+public:
+    static const size_t LINE_SIZE = 512;
+    static const size_t LOCATION_SIZE = 256;
+    static const size_t MAX_HEADER_BYTES = 8192;
+
+    enum class State {
+        STATUS_LINE,
+        HEADER_LINE,
+        BODY_IDENTITY,
+        CHUNK_SIZE,
+        CHUNK_EXTENSION,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        TRAILER,
+        DONE,
+        ERROR
+    };
+
+    OtaHttpParser();
+
+    void begin();
+
+    // Header phase: returns bytes consumed, stops right after the blank line
+    size_t feedHeaders(const uint8_t* data, size_t length);
+
+    // Body phase: strips transfer framing in place, returns body bytes now at data[0..]
+    size_t decodeBody(uint8_t* data, size_t length);
+
+    // Upper bound for the next socket read so a keep-alive connection is not over-read
+    size_t maxBodyRead(size_t requested) const;
+
+    bool headersComplete() const {
+        return state != State::STATUS_LINE && state != State::HEADER_LINE && state != State::ERROR;
+    }
+    bool isBodyComplete() const { return state == State::DONE; }
+    bool hasError() const { return state == State::ERROR; }
+    const char* getError() const { return error; }
+
+    // Parsed response
+    int getStatusCode() const { return statusCode; }
+    bool isRedirect() const { return statusCode >= 300 && statusCode < 400 && location[0] != '\0'; }
+    bool isChunked() const { return chunked; }
+    bool isKeepAlive() const { return keepAlive; }
+    bool isGzipEncoded() const { return gzipEncoded; }
+    bool acceptsRanges() const { return !rangesRefused; }
+    bool hasContentLength() const { return contentLength >= 0; }
+    size_t getContentLength() const { return contentLength >= 0 ? (size_t)contentLength : 0; }
+    bool hasContentRange() const { return contentRangeValid; }
+    size_t getContentRangeStart() const { return contentRangeStart; }
+    size_t getContentRangeTotal() const { return contentRangeTotal; }
+    const char* getLocation() const { return location; }
+    size_t getBodyBytes() const { return bodyBytes; }
+
+private:
+    State state;
+    const char* error;
+
+    char line[LINE_SIZE];
+    size_t lineLength;
+    bool lineTruncated;
+    size_t headerBytes;
+
+    int statusCode;
+    bool chunked;
+    bool keepAlive;
+    bool gzipEncoded;
+    bool rangesRefused;
+    long long contentLength;
+    bool contentRangeValid;
+    size_t contentRangeStart;
+    size_t contentRangeTotal;
+    char location[LOCATION_SIZE];
+
+    size_t bodyBytes;
+    size_t chunkRemaining;
+    bool chunkSizeDigits;
+
+    void resetResponse();
+    bool processLine();
+    bool parseStatusLine();
+    bool parseHeaderLine();
+    void finishHeaders();
+    void parseContentRange(const char* value);
+    void processFramingByte(uint8_t c);
+    void fail(const char* message);
+
+    static bool headerIs(const char* line, size_t nameLength, const char* name);
+    static bool containsToken(const char* value, const char* token);
+};
+
+#endif
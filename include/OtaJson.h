@@ -0,0 +1,93 @@
+#ifndef OTA_JSON_H
+#define OTA_JSON_H
+
+#include <Arduino.h>
+
+// Slice of the parsed buffer. String values are unescaped in place and
+// NUL-terminated; numbers and literals are not (use length).
+struct OtaJsonView {
+    const char* data;
+    size_t length;
+
+    OtaJsonView() : data(""), length(0) {}
+    OtaJsonView(const char* text, size_t size) : data(text), length(size) {}
+
+    bool isEmpty() const { return length == 0; }
+    bool equals(const char* text) const { return strncmp(data, text, length) == 0 && text[length] == '\0'; }
+    bool operator==(const char* text) const { return equals(text); }
+    bool operator!=(const char* text) const { return !equals(text); }
+
+    // Leading integer of a number or numeric string, 0 if there is none
+    long toInt() const;
+};
+
+enum class OtaJsonType : uint8_t {
+    STRING,
+    NUMBER,
+    BOOLEAN,
+    NULL_VALUE,
+    OBJECT,     // Start of an object, its members follow
+    ARRAY,      // Start of an array, its elements follow
+    END         // End of the innermost object or array
+};
+
+struct OtaJsonEvent {
+    OtaJsonType type;
+    uint8_t depth;          // 0 = top-level value, 1 = its members or elements
+    const OtaJsonView* keys; // keys[d]: member name at depth d, empty for array elements
+    int index;              // Position in the enclosing array, -1 in objects
+    OtaJsonView value;      // Scalar text, empty for containers
+
+    const OtaJsonView& key() const { return keys[depth]; }
+};
+
+// Returns false to stop parsing
+typedef bool (*OtaJsonHandler)(void* context, const OtaJsonEvent& event);
+
+// Single-pass, in-place JSON tokenizer.
+// Walks the buffer once and reports every value to a handler together with
+// the chain of member names leading to it; nothing is copied or allocated.
+// Escape sequences are decoded over the source bytes (the result is never
+// longer), so the buffer must be writable and is modified.
+class OtaJson {
+public:
+    static const uint8_t MAX_DEPTH = 8;
+
+    OtaJson();
+
+    // True when text holds one complete, valid JSON value
+    bool parse(char* text, size_t length, OtaJsonHandler handler, void* context);
+
+    const char* getError() const { return error; }
+    size_t getErrorOffset() const { return errorOffset; }
+
+private:
+    struct Frame {
+        bool isArray;
+        int count;          // Members or elements seen so far
+    };
+
+    char* text;
+    size_t length;
+    size_t pos;
+    const char* error;
+    size_t errorOffset;
+
+    OtaJsonHandler handler;
+    void* context;
+    Frame frames[MAX_DEPTH + 1];
+    OtaJsonView keys[MAX_DEPTH + 1];
+    uint8_t depth;
+
+    bool fail(const char* message);
+    void skipWhitespace();
+    bool parseValue();
+    bool parseString(OtaJsonView& view);
+    bool parseNumber(OtaJsonView& view);
+    bool parseLiteral(const char* literal, OtaJsonType type);
+    bool emit(OtaJsonType type, const OtaJsonView& value);
+    static size_t encodeUtf8(uint32_t codepoint, char* out);
+    static int hexValue(char c);
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef OTA_LOG_H
+#define OTA_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+#include "OtaRingBuffer.h"
+
+#define OTA_LOG_LEVEL_NONE  0
+#define OTA_LOG_LEVEL_ERROR 1
+#define OTA_LOG_LEVEL_WARN  2
+#define OTA_LOG_LEVEL_INFO  3
+#define OTA_LOG_LEVEL_DEBUG 4
+
+// Optional: disable logging to save ~7KB Flash
+// Uncomment the following line to disable all OTA debug logs:
+// #define OTA_DISABLE_LOGGING
+
+// Messages above this level are compiled out, arguments included
+#ifndef OTA_LOG_LEVEL
+  #ifdef OTA_DISABLE_LOGGING
+    #define OTA_LOG_LEVEL OTA_LOG_LEVEL_NONE
+  #else
+    #define OTA_LOG_LEVEL OTA_LOG_LEVEL_INFO
+  #endif
+#endif
+
+#define OTA_LOG_NOTHING() do {} while (0)
+
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_ERROR
+  #define OTA_LOGE(fmt, ...) OtaLog::write(OTA_LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+  #define OTA_LOGE(fmt, ...) OTA_LOG_NOTHING()
+#endif
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_WARN
+  #define OTA_LOGW(fmt, ...) OtaLog::write(OTA_LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+  #define OTA_LOGW(fmt, ...) OTA_LOG_NOTHING()
+#endif
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_INFO
+  #define OTA_LOGI(fmt, ...) OtaLog::write(OTA_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+  #define OTA_LOGI(fmt, ...) OTA_LOG_NOTHING()
+#endif
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_DEBUG
+  #define OTA_LOGD(fmt, ...) OtaLog::write(OTA_LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+  #define OTA_LOGD(fmt, ...) OTA_LOG_NOTHING()
+#endif
+
+// Earlier macros, kept for sketches that use them (OTA_LOG builds a String)
+#define OTA_LOG(msg) OTA_LOGI("%s", String(msg).c_str())
+#define OTA_LOG_F(fmt, ...) OTA_LOGI(fmt, ##__VA_ARGS__)
+
+// Deferred binary logging.
+// A log call stores the format string pointer (which must be a literal), a
+// timestamp and the raw arguments in a record; strings are copied, so callers
+// may pass temporaries. Records go into a byte ring and are only turned into
+// text when drained. Until begin() allocates the ring, records are formatted
+// and printed right away. Any task may log: records are copied into the ring
+// inside a short critical section. One drainer at a time, see claimDrain().
+class OtaLog {
+public:
+    static const size_t RECORD_SIZE = 128;  // Longer string arguments are cut
+    static const size_t LINE_SIZE = 192;
+
+    class Record {
+    public:
+        Record(uint8_t level, const char* format);
+
+        template<typename T>
+        typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type add(T value) {
+            if (sizeof(T) <= 4) {
+                addInt32((uint32_t)value);
+            } else {
+                addInt64((uint64_t)value);
+            }
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type add(T value) {
+            addDouble(value);
+        }
+
+        void add(const char* value);
+        void add(const String& value) { add(value.c_str()); }
+        void add(const void* value);
+
+        void seal() { bytes[0] = (uint8_t)length; }
+        const uint8_t* data() const { return bytes; }
+        size_t size() const { return length; }
+
+    private:
+        uint8_t bytes[RECORD_SIZE];
+        size_t length;
+
+        void addInt32(uint32_t value);
+        void addInt64(uint64_t value);
+        void addDouble(double value);
+        bool reserve(size_t count);
+    };
+
+    // Allocate the ring once; returns true if it is (already) allocated
+    static bool begin(size_t bufferSize);
+    static bool isBuffered() { return ring.isAllocated(); }
+
+    template<typename... Args>
+    static void write(uint8_t level, const char* format, const Args&... args) {
+        Record record(level, format);
+        int expand[] = {0, (record.add(args), 0)...};
+        (void)expand;
+        commit(record);
+    }
+
+    // Consumer side: oldest record as text (0 if none), removed by pop().
+    // Only the owner that claimDrain() accepted may call them.
+    static bool claimDrain(const void* owner);
+    static void releaseDrain(const void* owner);
+    static size_t peekLine(char* line, size_t size, uint8_t* level = nullptr);
+    static void pop();
+    static uint32_t getDropped() { return dropped.load(); }
+
+    static size_t formatRecord(const uint8_t* record, size_t length, char* line, size_t size);
+
+private:
+    static OtaRingBuffer ring;
+    static std::atomic<uint32_t> dropped;
+    static std::atomic<const void*> drainer;
+
+    static void commit(Record& record);
+};
+
+#endif
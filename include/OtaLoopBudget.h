@@ -0,0 +1,58 @@
+#ifndef OTA_LOOP_BUDGET_H
+#define OTA_LOOP_BUDGET_H
+
+#include <Arduino.h>
+
+// Per-call time budget for the download work done in loop().
+// Each stage that runs in loop() reports (bytes, microseconds) samples; the
+// per-byte cost of every stage is tracked as a moving average so the next
+// read can be sized to fit the time left in the current call.
+class OtaLoopBudget {
+public:
+    enum Stage {
+        RECV,   // Socket read + HTTP body decoding
+        HASH,   // SHA256 update
+        WRITE,  // Decompression, delta patching and flash write
+        STAGE_COUNT
+    };
+
+    static const size_t MIN_SLICE = 128; // Progress guaranteed per call, even over budget
+
+    OtaLoopBudget();
+
+    // Called at the start and end of each loop(); budgetMicros = 0 disables budgeting
+    void startIteration(unsigned long startMicros, unsigned long budgetMicros);
+    void finishIteration(unsigned long elapsedMicros);
+
+    void record(Stage stage, size_t bytes, unsigned long micros);
+    void addBytes(size_t bytes) { iterationBytes += bytes; }
+
+    // Largest slice up to maxSlice whose predicted cost fits the rest of this
+    // call, or 0 when the budget is spent. includeProcessing adds hash and
+    // write costs (serial mode); the pipelined reader only pays for receive.
+    size_t nextSlice(size_t maxSlice, bool includeProcessing) const;
+
+    bool isEnabled() const { return budgetMicros > 0; }
+    size_t getIterationBytes() const { return iterationBytes; }
+    uint32_t getCostNs(Stage stage) const { return costNs[stage]; }
+
+    // Counters over budgeted iterations
+    size_t getBytesPerIteration() const;
+    unsigned long getIterations() const { return iterations; }
+    unsigned long getOverruns() const { return overruns; }
+    void resetCounters();
+
+private:
+    unsigned long budgetMicros;
+    unsigned long iterationStart;
+    size_t iterationBytes;
+
+    uint32_t costNs[STAGE_COUNT];   // Nanoseconds per byte
+    bool measured[STAGE_COUNT];
+
+    unsigned long iterations;
+    unsigned long overruns;
+    uint64_t budgetedBytes;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef OTA_MIRROR_SET_H
+#define OTA_MIRROR_SET_H
+
+#include <Arduino.h>
+#include "OtaFixedString.h"
+
+// Firmware mirrors of one update, ranked by measured latency and throughput.
+// Measurements are kept per host (not per URL) in a small table that outlives
+// the mirror list, so a host seen in an earlier update starts out ranked by
+// its history. The table can be stored in NVS to survive the reboot into the
+// new firmware.
+class OtaMirrorSet {
+public:
+    static const size_t MAX_MIRRORS = 4;
+    static const size_t MAX_HOSTS = 8;
+
+    OtaMirrorSet();
+
+    // Mirror list of the current update (stats table is kept). Indexes past
+    // the list, including current() = -1 after clear(), read as empty and are
+    // not recorded
+    void clear();
+    bool add(const char* url, const char* host, uint16_t port);
+    size_t count() const { return mirrorCount; }
+    const char* getUrl(size_t index) const { return index < mirrorCount ? mirrors[index].url.c_str() : ""; }
+    const char* getHost(size_t index) const { return index < mirrorCount ? mirrors[index].host.c_str() : ""; }
+    uint16_t getPort(size_t index) const { return index < mirrorCount ? mirrors[index].port : 0; }
+    bool isMeasured(size_t index) const;
+
+    // Order mirrors by estimated time to fetch expectedBytes and select the best
+    void rank(size_t expectedBytes);
+    int current() const { return currentIndex; }
+    // Select the next untried mirror in rank order; re-ranks once all were tried
+    bool advance();
+    unsigned long estimateMillis(size_t index, size_t expectedBytes) const;
+
+    // Measurements of the mirror at index
+    void recordConnect(size_t index, unsigned long millis);
+    void recordFirstByte(size_t index, unsigned long millis);
+    void recordTransfer(size_t index, size_t bytes, unsigned long millis);
+    void recordFailure(size_t index);
+
+    bool load(const char* name);
+    bool save(const char* name) const;
+
+private:
+    static const size_t MIN_THROUGHPUT_SAMPLE = 16384; // Smaller transfers measure latency, not bandwidth
+
+    struct HostStats {
+        uint32_t hostHash;          // 0 = free slot
+        uint32_t lastUsed;          // Sequence number for LRU replacement
+        uint32_t connectMillis;     // 0 = not measured
+        uint32_t firstByteMillis;
+        uint32_t bytesPerSecond;
+        uint8_t failures;           // Halved on every successful transfer
+        uint8_t reserved[3];
+    };
+
+    struct Mirror {
+        OtaUrlString url;
+        OtaHostString host;
+        uint16_t port;
+        uint8_t stats;              // Index into hosts
+        bool tried;
+    };
+
+    Mirror mirrors[MAX_MIRRORS];
+    size_t mirrorCount;
+    uint8_t order[MAX_MIRRORS];     // Mirror indexes, best first
+    int currentIndex;
+    size_t lastExpectedBytes;
+
+    HostStats hosts[MAX_HOSTS];
+    uint32_t useCounter;
+
+    static uint32_t hashHost(const char* host, uint16_t port);
+    static uint32_t average(uint32_t previous, uint32_t sample);
+    uint8_t findOrAllocHost(uint32_t hash);
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef OTA_MQTT_ENGINE_H
+#define OTA_MQTT_ENGINE_H
+
+#include <Arduino.h>
+#include <functional>
+#include "OtaAsyncClient.h"
+
+// MQTT 3.1.1 client that never waits for the network.
+// A state machine over OtaAsyncClient: connect() only starts the DNS/TCP/TLS
+// connect, and every loop() advances it by one bounded step, then sends
+// CONNECT and waits for CONNACK across later calls. Outgoing packets are
+// encoded into a fixed send buffer that drains as the socket accepts bytes.
+// Incoming packets are decoded incrementally (fixed header, remaining length,
+// body) into a bounded receive buffer, so a packet that trickles in over many
+// calls costs each call only the bytes that have arrived; packets larger than
+// the buffer are skipped. Subscriptions and publishes use QoS 0; incoming
+// QoS 1 messages are acknowledged.
+class OtaMqttEngine {
+public:
+    typedef std::function<void(char*, uint8_t*, unsigned int)> Callback;  // As PubSubClient's
+
+    // state() codes, the same as PubSubClient's
+    static const int CONNECTION_TIMEOUT = -4;
+    static const int CONNECTION_LOST = -3;
+    static const int CONNECT_FAILED = -2;
+    static const int DISCONNECTED = -1;
+    static const int CONNECTED = 0;         // 1..5: CONNACK refusal codes
+
+    static const size_t SEND_BUFFER_SIZE = 1024;
+    static const uint16_t DEFAULT_BUFFER_SIZE = 256;   // Largest incoming packet, as PubSubClient
+
+    OtaMqttEngine();
+    ~OtaMqttEngine();
+
+    OtaMqttEngine(const OtaMqttEngine&) = delete;
+    OtaMqttEngine& operator=(const OtaMqttEngine&) = delete;
+
+    // host must outlive the engine, as with PubSubClient::setServer()
+    void setServer(const char* host, uint16_t port, bool secure);
+    // TLS: the strings must stay valid while connecting
+    void setInsecure();
+    void setCACert(const char* pem);
+    void setCertificate(const char* certPem, const char* keyPem);
+    // Parsed certificates and TLS session cache, in place of the PEM settings
+    void setTrustStore(OtaTrustStore* store) { trustStore = store; }
+    void setKeepAlive(uint16_t seconds) { keepAlive = seconds; }
+    // From connect() until CONNACK, including DNS, TCP and TLS
+    void setConnectTimeout(unsigned long ms) { connectTimeout = ms; }
+    void setCallback(Callback handler) { callback = handler; }
+
+    // Receive buffer, the largest packet that is delivered
+    bool setBufferSize(uint16_t size);
+    uint16_t getBufferSize() const { return bufferSize; }
+
+    // Starts connecting; false when it cannot start. loop() does the rest.
+    bool connect(const char* clientId, const char* user = nullptr, const char* password = nullptr);
+    void disconnect();
+    bool loop();                            // True while connected
+    bool connected() const { return phase == Phase::CONNECTED; }
+    bool isConnecting() const { return phase == Phase::CONNECTING || phase == Phase::AWAIT_CONNACK; }
+    int state() const { return result; }
+
+    // False when not connected or the send buffer is full
+    bool subscribe(const char* filter);
+    bool unsubscribe(const char* filter);
+    bool publish(const char* topic, const char* payload, bool retained = false);
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained = false);
+
+    unsigned long getMaxLoopMicros() const { return maxLoopMicros; }
+    void resetMaxLoopMicros() { maxLoopMicros = 0; }
+    uint32_t getRejectedSubscriptions() const { return rejectedSubscriptions; }
+    uint32_t getSkippedPackets() const { return skippedPackets; }   // Larger than the receive buffer
+
+private:
+    enum class Phase : uint8_t {
+        IDLE,
+        CONNECTING,         // DNS, TCP, TLS
+        AWAIT_CONNACK,
+        CONNECTED
+    };
+
+    enum class RxStage : uint8_t {
+        HEADER,
+        LENGTH,
+        BODY,
+        SKIP                // Body of a packet that does not fit
+    };
+
+    static const size_t READ_LIMIT = 1460;  // Bytes taken from the socket per loop()
+
+    OtaAsyncClient* client;
+    const char* host;
+    uint16_t port;
+    bool secure;
+    bool insecure;
+    const char* caCert;
+    const char* clientCert;
+    const char* clientKey;
+    OtaTrustStore* trustStore;
+    uint16_t keepAlive;
+    unsigned long connectTimeout;
+    Callback callback;
+
+    Phase phase;
+    int result;
+    unsigned long connectStart;
+    unsigned long lastSend;
+    unsigned long lastReceive;
+    unsigned long pingSent;
+    bool pingOutstanding;
+    uint16_t nextPacketId;
+
+    uint8_t* rxBuffer;
+    uint16_t bufferSize;
+    RxStage rxStage;
+    uint8_t rxHeader;
+    uint32_t rxLength;
+    uint8_t rxLengthBytes;
+    uint32_t rxReceived;
+
+    uint8_t txBuffer[SEND_BUFFER_SIZE];
+    size_t txStart;         // First unsent byte
+    size_t txEnd;
+
+    unsigned long maxLoopMicros;
+    uint32_t rejectedSubscriptions;
+    uint32_t skippedPackets;
+
+    void fail(int code);
+    bool flush();
+    bool receive(unsigned long now);
+    void handlePacket(unsigned long now);
+    void handlePublish();
+    void checkKeepAlive(unsigned long now);
+
+    // Packet encoding into the send buffer
+    bool beginPacket(uint8_t header, size_t bodyLength);
+    void putByte(uint8_t value);
+    void putUint16(uint16_t value);
+    void putBytes(const uint8_t* data, size_t length);
+    void putString(const char* text);
+    uint16_t takePacketId();
+};
+
+#endif
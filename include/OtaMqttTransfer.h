@@ -0,0 +1,68 @@
+#ifndef OTA_MQTT_TRANSFER_H
+#define OTA_MQTT_TRANSFER_H
+
+#include <Arduino.h>
+
+// Reassembly of a firmware stream published as numbered MQTT chunks.
+// Each chunk payload is "<index u32 LE><total u32 LE><data>", where every
+// chunk except the last carries exactly chunkSize data bytes. Chunks may
+// arrive out of order within a sliding window of `window` chunks starting at
+// the next in-order index; they are held in fixed slots (window x chunkSize,
+// allocated once) until the stream can be consumed in order. Chunks outside
+// the window and duplicates are dropped.
+class OtaMqttTransfer {
+public:
+    static const size_t HEADER_SIZE = 8;
+    static const size_t MAX_WINDOW = 32;
+
+    OtaMqttTransfer();
+    ~OtaMqttTransfer();
+
+    OtaMqttTransfer(const OtaMqttTransfer&) = delete;
+    OtaMqttTransfer& operator=(const OtaMqttTransfer&) = delete;
+
+    bool begin(size_t chunkSize, size_t window);
+    void end();
+
+    // Store a received chunk payload; returns false for a malformed chunk
+    bool onChunk(const uint8_t* payload, size_t length);
+
+    // Next in-order chunk, or nullptr if it has not arrived yet
+    const uint8_t* peekReady(size_t& length) const;
+    void releaseReady();
+
+    // In-window chunks still missing, up to max indexes
+    size_t collectMissing(uint32_t* indexes, size_t max) const;
+
+    bool isActive() const { return slots != nullptr; }
+    bool isComplete() const { return totalChunks > 0 && nextIndex >= totalChunks; }
+    bool hasError() const { return error != nullptr; }
+    const char* getError() const { return error; }
+
+    uint32_t getNextIndex() const { return nextIndex; }
+    uint32_t getTotalChunks() const { return totalChunks; }
+    size_t getChunkSize() const { return chunkSize; }
+    size_t getWindow() const { return window; }
+    unsigned long getLastChunkTime() const { return lastChunkTime; }
+    void touch() { lastChunkTime = millis(); }
+    size_t getDuplicates() const { return duplicates; }
+
+private:
+    static const uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+
+    uint8_t* slots;
+    size_t chunkSize;
+    size_t window;
+    uint32_t slotIndex[MAX_WINDOW];     // Chunk held by each slot, EMPTY_SLOT if none
+    uint16_t slotLength[MAX_WINDOW];
+
+    uint32_t nextIndex;                 // All chunks below this were consumed
+    uint32_t totalChunks;               // 0 until the first chunk arrives
+    unsigned long lastChunkTime;
+    size_t duplicates;
+    const char* error;
+
+    void fail(const char* message);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef OTA_PEM_DECODER_H
+#define OTA_PEM_DECODER_H
+
+#include <Arduino.h>
+
+// Streaming PEM to DER conversion.
+// Reads the input in small chunks and decodes the base64 body of one
+// "-----BEGIN x-----" ... "-----END x-----" block at a time into the caller's
+// buffer, so a file of any size costs one decoded block plus CHUNK_SIZE
+// bytes instead of the whole text. Text outside the blocks is skipped.
+class OtaPemDecoder {
+public:
+    static const size_t CHUNK_SIZE = 128;
+    static const size_t MAX_LABEL = 31;
+
+    enum class Result : uint8_t {
+        BLOCK,      // data()/size() hold the next block
+        END,        // No more blocks
+        ERROR       // Malformed base64 or the block does not fit
+    };
+
+    // output receives each decoded block in turn and must outlive the decoder
+    OtaPemDecoder(Stream& input, uint8_t* output, size_t capacity);
+
+    Result next();
+
+    const uint8_t* data() const { return output; }
+    size_t size() const { return length; }
+    const char* getLabel() const { return label; }  // "CERTIFICATE", "PRIVATE KEY", ...
+
+private:
+    static const size_t LINE_SIZE = 48;     // Kept of a boundary line, enough for its label
+
+    Stream& input;
+    uint8_t* output;
+    size_t capacity;
+    size_t length;
+
+    char chunk[CHUNK_SIZE];
+    size_t chunkPos;
+    size_t chunkLen;
+
+    char line[LINE_SIZE];   // Current boundary line
+    size_t lineLen;
+    bool lineStart;
+    bool boundary;
+    bool inBlock;
+    bool padded;
+    uint32_t bits;
+    uint8_t bitCount;
+    char label[MAX_LABEL + 1];
+
+    // BLOCK when the line closed a block, ERROR when it was malformed, else END (go on)
+    Result endLine();
+    bool decode(char c);
+};
+
+#endif
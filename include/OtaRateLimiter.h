@@ -0,0 +1,40 @@
+#ifndef OTA_RATE_LIMITER_H
+#define OTA_RATE_LIMITER_H
+
+#include <Arduino.h>
+
+// Token bucket on bytes.
+// Credit accrues at the configured rate up to the burst size, and a transfer
+// may move as many bytes as there is credit. Credit is kept in
+// byte-microseconds, so low rates accrue exactly without floating point.
+// Bytes consumed beyond the credit (data that has already arrived) leave a
+// debt that later credit pays off first.
+class OtaRateLimiter {
+public:
+    static const uint32_t UNLIMITED = 0xFFFFFFFF;
+
+    OtaRateLimiter();
+
+    // bytesPerSecond 0 pauses, UNLIMITED disables the limiter. Credit is kept
+    // across changes, capped at the new burst size.
+    void configure(uint32_t bytesPerSecond, size_t burstBytes);
+    uint32_t getRate() const { return rate; }
+    size_t getBurst() const { return burst; }
+    bool isLimited() const { return rate != UNLIMITED; }
+
+    // Bytes that may be moved now, at most maxBytes
+    size_t allowance(unsigned long nowMicros, size_t maxBytes);
+    void consume(size_t bytes);
+    // Back to a full bucket
+    void reset(unsigned long nowMicros);
+
+private:
+    uint32_t rate;
+    size_t burst;
+    int64_t credit;             // Byte-microseconds, negative while in debt
+    unsigned long lastRefill;
+
+    void refill(unsigned long nowMicros);
+};
+
+#endif
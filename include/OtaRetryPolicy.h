@@ -0,0 +1,83 @@
+#ifndef OTA_RETRY_POLICY_H
+#define OTA_RETRY_POLICY_H
+
+#include <Arduino.h>
+
+// When to try again after consecutive failures.
+// Exponential backoff with decorrelated jitter: each delay is drawn from
+// [base, 3 * previous delay] and capped at the maximum. The range triples per
+// failure (the mean grows about 1.5x) until it spans [base, max], where delays
+// average about a third of the maximum. Clients that failed together (a
+// broker or server restart) spread out instead of retrying in lockstep.
+class OtaRetryPolicy {
+public:
+    OtaRetryPolicy();
+
+    void setDelays(unsigned long baseMs, unsigned long maxMs);
+
+    // Schedules the next attempt, returns its delay (ms)
+    unsigned long recordFailure(unsigned long now);
+    void recordSuccess();
+
+    bool canAttempt(unsigned long now) const;
+    unsigned long getNextAttempt() const { return failures > 0 ? nextAttempt : 0; }  // millis(), 0 = now
+    uint16_t getFailures() const { return failures; }
+
+private:
+    unsigned long baseDelay;
+    unsigned long maxDelay;
+    unsigned long lastDelay;
+    unsigned long nextAttempt;
+    uint16_t failures;
+};
+
+// Per-host circuit breaker.
+// After `threshold` consecutive failures a host's circuit opens and attempts
+// to it are refused for the cooldown. Then one trial attempt is let through
+// (half-open): success closes the circuit, failure opens it for another
+// cooldown. Hosts are kept by hash in a small table; the least recently used
+// closed entry is reused when it is full.
+class OtaCircuitBreaker {
+public:
+    static const size_t MAX_HOSTS = 8;
+
+    enum class State : uint8_t {
+        CLOSED,
+        OPEN,
+        HALF_OPEN
+    };
+
+    OtaCircuitBreaker();
+
+    // threshold 0 disables the breaker
+    void configure(uint8_t threshold, unsigned long cooldownMs);
+
+    // False while the host's circuit is open
+    bool allow(const char* host, unsigned long now);
+    void recordSuccess(const char* host);
+    // True when this failure opened the circuit
+    bool recordFailure(const char* host, unsigned long now);
+
+    State getState(const char* host, unsigned long now) const;
+    unsigned long getOpenUntil(const char* host) const;    // millis(), 0 when not open
+
+private:
+    struct Entry {
+        uint32_t hash;
+        unsigned long openUntil;
+        unsigned long lastUsed;
+        uint8_t failures;
+        State state;
+        bool used;
+    };
+
+    Entry entries[MAX_HOSTS];
+    uint8_t threshold;
+    unsigned long cooldown;
+
+    static uint32_t hashHost(const char* host);
+    int find(const char* host) const;
+    Entry& findOrAlloc(const char* host, unsigned long now);
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef OTA_RING_BUFFER_H
+#define OTA_RING_BUFFER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "OtaArena.h"
+
+// Single-producer / single-consumer byte ring buffer.
+// The producer and consumer may run on different tasks (or cores): the only
+// shared state is the pair of monotonically increasing head/tail counters.
+// Capacity is rounded up to a power of two so indexes wrap with a mask.
+class OtaRingBuffer {
+private:
+    uint8_t* storage;
+    OtaArena::Slot slot;
+    size_t capacity;
+    size_t mask;
+    std::atomic<size_t> head;   // Total bytes written (producer owned)
+    std::atomic<size_t> tail;   // Total bytes read (consumer owned)
+
+public:
+    OtaRingBuffer() : storage(nullptr), slot(OtaArena::HEAP), capacity(0), mask(0), head(0), tail(0) {}
+    ~OtaRingBuffer() { end(); }
+
+    OtaRingBuffer(const OtaRingBuffer&) = delete;
+    OtaRingBuffer& operator=(const OtaRingBuffer&) = delete;
+
+    // Allocate storage once; no allocation happens while streaming
+    bool begin(size_t size, OtaArena::Slot slot = OtaArena::HEAP) {
+        end();
+        size_t rounded = 1;
+        while (rounded < size) rounded <<= 1;
+        storage = OtaArena::acquire(slot, rounded);
+        if (!storage) return false;
+        this->slot = slot;
+        capacity = rounded;
+        mask = rounded - 1;
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    void end() {
+        OtaArena::release(slot, storage);
+        storage = nullptr;
+        capacity = 0;
+        mask = 0;
+    }
+
+    bool isAllocated() const { return storage != nullptr; }
+    size_t size() const { return capacity; }
+
+    size_t used() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    size_t free() const { return capacity - used(); }
+
+    // Producer side: contiguous writable region starting at the write cursor
+    uint8_t* writePtr(size_t& contiguous) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t space = capacity - (h - tail.load(std::memory_order_acquire));
+        size_t offset = h & mask;
+        contiguous = min(space, capacity - offset);
+        return storage + offset;
+    }
+
+    void commitWrite(size_t count) {
+        head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // Consumer side: contiguous readable region starting at the read cursor
+    const uint8_t* readPtr(size_t& contiguous) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t avail = head.load(std::memory_order_acquire) - t;
+        size_t offset = t & mask;
+        contiguous = min(avail, capacity - offset);
+        return storage + offset;
+    }
+
+    void commitRead(size_t count) {
+        tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // Producer side: copy all of data or nothing, published with one commit
+    bool write(const uint8_t* data, size_t length) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (capacity - (h - tail.load(std::memory_order_acquire)) < length) return false;
+        size_t offset = h & mask;
+        size_t first = min(length, capacity - offset);
+        memcpy(storage + offset, data, first);
+        memcpy(storage, data + first, length - first);
+        head.store(h + length, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: copy length bytes at the read cursor without consuming them
+    bool peek(uint8_t* data, size_t length) const {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) - t < length) return false;
+        size_t offset = t & mask;
+        size_t first = min(length, capacity - offset);
+        memcpy(data, storage + offset, first);
+        memcpy(data + first, storage, length - first);
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef OTA_ROLLOUT_H
+#define OTA_ROLLOUT_H
+
+#include <Arduino.h>
+
+// Staged rollout decisions, identical on every boot for a device and seed.
+// The device identity and the seed are hashed into a cohort 0..99; devices
+// with cohort < percent take part, so raising the percentage only adds
+// devices. The start delay inside the jitter window comes from a second,
+// independent hash, spreading the first requests of the fleet evenly.
+class OtaRollout {
+public:
+    static uint8_t cohort(const uint8_t* id, size_t idLength, const char* seed, size_t seedLength);
+    static bool isIncluded(uint8_t cohort, uint8_t percent) { return cohort < percent; }
+    static uint32_t startDelay(const uint8_t* id, size_t idLength, const char* seed, size_t seedLength,
+                               uint32_t windowMs);
+
+private:
+    static uint32_t hash(uint8_t salt, const uint8_t* id, size_t idLength, const char* seed, size_t seedLength);
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef OTA_SEGMENTED_DOWNLOAD_H
+#define OTA_SEGMENTED_DOWNLOAD_H
+
+#include <Arduino.h>
+#include "OtaAsyncClient.h"
+#include "OtaHttpParser.h"
+#include "OtaFixedString.h"
+
+// Fetches one file as consecutive byte ranges over several connections.
+// The file is cut into blocks of blockSize bytes; each connection ("lane")
+// holds one block in flight and receives it into its own slot, so memory is
+// lanes x blockSize, allocated once. Blocks are handed out in file order and
+// read back in file order through peek()/consume(); a lane whose block is
+// ahead of the read cursor waits until the cursor has passed it before it
+// requests the next block. Lanes reuse their connection when the server
+// keeps it alive.
+class OtaSegmentedDownload {
+public:
+    static const size_t MAX_CONNECTIONS = 8;
+    static const size_t MIN_BLOCK_SIZE = 4096;
+
+    OtaSegmentedDownload();
+    ~OtaSegmentedDownload();
+
+    OtaSegmentedDownload(const OtaSegmentedDownload&) = delete;
+    OtaSegmentedDownload& operator=(const OtaSegmentedDownload&) = delete;
+
+    // Block size that gives every connection one slot within memoryCap
+    static size_t blockSizeFor(size_t connections, size_t memoryCap);
+
+    void setTimeouts(unsigned long dnsMs, unsigned long tcpMs, unsigned long tlsMs, unsigned long stallMs);
+    // Lanes share the store's certificates and TLS sessions; unverified unless verify
+    void setTrustStore(OtaTrustStore* store, bool verify);
+
+    // Fetch [start, totalBytes). A non-null firstClient is taken over as the
+    // first lane: its 206 response headers for [start, start + blockSize)
+    // were parsed by firstParser and the body is still unread. Lanes are
+    // reduced until their slots can be allocated.
+    bool begin(const char* host, uint16_t port, const char* path, bool secure,
+               size_t start, size_t totalBytes, size_t blockSize, size_t connections,
+               OtaAsyncClient* firstClient = nullptr, const OtaHttpParser* firstParser = nullptr);
+    void end();
+
+    // Advance every lane; reads at most maxBytes from the sockets
+    size_t poll(size_t maxBytes);
+
+    // Received bytes at the read cursor, in file order
+    const uint8_t* peek(size_t& length) const;
+    void consume(size_t length);
+
+    bool isActive() const { return slots != nullptr; }
+    bool isComplete() const { return cursor >= totalBytes; }
+    bool hasError() const { return error != nullptr; }
+    const char* getError() const { return error; }
+    size_t getLaneCount() const { return laneCount; }
+    size_t getReconnects() const { return reconnects; }
+
+private:
+    enum class LaneState {
+        IDLE,       // No block assigned
+        CONNECTING,
+        REQUEST,    // Range request partly sent
+        HEADERS,
+        BODY,
+        DONE        // Block received, waiting for the cursor
+    };
+
+    struct Lane {
+        OtaAsyncClient* client;
+        OtaHttpParser parser;
+        LaneState state;
+        size_t blockStart;
+        size_t blockEnd;        // Exclusive
+        size_t received;
+        size_t requestSent;
+        uint8_t* slot;
+        unsigned long lastProgress;
+    };
+
+    Lane lanes[MAX_CONNECTIONS];
+    size_t laneCount;
+    uint8_t* slots;
+    size_t blockSize;
+
+    OtaHostString host;
+    uint16_t port;
+    OtaUrlString path;
+    bool secure;
+    OtaTrustStore* trustStore;
+    bool verify;
+
+    size_t totalBytes;
+    size_t cursor;              // Next byte to hand out through peek()
+    size_t nextBlock;           // Start of the next unassigned block
+    size_t pollLane;            // Round-robin start for poll()
+    size_t reconnects;
+
+    unsigned long dnsTimeout;
+    unsigned long tcpTimeout;
+    unsigned long tlsTimeout;
+    unsigned long stallTimeout;
+
+    const char* error;
+
+    void assignBlock(Lane& lane);
+    void connectLane(Lane& lane);
+    void requestBlock(Lane& lane);
+    void sendRequest(Lane& lane);
+    size_t pollLaneState(Lane& lane, size_t maxBytes);
+    void closeLane(Lane& lane);
+    Lane* cursorLane() const;
+    void fail(const char* message);
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef OTA_SHA256_H
+#define OTA_SHA256_H
+
+#include <Arduino.h>
+#include <mbedtls/sha256.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
+#include "OtaRingBuffer.h"
+
+// Implementation used to hash the firmware image
+enum class OtaHashBackend {
+    SOFTWARE,   // Portable in-tree SHA-256 on the calling core
+    HARDWARE,   // mbedtls, backed by the SHA peripheral when CONFIG_MBEDTLS_HARDWARE_SHA is set
+    OFFLOAD     // HARDWARE, run by a task on the other core and fed through a ring buffer
+};
+
+// Compile-time default for OtaConfig::hashBackend
+#ifndef OTA_DEFAULT_HASH_BACKEND
+  #define OTA_DEFAULT_HASH_BACKEND OtaHashBackend::HARDWARE
+#endif
+
+// Incremental SHA-256 with a selectable backend.
+// With OFFLOAD, update() only copies into a ring buffer; the digest is
+// computed by a task pinned to the other core, and finish() waits for it to
+// drain. The ring is allocated once in begin(), so update() never allocates.
+class OtaSha256 {
+public:
+    static const size_t DIGEST_SIZE = 32;
+    static const size_t OFFLOAD_BUFFER_SIZE = 8192;
+
+    OtaSha256();
+    ~OtaSha256();
+
+    OtaSha256(const OtaSha256&) = delete;
+    OtaSha256& operator=(const OtaSha256&) = delete;
+
+    // offloadCore < 0 picks the core the caller is not running on.
+    // Falls back to HARDWARE if the offload task cannot be started.
+    bool begin(OtaHashBackend backend, int offloadCore = -1);
+    void update(const uint8_t* data, size_t length);
+    bool finish(uint8_t digest[DIGEST_SIZE]);
+    void end();
+
+    bool isActive() const { return active; }
+    OtaHashBackend getBackend() const { return backend; }
+    static const char* backendName(OtaHashBackend backend);
+
+private:
+    OtaHashBackend backend;
+    bool active;
+
+    // SOFTWARE
+    uint32_t softState[8];
+    uint64_t softLength;
+    uint8_t softBlock[64];
+    size_t softFill;
+
+    // HARDWARE / OFFLOAD
+    mbedtls_sha256_context mbedtlsContext;
+
+    // OFFLOAD
+    OtaRingBuffer offloadBuffer;
+    TaskHandle_t offloadTask;
+    std::atomic<bool> offloadInputDone;
+    std::atomic<bool> offloadRunning;
+
+    void softStart();
+    void softUpdate(const uint8_t* data, size_t length);
+    void softFinish(uint8_t digest[DIGEST_SIZE]);
+    static void softTransform(uint32_t state[8], const uint8_t block[64]);
+
+    bool startOffload(int core);
+    void stopOffload();
+    static void offloadTaskEntry(void* arg);
+    void runOffload();
+};
+
+#endif
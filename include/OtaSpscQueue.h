@@ -0,0 +1,54 @@
+#ifndef OTA_SPSC_QUEUE_H
+#define OTA_SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+
+// Single-producer / single-consumer queue of fixed-size items.
+// Lock-free: the producer only writes head, the consumer only writes tail,
+// and each item is published by the release store of head after it has been
+// copied in. N must be a power of two. Needs nothing but <atomic>, so it
+// builds on a host as well.
+template<typename T, size_t N>
+class OtaSpscQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "OtaSpscQueue capacity must be a power of two");
+
+public:
+    OtaSpscQueue() : head(0), tail(0) {}
+
+    OtaSpscQueue(const OtaSpscQueue&) = delete;
+    OtaSpscQueue& operator=(const OtaSpscQueue&) = delete;
+
+    // Producer side; false when full
+    bool push(const T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) return false;
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false when empty
+    bool pop(T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t) return false;
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side; a snapshot that may be stale by the time it is used
+    bool isFull() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire) == N;
+    }
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[N];
+    std::atomic<size_t> head;   // Items pushed (producer owned)
+    std::atomic<size_t> tail;   // Items popped (consumer owned)
+};
+
+#endif
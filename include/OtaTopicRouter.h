@@ -0,0 +1,98 @@
+#ifndef OTA_TOPIC_ROUTER_H
+#define OTA_TOPIC_ROUTER_H
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include "OtaMqttEngine.h"
+
+// payload is the MQTT client's receive buffer, valid until the handler returns.
+// Handlers of one message share it, so a handler that modifies it (the updater
+// parses its manifest in place) should not share its topic with others.
+typedef void (*OtaTopicHandler)(const char* topic, uint8_t* payload, unsigned int length, void* context);
+
+// Routes the messages of one MQTT connection to any number of handlers.
+// Filters are stored in a trie with one node per topic level, held in fixed
+// tables; '+' and '#' are nodes of their own. A message walks the trie level
+// by level, comparing its topic in place, so dispatch costs O(topic length)
+// (plus one branch per matching wildcard) and allocates nothing. The broker
+// subscription for a filter is sent once, when its first handler is added,
+// and removed with its last one.
+class OtaTopicRouter {
+public:
+    static const size_t MAX_NODES = 32;         // Topic levels over all filters
+    static const size_t MAX_HANDLERS = 16;
+    static const size_t LABEL_SPACE = 512;      // Bytes of level text over all nodes
+
+    OtaTopicRouter();
+
+    // Installs the router as the client's message callback; one client at a time
+    void attach(PubSubClient& client);
+    void attach(OtaMqttEngine& engine);
+    PubSubClient* getClient() const { return client; }
+    OtaMqttEngine* getEngine() const { return engine; }
+
+    // The attached client, whichever kind it is
+    bool isConnected();
+    bool publish(const char* topic, const char* payload);
+    uint16_t getBufferSize();
+    bool setBufferSize(uint16_t size);
+
+    // False when the filter is malformed or the tables are full
+    bool subscribe(const char* filter, OtaTopicHandler handler, void* context);
+    void unsubscribe(const char* filter, OtaTopicHandler handler, void* context);
+
+    // For applications that run the connection themselves: client.loop() or
+    // engine.loop(), and every filter is subscribed again when the connection
+    // has come back
+    bool loop();
+    // Sends every filter to the broker, e.g. right after connect()
+    void resubscribe();
+
+    // Number of handlers called
+    size_t dispatch(const char* topic, uint8_t* payload, unsigned int length);
+
+private:
+    static const uint8_t NONE = 0xFF;
+
+    struct Node {
+        uint16_t label;         // Offset of the level text in labels
+        uint8_t labelLength;
+        uint8_t parent;
+        uint8_t firstChild;
+        uint8_t nextSibling;
+        uint8_t firstHandler;
+        bool used;
+    };
+
+    struct Handler {
+        OtaTopicHandler handler;    // nullptr = free, or removed during dispatch
+        void* context;
+        uint8_t node;
+        uint8_t next;
+    };
+
+    PubSubClient* client;
+    OtaMqttEngine* engine;
+    Node nodes[MAX_NODES];
+    Handler handlers[MAX_HANDLERS];
+    char labels[LABEL_SPACE];
+    size_t labelsUsed;
+    uint8_t dispatching;        // Nesting depth: removals are deferred meanwhile
+    bool prunePending;
+    bool wasConnected;
+
+    static bool validFilter(const char* filter);
+    void sendSubscribe(const char* filter);
+    void sendUnsubscribe(const char* filter);
+    uint8_t findChild(uint8_t parent, const char* level, size_t length) const;
+    uint8_t addChild(uint8_t parent, const char* level, size_t length);
+    uint8_t findNode(const char* filter) const;
+    bool isActive(uint8_t node) const;
+    size_t match(uint8_t node, const char* topic, const char* level, uint8_t* payload, unsigned int length);
+    size_t callHandlers(uint8_t node, const char* topic, uint8_t* payload, unsigned int length);
+    void prune();
+    void removeNode(uint8_t node);
+    bool buildFilter(uint8_t node, char* filter, size_t size) const;
+};
+
+#endif
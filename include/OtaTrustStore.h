@@ -0,0 +1,101 @@
+#ifndef OTA_TRUST_STORE_H
+#define OTA_TRUST_STORE_H
+
+#include <Arduino.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/pk.h>
+#include "OtaCertBundle.h"
+
+// TLS credentials and sessions shared by the connections of one updater.
+// Certificates are parsed from PEM once, when they are set, and every
+// connection points its configuration at the parsed structures instead of
+// parsing the text again. The session of each completed handshake (session
+// ID or ticket, whichever the server uses) is kept per host and port and
+// offered on the next connection there, so reconnects, Range resumes,
+// segment connections and mirror retries get an abbreviated handshake when
+// the server allows it. Sessions from unverified connections are never
+// offered to verified ones. With a CA bundle, the server chain is checked
+// after the handshake against the one CA that issued it, loaded from the
+// bundle for that connection only.
+class OtaTrustStore {
+public:
+    static const size_t MAX_SESSIONS = 4;
+
+    OtaTrustStore();
+    ~OtaTrustStore();
+
+    OtaTrustStore(const OtaTrustStore&) = delete;
+    OtaTrustStore& operator=(const OtaTrustStore&) = delete;
+
+    // False when the PEM does not parse; the previous one is dropped either way
+    bool setCACert(const char* pem);
+    bool setCertificate(const char* certPem, const char* keyPem);
+    void setInsecure(bool insecure) { this->insecure = insecure; }
+
+    // Certificates one DER block at a time (see OtaPemDecoder); clear first
+    void clearCA();
+    bool addCA(const uint8_t* der, size_t length);
+    void clearCertificate();
+    bool addCertificate(const uint8_t* der, size_t length);    // Own certificate, then its chain
+    bool setKey(const uint8_t* der, size_t length);
+
+    // CAs looked up per connection; the bundle must outlive the store. nullptr = none
+    void setBundle(OtaCertBundle* bundle);
+
+    bool isInsecure() const { return insecure; }
+    bool hasCA() const { return caLoaded || hasBundle(); }     // Something to verify against
+    bool hasBundle() const { return bundle && bundle->isAttached(); }
+    bool hasCertificate() const { return certLoaded; }
+    mbedtls_x509_crt* getCA() { return caLoaded ? &ca : nullptr; }
+    mbedtls_x509_crt* getCertificate() { return &ownCert; }
+    mbedtls_pk_context* getKey() { return &ownKey; }
+
+    // Sets the cached session on ssl before the handshake; false when there is none
+    bool offerSession(const char* host, uint16_t port, bool verified, mbedtls_ssl_context* ssl);
+    // After the handshake, in this order
+    bool isResumed(const char* host, uint16_t port, bool verified, const mbedtls_ssl_context* ssl);
+    bool verifyPeer(const char* host, const mbedtls_ssl_context* ssl);    // Full handshakes only
+    void completeHandshake(const char* host, uint16_t port, bool verified, mbedtls_ssl_context* ssl,
+                           bool resumed, unsigned long micros);    // Records its time, keeps its session
+    void forgetSession(const char* host, uint16_t port);
+    void clearSessions();
+
+    uint32_t getFullHandshakes() const { return fullHandshakes; }
+    uint32_t getResumedHandshakes() const { return resumedHandshakes; }
+    unsigned long getFullHandshakeMicros() const;       // Average
+    unsigned long getResumedHandshakeMicros() const;    // Average
+    uint64_t getSavedMicros() const;    // Resumed handshakes times the average difference
+
+private:
+    struct Entry {
+        uint32_t hostHash;
+        uint16_t port;
+        bool verified;
+        bool used;
+        uint32_t lastUse;
+        mbedtls_ssl_session session;
+    };
+
+    mbedtls_x509_crt ca;
+    mbedtls_x509_crt ownCert;
+    mbedtls_pk_context ownKey;
+    OtaCertBundle* bundle;
+    bool caLoaded;
+    bool certLoaded;
+    bool insecure;
+
+    Entry entries[MAX_SESSIONS];
+    uint32_t useCounter;
+
+    uint32_t fullHandshakes;
+    uint32_t resumedHandshakes;
+    uint64_t fullMicros;
+    uint64_t resumedMicros;
+
+    static uint32_t hashHost(const char* host);
+    Entry* find(const char* host, uint16_t port, bool verified);
+    bool parseKey(const unsigned char* key, size_t length);
+};
+
+#endif
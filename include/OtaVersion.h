@@ -0,0 +1,149 @@
+#ifndef OTA_VERSION_H
+#define OTA_VERSION_H
+
+#include <Arduino.h>
+
+// Semantic version (SemVer 2.0.0), parsed once.
+// MAJOR.MINOR.PATCH and the "is a release" flag are packed into one 64-bit
+// key, so versions that differ in the core compare with a single integer
+// comparison; only two pre-releases of the same core walk their identifiers.
+// Build metadata is validated but ignored for precedence.
+// The version refers to the text it was parsed from (for the pre-release and
+// c_str()), which must outlive it. The parser is constexpr: with OTA_VERSION
+// a literal is checked and parsed by the compiler.
+class OtaVersion {
+public:
+    static const uint32_t MAX_COMPONENT = 0xFFFFF;  // Largest MAJOR, MINOR or PATCH
+    static const size_t MAX_LENGTH = 255;
+
+    constexpr OtaVersion() : text(nullptr), key(0), preStart(0), preLength(0), valid(false) {}
+
+    // Invalid (isValid() false) unless text is exactly one semantic version
+    static constexpr OtaVersion parse(const char* text) {
+        return text ? parseMajor(text, digitsEnd(text, 0)) : OtaVersion();
+    }
+
+    constexpr bool isValid() const { return valid; }
+    constexpr uint32_t getMajor() const { return (uint32_t)(key >> 44); }
+    constexpr uint32_t getMinor() const { return (uint32_t)(key >> 24) & MAX_COMPONENT; }
+    constexpr uint32_t getPatch() const { return (uint32_t)(key >> 4) & MAX_COMPONENT; }
+    constexpr bool isPrerelease() const { return valid && (key & 1) == 0; }
+    const char* c_str() const { return text ? text : ""; }
+
+    // SemVer precedence: <0, 0 or >0. An invalid version ranks below every valid one.
+    int compare(const OtaVersion& other) const {
+        if (valid != other.valid) return valid ? 1 : -1;
+        if (key != other.key) return key < other.key ? -1 : 1;
+        return isPrerelease() ? comparePrerelease(other) : 0;
+    }
+
+    bool operator==(const OtaVersion& other) const { return compare(other) == 0; }
+    bool operator!=(const OtaVersion& other) const { return compare(other) != 0; }
+    bool operator<(const OtaVersion& other) const { return compare(other) < 0; }
+    bool operator>(const OtaVersion& other) const { return compare(other) > 0; }
+    bool operator<=(const OtaVersion& other) const { return compare(other) <= 0; }
+    bool operator>=(const OtaVersion& other) const { return compare(other) >= 0; }
+
+private:
+    const char* text;
+    uint64_t key;           // major:20 | minor:20 | patch:20 | unused:3 | release:1
+    uint8_t preStart;       // Pre-release identifiers in text, without the '-'
+    uint8_t preLength;
+    bool valid;
+
+    constexpr OtaVersion(const char* source, uint64_t packed, size_t start, size_t length)
+        : text(source), key(packed), preStart((uint8_t)start), preLength((uint8_t)length), valid(true) {}
+
+    int comparePrerelease(const OtaVersion& other) const;
+
+    // C++11 constexpr: one return statement per function, loops become recursion
+    static constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    static constexpr bool isIdentifierChar(char c) {
+        return isDigit(c) || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '-';
+    }
+    static constexpr size_t digitsEnd(const char* s, size_t i) {
+        return isDigit(s[i]) ? digitsEnd(s, i + 1) : i;
+    }
+    static constexpr uint32_t value(const char* s, size_t i, size_t end, uint32_t sum) {
+        return i < end ? value(s, i + 1, end, sum * 10 + (uint32_t)(s[i] - '0')) : sum;
+    }
+    // Non-empty, no leading zero, at most MAX_COMPONENT
+    static constexpr bool validComponent(const char* s, size_t start, size_t end) {
+        return end > start && end - start <= 7 && (s[start] != '0' || end - start == 1) &&
+               value(s, start, end, 0) <= MAX_COMPONENT;
+    }
+    // End of a run of identifier characters and dots (stops at '+' and the NUL)
+    static constexpr size_t identifiersEnd(const char* s, size_t i) {
+        return isIdentifierChar(s[i]) || s[i] == '.' ? identifiersEnd(s, i + 1) : i;
+    }
+    static constexpr size_t identifierEnd(const char* s, size_t i, size_t end) {
+        return i < end && s[i] != '.' ? identifierEnd(s, i + 1, end) : i;
+    }
+    static constexpr bool isNumeric(const char* s, size_t i, size_t end) {
+        return i >= end || (isDigit(s[i]) && isNumeric(s, i + 1, end));
+    }
+    // Dot-separated, non-empty identifiers; numeric pre-release identifiers have no leading zero
+    static constexpr bool validIdentifiers(const char* s, size_t i, size_t end, bool prerelease) {
+        return validIdentifier(s, i, identifierEnd(s, i, end), prerelease) &&
+               (identifierEnd(s, i, end) == end ||
+                validIdentifiers(s, identifierEnd(s, i, end) + 1, end, prerelease));
+    }
+    static constexpr bool validIdentifier(const char* s, size_t start, size_t end, bool prerelease) {
+        return end > start &&
+               !(prerelease && end - start > 1 && s[start] == '0' && isNumeric(s, start, end));
+    }
+
+    static constexpr OtaVersion parseMajor(const char* s, size_t majorEnd) {
+        return validComponent(s, 0, majorEnd) && s[majorEnd] == '.'
+                   ? parseMinor(s, majorEnd, digitsEnd(s, majorEnd + 1))
+                   : OtaVersion();
+    }
+    static constexpr OtaVersion parseMinor(const char* s, size_t majorEnd, size_t minorEnd) {
+        return validComponent(s, majorEnd + 1, minorEnd) && s[minorEnd] == '.'
+                   ? parsePatch(s, majorEnd, minorEnd, digitsEnd(s, minorEnd + 1))
+                   : OtaVersion();
+    }
+    static constexpr OtaVersion parsePatch(const char* s, size_t majorEnd, size_t minorEnd, size_t patchEnd) {
+        return !validComponent(s, minorEnd + 1, patchEnd) ? OtaVersion()
+               : s[patchEnd] == '-' ? parsePrerelease(s, majorEnd, minorEnd, patchEnd,
+                                                      identifiersEnd(s, patchEnd + 1))
+               : parseBuild(s, majorEnd, minorEnd, patchEnd, patchEnd);
+    }
+    static constexpr OtaVersion parsePrerelease(const char* s, size_t majorEnd, size_t minorEnd, size_t patchEnd,
+                                                size_t preEnd) {
+        return validIdentifiers(s, patchEnd + 1, preEnd, true)
+                   ? parseBuild(s, majorEnd, minorEnd, patchEnd, preEnd)
+                   : OtaVersion();
+    }
+    static constexpr OtaVersion parseBuild(const char* s, size_t majorEnd, size_t minorEnd, size_t patchEnd,
+                                           size_t preEnd) {
+        return s[preEnd] == '\0' ? make(s, majorEnd, minorEnd, patchEnd, preEnd, preEnd)
+               : s[preEnd] == '+' && validIdentifiers(s, preEnd + 1, identifiersEnd(s, preEnd + 1), false)
+                   ? make(s, majorEnd, minorEnd, patchEnd, preEnd, identifiersEnd(s, preEnd + 1))
+               : OtaVersion();
+    }
+    static constexpr OtaVersion make(const char* s, size_t majorEnd, size_t minorEnd, size_t patchEnd,
+                                     size_t preEnd, size_t end) {
+        return s[end] != '\0' || end > MAX_LENGTH ? OtaVersion()
+               : OtaVersion(s,
+                            (uint64_t)value(s, 0, majorEnd, 0) << 44 |
+                            (uint64_t)value(s, majorEnd + 1, minorEnd, 0) << 24 |
+                            (uint64_t)value(s, minorEnd + 1, patchEnd, 0) << 4 |
+                            (preEnd == patchEnd ? 1 : 0),
+                            preEnd == patchEnd ? 0 : patchEnd + 1,
+                            preEnd == patchEnd ? 0 : preEnd - patchEnd - 1);
+    }
+};
+
+// Compile-time check behind OTA_VERSION
+template<bool valid>
+struct OtaVersionLiteral {
+    static_assert(valid, "OTA_VERSION: not a semantic version (MAJOR.MINOR.PATCH[-PRERELEASE][+BUILD])");
+    static constexpr OtaVersion get(const OtaVersion& version) { return version; }
+};
+
+// Version literal parsed and validated by the compiler:
+//   static constexpr OtaVersion FIRMWARE_VERSION = OTA_VERSION("1.4.0-rc.1");
+#define OTA_VERSION(text) (OtaVersionLiteral<OtaVersion::parse(text).isValid()>::get(OtaVersion::parse(text)))
+
+#endif
@@ -0,0 +1,85 @@
+// Download bandwidth shaping for ESP32OtaMqtt
+// A token bucket caps the bytes per second a download takes from the socket,
+// so application traffic on the same radio keeps some of the link. Data over
+// the limit stays in the socket, and the closing TCP window slows the sender.
+// The rate follows the priority mode, and the application can claim the link
+// for a while, which lowers it further or pauses the download.
+
+#include "ESP32OtaMqtt.h"
+
+// ============================================================================
+// PRIORITY AND CLAIMS
+// ============================================================================
+
+void ESP32OtaMqtt::setPriority(OtaPriority priority) {
+    if (isTaskCaller()) {
+        TaskCommand command;
+        command.type = TaskCommand::SET_PRIORITY;
+        command.value = (uint32_t)priority;
+        postCommand(command);
+        return;
+    }
+    config.priority = priority;
+    applyBandwidthLimit();
+}
+
+OtaPriority ESP32OtaMqtt::getPriority() const {
+    return isTaskCaller() ? snapshot.priority : config.priority;
+}
+
+void ESP32OtaMqtt::claimBandwidth(unsigned long durationMs, uint32_t downloadRate) {
+    if (isTaskCaller()) {
+        TaskCommand command;
+        command.type = TaskCommand::CLAIM_BANDWIDTH;
+        command.value = downloadRate;
+        command.duration = durationMs;
+        postCommand(command);
+        return;
+    }
+    bandwidthClaimed = true;
+    claimRate = downloadRate;
+    claimStart = millis();
+    claimDuration = durationMs;
+    applyBandwidthLimit();
+    OTA_LOGD("Link claimed for %lu ms, download limited to %lu B/s", durationMs, (unsigned long)downloadRate);
+}
+
+void ESP32OtaMqtt::releaseBandwidth() {
+    if (isTaskCaller()) {
+        TaskCommand command;
+        command.type = TaskCommand::RELEASE_BANDWIDTH;
+        postCommand(command);
+        return;
+    }
+    if (!bandwidthClaimed) return;
+    bandwidthClaimed = false;
+    applyBandwidthLimit();
+    OTA_LOGD("Link claim released");
+}
+
+bool ESP32OtaMqtt::isBandwidthClaimed() const {
+    return isTaskCaller() ? snapshot.bandwidthClaimed : bandwidthClaimed;
+}
+
+// ============================================================================
+// LIMIT
+// ============================================================================
+
+void ESP32OtaMqtt::applyBandwidthLimit() {
+    uint32_t rate = OtaRateLimiter::UNLIMITED;
+    if (config.priority == OtaPriority::BACKGROUND && config.backgroundRateLimit > 0) {
+        rate = config.backgroundRateLimit;
+    } else if (config.priority == OtaPriority::NORMAL && config.downloadRateLimit > 0) {
+        rate = config.downloadRateLimit;
+    }
+    if (bandwidthClaimed && claimRate < rate) {
+        rate = claimRate;
+    }
+    bandwidth.configure(rate, config.downloadBurst);
+}
+
+void ESP32OtaMqtt::expireBandwidthClaim() {
+    if (bandwidthClaimed && claimDuration > 0 && millis() - claimStart >= claimDuration) {
+        releaseBandwidth();
+    }
+}
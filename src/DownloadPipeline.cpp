@@ -0,0 +1,179 @@
+// Pipelined download for ESP32OtaMqtt
+// loop() acts as the network reader and fills a SPSC ring buffer straight from
+// the socket, while a dedicated task drains it into SHA256 and flash. A flash
+// erase/program stall then only blocks the writer task, not the socket.
+
+#include "ESP32OtaMqtt.h"
+
+// Largest slice handed to the flash writer at once (one flash sector)
+static const size_t PIPELINE_WRITE_SLICE = 4096;
+static const uint32_t PIPELINE_WRITER_STACK = 4096;
+static const UBaseType_t PIPELINE_WRITER_PRIORITY = 1;
+
+// ============================================================================
+// PIPELINE LIFECYCLE
+// ============================================================================
+
+bool ESP32OtaMqtt::startPipeline() {
+    if (!pipelineBuffer.begin(config.pipelineBufferSize, OtaArena::PIPELINE_BUFFER)) {
+        OTA_LOGW("Pipeline buffer allocation failed");
+        return false;
+    }
+
+    pipelineProducerDone.store(false);
+    pipelineAbort.store(false);
+    pipelineError.store(0);
+    pipelineWriterRunning.store(true);
+
+    if (!OtaArena::createTask(flashWriterTaskEntry, "ota_flash_writer", PIPELINE_WRITER_STACK, this,
+                              PIPELINE_WRITER_PRIORITY, &flashWriterTask, config.pipelineWriterCore,
+                              OtaArena::PIPELINE_STACK, OtaArena::PIPELINE_TASK)) {
+        OTA_LOGW("Failed to create flash writer task");
+        pipelineWriterRunning.store(false);
+        pipelineBuffer.end();
+        return false;
+    }
+
+    OTA_LOGI("Pipelined download enabled (%u byte ring, writer on core %d)",
+             (unsigned)pipelineBuffer.size(), config.pipelineWriterCore);
+    return true;
+}
+
+void ESP32OtaMqtt::stopPipeline() {
+    if (!flashWriterTask) return;
+
+    // Ask the writer to stop and wait for it to leave the flash write
+    pipelineAbort.store(true);
+    xTaskNotifyGive(flashWriterTask);
+    while (pipelineWriterRunning.load(std::memory_order_acquire)) {
+        delay(1);
+    }
+
+    vTaskDelete(flashWriterTask);
+    flashWriterTask = nullptr;
+    pipelineBuffer.end();
+}
+
+bool ESP32OtaMqtt::isPipelineActive() const {
+    return flashWriterTask != nullptr;
+}
+
+bool ESP32OtaMqtt::isPipelineDrained() const {
+    return !pipelineWriterRunning.load(std::memory_order_acquire);
+}
+
+// ============================================================================
+// NETWORK READER (runs in loop())
+// ============================================================================
+
+bool ESP32OtaMqtt::pumpPipeline() {
+    int writerError = pipelineError.load(std::memory_order_acquire);
+    if (writerError != 0) {
+        reportWriteError(writerError);
+        cleanupDownload();
+        return false;
+    }
+
+    size_t available = downloadClient ? downloadClient->available() : 0;
+    if (available == 0) {
+        if (!downloadClient || !downloadClient->connected()) {
+            // Connection closed: let the writer drain what is left
+            pipelineProducerDone.store(true, std::memory_order_release);
+            xTaskNotifyGive(flashWriterTask);
+            return false;
+        }
+        return true; // Continue waiting
+    }
+
+    // Read straight into the ring, as much as the socket has and the ring can hold
+    size_t received = 0;
+    while (available > 0) {
+        size_t contiguous = 0;
+        uint8_t* dst = pipelineBuffer.writePtr(contiguous);
+        if (contiguous == 0) break; // Writer is behind, retry next iteration
+
+        // Only the receive cost is paid here; hashing and flashing run in the writer task
+        size_t slice = bandwidth.allowance(micros(), loopBudget.nextSlice(contiguous, false));
+        size_t want = httpParser.maxBodyRead(min(available, slice));
+        if (want == 0) break;
+
+        unsigned long recvStart = micros();
+        int bytesRead = downloadClient->read(dst, want);
+        if (bytesRead <= 0) break;
+        available -= bytesRead;
+        bandwidth.consume(bytesRead);
+        loopBudget.record(OtaLoopBudget::RECV, bytesRead, micros() - recvStart);
+        loopBudget.addBytes(bytesRead);
+
+        // Strip chunked framing in place before publishing to the writer
+        size_t bodyLength = httpParser.decodeBody(dst, bytesRead);
+        if (httpParser.hasError()) {
+            reportError(String("HTTP body error: ") + httpParser.getError());
+            cleanupDownload();
+            return false;
+        }
+        pipelineBuffer.commitWrite(bodyLength);
+        received += bodyLength;
+    }
+
+    if (received > 0) {
+        xTaskNotifyGive(flashWriterTask);
+        downloadedBytes += received;
+
+        if (totalBytes > 0) {
+            int progress = (downloadedBytes * 100) / totalBytes;
+            updateStatus(OtaStatus::DOWNLOADING, progress);
+        }
+    }
+
+    if (httpParser.isBodyComplete()) {
+        downloadClientReusable = httpParser.isKeepAlive();
+        pipelineProducerDone.store(true, std::memory_order_release);
+        xTaskNotifyGive(flashWriterTask);
+        return false; // Signal completion
+    }
+
+    return true; // Continue downloading
+}
+
+// ============================================================================
+// FLASH WRITER (runs in its own task)
+// ============================================================================
+
+void ESP32OtaMqtt::flashWriterTaskEntry(void* arg) {
+    static_cast<ESP32OtaMqtt*>(arg)->runFlashWriter();
+
+    // The owner deletes this task in stopPipeline(); park until then so the
+    // handle stays valid for xTaskNotifyGive() in the meantime
+    for (;;) {
+        vTaskDelay(portMAX_DELAY);
+    }
+}
+
+void ESP32OtaMqtt::runFlashWriter() {
+    while (!pipelineAbort.load(std::memory_order_acquire)) {
+        size_t contiguous = 0;
+        const uint8_t* data = pipelineBuffer.readPtr(contiguous);
+
+        if (contiguous == 0) {
+            if (pipelineProducerDone.load(std::memory_order_acquire) && pipelineBuffer.used() == 0) {
+                break; // Everything received has been written
+            }
+            // Nothing to write: erase ahead of the write cursor instead
+            if (!flashWriter.eraseAhead(1)) {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            }
+            continue;
+        }
+
+        size_t slice = min(contiguous, PIPELINE_WRITE_SLICE);
+        if (!consumeDownloadData(data, slice)) {
+            int code = flashWriter.getError();
+            pipelineError.store(code != 0 ? code : -1, std::memory_order_release);
+            break;
+        }
+        pipelineBuffer.commitRead(slice);
+    }
+
+    pipelineWriterRunning.store(false, std::memory_order_release);
+}
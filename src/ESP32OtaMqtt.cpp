@@ -1,124 +1,325 @@
 #include "ESP32OtaMqtt.h"
+#include <esp_heap_caps.h>
 
-// Static instance for callback
-ESP32OtaMqtt* ESP32OtaMqtt::instance = nullptr;
+static const int LOG_LINES_PER_LOOP = 4;    // Log lines drained per idle loop() call
+static const long MAX_ROLLOUT_JITTER = 86400; // Longest accepted rollout_jitter (s)
+static const size_t PEM_BLOCK_SIZE = OtaCertBundle::MAX_CERT_SIZE; // Largest decoded certificate or key
+
+std::atomic<const ESP32OtaMqtt*> ESP32OtaMqtt::installingUpdater(nullptr);
+
+// Top-level manifest members and where they are stored
+static const struct {
+    const char* key;
+    OtaJsonView OtaManifest::* field;
+} MANIFEST_FIELDS[] = {
+    {"version", &OtaManifest::version},
+    {"firmware_url", &OtaManifest::firmwareUrl},
+    {"checksum", &OtaManifest::checksum},
+    {"command", &OtaManifest::command},
+    {"patch_url", &OtaManifest::patchUrl},
+    {"base_version", &OtaManifest::baseVersion},
+    {"compression", &OtaManifest::compression},
+    {"compression_window", &OtaManifest::compressionWindow},
+    {"compression_lookahead", &OtaManifest::compressionLookahead},
+    {"checksum_scope", &OtaManifest::checksumScope},
+    {"image_size", &OtaManifest::imageSize},
+    {"rollout_percent", &OtaManifest::rolloutPercent},
+    {"rollout_seed", &OtaManifest::rolloutSeed},
+    {"rollout_jitter", &OtaManifest::rolloutJitter}
+};
 
 // Simple constructor - creates own WiFiClientSecure and PubSubClient
 ESP32OtaMqtt::ESP32OtaMqtt(const String& topic)
-    : updateTopic(topic), ownsMqttClient(true), ownsWifiClient(true),
-      currentStatus(OtaStatus::IDLE), lastCheck(0), retryCount(0),
-      statusCallback(nullptr), errorCallback(nullptr), useInsecure(false),
-      mqttState(MqttConnState::DISCONNECTED), mqttConnectStartTime(0), lastMqttAttempt(0),
-      downloadState(DownloadState::IDLE), downloadClient(nullptr), downloadStartTime(0),
-      lastYield(0), totalBytes(0), downloadedBytes(0), sha256Initialized(false),
-      mqttPort(8883) {
+    : mqttEngine(nullptr), ownsMqttClient(true), ownsMqttEngine(false), ownsWifiClient(true),
+      router(&ownRouter), sharedConnection(false),
+      updateTopic(topic), mqttPort(8883),
+      useInsecure(false),
+      currentStatus(OtaStatus::IDLE), lastCheck(0),
+      runningVersionText(config.currentVersion.c_str()),
+      runningVersion(OtaVersion::parse(runningVersionText.c_str())),
+      pendingCompression(OtaCompression::NONE), pendingWindowBits(8), pendingLookaheadBits(4),
+      pendingChecksumCompressed(false), pendingImageSize(0), pendingCohort(0), pendingRolloutPercent(100),
+      pendingStartDelay(0), scheduledStart(0), startScheduled(false), retryCount(0),
+      mqttState(MqttConnState::DISCONNECTED), mqttConnectStartTime(0),
+      downloadState(DownloadState::IDLE), downloadClient(nullptr), requestSent(0), redirectCount(0),
+      connectedPort(0), connectedSecure(false), downloadClientReusable(false), keepAliveSince(0),
+      downloadStartTime(0), lastYield(0), totalBytes(0), downloadedBytes(0), consumedBytes(0),
+      memoryStats(), memoryCycleActive(false), cycleStartAllocations(0), heapTotal(0), heapMinFree(0),
+      maxLoopMicros(0), maxConnectStepMicros(0),
+      measureStages(false), stageHashMicros(0),
+      flashWriterTask(nullptr), pipelineProducerDone(false), pipelineWriterRunning(false),
+      pipelineAbort(false), pipelineError(0),
+      resumeOffset(0), resumeTotal(0), rangesSupported(true), resumeBytesSaved(0),
+      mqttRequestedNext(0), mqttTimeouts(0), mqttSavedBufferSize(0),
+      segmentRangeRequested(false),
+      bandwidthClaimed(false), claimRate(0), claimStart(0), claimDuration(0),
+      mirrorActive(false), mirrorsRanked(false), probeClients(), probeStartTime(0), transferStartBytes(0),
+      deltaActive(false),
+      hashDownloadStream(false),
+      engineTask(nullptr), engineTaskStop(false), engineTaskRunning(false), deliveredStatus(OtaStatus::IDLE),
+      droppedCommands(0), configPending(false), paused(false), pausedAt(0),
+      statusCallback(nullptr), errorCallback(nullptr), eventCallback(nullptr), eventContext(nullptr) {
 
     wifiClient = new WiFiClientSecure();
     mqttClient = new PubSubClient(*wifiClient);
-    instance = this;
 }
 
 // Constructor with existing WiFi only
 ESP32OtaMqtt::ESP32OtaMqtt(WiFiClientSecure& wifi, const String& topic)
-    : wifiClient(&wifi), updateTopic(topic), ownsMqttClient(true), ownsWifiClient(false),
-      currentStatus(OtaStatus::IDLE), lastCheck(0), retryCount(0),
-      statusCallback(nullptr), errorCallback(nullptr), useInsecure(false),
-      mqttState(MqttConnState::DISCONNECTED), mqttConnectStartTime(0), lastMqttAttempt(0),
-      downloadState(DownloadState::IDLE), downloadClient(nullptr), downloadStartTime(0),
-      lastYield(0), totalBytes(0), downloadedBytes(0), sha256Initialized(false),
-      mqttPort(8883) {
+    : wifiClient(&wifi), mqttEngine(nullptr), ownsMqttClient(true), ownsMqttEngine(false),
+      ownsWifiClient(false), router(&ownRouter), sharedConnection(false),
+      updateTopic(topic), mqttPort(8883),
+      useInsecure(false),
+      currentStatus(OtaStatus::IDLE), lastCheck(0),
+      runningVersionText(config.currentVersion.c_str()),
+      runningVersion(OtaVersion::parse(runningVersionText.c_str())),
+      pendingCompression(OtaCompression::NONE), pendingWindowBits(8), pendingLookaheadBits(4),
+      pendingChecksumCompressed(false), pendingImageSize(0), pendingCohort(0), pendingRolloutPercent(100),
+      pendingStartDelay(0), scheduledStart(0), startScheduled(false), retryCount(0),
+      mqttState(MqttConnState::DISCONNECTED), mqttConnectStartTime(0),
+      downloadState(DownloadState::IDLE), downloadClient(nullptr), requestSent(0), redirectCount(0),
+      connectedPort(0), connectedSecure(false), downloadClientReusable(false), keepAliveSince(0),
+      downloadStartTime(0), lastYield(0), totalBytes(0), downloadedBytes(0), consumedBytes(0),
+      memoryStats(), memoryCycleActive(false), cycleStartAllocations(0), heapTotal(0), heapMinFree(0),
+      maxLoopMicros(0), maxConnectStepMicros(0),
+      measureStages(false), stageHashMicros(0),
+      flashWriterTask(nullptr), pipelineProducerDone(false), pipelineWriterRunning(false),
+      pipelineAbort(false), pipelineError(0),
+      resumeOffset(0), resumeTotal(0), rangesSupported(true), resumeBytesSaved(0),
+      mqttRequestedNext(0), mqttTimeouts(0), mqttSavedBufferSize(0),
+      segmentRangeRequested(false),
+      bandwidthClaimed(false), claimRate(0), claimStart(0), claimDuration(0),
+      mirrorActive(false), mirrorsRanked(false), probeClients(), probeStartTime(0), transferStartBytes(0),
+      deltaActive(false),
+      hashDownloadStream(false),
+      engineTask(nullptr), engineTaskStop(false), engineTaskRunning(false), deliveredStatus(OtaStatus::IDLE),
+      droppedCommands(0), configPending(false), paused(false), pausedAt(0),
+      statusCallback(nullptr), errorCallback(nullptr), eventCallback(nullptr), eventContext(nullptr) {
 
     mqttClient = new PubSubClient(*wifiClient);
-    instance = this;
 }
 
 // Constructor with existing WiFi and MQTT
 ESP32OtaMqtt::ESP32OtaMqtt(WiFiClientSecure& wifi, PubSubClient& mqtt, const String& topic)
-    : wifiClient(&wifi), mqttClient(&mqtt), updateTopic(topic), ownsMqttClient(false), ownsWifiClient(false),
-      currentStatus(OtaStatus::IDLE), lastCheck(0), retryCount(0),
-      statusCallback(nullptr), errorCallback(nullptr), useInsecure(false),
-      mqttState(MqttConnState::DISCONNECTED), mqttConnectStartTime(0), lastMqttAttempt(0),
-      downloadState(DownloadState::IDLE), downloadClient(nullptr), downloadStartTime(0),
-      lastYield(0), totalBytes(0), downloadedBytes(0), sha256Initialized(false),
-      mqttPort(8883) {
+    : wifiClient(&wifi), mqttClient(&mqtt), mqttEngine(nullptr), ownsMqttClient(false), ownsMqttEngine(false),
+      ownsWifiClient(false), router(&ownRouter), sharedConnection(false),
+      updateTopic(topic), mqttPort(8883),
+      useInsecure(false),
+      currentStatus(OtaStatus::IDLE), lastCheck(0),
+      runningVersionText(config.currentVersion.c_str()),
+      runningVersion(OtaVersion::parse(runningVersionText.c_str())),
+      pendingCompression(OtaCompression::NONE), pendingWindowBits(8), pendingLookaheadBits(4),
+      pendingChecksumCompressed(false), pendingImageSize(0), pendingCohort(0), pendingRolloutPercent(100),
+      pendingStartDelay(0), scheduledStart(0), startScheduled(false), retryCount(0),
+      mqttState(MqttConnState::DISCONNECTED), mqttConnectStartTime(0),
+      downloadState(DownloadState::IDLE), downloadClient(nullptr), requestSent(0), redirectCount(0),
+      connectedPort(0), connectedSecure(false), downloadClientReusable(false), keepAliveSince(0),
+      downloadStartTime(0), lastYield(0), totalBytes(0), downloadedBytes(0), consumedBytes(0),
+      memoryStats(), memoryCycleActive(false), cycleStartAllocations(0), heapTotal(0), heapMinFree(0),
+      maxLoopMicros(0), maxConnectStepMicros(0),
+      measureStages(false), stageHashMicros(0),
+      flashWriterTask(nullptr), pipelineProducerDone(false), pipelineWriterRunning(false),
+      pipelineAbort(false), pipelineError(0),
+      resumeOffset(0), resumeTotal(0), rangesSupported(true), resumeBytesSaved(0),
+      mqttRequestedNext(0), mqttTimeouts(0), mqttSavedBufferSize(0),
+      segmentRangeRequested(false),
+      bandwidthClaimed(false), claimRate(0), claimStart(0), claimDuration(0),
+      mirrorActive(false), mirrorsRanked(false), probeClients(), probeStartTime(0), transferStartBytes(0),
+      deltaActive(false),
+      hashDownloadStream(false),
+      engineTask(nullptr), engineTaskStop(false), engineTaskRunning(false), deliveredStatus(OtaStatus::IDLE),
+      droppedCommands(0), configPending(false), paused(false), pausedAt(0),
+      statusCallback(nullptr), errorCallback(nullptr), eventCallback(nullptr), eventContext(nullptr) {
+}
 
-    instance = this;
+// Constructor sharing a connection through a topic router
+ESP32OtaMqtt::ESP32OtaMqtt(OtaTopicRouter& sharedRouter, const String& topic)
+    : wifiClient(nullptr), mqttClient(sharedRouter.getClient()), mqttEngine(nullptr), ownsMqttClient(false),
+      ownsMqttEngine(false), ownsWifiClient(false), router(&sharedRouter), sharedConnection(true),
+      updateTopic(topic), mqttPort(8883),
+      useInsecure(false),
+      currentStatus(OtaStatus::IDLE), lastCheck(0),
+      runningVersionText(config.currentVersion.c_str()),
+      runningVersion(OtaVersion::parse(runningVersionText.c_str())),
+      pendingCompression(OtaCompression::NONE), pendingWindowBits(8), pendingLookaheadBits(4),
+      pendingChecksumCompressed(false), pendingImageSize(0), pendingCohort(0), pendingRolloutPercent(100),
+      pendingStartDelay(0), scheduledStart(0), startScheduled(false), retryCount(0),
+      mqttState(MqttConnState::DISCONNECTED), mqttConnectStartTime(0),
+      downloadState(DownloadState::IDLE), downloadClient(nullptr), requestSent(0), redirectCount(0),
+      connectedPort(0), connectedSecure(false), downloadClientReusable(false), keepAliveSince(0),
+      downloadStartTime(0), lastYield(0), totalBytes(0), downloadedBytes(0), consumedBytes(0),
+      memoryStats(), memoryCycleActive(false), cycleStartAllocations(0), heapTotal(0), heapMinFree(0),
+      maxLoopMicros(0), maxConnectStepMicros(0),
+      measureStages(false), stageHashMicros(0),
+      flashWriterTask(nullptr), pipelineProducerDone(false), pipelineWriterRunning(false),
+      pipelineAbort(false), pipelineError(0),
+      resumeOffset(0), resumeTotal(0), rangesSupported(true), resumeBytesSaved(0),
+      mqttRequestedNext(0), mqttTimeouts(0), mqttSavedBufferSize(0),
+      segmentRangeRequested(false),
+      bandwidthClaimed(false), claimRate(0), claimStart(0), claimDuration(0),
+      mirrorActive(false), mirrorsRanked(false), probeClients(), probeStartTime(0), transferStartBytes(0),
+      deltaActive(false),
+      hashDownloadStream(false),
+      engineTask(nullptr), engineTaskStop(false), engineTaskRunning(false), deliveredStatus(OtaStatus::IDLE),
+      droppedCommands(0), configPending(false), paused(false), pausedAt(0),
+      statusCallback(nullptr), errorCallback(nullptr), eventCallback(nullptr), eventContext(nullptr) {
 }
 
 // Destructor
 ESP32OtaMqtt::~ESP32OtaMqtt() {
+    stopEngineTask();
+    OtaLog::releaseDrain(this);
     cleanupDownload();
+    releaseInstall();
+    if (OtaArena::isInstalledBy(this)) {
+        OtaArena::install(nullptr, 0, nullptr); // The buffer may not outlive this updater
+    }
+    // A shared router outlives this updater
+    router->unsubscribe(updateTopic.c_str(), onUpdateMessage, this);
+    if (mqttClient || mqttEngine) {
+        stopMqttTransfer();
+    }
+    if (ownsMqttEngine) {
+        delete mqttEngine;
+    }
     if (ownsMqttClient && mqttClient) {
         delete mqttClient;
     }
     if (ownsWifiClient && wifiClient) {
         delete wifiClient;
     }
-    if (instance == this) {
-        instance = nullptr;
-    }
 }
 
 // Configuration methods
 void ESP32OtaMqtt::setConfig(const OtaConfig& newConfig) {
+    if (isTaskCaller()) {
+        taskConfig = newConfig;
+        postConfig();
+        return;
+    }
     config = newConfig;
+    parseCurrentVersion();
+    applyRetryConfig();
+    applyBandwidthLimit();
 }
 
 OtaConfig ESP32OtaMqtt::getConfig() const {
-    return config;
+    return isTaskCaller() ? taskConfig : config;
 }
 
 void ESP32OtaMqtt::setCheckInterval(unsigned long intervalMs) {
+    if (isTaskCaller()) {
+        taskConfig.checkInterval = intervalMs;
+        postConfig();
+        return;
+    }
     config.checkInterval = intervalMs;
 }
 
 void ESP32OtaMqtt::setDownloadTimeout(unsigned long timeoutMs) {
+    if (isTaskCaller()) {
+        taskConfig.downloadTimeout = timeoutMs;
+        postConfig();
+        return;
+    }
     config.downloadTimeout = timeoutMs;
 }
 
 void ESP32OtaMqtt::setMaxRetries(int retries) {
+    if (isTaskCaller()) {
+        taskConfig.maxRetries = retries;
+        postConfig();
+        return;
+    }
     config.maxRetries = retries;
 }
 
 void ESP32OtaMqtt::setCurrentVersion(const String& version) {
+    if (isTaskCaller()) {
+        taskConfig.currentVersion = version;
+        postConfig();
+        return;
+    }
     config.currentVersion = version;
+    parseCurrentVersion();
+}
+
+void ESP32OtaMqtt::setCurrentVersion(const OtaVersion& version) {
+    setCurrentVersion(String(version.c_str()));
+}
+
+// runningVersion points into runningVersionText, which only changes here, so
+// reassigning config.currentVersion cannot leave it dangling. Call after every
+// assignment all the same, or comparisons use the previous version.
+void ESP32OtaMqtt::parseCurrentVersion() {
+    runningVersionText = config.currentVersion;
+    runningVersion = runningVersionText.isTruncated() ? OtaVersion()
+                                                      : OtaVersion::parse(runningVersionText.c_str());
+    if (!runningVersion.isValid()) {
+        OTA_LOGW("Current version %s is not a semantic version, any valid update is newer",
+                 config.currentVersion.c_str());
+    }
 }
 
 // MQTT configuration methods
 void ESP32OtaMqtt::setMqttServer(const char* server, int port) {
+    if (rejectTaskCall("setMqttServer()")) return;
     mqttServer = String(server);
     mqttPort = port;
-    mqttClient->setServer(server, port);
-    OTA_LOG("MQTT server configured: " + mqttServer + ":" + String(mqttPort));
+    if (mqttClient) {
+        mqttClient->setServer(server, port);
+    }
+    OTA_LOGI("MQTT server configured: %s:%d", mqttServer.c_str(), mqttPort);
 }
 
 void ESP32OtaMqtt::setMqttCredentials(const String& user, const String& password) {
+    if (rejectTaskCall("setMqttCredentials()")) return;
     mqttUser = user;
     mqttPassword = password;
-    OTA_LOG("MQTT credentials configured for user: " + user);
+    OTA_LOGI("MQTT credentials configured for user: %s", user.c_str());
 }
 
 // SSL/TLS configuration methods
 void ESP32OtaMqtt::setCACert(const char* caCert) {
+    if (rejectTaskCall("setCACert()")) return;
     this->caCert = String(caCert);
     useInsecure = false;
+    trustStore.setInsecure(false);
+    if (!trustStore.setCACert(caCert)) {
+        reportError("Invalid CA certificate");
+        return;
+    }
     
     // Apply CA certificate to WiFiClientSecure using stored string
+    if (!wifiClient) {
+        OTA_LOGW("Shared MQTT connection: TLS is configured by the application");
+        return;
+    }
     wifiClient->setCACert(this->caCert.c_str());
-    OTA_LOG("CA certificate configured for secure MQTT connection");
+    OTA_LOGI("CA certificate configured for secure MQTT connection");
 }
 
 void ESP32OtaMqtt::setClientCert(const char* clientCert, const char* clientKey) {
+    if (rejectTaskCall("setClientCert()")) return;
     this->clientCert = String(clientCert);
     this->clientKey = String(clientKey);
+    if (!trustStore.setCertificate(clientCert, clientKey)) {
+        reportError("Invalid client certificate or key");
+        return;
+    }
     
     // Apply client certificate and key
+    if (!wifiClient) {
+        OTA_LOGW("Shared MQTT connection: TLS is configured by the application");
+        return;
+    }
     wifiClient->setCertificate(clientCert);
     wifiClient->setPrivateKey(clientKey);
-    OTA_LOG("Client certificate and key configured");
+    OTA_LOGI("Client certificate and key configured");
 }
 
 void ESP32OtaMqtt::setCACertFromFile(const String& caCertPath) {
+    if (rejectTaskCall("setCACertFromFile()")) return;
     if (!SPIFFS.begin(true)) {
         reportError("Failed to mount SPIFFS");
         return;
@@ -129,78 +330,149 @@ void ESP32OtaMqtt::setCACertFromFile(const String& caCertPath) {
         reportError("Failed to open CA certificate file: " + caCertPath);
         return;
     }
+    OTA_LOGD("Certificate file size: %u bytes", (unsigned)file.size());
     
-    String cert = file.readString();
-    file.close();
-    
-    if (cert.length() == 0) {
-        reportError("CA certificate file is empty: " + caCertPath);
-        return;
-    }
-    
-    // Debug: Print certificate info
-    OTA_LOG("Certificate file size: " + String(cert.length()) + " bytes");
-    OTA_LOG("Certificate starts with: " + cert.substring(0, min(50, (int)cert.length())));
-    OTA_LOG("Certificate ends with: " + cert.substring(max(0, (int)cert.length()-50)));
-    
-    // Validate certificate format
-    if (!cert.startsWith("-----BEGIN CERTIFICATE-----")) {
-        reportError("Invalid certificate format - missing BEGIN CERTIFICATE header");
+    // Decoded one certificate at a time, the file is never held in RAM
+    trustStore.clearCA();
+    int loaded = loadPem(file, PemTarget::CA);
+    if (loaded <= 0) {
+        trustStore.clearCA();
+        file.close();
+        reportError(String(loaded < 0 ? "Invalid CA certificate file: " : "No certificate in file: ") + caCertPath);
         return;
     }
+    caCert = String();
+    useInsecure = false;
+    trustStore.setInsecure(false);
     
-    if (!cert.endsWith("-----END CERTIFICATE-----") && !cert.endsWith("-----END CERTIFICATE-----\n")) {
-        reportError("Invalid certificate format - missing END CERTIFICATE footer");
-        return;
+    // WiFiClientSecure keeps its own copy of the PEM; the non-blocking client needs none
+    if (wifiClient && !config.asyncMqtt) {
+        file.seek(0);
+        wifiClient->loadCACert(file, file.size());
     }
-    
-    setCACert(cert.c_str());
-    OTA_LOG("CA certificate loaded from SPIFFS: " + caCertPath);
+    file.close();
+    OTA_LOGI("%d CA certificate(s) loaded from SPIFFS: %s", loaded, caCertPath.c_str());
 }
 
 void ESP32OtaMqtt::setClientCertFromFiles(const String& clientCertPath, const String& clientKeyPath) {
+    if (rejectTaskCall("setClientCertFromFiles()")) return;
     if (!SPIFFS.begin(true)) {
         reportError("Failed to mount SPIFFS");
         return;
     }
     
-    // Read client certificate
     File certFile = SPIFFS.open(clientCertPath, "r");
     if (!certFile) {
         reportError("Failed to open client certificate file: " + clientCertPath);
         return;
     }
-    
-    String cert = certFile.readString();
-    certFile.close();
-    
-    // Read client key
     File keyFile = SPIFFS.open(clientKeyPath, "r");
     if (!keyFile) {
+        certFile.close();
         reportError("Failed to open client key file: " + clientKeyPath);
         return;
     }
     
-    String key = keyFile.readString();
+    trustStore.clearCertificate();
+    bool loaded = loadPem(certFile, PemTarget::CERTIFICATE) > 0 && loadPem(keyFile, PemTarget::KEY) > 0;
+    if (loaded) {
+        clientCert = String();
+        clientKey = String();
+        if (wifiClient && !config.asyncMqtt) {
+            certFile.seek(0);
+            keyFile.seek(0);
+            wifiClient->loadCertificate(certFile, certFile.size());
+            wifiClient->loadPrivateKey(keyFile, keyFile.size());
+        }
+    }
+    certFile.close();
     keyFile.close();
     
-    if (cert.length() == 0 || key.length() == 0) {
-        reportError("Client certificate or key file is empty");
+    if (!loaded) {
+        trustStore.clearCertificate();
+        reportError("Invalid client certificate or key file");
         return;
     }
+    OTA_LOGI("Client certificate and key loaded from SPIFFS");
+}
+
+// Streams the PEM blocks of file into the trust store through one decode
+// buffer. Number of blocks taken, -1 when the file or a block is malformed.
+int ESP32OtaMqtt::loadPem(File& file, PemTarget target) {
+    uint8_t* der = OtaArena::acquire(OtaArena::HEAP, PEM_BLOCK_SIZE);
+    if (!der) return -1;
+    
+    OtaPemDecoder pem(file, der, PEM_BLOCK_SIZE);
+    int loaded = 0;
+    OtaPemDecoder::Result result;
+    while ((result = pem.next()) == OtaPemDecoder::Result::BLOCK) {
+        const char* label = pem.getLabel();
+        bool taken;
+        if (target == PemTarget::KEY) {
+            // "PRIVATE KEY", "RSA PRIVATE KEY", "EC PRIVATE KEY"
+            size_t length = strlen(label);
+            if (length < 11 || strcmp(label + length - 11, "PRIVATE KEY") != 0) continue;
+            taken = trustStore.setKey(pem.data(), pem.size());
+        } else if (strcmp(label, "CERTIFICATE") != 0) {
+            continue;
+        } else if (target == PemTarget::CA) {
+            taken = trustStore.addCA(pem.data(), pem.size());
+        } else {
+            taken = trustStore.addCertificate(pem.data(), pem.size());
+        }
+        if (!taken) {
+            result = OtaPemDecoder::Result::ERROR;
+            break;
+        }
+        loaded++;
+        if (target == PemTarget::KEY) break;
+    }
     
-    setClientCert(cert.c_str(), key.c_str());
-    OTA_LOG("Client certificate and key loaded from SPIFFS");
+    OtaArena::release(OtaArena::HEAP, der);
+    return result == OtaPemDecoder::Result::ERROR ? -1 : loaded;
+}
+
+void ESP32OtaMqtt::setCABundle(const uint8_t* bundle, size_t size) {
+    if (rejectTaskCall("setCABundle()")) return;
+    if (!caBundle.attach(bundle, size)) {
+        reportError("Invalid CA bundle");
+        return;
+    }
+    trustStore.setBundle(&caBundle);
+    useInsecure = false;
+    trustStore.setInsecure(false);
+    OTA_LOGI("CA bundle with %u certificates configured", (unsigned)caBundle.getCount());
+}
+
+void ESP32OtaMqtt::setCABundleFromFile(const String& bundlePath) {
+    if (rejectTaskCall("setCABundleFromFile()")) return;
+    if (!SPIFFS.begin(true)) {
+        reportError("Failed to mount SPIFFS");
+        return;
+    }
+    if (!caBundle.open(SPIFFS, bundlePath.c_str())) {
+        reportError("Invalid CA bundle file: " + bundlePath);
+        return;
+    }
+    trustStore.setBundle(&caBundle);
+    useInsecure = false;
+    trustStore.setInsecure(false);
+    OTA_LOGI("CA bundle with %u certificates loaded from SPIFFS: %s",
+             (unsigned)caBundle.getCount(), bundlePath.c_str());
 }
 
 void ESP32OtaMqtt::setInsecure(bool insecure) {
+    if (rejectTaskCall("setInsecure()")) return;
     useInsecure = insecure;
+    trustStore.setInsecure(insecure);
     
-    if (insecure) {
+    if (insecure && !wifiClient) {
+        OTA_LOGW("Shared MQTT connection: TLS is configured by the application");
+    } else if (insecure) {
         wifiClient->setInsecure();
-        OTA_LOG("WARNING: Using insecure connection (certificates not verified)");
+        OTA_LOGW("Using insecure connection (certificates not verified)");
     } else {
-        OTA_LOG("Secure connection enabled");
+        OTA_LOGI("Secure connection enabled");
     }
 }
 
@@ -213,261 +485,400 @@ void ESP32OtaMqtt::onError(OtaErrorCallback callback) {
     errorCallback = callback;
 }
 
-// Semantic version comparison
-bool ESP32OtaMqtt::isNewerVersion(const String& newVersion, const String& currentVersion) {
-    return compareVersions(newVersion, currentVersion) > 0;
+void ESP32OtaMqtt::onEvent(OtaEventCallback callback, void* context) {
+    eventCallback = callback;
+    eventContext = context;
 }
 
-int ESP32OtaMqtt::compareVersions(const String& v1, const String& v2) {
-    if (v1 == v2) return 0;
-    
-    // Parse version strings (e.g., "1.2.3")
-    int v1Parts[3] = {0, 0, 0};
-    int v2Parts[3] = {0, 0, 0};
-    
-    // Parse v1
-    int partIndex = 0;
-    String temp = "";
-    for (int i = 0; i < v1.length() && partIndex < 3; i++) {
-        char c = v1.charAt(i);
-        if (c == '.') {
-            v1Parts[partIndex++] = temp.toInt();
-            temp = "";
-        } else if (isDigit(c)) {
-            temp += c;
-        }
-    }
-    if (partIndex < 3 && temp.length() > 0) {
-        v1Parts[partIndex] = temp.toInt();
-    }
-    
-    // Parse v2
-    partIndex = 0;
-    temp = "";
-    for (int i = 0; i < v2.length() && partIndex < 3; i++) {
-        char c = v2.charAt(i);
-        if (c == '.') {
-            v2Parts[partIndex++] = temp.toInt();
-            temp = "";
-        } else if (isDigit(c)) {
-            temp += c;
-        }
-    }
-    if (partIndex < 3 && temp.length() > 0) {
-        v2Parts[partIndex] = temp.toInt();
-    }
-    
-    // Compare parts
-    for (int i = 0; i < 3; i++) {
-        if (v1Parts[i] > v2Parts[i]) return 1;
-        if (v1Parts[i] < v2Parts[i]) return -1;
-    }
-    
-    return 0;
+// Router handlers; context is the updater
+void ESP32OtaMqtt::onUpdateMessage(const char* topic, uint8_t* payload, unsigned int length, void* context) {
+    (void)topic;
+    static_cast<ESP32OtaMqtt*>(context)->handleUpdateMessage(payload, length);
 }
 
-// Static MQTT callback wrapper
-void ESP32OtaMqtt::staticMqttCallback(char* topic, byte* payload, unsigned int length) {
-    if (instance) {
-        instance->mqttCallback(topic, payload, length);
+void ESP32OtaMqtt::onChunkMessage(const char* topic, uint8_t* payload, unsigned int length, void* context) {
+    (void)topic;
+    ESP32OtaMqtt* updater = static_cast<ESP32OtaMqtt*>(context);
+    if (updater->mqttTransfer.isActive()) {
+        updater->mqttTransfer.onChunk(payload, length);
     }
 }
 
 // MQTT message handler
-void ESP32OtaMqtt::mqttCallback(char* topic, byte* payload, unsigned int length) {
-    if (String(topic) != updateTopic) return;
-    
-    String message;
-    for (unsigned int i = 0; i < length; i++) {
-        message += (char)payload[i];
+void ESP32OtaMqtt::handleUpdateMessage(uint8_t* payload, unsigned int length) {
+    OTA_LOGD("Received update message (%u bytes)", length);
+
+    // The pending fields and the mirror list describe the image being written;
+    // a manifest redelivered meanwhile (retained, after resubscribe()) waits
+    // for the next check
+    if (downloadState != DownloadState::IDLE || currentStatus == OtaStatus::DOWNLOADING ||
+        currentStatus == OtaStatus::INSTALLING) {
+        OTA_LOGI("Update in progress, manifest ignored");
+        return;
     }
     
-    OTA_LOG("Received update message: " + message);
-    
-    if (parseUpdateMessage(message)) {
-        // Check if this is a newer version
-        if (isNewerVersion(pendingVersion, config.currentVersion)) {
-            OTA_LOG("New version available: " + pendingVersion);
+    // Parsed in place: the payload lives in the MQTT client's buffer until the next message
+    if (parseUpdateMessage(reinterpret_cast<char*>(payload), length)) {
+        // Check if this is a newer version (SemVer precedence)
+        OtaVersion offered = OtaVersion::parse(pendingVersion.c_str());
+        if (!offered.isValid()) {
+            reportError("Update version is not a semantic version");
+        } else if (offered > runningVersion &&
+                   !OtaRollout::isIncluded(pendingCohort, pendingRolloutPercent)) {
+            OTA_LOGI("Version %s is rolling out to %u%%, not yet to this device (cohort %u)",
+                     pendingVersion.c_str(), (unsigned)pendingRolloutPercent, (unsigned)pendingCohort);
+        } else if (offered > runningVersion) {
+            OTA_LOGI("New version available: %s", pendingVersion.c_str());
+            downloadRetry.recordSuccess();
+            startScheduled = pendingStartDelay > 0;
+            scheduledStart = millis() + pendingStartDelay;
+            if (startScheduled) {
+                OTA_LOGI("Download starts in %u s (rollout jitter)", (unsigned)(pendingStartDelay / 1000));
+            }
             updateStatus(OtaStatus::DOWNLOADING);
             
             // Start download in next loop iteration to avoid blocking MQTT
             // The actual download will be handled in loop()
         } else {
-            OTA_LOG("Version " + pendingVersion + " is not newer than current " + config.currentVersion);
+            OTA_LOGI("Version %s is not newer than current %s", pendingVersion.c_str(), config.currentVersion.c_str());
         }
     }
 }
 
-// Simple JSON value extractor
-String ESP32OtaMqtt::extractJsonValue(const String& json, const String& key) {
-    String searchKey = "\"" + key + "\"";
-    int keyIndex = json.indexOf(searchKey);
-    if (keyIndex == -1) return "";
-    
-    int colonIndex = json.indexOf(":", keyIndex);
-    if (colonIndex == -1) return "";
-    
-    int startIndex = json.indexOf("\"", colonIndex);
-    if (startIndex == -1) return "";
-    startIndex++; // Skip opening quote
-    
-    int endIndex = json.indexOf("\"", startIndex);
-    if (endIndex == -1) return "";
-    
-    return json.substring(startIndex, endIndex);
+// Tokenizer callback: fills the OtaManifest passed as context
+bool ESP32OtaMqtt::onManifestValue(void* context, const OtaJsonEvent& event) {
+    OtaManifest& manifest = *static_cast<OtaManifest*>(context);
+    if (event.type == OtaJsonType::OBJECT || event.type == OtaJsonType::ARRAY || event.type == OtaJsonType::END) {
+        return true;
+    }
+
+    if (event.depth == 2 && event.index >= 0 && event.keys[1] == "mirrors") {
+        if (event.type == OtaJsonType::STRING && manifest.mirrorCount < OtaMirrorSet::MAX_MIRRORS - 1) {
+            manifest.mirrors[manifest.mirrorCount++] = event.value;
+        }
+        return true;
+    }
+    if (event.depth != 1) return true; // Nested members are not manifest fields
+
+    for (size_t i = 0; i < sizeof(MANIFEST_FIELDS) / sizeof(MANIFEST_FIELDS[0]); i++) {
+        if (event.key() == MANIFEST_FIELDS[i].key) {
+            manifest.*MANIFEST_FIELDS[i].field = event.type == OtaJsonType::NULL_VALUE ? OtaJsonView() : event.value;
+            break;
+        }
+    }
+    return true;
 }
 
-// Parse JSON update message
-bool ESP32OtaMqtt::parseUpdateMessage(const String& message) {
-    // Extract required fields using simple parser
-    String version = extractJsonValue(message, "version");
-    String url = extractJsonValue(message, "firmware_url");
-    String checksum = extractJsonValue(message, "checksum");
-    String command = extractJsonValue(message, "command");
-    
-    if (version.isEmpty() || url.isEmpty() || checksum.isEmpty() || command.isEmpty()) {
+OtaCompression ESP32OtaMqtt::parseCompression(const OtaJsonView& name) {
+    if (name == "gzip") return OtaCompression::GZIP;
+    if (name == "heatshrink") return OtaCompression::HEATSHRINK;
+    return OtaCompression::NONE;
+}
+
+// Parse JSON update message in a single pass over the payload
+bool ESP32OtaMqtt::parseUpdateMessage(char* message, size_t length) {
+    OtaManifest manifest;
+    OtaJson json;
+    if (!json.parse(message, length, onManifestValue, &manifest)) {
+        OTA_LOGW("Update message invalid at byte %u", (unsigned)json.getErrorOffset());
+        reportError(String("Malformed update message: ") + json.getError());
+        return false;
+    }
+
+    // Strings are already terminated; a number or literal is followed by a
+    // delimiter that is no longer needed once parsing is done
+    for (size_t i = 0; i < sizeof(MANIFEST_FIELDS) / sizeof(MANIFEST_FIELDS[0]); i++) {
+        const OtaJsonView& field = manifest.*MANIFEST_FIELDS[i].field;
+        if (!field.isEmpty()) const_cast<char*>(field.data)[field.length] = '\0';
+    }
+
+    if (manifest.version.isEmpty() || manifest.firmwareUrl.isEmpty() || manifest.checksum.isEmpty() ||
+        manifest.command.isEmpty()) {
         reportError("Missing required fields in update message");
         return false;
     }
     
-    if (command != "update") {
-        OTA_LOG("Ignoring non-update command: " + command);
+    if (manifest.command != "update") {
+        OTA_LOGI("Ignoring non-update command: %s", manifest.command.data);
         return false;
     }
     
-    pendingVersion = version;
-    pendingUrl = url;
-    pendingChecksum = checksum;
+    pendingVersion.assign(manifest.version.data, manifest.version.length);
+    pendingUrl.assign(manifest.firmwareUrl.data, manifest.firmwareUrl.length);
+    pendingChecksum.assign(manifest.checksum.data, manifest.checksum.length);
+    pendingPatchUrl = "";
+    pendingCompression = parseCompression(manifest.compression);
+    pendingWindowBits = manifest.compressionWindow.isEmpty() ? 8 : manifest.compressionWindow.toInt();
+    pendingLookaheadBits = manifest.compressionLookahead.isEmpty() ? 4 : manifest.compressionLookahead.toInt();
+    pendingChecksumCompressed = (manifest.checksumScope == "compressed");
+    pendingImageSize = manifest.imageSize.isEmpty() ? 0 : (size_t)manifest.imageSize.toInt();
+    if (pendingVersion.isTruncated() || pendingUrl.isTruncated() || pendingChecksum.isTruncated()) {
+        reportError("Update message field too long");
+        return false;
+    }
+    setMirrors(manifest);
+    planRollout(manifest);
+
+    if (!manifest.compression.isEmpty() && pendingCompression == OtaCompression::NONE &&
+        manifest.compression != "none") {
+        reportError(String("Unsupported compression: ") + manifest.compression.data);
+        return false;
+    }
+
+    // A delta patch only applies on top of the exact image it was built from
+    if (!manifest.patchUrl.isEmpty()) {
+        if (manifest.baseVersion != config.currentVersion.c_str()) {
+            OTA_LOGI("Ignoring delta patch for base %s, using full image", manifest.baseVersion.data);
+        } else if (!pendingPatchUrl.assign(manifest.patchUrl.data, manifest.patchUrl.length)) {
+            pendingPatchUrl.clear();
+            OTA_LOGW("Patch URL too long, using full image");
+        } else {
+            OTA_LOGI("Delta update available against %s", manifest.baseVersion.data);
+        }
+    }
     
     return true;
 }
 
+// Staged rollout: this device's cohort and download delay for the offered update
+void ESP32OtaMqtt::planRollout(const OtaManifest& manifest) {
+    uint8_t mac[6];
+    const uint8_t* id = reinterpret_cast<const uint8_t*>(config.rolloutId.c_str());
+    size_t idLength = config.rolloutId.length();
+    if (idLength == 0) {
+        WiFi.macAddress(mac);
+        id = mac;
+        idLength = sizeof(mac);
+    }
+
+    // Without a seed every version draws the fleet's order anew
+    const OtaJsonView& seed = manifest.rolloutSeed.isEmpty() ? manifest.version : manifest.rolloutSeed;
+    long percent = manifest.rolloutPercent.isEmpty() ? 100 : manifest.rolloutPercent.toInt();
+    long jitter = manifest.rolloutJitter.isEmpty() ? 0 : manifest.rolloutJitter.toInt();
+
+    pendingRolloutPercent = (uint8_t)constrain(percent, 0L, 100L);
+    pendingCohort = OtaRollout::cohort(id, idLength, seed.data, seed.length);
+    pendingStartDelay = OtaRollout::startDelay(id, idLength, seed.data, seed.length,
+                                               (uint32_t)constrain(jitter, 0L, MAX_ROLLOUT_JITTER) * 1000);
+}
+
 // Initialize the OTA updater
 bool ESP32OtaMqtt::begin() {
+    OtaLog::begin(config.logBufferSize);
+    applyRetryConfig();
+    applyBandwidthLimit();
     if (!WiFi.isConnected()) {
         reportError("WiFi not connected");
         return false;
     }
+    // A shared router delivers messages on the application's task, which
+    // would run the handlers alongside the updater task
+    if (config.runInTask && sharedConnection) {
+        reportError("runInTask needs the updater's own MQTT connection");
+        return false;
+    }
     
-    // Set up MQTT callback
-    mqttClient->setCallback(staticMqttCallback);
-    
-    OTA_LOG("ESP32 OTA MQTT updater initialized");
-    OTA_LOG("Current version: " + config.currentVersion);
-    OTA_LOG("Update topic: " + updateTopic);
-    OTA_LOG("Check interval: " + String(config.checkInterval) + "ms");
+    // Set up MQTT routing; a shared router is attached by the application
+    if (sharedConnection) {
+        mqttClient = router->getClient();
+        mqttEngine = router->getEngine();
+        if (!mqttClient && !mqttEngine) {
+            reportError("Shared topic router has no MQTT client");
+            return false;
+        }
+    } else if (config.asyncMqtt) {
+        if (!mqttEngine) {
+            mqttEngine = new OtaMqttEngine();
+            ownsMqttEngine = true;
+        }
+        router->attach(*mqttEngine);
+    } else {
+        router->attach(*mqttClient);
+    }
+    if (!router->subscribe(updateTopic.c_str(), onUpdateMessage, this)) {
+        reportError("Cannot route update topic");
+        return false;
+    }
+    loadMirrorStats();
     
+    OTA_LOGI("ESP32 OTA MQTT updater initialized");
+    OTA_LOGI("Current version: %s", config.currentVersion.c_str());
+    OTA_LOGI("Update topic: %s", updateTopic.c_str());
+    OTA_LOGI("Check interval: %lums", config.checkInterval);
+
+    if (config.runInTask && !engineTask && !startEngineTask()) {
+        reportError("Failed to create updater task");
+        return false;
+    }
     return true;
 }
 
 // Non-blocking main loop with task-based management
 void ESP32OtaMqtt::loop() {
+    if (engineTask) {
+        if (configPending) postConfig();
+        deliverTaskEvents(); // The updater task does the rest
+        receiveSnapshots();
+        return;
+    }
+    runLoop();
+}
+
+void ESP32OtaMqtt::runLoop() {
     if (!WiFi.isConnected()) return;
+    unsigned long loopStart = micros();
+    bool budgeted = config.loopBudgetMicros > 0 && currentStatus == OtaStatus::DOWNLOADING;
+    loopBudget.startIteration(loopStart, budgeted ? config.loopBudgetMicros : 0);
 
     // Task 1: Handle MQTT connection (non-blocking state machine)
     handleMqttConnection();
 
     // Task 2: Periodic update check
-    if (millis() - lastCheck >= config.checkInterval) {
+    if (!paused && millis() - lastCheck >= config.checkInterval) {
         lastCheck = millis();
         checkForUpdates();
     }
 
     // Task 3: Handle download (chunked, non-blocking)
-    if (currentStatus == OtaStatus::DOWNLOADING) {
-        if (downloadState == DownloadState::IDLE && !pendingUrl.isEmpty()) {
-            // Start new download
-            if (startDownload(pendingUrl)) {
-                downloadState = DownloadState::DOWNLOADING;
-            } else {
+    expireBandwidthClaim();
+    if (currentStatus == OtaStatus::DOWNLOADING && !paused) {
+        if (downloadState == DownloadState::IDLE && !pendingUrl.isEmpty() &&
+            (!startScheduled || (long)(millis() - scheduledStart) >= 0)) {
+            startScheduled = false;
+            // Start new download (delta patch first when one is offered)
+            if (!downloadHostAvailable()) {
+                // Waits for the host's cooldown, without using up a retry
+            } else if (!claimInstall()) {
+                // Another updater is installing; waits for it the same way
+            } else if (!startDownload((pendingPatchUrl.isEmpty() ? pendingUrl : pendingPatchUrl).c_str())) {
                 // Failed to start
                 retryCount++;
                 if (retryCount >= config.maxRetries) {
+                    cleanupDownload();
+                    flashWriter.abort();
                     updateStatus(OtaStatus::ERROR);
                     retryCount = 0;
                     pendingUrl = "";
+                    pendingPatchUrl = "";
                     pendingChecksum = "";
                     pendingVersion = "";
+                } else {
+                    scheduleRetry();
                 }
             }
         } else if (downloadState != DownloadState::IDLE) {
             // Continue download
             handleDownload();
 
-            // Check if download finished (success or failure)
-            if (downloadState == DownloadState::IDLE) {
+            // Check if download finished (success or failure); a retry keeps DOWNLOADING
+            if (downloadState == DownloadState::IDLE && currentStatus != OtaStatus::DOWNLOADING) {
                 // Clear pending data after completion
                 pendingUrl = "";
+                pendingPatchUrl = "";
                 pendingChecksum = "";
                 pendingVersion = "";
             }
         }
     }
 
+    closeIdleDownloadClient();
+    dispatchEvents();
+    drainLog();
+    trackMemory();
+
+    unsigned long loopMicros = micros() - loopStart;
+    if (loopMicros > maxLoopMicros) {
+        maxLoopMicros = loopMicros;
+    }
+    loopBudget.finishIteration(loopMicros);
+
     // Yield to prevent watchdog timeout
     yieldIfNeeded();
 }
 
 // Check for updates (called periodically)
-void ESP32OtaMqtt::checkForUpdates() {
-    if (currentStatus != OtaStatus::IDLE) return;
+bool ESP32OtaMqtt::checkForUpdates() {
+    if (isTaskCaller()) {
+        TaskCommand command;
+        command.type = TaskCommand::CHECK;
+        return postCommand(command);
+    }
+    if (currentStatus != OtaStatus::IDLE) return false;
     
     updateStatus(OtaStatus::CHECKING);
     // The actual check happens via MQTT callback
     // This just updates the status
     updateStatus(OtaStatus::IDLE);
+    return true;
 }
 
 // Force a specific update
-void ESP32OtaMqtt::forceUpdate(const String& version, const String& url, const String& checksum) {
+bool ESP32OtaMqtt::forceUpdate(const String& version, const String& url, const String& checksum) {
+    if (isTaskCaller()) {
+        TaskCommand command;
+        command.type = TaskCommand::FORCE_UPDATE;
+        command.version.assign(version.c_str());
+        command.url.assign(url.c_str());
+        command.checksum.assign(checksum.c_str());
+        return postCommand(command);
+    }
     if (currentStatus != OtaStatus::IDLE) {
         reportError("Update already in progress");
-        return;
+        return false;
     }
     
     pendingVersion = version;
     pendingUrl = url;
+    pendingPatchUrl = "";
+    pendingCompression = OtaCompression::NONE;
+    pendingChecksumCompressed = false;
+    pendingImageSize = 0;
     pendingChecksum = checksum;
+    startScheduled = false;
+    downloadRetry.recordSuccess();
+    if (pendingVersion.isTruncated() || pendingUrl.isTruncated() || pendingChecksum.isTruncated()) {
+        reportError("Update field too long");
+        return false;
+    }
+    OtaManifest manifest;
+    manifest.firmwareUrl = OtaJsonView(url.c_str(), url.length());
+    setMirrors(manifest);
     retryCount = 0;
     
     updateStatus(OtaStatus::DOWNLOADING);
+    return true;
 }
 
 // Download firmware with progress tracking
 
 // Install firmware
 bool ESP32OtaMqtt::installFirmware() {
-    OTA_LOG("Installing firmware...");
+    OTA_LOGI("Installing firmware...");
     
-    // The firmware is already written by Update.write() in downloadFirmware()
-    // Update.end() should have completed the installation
+    // The firmware is already written by the flash writer during download
+    // and finalizeDownload() has selected it as the boot partition
     
-    if (Update.hasError()) {
-        reportError("Installation failed", Update.getError());
+    if (flashWriter.getError() != 0) {
+        reportError("Installation failed", flashWriter.getError());
         return false;
     }
     
-    OTA_LOG("Installation completed successfully");
+    OTA_LOGI("Installation completed successfully");
     return true;
 }
 
 // Verify SHA256 checksum
-bool ESP32OtaMqtt::verifyChecksum(const String& expectedChecksum) {
-    OTA_LOG("Expected checksum: " + expectedChecksum);
-    OTA_LOG("Calculated checksum: " + calculatedChecksum);
-    
-    // Convert both checksums to lowercase for comparison
-    String expectedLower = expectedChecksum;
-    String calculatedLower = calculatedChecksum;
-    expectedLower.toLowerCase();
-    calculatedLower.toLowerCase();
+bool ESP32OtaMqtt::verifyChecksum(const char* expectedChecksum) {
+    OTA_LOGI("Expected checksum: %s", expectedChecksum);
+    OTA_LOGI("Calculated checksum: %s", calculatedChecksum.c_str());
     
-    bool isValid = (expectedLower == calculatedLower);
+    // Case-insensitive hex comparison
+    bool isValid = strcasecmp(expectedChecksum, calculatedChecksum.c_str()) == 0;
     
     if (isValid) {
-        OTA_LOG("Checksum verification: PASSED");
+        OTA_LOGI("Checksum verification: PASSED");
     } else {
-        OTA_LOG("Checksum verification: FAILED");
+        OTA_LOGE("Checksum verification: FAILED");
     }
     
     return isValid;
@@ -475,81 +886,249 @@ bool ESP32OtaMqtt::verifyChecksum(const String& expectedChecksum) {
 
 // Perform rollback to previous firmware
 void ESP32OtaMqtt::performRollback() {
-    OTA_LOG("Rollback requested...");
+    OTA_LOGW("Rollback requested...");
     updateStatus(OtaStatus::ROLLBACK);
     
     // Simple rollback strategy - just restart and hope for the best
     // In a production implementation, you would use ESP32 partition management
     reportError("Manual rollback required - restart device to previous firmware");
-    OTA_LOG("Restarting device...");
+    OTA_LOGI("Restarting device...");
+    dispatchEvents();
     delay(2000);
     ESP.restart();
 }
 
 // Update status and notify callback
+// Held from the first download attempt until the status leaves DOWNLOADING /
+// INSTALLING; retries of the same update keep it
+bool ESP32OtaMqtt::claimInstall() {
+    const ESP32OtaMqtt* expected = nullptr;
+    return installingUpdater.compare_exchange_strong(expected, this) || expected == this;
+}
+
+void ESP32OtaMqtt::releaseInstall() {
+    const ESP32OtaMqtt* expected = this;
+    installingUpdater.compare_exchange_strong(expected, nullptr);
+}
+
 void ESP32OtaMqtt::updateStatus(OtaStatus status, int progress) {
+    OtaEventType type = status != currentStatus ? OtaEventType::STATUS : OtaEventType::PROGRESS;
     currentStatus = status;
-    
-    if (statusCallback) {
-        statusCallback(getStatusString(), progress);
+    if (status != OtaStatus::DOWNLOADING && status != OtaStatus::INSTALLING) {
+        releaseInstall();
     }
-    
-    OTA_LOG("Status: " + getStatusString() + " (" + String(progress) + "%)");
+    queueEvent(type, progress, 0);
 }
 
-// Report error and notify callback
+// Report error and notify callback. The status is left alone: a failed
+// download attempt may still be retried, the paths that give up set ERROR.
 void ESP32OtaMqtt::reportError(const String& error, int errorCode) {
-    OTA_LOG("Error: " + error + " (Code: " + String(errorCode) + ")");
-    
+    OTA_LOGE("Error: %s (Code: %d)", error.c_str(), errorCode);
+
+    // Task mode: the callbacks run in the application's loop()
+    if (engineTask && forwardError(error, errorCode)) return;
+    if (engineTask) {
+        queueEvent(OtaEventType::ERROR, 0, errorCode); // Queue full: delivered later, without the text
+        return;
+    }
+
     if (errorCallback) {
         errorCallback(error, errorCode);
     }
     
-    currentStatus = OtaStatus::ERROR;
+    queueEvent(OtaEventType::ERROR, 0, errorCode);
+}
+
+// Callbacks run from dispatchEvents(), at most CAPACITY events behind
+void ESP32OtaMqtt::queueEvent(OtaEventType type, int progress, int errorCode) {
+    OtaEvent event;
+    event.type = type;
+    event.status = currentStatus;
+    event.progress = progress;
+    event.errorCode = errorCode;
+    event.bytesDone = downloadedBytes;
+    event.bytesTotal = totalBytes;
+
+    events.setProgressRate(config.progressInterval, config.progressStep);
+    events.push(event, millis());
+}
+
+void ESP32OtaMqtt::dispatchEvents() {
+    if (engineTask) {
+        forwardEvents();
+        return;
+    }
+    OtaEvent event;
+    while (events.pop(event)) {
+        if (event.type != OtaEventType::ERROR) {
+            OTA_LOGI("Status: %s (%d%%)", OtaEventQueue::statusName(event.status), event.progress);
+            // Adapter for the String-based callback
+            if (statusCallback) {
+                statusCallback(statusString(event.status), event.progress);
+            }
+        }
+        if (eventCallback) {
+            eventCallback(event, eventContext);
+        }
+    }
+}
+
+// The String-based status callback gets one of these rather than a String
+// built per event; they are made on first use and kept
+const String& ESP32OtaMqtt::statusString(OtaStatus status) {
+    static const String names[] = {
+        OtaEventQueue::statusName(OtaStatus::IDLE),
+        OtaEventQueue::statusName(OtaStatus::CHECKING),
+        OtaEventQueue::statusName(OtaStatus::DOWNLOADING),
+        OtaEventQueue::statusName(OtaStatus::INSTALLING),
+        OtaEventQueue::statusName(OtaStatus::SUCCESS),
+        OtaEventQueue::statusName(OtaStatus::ERROR),
+        OtaEventQueue::statusName(OtaStatus::ROLLBACK)
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)OtaStatus::ROLLBACK + 1, "One name per OtaStatus");
+    return names[(size_t)status];
+}
+
+// Log lines are formatted and written only in calls that moved no download
+// data, and only as many as fit the Serial TX buffer
+void ESP32OtaMqtt::drainLog() {
+    if (!OtaLog::isBuffered() || !OtaLog::claimDrain(this)) return;
+    if (downloadState != DownloadState::IDLE && loopBudget.getIterationBytes() > 0) return;
+
+    bool toMqtt = !config.logTopic.isEmpty() && mqttState == MqttConnState::CONNECTED;
+    char line[OtaLog::LINE_SIZE];
+    for (int i = 0; i < LOG_LINES_PER_LOOP; i++) {
+        size_t length = OtaLog::peekLine(line, sizeof(line));
+        if (length == 0) break;
+        if (toMqtt) {
+            router->publish(config.logTopic.c_str(), line);
+        } else {
+            if (Serial.availableForWrite() < (int)length + 2) break;
+            Serial.write((const uint8_t*)line, length);
+            Serial.write((const uint8_t*)"\r\n", 2);
+        }
+        OtaLog::pop();
+    }
+}
+
+// One cycle spans every loop() from the start of a download until the update
+// ends; heap use is sampled at the end of each of those calls
+void ESP32OtaMqtt::trackMemory() {
+    if (isUpdateInProgress()) {
+        if (!memoryCycleActive) {
+            memoryCycleActive = true;
+            cycleStartAllocations = OtaArena::getHeapAllocations();
+            heapTotal = heap_caps_get_total_size(MALLOC_CAP_8BIT);
+            heapMinFree = heapTotal;
+            memoryStats.largestFreeBlock = 0;
+        }
+        heapMinFree = min(heapMinFree, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    } else if (!memoryCycleActive) {
+        return;
+    }
+
+    memoryStats.heapAllocations = OtaArena::getHeapAllocations() - cycleStartAllocations;
+    memoryStats.heapHighWater = heapTotal - heapMinFree;
+    memoryStats.arenaUsed = OtaArena::getUsed();
+    memoryStats.arenaSize = OtaArena::getSize();
+    memoryStats.arenaFailures = OtaArena::getFailures();
+
+    if (!isUpdateInProgress()) {
+        memoryCycleActive = false;
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+        memoryStats.largestFreeBlock = info.largest_free_block;
+        OTA_LOGI("Memory: %u heap allocations, heap high-water %u bytes, largest free block %u",
+                 (unsigned)memoryStats.heapAllocations, (unsigned)memoryStats.heapHighWater,
+                 (unsigned)memoryStats.largestFreeBlock);
+        if (OtaArena::isInstalled()) {
+            OTA_LOGI("Arena: %u/%u bytes used, %u requests did not fit", (unsigned)memoryStats.arenaUsed,
+                     (unsigned)memoryStats.arenaSize, (unsigned)memoryStats.arenaFailures);
+        }
+    }
+}
+
+bool ESP32OtaMqtt::setArena(uint8_t* buffer, size_t size) {
+    if (engineTask || isUpdateInProgress() || downloadState != DownloadState::IDLE || resumeOffset > 0) {
+        return false;
+    }
+    if (installingUpdater.load() != nullptr) {
+        return false; // Another updater is downloading with the current arena
+    }
+    closeDownloadClient(); // A kept-alive client may live in the current pool
+    OtaArena::install(buffer, size, this);
+    return true;
+}
+
+OtaMemoryStats ESP32OtaMqtt::getMemoryStats() const {
+    return isTaskCaller() ? snapshot.memoryStats : memoryStats;
+}
+
+unsigned long ESP32OtaMqtt::getScheduledStart() const {
+    if (isTaskCaller()) return snapshot.scheduledStart;
+    return startScheduled ? scheduledStart : 0;
+}
+
+unsigned long ESP32OtaMqtt::getNextMqttAttempt() const {
+    if (isTaskCaller()) return snapshot.nextMqttAttempt;
+    if (sharedConnection || mqttState == MqttConnState::CONNECTED) return 0;
+    return mqttRetry.getNextAttempt();
+}
+
+// Per-host state is not in the task snapshot
+unsigned long ESP32OtaMqtt::getHostBlockedUntil(const char* host) const {
+    if (isTaskCaller()) return 0;
+    return host ? hostBreaker.getOpenUntil(host) : 0;
 }
 
 // Status methods
+// In task mode the application sees the status of the events delivered so far
 OtaStatus ESP32OtaMqtt::getStatus() const {
-    return currentStatus;
+    return isTaskCaller() ? deliveredStatus : currentStatus;
 }
 
 String ESP32OtaMqtt::getStatusString() const {
-    switch (currentStatus) {
-        case OtaStatus::IDLE: return "IDLE";
-        case OtaStatus::CHECKING: return "CHECKING";
-        case OtaStatus::DOWNLOADING: return "DOWNLOADING";
-        case OtaStatus::INSTALLING: return "INSTALLING";
-        case OtaStatus::SUCCESS: return "SUCCESS";
-        case OtaStatus::ERROR: return "ERROR";
-        case OtaStatus::ROLLBACK: return "ROLLBACK";
-        default: return "UNKNOWN";
-    }
+    return OtaEventQueue::statusName(getStatus());
 }
 
 String ESP32OtaMqtt::getCurrentVersion() const {
-    return config.currentVersion;
+    return isTaskCaller() ? taskConfig.currentVersion : config.currentVersion;
 }
 
 String ESP32OtaMqtt::getPendingVersion() const {
-    return pendingVersion;
+    return String(isTaskCaller() ? snapshot.pendingVersion.c_str() : pendingVersion.c_str());
 }
 
 unsigned long ESP32OtaMqtt::getLastCheck() const {
-    return lastCheck;
+    return isTaskCaller() ? snapshot.lastCheck : lastCheck;
 }
 
 // Reset the updater
 void ESP32OtaMqtt::reset() {
+    if (isTaskCaller()) {
+        TaskCommand command;
+        command.type = TaskCommand::RESET;
+        postCommand(command);
+        return;
+    }
+    if (downloadState != DownloadState::IDLE || resumeOffset > 0) {
+        cleanupDownload();
+        flashWriter.abort();
+    }
     currentStatus = OtaStatus::IDLE;
     pendingVersion = "";
     pendingUrl = "";
+    pendingPatchUrl = "";
     pendingChecksum = "";
+    startScheduled = false;
+    downloadRetry.recordSuccess();
     retryCount = 0;
 }
 
 // Check if update is in progress
 bool ESP32OtaMqtt::isUpdateInProgress() const {
-    return currentStatus == OtaStatus::DOWNLOADING || 
-           currentStatus == OtaStatus::INSTALLING ||
-           currentStatus == OtaStatus::ROLLBACK;
+    OtaStatus status = getStatus();
+    return status == OtaStatus::DOWNLOADING || 
+           status == OtaStatus::INSTALLING ||
+           status == OtaStatus::ROLLBACK;
 }
\ No newline at end of file
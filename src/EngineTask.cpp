@@ -0,0 +1,281 @@
+// Background task mode for ESP32OtaMqtt
+// With runInTask the state machine runs in its own task, pinned to
+// config.taskCore, instead of in the application's loop(). The application
+// and the task share no state: control calls (forceUpdate(), reset(),
+// pause(), ...) become commands in one SPSC queue, and config setters send
+// copies of the config through another; the task takes both at the start of
+// each iteration. Status, progress and error events come back in a third
+// queue, to be delivered by the application's loop(), and a snapshot of the
+// state behind the getters in a fourth. All queues are lock-free, so neither
+// side ever waits on the other.
+//
+// Each queue has a single producer: the application must call the updater
+// from one task, the one that runs loop(). Connection and TLS setters are
+// refused while the task runs.
+
+#include "ESP32OtaMqtt.h"
+
+// ============================================================================
+// TASK LIFECYCLE
+// ============================================================================
+
+bool ESP32OtaMqtt::startEngineTask() {
+    // From here on the application only sees this copy and the snapshots
+    taskConfig = config;
+    OTA_LOGI("Starting updater task on core %d", config.taskCore);
+    engineTaskStop.store(false);
+    engineTaskRunning.store(true);
+    if (xTaskCreatePinnedToCore(engineTaskEntry, "ota_updater", config.taskStackSize, this,
+                                (UBaseType_t)config.taskPriority, &engineTask, config.taskCore) != pdPASS) {
+        engineTask = nullptr;
+        engineTaskRunning.store(false);
+        return false;
+    }
+    return true;
+}
+
+void ESP32OtaMqtt::stopEngineTask() {
+    if (!engineTask) return;
+
+    // Let the current iteration finish, then delete the parked task
+    engineTaskStop.store(true, std::memory_order_release);
+    while (engineTaskRunning.load(std::memory_order_acquire)) {
+        delay(1);
+    }
+    vTaskDelete(engineTask);
+    engineTask = nullptr;
+
+    // Commands the task never ran are dropped; the latest config still applies
+    TaskCommand command;
+    while (taskCommands.pop(command)) {
+    }
+    bool configQueued = configPending;
+    while (taskConfigs.pop(receivedConfig)) {
+        configQueued = true;
+    }
+    configPending = false;
+    if (configQueued) setConfig(taskConfig);
+}
+
+void ESP32OtaMqtt::engineTaskEntry(void* arg) {
+    static_cast<ESP32OtaMqtt*>(arg)->runEngineTask();
+
+    // Deleted by stopEngineTask()
+    for (;;) {
+        vTaskDelay(portMAX_DELAY);
+    }
+}
+
+void ESP32OtaMqtt::runEngineTask() {
+    while (!engineTaskStop.load(std::memory_order_acquire)) {
+        runCommands();
+        runLoop();
+        publishSnapshot();
+        vTaskDelay(1);
+    }
+    engineTaskRunning.store(false, std::memory_order_release);
+}
+
+// True when called from the application, i.e. any task but the updater's
+bool ESP32OtaMqtt::isTaskCaller() const {
+    return engineTask && xTaskGetCurrentTaskHandle() != engineTask;
+}
+
+// ============================================================================
+// COMMANDS (application -> task)
+// ============================================================================
+
+// False when the queue is full: the command is dropped and counted
+bool ESP32OtaMqtt::postCommand(const TaskCommand& command) {
+    if (taskCommands.push(command)) return true;
+    droppedCommands++;
+    OTA_LOGW("Command queue full, command %d dropped", (int)command.type);
+    return false;
+}
+
+// Queues a copy of taskConfig, which the application's setters just changed.
+// The queue's slots are reused, so this allocates nothing; while the task has
+// not taken the earlier copies, the application's loop() queues it later.
+// Only the latest config matters, so none is ever dropped.
+bool ESP32OtaMqtt::postConfig() {
+    if (!isTaskCaller()) return false;
+    configPending = !taskConfigs.push(taskConfig);
+    return true;
+}
+
+// Setters that would change the task's connections while it uses them
+bool ESP32OtaMqtt::rejectTaskCall(const char* method) {
+    if (!isTaskCaller()) return false;
+    droppedCommands++;
+    OTA_LOGW("%s ignored: call it before begin() in task mode", method);
+    return true;
+}
+
+void ESP32OtaMqtt::runCommands() {
+    while (taskConfigs.pop(receivedConfig)) {
+        setConfig(receivedConfig);
+    }
+
+    TaskCommand command;
+    while (taskCommands.pop(command)) {
+        switch (command.type) {
+            case TaskCommand::CHECK:
+                checkForUpdates();
+                break;
+            case TaskCommand::FORCE_UPDATE:
+                if (command.version.isTruncated() || command.url.isTruncated() || command.checksum.isTruncated()) {
+                    reportError("Update field too long");
+                    break;
+                }
+                forceUpdate(command.version.c_str(), command.url.c_str(), command.checksum.c_str());
+                break;
+            case TaskCommand::RESET:
+                reset();
+                break;
+            case TaskCommand::PAUSE:
+                pause();
+                break;
+            case TaskCommand::RESUME:
+                resume();
+                break;
+            case TaskCommand::SET_PRIORITY:
+                setPriority((OtaPriority)command.value);
+                break;
+            case TaskCommand::CLAIM_BANDWIDTH:
+                claimBandwidth(command.duration, command.value);
+                break;
+            case TaskCommand::RELEASE_BANDWIDTH:
+                releaseBandwidth();
+                break;
+            case TaskCommand::RESET_TIMING_STATS:
+                resetTimingStats();
+                break;
+        }
+    }
+}
+
+uint32_t ESP32OtaMqtt::getDroppedCommands() const {
+    return droppedCommands;
+}
+
+// ============================================================================
+// PAUSE
+// ============================================================================
+
+void ESP32OtaMqtt::pause() {
+    if (isTaskCaller()) {
+        TaskCommand command;
+        command.type = TaskCommand::PAUSE;
+        postCommand(command);
+        return;
+    }
+    if (paused) return;
+    paused = true;
+    pausedAt = millis();
+    OTA_LOGI("Updater paused");
+}
+
+void ESP32OtaMqtt::resume() {
+    if (isTaskCaller()) {
+        TaskCommand command;
+        command.type = TaskCommand::RESUME;
+        postCommand(command);
+        return;
+    }
+    if (!paused) return;
+    paused = false;
+
+    // The pause does not count against the download and chunk timeouts
+    downloadStartTime += millis() - pausedAt;
+    if (mqttTransfer.isActive()) {
+        mqttTransfer.touch();
+    }
+    OTA_LOGI("Updater resumed");
+}
+
+bool ESP32OtaMqtt::isPaused() const {
+    return isTaskCaller() ? snapshot.paused : paused;
+}
+
+// ============================================================================
+// EVENTS (task -> application)
+// ============================================================================
+
+// Moves coalesced events into the application's queue while it has room;
+// the rest wait in the coalescing queue, which keeps only the latest progress
+void ESP32OtaMqtt::forwardEvents() {
+    TaskEvent record;
+    while (!taskEvents.isFull() && events.pop(record.event)) {
+        if (record.event.type != OtaEventType::ERROR) {
+            OTA_LOGI("Status: %s (%d%%)", OtaEventQueue::statusName(record.event.status), record.event.progress);
+        }
+        taskEvents.push(record);
+    }
+}
+
+// Error with its text, behind the events queued before it; false when the queue is full
+bool ESP32OtaMqtt::forwardError(const String& error, int errorCode) {
+    forwardEvents();
+    if (taskEvents.isFull()) return false;
+
+    TaskEvent record;
+    record.event.type = OtaEventType::ERROR;
+    record.event.status = currentStatus;
+    record.event.progress = 0;
+    record.event.errorCode = errorCode;
+    record.event.bytesDone = downloadedBytes;
+    record.event.bytesTotal = totalBytes;
+    record.message.assign(error.c_str());
+    return taskEvents.push(record);
+}
+
+// ============================================================================
+// SNAPSHOTS (task -> application)
+// ============================================================================
+
+// Skipped while the application has not taken the last one
+void ESP32OtaMqtt::publishSnapshot() {
+    if (taskSnapshots.size() > 0) return;
+
+    TaskSnapshot state;
+    state.pendingVersion = pendingVersion.c_str();
+    state.activeMirror = getActiveMirror().c_str();
+    state.memoryStats = memoryStats;
+    state.lastCheck = lastCheck;
+    state.scheduledStart = getScheduledStart();
+    state.nextMqttAttempt = getNextMqttAttempt();
+    state.maxLoopMicros = maxLoopMicros;
+    state.maxConnectStepMicros = maxConnectStepMicros;
+    state.budgetOverruns = loopBudget.getOverruns();
+    state.handshakeTimeSaved = getHandshakeTimeSaved();
+    state.resumeBytesSaved = resumeBytesSaved;
+    state.bytesPerLoop = loopBudget.getBytesPerIteration();
+    state.priority = config.priority;
+    state.bandwidthClaimed = bandwidthClaimed;
+    state.paused = paused;
+    taskSnapshots.push(state);
+}
+
+void ESP32OtaMqtt::receiveSnapshots() {
+    while (taskSnapshots.pop(snapshot)) {
+    }
+}
+
+// Runs in the application's loop(): the callbacks never run in the updater task
+void ESP32OtaMqtt::deliverTaskEvents() {
+    TaskEvent record;
+    while (taskEvents.pop(record)) {
+        const OtaEvent& event = record.event;
+        deliveredStatus = event.status;
+        if (event.type == OtaEventType::ERROR) {
+            if (errorCallback) {
+                errorCallback(String(record.message.c_str()), event.errorCode);
+            }
+        } else if (statusCallback) {
+            statusCallback(statusString(event.status), event.progress);
+        }
+        if (eventCallback) {
+            eventCallback(event, eventContext);
+        }
+    }
+}
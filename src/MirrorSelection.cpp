@@ -0,0 +1,161 @@
+// Firmware mirror selection for ESP32OtaMqtt
+// The manifest may list "mirrors" next to firmware_url. Hosts without history
+// are probed with a plain TCP connect (all at once, bounded by
+// mirrorProbeTimeout), then the download starts from the mirror with the
+// lowest estimated fetch time. A failed attempt moves to the next mirror and
+// resumes at the current offset with a Range request. Connect time, time to
+// first byte and throughput are recorded per host on every attempt.
+
+#include "ESP32OtaMqtt.h"
+
+static const char* MIRROR_STATS_NAMESPACE = "ota_mirrors";
+
+// ============================================================================
+// MANIFEST
+// ============================================================================
+
+// firmware_url first, then the listed mirrors; only HTTP(S) URLs take part
+void ESP32OtaMqtt::setMirrors(const OtaManifest& manifest) {
+    mirrors.clear();
+    mirrorsRanked = false;
+
+    const OtaJsonView* urls[OtaMirrorSet::MAX_MIRRORS];
+    urls[0] = &manifest.firmwareUrl;
+    size_t count = 1;
+    for (size_t i = 0; i < manifest.mirrorCount; i++) {
+        urls[count++] = &manifest.mirrors[i];
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        bool secure = false;
+        OtaHostString host;
+        OtaUrlString path;
+        int port = 0;
+        if (!parseUrl(urls[i]->data, secure, host, port, path) || urls[i]->length > OTA_MAX_URL_LENGTH) {
+            if (i == 0) return; // Mirrors only back up an HTTP(S) firmware_url
+            OTA_LOGW("Ignoring mirror: %s", urls[i]->data);
+            continue;
+        }
+        mirrors.add(urls[i]->data, host.c_str(), (uint16_t)port);
+    }
+
+    if (mirrors.count() > 1) {
+        OTA_LOGI("Firmware available from %u mirrors", (unsigned)mirrors.count());
+    }
+}
+
+// ============================================================================
+// PROBING AND RANKING
+// ============================================================================
+
+// Start a TCP connect to every mirror without history; false if none needs one
+bool ESP32OtaMqtt::startProbes() {
+    if (config.mirrorProbeTimeout == 0) return false;
+
+    size_t started = 0;
+    for (size_t i = 0; i < mirrors.count(); i++) {
+        if (mirrors.isMeasured(i)) continue;
+
+        probeClients[i] = OtaAsyncClient::create();
+        if (!probeClients[i]) break;
+        probeClients[i]->setTimeouts(config.dnsTimeout, config.mirrorProbeTimeout, 0);
+        // TCP only: a TLS handshake per mirror would cost more than it tells
+        if (!probeClients[i]->begin(mirrors.getHost(i), mirrors.getPort(i), false)) {
+            mirrors.recordFailure(i);
+            OtaAsyncClient::destroy(probeClients[i]);
+            probeClients[i] = nullptr;
+            continue;
+        }
+        started++;
+    }
+    if (started == 0) return false;
+
+    OTA_LOGI("Probing %u mirrors", (unsigned)started);
+    probeStartTime = millis();
+    downloadState = DownloadState::PROBING;
+    return true;
+}
+
+void ESP32OtaMqtt::processProbes() {
+    bool pending = false;
+    for (size_t i = 0; i < mirrors.count(); i++) {
+        OtaAsyncClient* probe = probeClients[i];
+        if (!probe) continue;
+
+        OtaAsyncClient::State state = probe->poll();
+        if (state == OtaAsyncClient::State::CONNECTED) {
+            mirrors.recordConnect(i, probe->getConnectMillis());
+        } else if (state == OtaAsyncClient::State::FAILED) {
+            mirrors.recordFailure(i);
+        } else {
+            pending = true;
+            continue;
+        }
+        OtaAsyncClient::destroy(probe);
+        probeClients[i] = nullptr;
+    }
+
+    if (pending && millis() - probeStartTime < config.mirrorProbeTimeout) {
+        return;
+    }
+
+    // Mirrors still connecting are at least as slow as the timeout
+    for (size_t i = 0; i < mirrors.count(); i++) {
+        if (probeClients[i]) {
+            mirrors.recordConnect(i, config.mirrorProbeTimeout);
+        }
+    }
+    stopProbes();
+
+    rankMirrors();
+    downloadUrl = mirrors.getUrl(mirrors.current());
+    redirectCount = 0;
+    if (!sendDownloadRequest()) {
+        downloadState = DownloadState::FAILED;
+    }
+}
+
+void ESP32OtaMqtt::stopProbes() {
+    for (size_t i = 0; i < OtaMirrorSet::MAX_MIRRORS; i++) {
+        OtaAsyncClient::destroy(probeClients[i]);
+        probeClients[i] = nullptr;
+    }
+}
+
+void ESP32OtaMqtt::rankMirrors() {
+    size_t expectedBytes = pendingImageSize;
+    mirrors.rank(expectedBytes);
+    mirrorsRanked = true;
+
+    int best = mirrors.current();
+    OTA_LOGI("Selected mirror %s (estimated %lu ms)",
+             mirrors.getUrl(best), mirrors.estimateMillis(best, expectedBytes));
+}
+
+// ============================================================================
+// MEASUREMENTS
+// ============================================================================
+
+// Throughput of the response body that just ended (complete or interrupted)
+void ESP32OtaMqtt::recordMirrorTransfer() {
+    if (!mirrorActive || downloadedBytes <= transferStartBytes) return;
+    mirrors.recordTransfer(mirrors.current(), downloadedBytes - transferStartBytes,
+                           millis() - downloadStartTime);
+}
+
+void ESP32OtaMqtt::loadMirrorStats() {
+    if (config.persistMirrorStats && mirrors.load(MIRROR_STATS_NAMESPACE)) {
+        OTA_LOGD("Loaded mirror stats");
+    }
+}
+
+void ESP32OtaMqtt::saveMirrorStats() {
+    if (config.persistMirrorStats && mirrors.count() > 1 && !mirrors.save(MIRROR_STATS_NAMESPACE)) {
+        OTA_LOGW("Failed to store mirror stats");
+    }
+}
+
+String ESP32OtaMqtt::getActiveMirror() const {
+    if (isTaskCaller()) return String(snapshot.activeMirror.c_str());
+    return mirrorActive ? mirrors.getUrl(mirrors.current()) : String();
+}
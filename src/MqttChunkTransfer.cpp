@@ -0,0 +1,199 @@
+// Firmware transfer over MQTT for ESP32OtaMqtt
+// A "mqtt://<topic>" firmware URL makes the device fetch the image from the
+// broker instead of over HTTP. The publisher sends numbered chunks on <topic>;
+// the device asks for chunks on <topic>/req with a JSON request naming the
+// next in-order chunk and the window it can accept, plus an explicit list of
+// missing chunks when it re-requests after a timeout. Chunks go through the
+// same hash and flash path as HTTP downloads.
+
+#include "ESP32OtaMqtt.h"
+
+static const size_t MIN_MQTT_CHUNK = 128;
+static const size_t MQTT_PUBLISH_OVERHEAD = 7;  // Fixed header (max 5) + topic length (2)
+
+// ============================================================================
+// TRANSFER LIFECYCLE
+// ============================================================================
+
+bool ESP32OtaMqtt::startMqttTransfer(const char* topic) {
+    if (mqttState != MqttConnState::CONNECTED) {
+        OTA_LOGW("MQTT not connected, cannot fetch firmware chunks");
+        return false;
+    }
+
+    // Room for the "/req" suffix of the request topic
+    if (!mqttChunkTopic.assign(topic) || mqttChunkTopic.length() + 4 > mqttChunkTopic.capacity()) {
+        reportError("MQTT firmware topic too long");
+        return false;
+    }
+    size_t chunkSize = negotiateChunkSize();
+    if (chunkSize == 0) {
+        reportError("Cannot grow MQTT buffer for firmware chunks");
+        return false;
+    }
+
+    size_t window = min((size_t)config.mqttChunkWindow, (size_t)OtaMqttTransfer::MAX_WINDOW); // By value: std::min binds a reference
+    if (!mqttTransfer.begin(chunkSize, window)) {
+        reportError(String("MQTT transfer init failed: ") + mqttTransfer.getError());
+        stopMqttTransfer();
+        return false;
+    }
+    if (!router->subscribe(mqttChunkTopic.c_str(), onChunkMessage, this)) {
+        reportError("Cannot route MQTT firmware topic");
+        stopMqttTransfer();
+        return false;
+    }
+
+    // Chunks carry no byte offsets usable for HTTP Range
+    rangesSupported = false;
+    totalBytes = 0;
+    downloadedBytes = 0;
+    mqttTimeouts = 0;
+
+    OTA_LOGI("MQTT transfer on %s: %u byte chunks, window %u",
+             mqttChunkTopic.c_str(), (unsigned)chunkSize, (unsigned)window);
+    sendChunkRequest(false);
+
+    downloadStartTime = millis();
+    downloadState = DownloadState::DOWNLOADING;
+    return true;
+}
+
+void ESP32OtaMqtt::stopMqttTransfer() {
+    if (mqttTransfer.isActive()) {
+        router->unsubscribe(mqttChunkTopic.c_str(), onChunkMessage, this); // Also at the broker
+    }
+    mqttTransfer.end();
+
+    // Give back the RAM taken for large chunks
+    if (mqttSavedBufferSize > 0 && router->getBufferSize() > mqttSavedBufferSize) {
+        router->setBufferSize(mqttSavedBufferSize);
+    }
+    mqttSavedBufferSize = 0;
+}
+
+// Largest chunk up to config.mqttChunkSize that the MQTT client's buffer can hold
+size_t ESP32OtaMqtt::negotiateChunkSize() {
+    size_t overhead = OtaMqttTransfer::HEADER_SIZE + mqttChunkTopic.length() + MQTT_PUBLISH_OVERHEAD;
+    uint16_t current = router->getBufferSize();
+    mqttSavedBufferSize = current;
+
+    for (size_t chunkSize = config.mqttChunkSize; chunkSize >= MIN_MQTT_CHUNK; chunkSize /= 2) {
+        size_t needed = chunkSize + overhead;
+        if (needed > 0xFFFF) continue;
+        if (needed <= current || router->setBufferSize((uint16_t)needed)) {
+            return chunkSize;
+        }
+    }
+    return 0;
+}
+
+// Ask for the window starting at the next in-order chunk; a selective request
+// lists the chunks in the window that have not arrived
+void ESP32OtaMqtt::sendChunkRequest(bool selective) {
+    // Worst case: 32 missing indexes of 10 digits each
+    OtaFixedString<OTA_MAX_VERSION_LENGTH + 96 + OtaMqttTransfer::MAX_WINDOW * 11> request;
+    request.appendf("{\"version\":\"%s\",\"chunk_size\":%u,\"next\":%u,\"window\":%u",
+                    pendingVersion.c_str(), (unsigned)mqttTransfer.getChunkSize(),
+                    (unsigned)mqttTransfer.getNextIndex(), (unsigned)mqttTransfer.getWindow());
+
+    if (selective) {
+        uint32_t missing[OtaMqttTransfer::MAX_WINDOW];
+        size_t count = mqttTransfer.collectMissing(missing, OtaMqttTransfer::MAX_WINDOW);
+        request.append(",\"missing\":[");
+        for (size_t i = 0; i < count; i++) {
+            request.appendf(i > 0 ? ",%u" : "%u", (unsigned)missing[i]);
+        }
+        request.append("]");
+    }
+    request.append("}");
+
+    OtaFixedString<OTA_MAX_TOPIC_LENGTH> requestTopic(mqttChunkTopic.c_str());
+    requestTopic.append("/req");
+    router->publish(requestTopic.c_str(), request.c_str());
+    mqttRequestedNext = mqttTransfer.getNextIndex();
+}
+
+// ============================================================================
+// CHUNK PROCESSING (runs in loop())
+// ============================================================================
+
+bool ESP32OtaMqtt::processMqttTransfer() {
+    if (mqttTransfer.hasError()) {
+        reportError(String("MQTT transfer error: ") + mqttTransfer.getError());
+        cleanupDownload();
+        return false;
+    }
+
+    // Feed every in-order chunk that has arrived, within the loop() budget
+    bool consumed = false;
+    size_t length = 0;
+    const uint8_t* chunk;
+    while ((chunk = mqttTransfer.peekReady(length)) != nullptr) {
+        if (consumed && loopBudget.nextSlice(length, true) < length) break;
+
+        unsigned long consumeStart = micros();
+        stageHashMicros = 0;
+        measureStages = loopBudget.isEnabled();
+        bool ok = consumeDownloadData(chunk, length);
+        measureStages = false;
+        if (!ok) {
+            reportWriteError(flashWriter.getError());
+            cleanupDownload();
+            return false;
+        }
+        unsigned long consumeMicros = micros() - consumeStart;
+        loopBudget.record(OtaLoopBudget::HASH, length, stageHashMicros);
+        loopBudget.record(OtaLoopBudget::WRITE, length, consumeMicros - min(consumeMicros, stageHashMicros));
+        loopBudget.addBytes(length);
+
+        mqttTransfer.releaseReady();
+        bandwidth.consume(length);
+        downloadedBytes += length;
+        consumed = true;
+    }
+
+    if (mqttTransfer.isComplete()) {
+        totalBytes = downloadedBytes;
+        OTA_LOGI("MQTT transfer complete: %u chunks, %u duplicates dropped",
+                 (unsigned)mqttTransfer.getTotalChunks(), (unsigned)mqttTransfer.getDuplicates());
+        return false; // Signal completion
+    }
+
+    if (consumed) {
+        mqttTimeouts = 0;
+        if (totalBytes == 0 && mqttTransfer.getTotalChunks() > 0) {
+            totalBytes = (size_t)mqttTransfer.getTotalChunks() * mqttTransfer.getChunkSize();
+        }
+        if (totalBytes > 0) {
+            int progress = (downloadedBytes * 100) / totalBytes;
+            updateStatus(OtaStatus::DOWNLOADING, progress);
+        }
+    }
+
+    // Slide the window once half of it has been consumed. Chunks arrive
+    // unasked-for within the window, so the rate limit holds back the request.
+    size_t slideAfter = max((size_t)1, mqttTransfer.getWindow() / 2);
+    if (mqttTransfer.getNextIndex() - mqttRequestedNext >= slideAfter) {
+        if (bandwidth.allowance(micros(), 1) > 0) {
+            sendChunkRequest(false);
+        } else {
+            mqttTransfer.touch(); // Waiting for credit, not for the publisher
+        }
+    }
+
+    // Nothing new for a while: ask again for exactly the missing chunks
+    if (millis() - mqttTransfer.getLastChunkTime() > config.mqttChunkTimeout) {
+        if (++mqttTimeouts > config.mqttChunkRetries) {
+            reportError("MQTT chunk transfer timed out");
+            cleanupDownload();
+            return false;
+        }
+        OTA_LOGW("No chunk since %lu ms, re-requesting from chunk %u",
+                 config.mqttChunkTimeout, (unsigned)mqttTransfer.getNextIndex());
+        sendChunkRequest(true);
+        mqttTransfer.touch();
+    }
+
+    return true; // Continue downloading
+}
@@ -3,6 +3,10 @@
 
 #include "ESP32OtaMqtt.h"
 
+static const unsigned long HEADER_TIMEOUT_MS = 5000;   // Status line + headers must arrive within this
+static const size_t HEADER_BYTES_PER_LOOP = 512;       // Header bytes parsed per loop() call
+static const int MAX_REDIRECTS = 5;
+
 // ============================================================================
 // YIELD MANAGEMENT
 // ============================================================================
@@ -12,7 +16,9 @@ void ESP32OtaMqtt::yieldIfNeeded() {
     if (now - lastYield >= config.yieldInterval) {
         lastYield = now;
         yield(); // Allow other tasks to run
-        delay(1); // Minimal delay to prevent watchdog timeout
+        if (!loopBudget.isEnabled()) {
+            delay(1); // Minimal delay to prevent watchdog timeout; budget mode leaves pacing to the sketch
+        }
     }
 }
 
@@ -23,39 +29,63 @@ void ESP32OtaMqtt::yieldIfNeeded() {
 void ESP32OtaMqtt::handleMqttConnection() {
     unsigned long now = millis();
 
+    // Shared connection: the application connects and runs the router, only follow its state
+    if (sharedConnection) {
+        bool connected = router->isConnected();
+        if (connected && mqttState != MqttConnState::CONNECTED && mqttTransfer.isActive()) {
+            sendChunkRequest(true); // Requests and chunks in flight were lost with the old session
+        }
+        mqttState = connected ? MqttConnState::CONNECTED : MqttConnState::DISCONNECTED;
+        return;
+    }
+
     switch (mqttState) {
         case MqttConnState::DISCONNECTED:
-            // Throttle reconnection attempts (every 5 seconds)
-            if (now - lastMqttAttempt >= 5000) {
-                lastMqttAttempt = now;
+            // Reconnect right away after a drop, then back off while attempts fail
+            if (mqttRetry.canAttempt(now)) {
                 mqttConnectStartTime = now;
                 mqttState = MqttConnState::CONNECTING;
-                OTA_LOG("Initiating MQTT connection...");
+                OTA_LOGI("Initiating MQTT connection...");
+                if (mqttEngine && !startMqttEngine()) {
+                    OTA_LOGW("MQTT connection failed, state: %d", mqttEngine->state());
+                    mqttState = MqttConnState::FAILED;
+                }
             }
             break;
 
         case MqttConnState::CONNECTING:
+            if (mqttEngine) {
+                // One bounded step per call until CONNACK; the engine enforces mqttConnectTimeout
+                if (mqttEngine->loop()) {
+                    onMqttConnected();
+                } else if (!mqttEngine->isConnecting()) {
+                    OTA_LOGW("MQTT connection failed, state: %d", mqttEngine->state());
+                    mqttState = MqttConnState::FAILED;
+                }
+                break;
+            }
             // Attempt connection with timeout
             if (now - mqttConnectStartTime < config.mqttConnectTimeout) {
                 if (attemptMqttConnect()) {
-                    mqttState = MqttConnState::CONNECTED;
-                    OTA_LOG("MQTT connected successfully");
+                    onMqttConnected();
                 } else {
                     // Connection failed, but don't immediately retry
                     mqttState = MqttConnState::FAILED;
                 }
             } else {
                 // Timeout reached
-                OTA_LOG("MQTT connection timeout");
+                OTA_LOGW("MQTT connection timeout");
                 mqttState = MqttConnState::FAILED;
             }
             break;
 
         case MqttConnState::CONNECTED:
             // Connection active, just maintain it
-            if (!mqttClient->connected()) {
-                OTA_LOG("MQTT connection lost");
+            if (!router->isConnected()) {
+                OTA_LOGW("MQTT connection lost");
                 mqttState = MqttConnState::DISCONNECTED;
+            } else if (mqttEngine) {
+                mqttEngine->loop();
             } else {
                 // Process MQTT messages (non-blocking)
                 mqttClient->loop();
@@ -63,18 +93,23 @@ void ESP32OtaMqtt::handleMqttConnection() {
             break;
 
         case MqttConnState::FAILED:
-            // Wait before retry
-            if (now - lastMqttAttempt >= 5000) {
-                mqttState = MqttConnState::DISCONNECTED;
-            }
+            OTA_LOGI("MQTT reconnect in %lu ms", mqttRetry.recordFailure(millis()));
+            mqttState = MqttConnState::DISCONNECTED;
             break;
     }
 
     yieldIfNeeded();
 }
 
+static void makeClientId(OtaFixedString<24>& clientId) {
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    clientId.appendf("OTA_%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
 bool ESP32OtaMqtt::attemptMqttConnect() {
-    String clientId = "OTA_" + WiFi.macAddress();
+    OtaFixedString<24> clientId;
+    makeClientId(clientId);
     bool connected = false;
 
     // PubSubClient connect() can block for 15 seconds by default
@@ -85,13 +120,34 @@ bool ESP32OtaMqtt::attemptMqttConnect() {
         connected = mqttClient->connect(clientId.c_str());
     }
 
-    if (connected) {
-        OTA_LOG("MQTT connected, subscribing to: " + updateTopic);
-        mqttClient->subscribe(updateTopic.c_str());
-        return true;
-    } else {
-        OTA_LOG("MQTT connection failed, state: " + String(mqttClient->state()));
-        return false;
+    if (!connected) {
+        OTA_LOGW("MQTT connection failed, state: %d", mqttClient->state());
+    }
+    return connected;
+}
+
+// Hands the current server, TLS and credential settings to the engine and
+// starts its connect; handleMqttConnection() drives it from there
+bool ESP32OtaMqtt::startMqttEngine() {
+    mqttEngine->setServer(mqttServer.c_str(), mqttPort, true);
+    mqttEngine->setTrustStore(&trustStore);
+    mqttEngine->setConnectTimeout(config.mqttConnectTimeout);
+
+    OtaFixedString<24> clientId;
+    makeClientId(clientId);
+    bool credentials = mqttUser.length() > 0 && mqttPassword.length() > 0;
+    return mqttEngine->connect(clientId.c_str(), credentials ? mqttUser.c_str() : nullptr,
+                               credentials ? mqttPassword.c_str() : nullptr);
+}
+
+void ESP32OtaMqtt::onMqttConnected() {
+    mqttRetry.recordSuccess();
+    mqttState = MqttConnState::CONNECTED;
+    OTA_LOGI("MQTT connected, subscribing to: %s", updateTopic.c_str());
+    router->resubscribe(); // Update topic, chunk topic and application filters
+    if (mqttTransfer.isActive()) {
+        // Requests and chunks in flight were lost with the old session
+        sendChunkRequest(true);
     }
 }
 
@@ -105,15 +161,39 @@ void ESP32OtaMqtt::handleDownload() {
             // Nothing to do
             break;
 
+        case DownloadState::PROBING:
+            // Connect probes of mirrors without history
+            processProbes();
+            break;
+
         case DownloadState::CONNECTING:
-            // Connection attempt is in progress (managed by startDownload)
+            // DNS, TCP connect and TLS handshake, one bounded step per call
+            processConnect();
+            eraseAheadWhileIdle();
+            break;
+
+        case DownloadState::RECEIVING_HEADERS:
+            processResponseHeaders();
+            eraseAheadWhileIdle();
             break;
 
         case DownloadState::DOWNLOADING:
             // Process chunk by chunk
-            if (!processDownloadChunk()) {
-                // Download failed or completed
-                if (downloadedBytes > 0) {
+            bool more;
+            if (mqttTransfer.isActive()) {
+                more = processMqttTransfer();
+            } else if (segments.isActive()) {
+                more = processSegmentedDownload();
+            } else {
+                more = processDownloadChunk();
+            }
+            if (!more) {
+                recordMirrorTransfer();
+                // Download failed, interrupted or completed
+                if (isDownloadInterrupted()) {
+                    suspendDownload();
+                    downloadState = DownloadState::FAILED;
+                } else if (downloadedBytes > 0) {
                     downloadState = DownloadState::VERIFYING;
                 } else {
                     downloadState = DownloadState::FAILED;
@@ -122,13 +202,27 @@ void ESP32OtaMqtt::handleDownload() {
             break;
 
         case DownloadState::VERIFYING:
+            if (isPipelineActive()) {
+                // Wait for the flash writer to drain the ring buffer
+                if (!isPipelineDrained()) break;
+                int writerError = pipelineError.load();
+                stopPipeline();
+                if (writerError != 0) {
+                    reportWriteError(writerError);
+                    cleanupDownload();
+                    downloadState = DownloadState::FAILED;
+                    break;
+                }
+            }
+
             // Finalize and verify
-            if (finalizeDownload(pendingChecksum)) {
+            if (finalizeDownload(pendingChecksum.c_str())) {
+                saveMirrorStats();
                 downloadState = DownloadState::COMPLETE;
-                OTA_LOG("Download completed successfully");
+                OTA_LOGI("Download completed successfully");
             } else {
                 downloadState = DownloadState::FAILED;
-                OTA_LOG("Download verification failed");
+                OTA_LOGE("Download verification failed");
             }
             break;
 
@@ -137,7 +231,8 @@ void ESP32OtaMqtt::handleDownload() {
             updateStatus(OtaStatus::INSTALLING);
             if (installFirmware()) {
                 updateStatus(OtaStatus::SUCCESS);
-                config.currentVersion = pendingVersion;
+                config.currentVersion = pendingVersion.c_str();
+                parseCurrentVersion();
             } else {
                 updateStatus(OtaStatus::ERROR);
                 if (config.enableRollback) {
@@ -146,21 +241,45 @@ void ESP32OtaMqtt::handleDownload() {
             }
             cleanupDownload();
             downloadState = DownloadState::IDLE;
+            downloadRetry.recordSuccess();
             break;
 
         case DownloadState::FAILED:
             // Handle failure
             retryCount++;
+            if (mirrorActive) {
+                mirrors.recordFailure(mirrors.current());
+            }
+            if (!requestHost.isEmpty() && hostBreaker.recordFailure(requestHost.c_str(), millis())) {
+                OTA_LOGW("Host %s keeps failing, no requests for %lu ms", requestHost.c_str(), config.hostCooldown);
+            }
             if (retryCount >= config.maxRetries) {
+                saveMirrorStats();
+                cleanupDownload();
+                flashWriter.abort();
                 updateStatus(OtaStatus::ERROR);
                 retryCount = 0;
             } else {
-                OTA_LOG("Retry " + String(retryCount) + "/" + String(config.maxRetries));
-                // Reset for retry
-                cleanupDownload();
+                scheduleRetry();
+                if (mirrorActive && mirrors.advance()) {
+                    // The partial image stays valid: mirrors serve the same bytes
+                    OTA_LOGI("Failing over to mirror %s", mirrors.getUrl(mirrors.current()));
+                }
+                if (resumeOffset > 0) {
+                    // Keep the partial image and hash state, continue with a Range request
+                    OTA_LOGI("Will resume at byte %u", (unsigned)resumeOffset);
+                } else {
+                    // Reset for a full restart
+                    if (deltaActive) {
+                        OTA_LOGW("Delta update failed, falling back to full image");
+                        pendingPatchUrl = "";
+                    }
+                    cleanupDownload();
+                    flashWriter.abort();
+                }
                 downloadState = DownloadState::IDLE;
                 updateStatus(OtaStatus::DOWNLOADING);
-                // Will restart download in next loop() when pendingUrl is still set
+                // loop() restarts the download once the backoff has passed
             }
             break;
     }
@@ -168,156 +287,511 @@ void ESP32OtaMqtt::handleDownload() {
     yieldIfNeeded();
 }
 
-bool ESP32OtaMqtt::startDownload(const String& url) {
-    OTA_LOG("Starting non-blocking download from: " + url);
+// Delay the next attempt; consecutive failures back off with jitter
+void ESP32OtaMqtt::scheduleRetry() {
+    unsigned long delayMs = downloadRetry.recordFailure(millis());
+    scheduledStart = downloadRetry.getNextAttempt();
+    startScheduled = true;
+    OTA_LOGW("Retry %d/%d in %lu ms", retryCount, config.maxRetries, delayMs);
+}
+
+// False while the host of the next attempt is blocked; the start is then
+// moved to another mirror or to the end of the host's cooldown
+bool ESP32OtaMqtt::downloadHostAvailable() {
+    const char* url = (pendingPatchUrl.isEmpty() ? pendingUrl : pendingPatchUrl).c_str();
+    if (strncmp(url, "mqtt://", 7) == 0) return true;
+
+    unsigned long now = millis();
+    OtaHostString host;
+    if (pendingPatchUrl.isEmpty() && mirrors.count() > 1 && mirrorsRanked) {
+        // Skip blocked mirrors; when all are blocked, wait for the one that opens first
+        for (size_t i = 0; i < mirrors.count(); i++) {
+            const char* mirrorHost = mirrors.getHost(mirrors.current());
+            if (hostBreaker.allow(mirrorHost, now)) return true;
+            if (host.isEmpty() || (long)(hostBreaker.getOpenUntil(mirrorHost) -
+                                         hostBreaker.getOpenUntil(host.c_str())) < 0) {
+                host = mirrorHost;
+            }
+            mirrors.advance();
+        }
+    } else {
+        bool secure;
+        int port;
+        OtaUrlString path;
+        if (!parseUrl(url, secure, host, port, path) || hostBreaker.allow(host.c_str(), now)) {
+            return true; // startDownload() reports a bad URL
+        }
+    }
+
+    scheduledStart = hostBreaker.getOpenUntil(host.c_str());
+    startScheduled = true;
+    OTA_LOGW("Host %s is blocked, download waits %lu ms", host.c_str(), scheduledStart - now);
+    return false;
+}
+
+void ESP32OtaMqtt::applyRetryConfig() {
+    downloadRetry.setDelays(config.retryBaseDelay, config.retryMaxDelay);
+    mqttRetry.setDelays(config.mqttReconnectBaseDelay, config.mqttReconnectMaxDelay);
+    hostBreaker.configure((uint8_t)constrain(config.hostFailureThreshold, 0, 255), config.hostCooldown);
+}
+
+bool ESP32OtaMqtt::startDownload(const char* url) {
+    OTA_LOGI("Starting non-blocking download from: %s", url);
+    if (!claimInstall()) {
+        reportError("Another updater is installing");
+        return false;
+    }
+    requestHost.clear(); // Set again by the HTTP request, so failures are charged to its host
+
+    bool resuming = resumeOffset > 0;
+    if (!resuming) {
+        if (retryCount == 0) {
+            resumeBytesSaved = 0;
+        }
+        deltaActive = !pendingPatchUrl.isEmpty();
+        if (!beginImage()) {
+            return false;
+        }
+    }
+
+    if (strncmp(url, "mqtt://", 7) == 0) {
+        if (!startMqttTransfer(url + 7)) {
+            cleanupDownload();
+            flashWriter.abort();
+            return false;
+        }
+        return true;
+    }
+
+    mirrorActive = pendingUrl == url && mirrors.count() > 1;
+    if (mirrorActive) {
+        if (!mirrorsRanked) {
+            if (startProbes()) {
+                return true; // processProbes() sends the request
+            }
+            rankMirrors();
+        }
+        downloadUrl = mirrors.getUrl(mirrors.current());
+    } else {
+        downloadUrl = url;
+    }
+    redirectCount = 0;
+    return sendDownloadRequest();
+}
 
-    // Prepare for OTA
-    if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
-        reportError("Cannot begin update", Update.getError());
+// Split "http[s]://host[:port][/path]"
+bool ESP32OtaMqtt::parseUrl(const char* url, bool& secure, OtaHostString& host, int& port, OtaUrlString& path) {
+    secure = strncmp(url, "https://", 8) == 0;
+    if (!secure && strncmp(url, "http://", 7) != 0) {
         return false;
     }
 
-    // Initialize SHA256 context
-    if (!sha256Initialized) {
-        mbedtls_sha256_init(&sha256_ctx);
-        mbedtls_sha256_starts(&sha256_ctx, 0);
-        sha256Initialized = true;
+    const char* hostStart = url + (secure ? 8 : 7);
+    const char* pathStart = strchr(hostStart, '/');
+    const char* hostEnd = pathStart ? pathStart : hostStart + strlen(hostStart);
+    const char* portStart = (const char*)memchr(hostStart, ':', hostEnd - hostStart);
+    port = secure ? 443 : 80;
+
+    if (portStart) {
+        port = atoi(portStart + 1);
+        hostEnd = portStart;
     }
+    host.assign(hostStart, hostEnd - hostStart);
+    path = pathStart ? pathStart : "/";
+
+    return !host.isEmpty() && !host.isTruncated() && !path.isTruncated() && port > 0;
+}
 
-    // Parse URL
-    bool isHTTPS = url.startsWith("https://");
-    bool isHTTP = url.startsWith("http://");
+// Reuse a kept-alive connection or start connecting for the GET of downloadUrl
+bool ESP32OtaMqtt::sendDownloadRequest() {
+    bool isHTTPS = false;
+    OtaHostString host;
+    OtaUrlString path;
+    int port = 0;
 
-    if (!isHTTP && !isHTTPS) {
+    if (!parseUrl(downloadUrl.c_str(), isHTTPS, host, port, path)) {
         reportError("Invalid URL protocol");
         cleanupDownload();
+        flashWriter.abort();
         return false;
     }
 
-    // Parse host, port, path
-    String host = "";
-    String path = "";
-    int port = isHTTPS ? 443 : 80;
+    OTA_LOGD("Protocol: %s", isHTTPS ? "HTTPS" : "HTTP");
+    OTA_LOGD("Host: %s:%d", host.c_str(), port);
+    OTA_LOGD("Path: %s", path.c_str());
 
-    int protocolEnd = url.indexOf("://");
-    if (protocolEnd != -1) {
-        int hostStart = protocolEnd + 3;
-        int portStart = url.indexOf(':', hostStart);
-        int pathStart = url.indexOf('/', hostStart);
+    bool reuse = downloadClient && downloadClientReusable && downloadClient->connected() &&
+                 connectedSecure == isHTTPS && connectedPort == port && connectedHost == host.c_str();
+    downloadClientReusable = false;
+    requestHost = host;
+    requestPath = path;
 
-        if (portStart != -1 && (pathStart == -1 || portStart < pathStart)) {
-            host = url.substring(hostStart, portStart);
-            if (pathStart != -1) {
-                port = url.substring(portStart + 1, pathStart).toInt();
-                path = url.substring(pathStart);
-            } else {
-                port = url.substring(portStart + 1).toInt();
-                path = "/";
-            }
-        } else if (pathStart != -1) {
-            host = url.substring(hostStart, pathStart);
-            path = url.substring(pathStart);
-        } else {
-            host = url.substring(hostStart);
-            path = "/";
+    if (reuse) {
+        OTA_LOGI("Reusing keep-alive connection");
+        writeDownloadRequest();
+        return true;
+    }
+
+    closeDownloadClient();
+    downloadClient = OtaAsyncClient::create();
+    if (!downloadClient) {
+        reportError("No client available for download");
+        cleanupDownload();
+        flashWriter.abort();
+        return false;
+    }
+    if (isHTTPS) {
+        downloadClient->setTrustStore(&trustStore);
+        if (!verifyDownloadServer()) {
+            downloadClient->setInsecure(); // The image is still checked against the manifest SHA256
         }
     }
+    downloadClient->setTimeouts(config.dnsTimeout, config.tcpConnectTimeout, config.tlsHandshakeTimeout);
+
+    // Only starts the connect; handleDownload() drives it in CONNECTING
+    OTA_LOGI("Connecting to server...");
+    downloadClient->begin(host.c_str(), port, isHTTPS);
+    connectedHost = host;
+    connectedPort = port;
+    connectedSecure = isHTTPS;
+    downloadStartTime = millis();
+    downloadState = DownloadState::CONNECTING;
+    return true;
+}
 
-    OTA_LOG("Protocol: " + String(isHTTPS ? "HTTPS" : "HTTP"));
-    OTA_LOG("Host: " + host + ":" + String(port));
-    OTA_LOG("Path: " + path);
+void ESP32OtaMqtt::processConnect() {
+    OtaAsyncClient::State state = downloadClient->poll();
 
-    // Create download client
-    if (isHTTP) {
-        downloadClient = new WiFiClient();
-    } else {
-        WiFiClientSecure* secureClient = new WiFiClientSecure();
-        secureClient->setInsecure(); // Use dedicated insecure client for download
-        downloadClient = secureClient;
+    if (downloadClient->getMaxStepMicros() > maxConnectStepMicros) {
+        maxConnectStepMicros = downloadClient->getMaxStepMicros();
     }
 
-    // Connect to server (this may block briefly, but unavoidable with WiFiClient)
-    OTA_LOG("Connecting to server...");
-    if (!downloadClient->connect(host.c_str(), port)) {
-        reportError("Connection failed");
-        cleanupDownload();
-        return false;
+    if (state == OtaAsyncClient::State::CONNECTED) {
+        OTA_LOGI("Connected in %lu ms (longest step %lu us)",
+                 downloadClient->getConnectMillis(), downloadClient->getMaxStepMicros());
+        if (mirrorActive) {
+            mirrors.recordConnect(mirrors.current(), downloadClient->getConnectMillis());
+        }
+        writeDownloadRequest();
+    } else if (state == OtaAsyncClient::State::FAILED) {
+        OTA_LOGW("Connection failed: %s (%d)", downloadClient->getError(), downloadClient->getErrorCode());
+        failResponse();
     }
+}
 
-    // Send HTTP request
-    downloadClient->println("GET " + path + " HTTP/1.1");
-    downloadClient->println("Host: " + host);
-    downloadClient->println("Connection: close");
-    downloadClient->println();
+void ESP32OtaMqtt::writeDownloadRequest() {
+    httpRequest.clear();
+    httpRequest.appendf("GET %s HTTP/1.1\r\nHost: %s\r\n", requestPath.c_str(), requestHost.c_str());
+    segmentRangeRequested = useSegments();
+    if (segmentRangeRequested) {
+        // First block only; the response tells whether the rest can be fetched in parallel
+        httpRequest.appendf("Range: bytes=%u-%u\r\n", (unsigned)resumeOffset,
+                        (unsigned)(resumeOffset + segmentBlockSize() - 1));
+    } else if (resumeOffset > 0) {
+        httpRequest.appendf("Range: bytes=%u-\r\n", (unsigned)resumeOffset);
+    }
+    if (config.acceptGzipEncoding) {
+        httpRequest.append("Accept-Encoding: gzip\r\n");
+    }
+    httpRequest.append(config.keepAliveTimeout > 0 ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
 
-    // Read headers (quickly, non-blocking)
-    unsigned long headerStart = millis();
-    totalBytes = 0;
+    // Headers are read only once the whole request is out; the first send
+    // usually takes all of it, in a single segment / TLS record
+    requestSent = 0;
+    httpParser.begin();
+    downloadStartTime = millis();
+    downloadState = DownloadState::RECEIVING_HEADERS;
+    sendPendingRequest();
+}
+
+// Sends what the socket takes of the rest of the httpRequest. false while some
+// of it is still waiting for room, or when the connection failed
+bool ESP32OtaMqtt::sendPendingRequest() {
+    while (requestSent < httpRequest.length()) {
+        int sent = downloadClient->send((const uint8_t*)httpRequest.c_str() + requestSent, httpRequest.length() - requestSent);
+        if (sent < 0) {
+            OTA_LOGW("Failed to send request");
+            failResponse();
+            return false;
+        }
+        if (sent == 0) return false; // Socket buffer full; continued from processResponseHeaders()
+        requestSent += sent;
+    }
+    return true;
+}
+
+// Feed response header bytes to the parser without blocking loop()
+void ESP32OtaMqtt::processResponseHeaders() {
+    if (millis() - downloadStartTime > HEADER_TIMEOUT_MS) {
+        OTA_LOGW("Timeout waiting for response headers");
+        failResponse();
+        return;
+    }
+    if (!sendPendingRequest()) return;
+
+    // Read byte by byte so no body bytes are pulled out of the socket here
+    size_t budget = HEADER_BYTES_PER_LOOP;
+    while (budget-- > 0 && !httpParser.headersComplete() && !httpParser.hasError()) {
+        int c = downloadClient->read();
+        if (c < 0) {
+            if (!downloadClient->connected()) {
+                OTA_LOGW("Connection closed while reading headers");
+                failResponse();
+            }
+            return;
+        }
+        uint8_t byteValue = (uint8_t)c;
+        httpParser.feedHeaders(&byteValue, 1);
+    }
+
+    if (httpParser.hasError()) {
+        reportError(String("HTTP response error: ") + httpParser.getError());
+        failResponse();
+        return;
+    }
+
+    if (httpParser.headersComplete()) {
+        handleResponseHeaders();
+    }
+}
 
-    while (downloadClient->connected() && millis() - headerStart < 5000) {
-        if (downloadClient->available()) {
-            String line = downloadClient->readStringUntil('\n');
-            line.trim();
+void ESP32OtaMqtt::handleResponseHeaders() {
+    int statusCode = httpParser.getStatusCode();
+    bool resuming = resumeOffset > 0;
+    OTA_LOGI("HTTP %d, Content-Length: %u%s", statusCode, (unsigned)httpParser.getContentLength(),
+             httpParser.isChunked() ? " (chunked)" : "");
+    if (mirrorActive) {
+        mirrors.recordFirstByte(mirrors.current(), millis() - downloadStartTime);
+    }
 
-            if (line.startsWith("Content-Length:")) {
-                totalBytes = line.substring(15).toInt();
-                OTA_LOG("Content-Length: " + String(totalBytes));
+    if (httpParser.isRedirect()) {
+        followRedirect();
+        return;
+    }
+
+    if ((resuming || segmentRangeRequested) && statusCode == 206) {
+        // Server honoured the range: it must start exactly where we stopped
+        size_t rangeTotal = httpParser.getContentRangeTotal();
+        if (!httpParser.hasContentRange() || httpParser.getContentRangeStart() != resumeOffset ||
+            (rangeTotal > 0 && resumeTotal > 0 && rangeTotal != resumeTotal) ||
+            (segmentRangeRequested && rangeTotal == 0)) {
+            reportError("Content-Range mismatch on resume", statusCode);
+            cleanupDownload();
+            flashWriter.abort();
+            downloadState = DownloadState::FAILED;
+            return;
+        }
+        totalBytes = rangeTotal > 0 ? rangeTotal : resumeOffset + httpParser.getContentLength();
+        downloadedBytes = resumeOffset;
+        if (resuming) {
+            resumeBytesSaved += resumeOffset;
+            OTA_LOGI("Resuming download at byte %u/%u", (unsigned)resumeOffset, (unsigned)totalBytes);
+        }
+    } else if (statusCode == 200) {
+        if (resuming) {
+            // Range not supported: the body is the full image, restart from byte 0
+            OTA_LOGW("Server ignored Range request, restarting from byte 0");
+            flashWriter.abort();
+            imageHash.end();
+            if (!beginImage()) {
+                cleanupDownload();
+                downloadState = DownloadState::FAILED;
+                return;
             }
+        }
+        totalBytes = httpParser.getContentLength();
+        downloadedBytes = 0;
 
-            if (line.length() == 0) {
-                break; // End of headers
+        // Transfer encoding selects gzip when the manifest did not ask for compression
+        if (httpParser.isGzipEncoded() && pendingCompression == OtaCompression::NONE) {
+            OTA_LOGD("Content-Encoding: gzip");
+            if (!startDecompressor(OtaCompression::GZIP)) {
+                cleanupDownload();
+                flashWriter.abort();
+                downloadState = DownloadState::FAILED;
+                return;
             }
         }
-        yield();
+    } else {
+        // Never flash an error page
+        reportError("Unexpected HTTP status", statusCode);
+        cleanupDownload();
+        flashWriter.abort();
+        downloadState = DownloadState::FAILED;
+        return;
+    }
+    hostBreaker.recordSuccess(requestHost.c_str());
+
+    // An uncompressed full image is exactly as large as the response says
+    if (downloadedBytes == 0 && pendingImageSize == 0 && !deltaActive && pendingCompression == OtaCompression::NONE &&
+        !httpParser.isGzipEncoded() && totalBytes > 0) {
+        flashWriter.setImageSize(totalBytes);
+    }
+
+    // On-the-fly encodings are not byte-stable across requests
+    rangesSupported = httpParser.acceptsRanges() && !httpParser.isGzipEncoded();
+    resumeOffset = 0;
+    resumeTotal = 0;
+
+    // More than the first block left: fetch the rest over parallel connections
+    if (segmentRangeRequested && statusCode == 206 && downloadedBytes + httpParser.getContentLength() < totalBytes) {
+        if (!startSegmentedDownload()) {
+            cleanupDownload();
+            flashWriter.abort();
+            downloadState = DownloadState::FAILED;
+            return;
+        }
     }
 
-    downloadedBytes = 0;
     downloadStartTime = millis();
+    transferStartBytes = downloadedBytes;
     downloadState = DownloadState::DOWNLOADING;
-    OTA_LOG("Starting chunked download...");
 
-    return true;
+    if (config.pipelinedDownload && !segments.isActive() && !startPipeline()) {
+        OTA_LOGW("Falling back to serial download");
+    }
+    OTA_LOGI("Starting chunked download...");
+}
+
+void ESP32OtaMqtt::followRedirect() {
+    if (++redirectCount > MAX_REDIRECTS) {
+        reportError("Too many redirects", httpParser.getStatusCode());
+        failResponse();
+        return;
+    }
+
+    const char* target = httpParser.getLocation();
+    OtaUrlString location;
+    if (strncmp(target, "http://", 7) != 0 && strncmp(target, "https://", 8) != 0) {
+        // Relative reference: resolve against the current URL
+        int hostStart = downloadUrl.indexOf(':') + 3;
+        int pathStart = downloadUrl.indexOf('/', hostStart);
+        if (target[0] == '/') {
+            location.assign(downloadUrl.c_str(), pathStart != -1 ? pathStart : downloadUrl.length());
+        } else if (pathStart != -1) {
+            location.assign(downloadUrl.c_str(), downloadUrl.lastIndexOf('/') + 1);
+        } else {
+            location.assign(downloadUrl.c_str());
+            location.append('/');
+        }
+    }
+    location.append(target);
+    if (location.isTruncated()) {
+        reportError("Redirect location too long", httpParser.getStatusCode());
+        failResponse();
+        return;
+    }
+
+    OTA_LOGI("Redirect %d to %s", httpParser.getStatusCode(), location.c_str());
+
+    // An empty redirect body leaves the connection usable for the next request
+    downloadClientReusable = httpParser.isBodyComplete() && httpParser.isKeepAlive();
+    downloadUrl = location;
+    if (!sendDownloadRequest()) {
+        downloadState = DownloadState::FAILED;
+    }
+}
+
+// Request or response failed before the body started
+void ESP32OtaMqtt::failResponse() {
+    if (resumeOffset > 0) {
+        closeDownloadClient(); // Keep partial image for the next attempt
+    } else {
+        cleanupDownload();
+        flashWriter.abort();
+    }
+    downloadState = DownloadState::FAILED;
 }
 
 bool ESP32OtaMqtt::processDownloadChunk() {
     // Check timeout
     if (millis() - downloadStartTime > config.downloadTimeout) {
-        reportError("Download timeout");
-        cleanupDownload();
+        if (isDownloadInterrupted()) {
+            OTA_LOGW("Download timeout, will resume");
+        } else {
+            reportError("Download timeout");
+            cleanupDownload();
+        }
         return false;
     }
 
-    // Check if data available
-    if (!downloadClient || !downloadClient->connected()) {
-        // Connection closed, download complete or failed
-        return false;
+    if (isPipelineActive()) {
+        return pumpPipeline();
     }
 
-    size_t available = downloadClient->available();
-    if (available == 0) {
-        // No data yet, check if still connected
-        yieldIfNeeded();
-        return true; // Continue waiting
+    if (!downloadClient) {
+        return false;
     }
 
-    // Read chunk (configurable size, default 512 bytes)
+    // Fixed mode reads config.chunkSize bytes per call (in buffer-sized
+    // slices); budget mode keeps reading while the next slice fits the budget
     uint8_t buffer[1024];
-    size_t bytesToRead = min(available, min(config.chunkSize, sizeof(buffer)));
-    size_t bytesRead = downloadClient->readBytes(buffer, bytesToRead);
+    size_t quota = loopBudget.isEnabled() ? SIZE_MAX : config.chunkSize;
+    bool received = false;
+
+    while (quota > 0 && !httpParser.isBodyComplete()) {
+        size_t available = downloadClient->available();
+        if (available == 0) {
+            // No data yet: connection closed means complete (close-delimited) or interrupted
+            if (!received && !downloadClient->connected()) {
+                return false;
+            }
+            if (!received) {
+                eraseAheadWhileIdle();
+            }
+            break;
+        }
+
+        size_t slice = loopBudget.nextSlice(min(quota, sizeof(buffer)), true);
+        size_t allowed = bandwidth.allowance(micros(), slice);
+        if (allowed == 0 && slice > 0) {
+            // Over the rate limit: use the wait for flash erases
+            if (!received) {
+                eraseAheadWhileIdle();
+            }
+            break;
+        }
+        size_t bytesToRead = httpParser.maxBodyRead(min(available, allowed));
+        if (bytesToRead == 0) break;
 
-    if (bytesRead > 0) {
-        // Update SHA256
-        mbedtls_sha256_update(&sha256_ctx, buffer, bytesRead);
+        unsigned long recvStart = micros();
+        int bytesRead = downloadClient->read(buffer, bytesToRead);
+        if (bytesRead <= 0) break;
+        quota -= min(quota, (size_t)bytesRead);
+        bandwidth.consume(bytesRead);
 
-        // Write to flash
-        if (Update.write(buffer, bytesRead) != bytesRead) {
-            reportError("Flash write failed", Update.getError());
+        // Strip chunked framing in place
+        size_t bodyLength = httpParser.decodeBody(buffer, bytesRead);
+        if (httpParser.hasError()) {
+            reportError(String("HTTP body error: ") + httpParser.getError());
             cleanupDownload();
             return false;
         }
 
-        downloadedBytes += bytesRead;
+        unsigned long consumeStart = micros();
+        stageHashMicros = 0;
+        measureStages = loopBudget.isEnabled();
+        bool consumed = bodyLength == 0 || consumeDownloadData(buffer, bodyLength);
+        measureStages = false;
+        if (!consumed) {
+            reportWriteError(flashWriter.getError());
+            cleanupDownload();
+            return false;
+        }
+        unsigned long consumeMicros = micros() - consumeStart;
+
+        loopBudget.record(OtaLoopBudget::RECV, bytesRead, consumeStart - recvStart);
+        if (bodyLength > 0) {
+            loopBudget.record(OtaLoopBudget::HASH, bodyLength, stageHashMicros);
+            loopBudget.record(OtaLoopBudget::WRITE, bodyLength, consumeMicros - min(consumeMicros, stageHashMicros));
+        }
+        loopBudget.addBytes(bytesRead);
+
+        downloadedBytes += bodyLength;
+        received = true;
+    }
 
+    if (received) {
         // Report progress
         if (totalBytes > 0) {
             int progress = (downloadedBytes * 100) / totalBytes;
@@ -329,68 +803,323 @@ bool ESP32OtaMqtt::processDownloadChunk() {
     }
 
     // Check if download complete
-    if (totalBytes > 0 && downloadedBytes >= totalBytes) {
+    if (httpParser.isBodyComplete()) {
+        downloadClientReusable = httpParser.isKeepAlive();
         return false; // Signal completion
     }
 
     return true; // Continue downloading
 }
 
-bool ESP32OtaMqtt::finalizeDownload(const String& expectedChecksum) {
-    OTA_LOG("Finalizing download: " + String(downloadedBytes) + " bytes");
+// Feed a slice of the download stream into the image. Called from loop() in
+// serial mode and from the flash writer task in pipelined mode.
+bool ESP32OtaMqtt::consumeDownloadData(const uint8_t* data, size_t length) {
+    if (hashDownloadStream) {
+        unsigned long hashStart = measureStages ? micros() : 0;
+        imageHash.update(data, length);
+        if (measureStages) stageHashMicros += micros() - hashStart;
+    }
+
+    // Decompressor passes data straight through when the stream is not compressed
+    if (!decompressor.feed(data, length)) {
+        return false;
+    }
+    consumedBytes.fetch_add(length, std::memory_order_release);
+    return true;
+}
+
+// Decompressed stream: apply the delta patch or write the image directly
+bool ESP32OtaMqtt::writeDecompressedData(void* context, const uint8_t* data, size_t length) {
+    ESP32OtaMqtt* self = static_cast<ESP32OtaMqtt*>(context);
+    if (self->deltaActive) {
+        return self->deltaPatcher.feed(data, length);
+    }
+    return self->writeImageData(data, length);
+}
+
+// Hash and flash a slice of the reconstructed firmware image
+bool ESP32OtaMqtt::writeImageData(const uint8_t* data, size_t length) {
+    if (!hashDownloadStream) {
+        unsigned long hashStart = measureStages ? micros() : 0;
+        imageHash.update(data, length);
+        if (measureStages) stageHashMicros += micros() - hashStart;
+    }
+    return flashWriter.write(data, length);
+}
+
+bool ESP32OtaMqtt::startDecompressor(OtaCompression compression) {
+    if (!decompressor.begin(compression, writeDecompressedData, this,
+                            pendingWindowBits, pendingLookaheadBits)) {
+        reportError(String("Decompressor init failed: ") + decompressor.getError());
+        return false;
+    }
+    if (compression != OtaCompression::NONE) {
+        OTA_LOGI("Decompression enabled, window %u bytes", (unsigned)decompressor.getMemoryUsage());
+    }
+    return true;
+}
+
+void ESP32OtaMqtt::reportWriteError(int errorCode) {
+    if (decompressor.hasError()) {
+        reportError(String("Decompression failed: ") + decompressor.getError());
+    } else if (deltaActive && deltaPatcher.hasError()) {
+        reportError(String("Delta patch failed: ") + deltaPatcher.getError());
+    } else {
+        reportError("Flash write failed", errorCode);
+    }
+}
+
+bool ESP32OtaMqtt::finalizeDownload(const char* expectedChecksum) {
+    OTA_LOGI("Finalizing download: %u bytes", (unsigned)downloadedBytes);
 
     if (downloadedBytes == 0) {
         reportError("No data received");
         cleanupDownload();
-        Update.abort();
+        flashWriter.abort();
+        return false;
+    }
+
+    if (!decompressor.isComplete()) {
+        reportError("Incomplete compressed stream");
+        cleanupDownload();
+        flashWriter.abort();
+        return false;
+    }
+
+    if (deltaActive && !deltaPatcher.isComplete()) {
+        reportError("Incomplete delta patch");
+        cleanupDownload();
+        flashWriter.abort();
+        return false;
+    }
+
+    // heatshrink has no end marker: a stream cut on a symbol boundary only shows in its size
+    if (pendingCompression == OtaCompression::HEATSHRINK && !deltaActive && pendingImageSize > 0 &&
+        decompressor.getOutputBytes() != pendingImageSize) {
+        reportError("Incomplete compressed stream");
+        cleanupDownload();
+        flashWriter.abort();
         return false;
     }
 
     // Finalize SHA256
     unsigned char hash[32];
-    mbedtls_sha256_finish(&sha256_ctx, hash);
+    imageHash.finish(hash);
 
-    calculatedChecksum = "";
+    calculatedChecksum.clear();
     for (int i = 0; i < 32; i++) {
-        char hex[3];
-        sprintf(hex, "%02x", hash[i]);
-        calculatedChecksum += hex;
+        calculatedChecksum.appendf("%02x", hash[i]);
     }
 
-    OTA_LOG("Calculated checksum: " + calculatedChecksum);
+    OTA_LOGI("Calculated checksum: %s", calculatedChecksum.c_str());
+    if (decompressor.getOutputBytes() != downloadedBytes) {
+        OTA_LOGI("Received %u bytes for a %u byte stream",
+                 (unsigned)downloadedBytes, (unsigned)decompressor.getOutputBytes());
+    }
+    if (resumeBytesSaved > 0) {
+        OTA_LOGI("Resume saved %u bytes of transfer", (unsigned)resumeBytesSaved);
+    }
 
-    // End update
-    if (!Update.end(true)) {
-        reportError("Update end failed", Update.getError());
+    // Verify checksum before the image can become the boot partition
+    if (config.verifyChecksum && !verifyChecksum(expectedChecksum)) {
+        reportError("Checksum mismatch");
         cleanupDownload();
+        flashWriter.abort();
         return false;
     }
 
-    // Verify checksum
-    if (config.verifyChecksum && !verifyChecksum(expectedChecksum)) {
-        reportError("Checksum mismatch");
+    if (flashWriter.getBackend() == OtaFlashBackend::ESP_OTA) {
+        OTA_LOGD("Flash: %u sectors erased ahead, %u inline",
+                 (unsigned)flashWriter.getAheadErases(), (unsigned)flashWriter.getInlineErases());
+    }
+
+    // End update
+    if (!flashWriter.end()) {
+        reportError("Update end failed", flashWriter.getError());
         cleanupDownload();
-        Update.abort();
         return false;
     }
 
-    OTA_LOG("Download verified successfully");
+    OTA_LOGI("Download verified successfully");
     return true;
 }
 
-void ESP32OtaMqtt::cleanupDownload() {
+void ESP32OtaMqtt::closeDownloadClient() {
     if (downloadClient) {
         downloadClient->stop();
-        delete downloadClient;
+        OtaAsyncClient::destroy(downloadClient);
         downloadClient = nullptr;
     }
+    downloadClientReusable = false;
+}
 
-    if (sha256Initialized) {
-        mbedtls_sha256_free(&sha256_ctx);
-        sha256Initialized = false;
+// Keep the connection open for the next request when the server allows it
+void ESP32OtaMqtt::releaseDownloadClient() {
+    if (downloadClient && downloadClientReusable && config.keepAliveTimeout > 0 &&
+        downloadClient->connected()) {
+        keepAliveSince = millis();
+        return;
     }
+    closeDownloadClient();
+}
+
+void ESP32OtaMqtt::closeIdleDownloadClient() {
+    if (downloadState == DownloadState::IDLE && downloadClient &&
+        millis() - keepAliveSince >= config.keepAliveTimeout) {
+        OTA_LOGD("Closing idle keep-alive connection");
+        closeDownloadClient();
+    }
+}
+
+void ESP32OtaMqtt::cleanupDownload() {
+    stopPipeline();
+    segments.end();
+    stopProbes();
+    releaseDownloadClient();
+    stopMqttTransfer();
+    decompressor.end();
+
+    imageHash.end();
 
     downloadState = DownloadState::IDLE;
     downloadedBytes = 0;
+    consumedBytes.store(0);
     totalBytes = 0;
+    resumeOffset = 0;
+    resumeTotal = 0;
+}
+
+// Use a loop() that has nothing to receive to erase the next flash sector.
+// In pipelined mode the writer task owns the flash and erases when it idles.
+void ESP32OtaMqtt::eraseAheadWhileIdle() {
+    if (!isPipelineActive()) {
+        flashWriter.eraseAhead(1);
+    }
+}
+
+// ============================================================================
+// RESUMABLE DOWNLOAD (HTTP Range)
+// ============================================================================
+
+// Start a fresh image: open the OTA partition and reset the hash
+bool ESP32OtaMqtt::beginImage() {
+    OtaFlashBackend backend = config.directFlashWrites ? OtaFlashBackend::ESP_OTA : OtaFlashBackend::UPDATE;
+    if (!flashWriter.begin(backend)) {
+        reportError("Cannot begin update", flashWriter.getError());
+        return false;
+    }
+    if (flashWriter.getBackend() != backend) {
+        OTA_LOGW("Direct flash writes unavailable, using Update");
+    }
+    if (pendingImageSize > 0) {
+        flashWriter.setImageSize(pendingImageSize);
+    }
+
+    imageHash.begin(config.hashBackend, config.hashOffloadCore);
+    if (imageHash.getBackend() != config.hashBackend) {
+        OTA_LOGW("Hash offload task unavailable, hashing inline");
+    }
+    consumedBytes.store(0);
+    hashDownloadStream = pendingChecksumCompressed;
+
+    if (!startDecompressor(pendingCompression)) {
+        flashWriter.abort();
+        return false;
+    }
+
+    if (deltaActive) {
+        const esp_partition_t* running = esp_ota_get_running_partition();
+        if (!running) {
+            reportError("Running partition not found");
+            flashWriter.abort();
+            return false;
+        }
+        deltaPatcher.begin(readRunningImage, writePatchedImage, this, running->size);
+        OTA_LOGI("Applying delta patch against partition %s", running->label);
+    }
+    return true;
+}
+
+// The transfer stopped before Content-Length bytes arrived and the server
+// has not ruled out Range requests
+bool ESP32OtaMqtt::isDownloadInterrupted() const {
+    return rangesSupported && totalBytes > 0 &&
+           downloadedBytes > 0 && downloadedBytes < totalBytes;
+}
+
+// Drop the connection but keep the flash write offset and SHA256 state so the
+// next attempt can continue with "Range: bytes=N-"
+void ESP32OtaMqtt::suspendDownload() {
+    // Unwritten bytes still in the ring are discarded and fetched again
+    stopPipeline();
+    segments.end();
+    closeDownloadClient();
+
+    resumeOffset = consumedBytes.load();
+    resumeTotal = totalBytes;
+    downloadedBytes = resumeOffset;
+    OTA_LOGW("Download interrupted at %u/%u bytes", (unsigned)resumeOffset, (unsigned)totalBytes);
+}
+
+// Without a CA there is nothing to verify against, as before the trust store
+bool ESP32OtaMqtt::verifyDownloadServer() const {
+    return config.verifyDownloads && trustStore.hasCA() && !trustStore.isInsecure();
+}
+
+const OtaTrustStore& ESP32OtaMqtt::getTrustStore() const {
+    return trustStore;
+}
+
+unsigned long ESP32OtaMqtt::getHandshakeTimeSaved() const {
+    if (isTaskCaller()) return snapshot.handshakeTimeSaved;
+    return (unsigned long)(trustStore.getSavedMicros() / 1000);
+}
+
+size_t ESP32OtaMqtt::getResumeBytesSaved() const {
+    return isTaskCaller() ? snapshot.resumeBytesSaved : resumeBytesSaved;
 }
+
+unsigned long ESP32OtaMqtt::getMaxLoopTime() const {
+    return isTaskCaller() ? snapshot.maxLoopMicros : maxLoopMicros;
+}
+
+unsigned long ESP32OtaMqtt::getMaxConnectStepTime() const {
+    return isTaskCaller() ? snapshot.maxConnectStepMicros : maxConnectStepMicros;
+}
+
+void ESP32OtaMqtt::resetTimingStats() {
+    if (isTaskCaller()) {
+        TaskCommand command;
+        command.type = TaskCommand::RESET_TIMING_STATS;
+        postCommand(command);
+        return;
+    }
+    maxLoopMicros = 0;
+    maxConnectStepMicros = 0;
+    loopBudget.resetCounters();
+}
+
+size_t ESP32OtaMqtt::getBytesPerLoop() const {
+    if (isTaskCaller()) return snapshot.bytesPerLoop;
+    return loopBudget.getBytesPerIteration();
+}
+
+unsigned long ESP32OtaMqtt::getBudgetOverruns() const {
+    if (isTaskCaller()) return snapshot.budgetOverruns;
+    return loopBudget.getOverruns();
+}
+
+
+// ============================================================================
+// DELTA UPDATE
+// ============================================================================
+
+bool ESP32OtaMqtt::readRunningImage(void* context, size_t offset, uint8_t* buffer, size_t length) {
+    (void)context;
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    return running && esp_partition_read(running, offset, buffer, length) == ESP_OK;
+}
+
+bool ESP32OtaMqtt::writePatchedImage(void* context, const uint8_t* data, size_t length) {
+    return static_cast<ESP32OtaMqtt*>(context)->writeImageData(data, length);
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+// Slot allocator over a caller-provided buffer
+
+#include "OtaArena.h"
+#include <new>
+
+std::atomic<const void*> OtaArena::installer(nullptr);
+std::atomic<uint8_t*> OtaArena::base(nullptr);
+size_t OtaArena::capacity = 0;
+size_t OtaArena::used = 0;
+OtaArena::Block OtaArena::blocks[OtaArena::SLOT_COUNT];
+std::atomic<uint32_t> OtaArena::heapAllocations(0);
+std::atomic<uint32_t> OtaArena::failures(0);
+
+// Held for a few comparisons at a time; nothing allocates under it
+static portMUX_TYPE arenaLock = portMUX_INITIALIZER_UNLOCKED;
+
+void OtaArena::install(uint8_t* buffer, size_t size, const void* owner) {
+    size_t skip = buffer ? (ALIGNMENT - (uintptr_t)buffer % ALIGNMENT) % ALIGNMENT : 0;
+    if (!buffer || size <= skip) {
+        buffer = nullptr;
+        size = skip = 0;
+    }
+
+    portENTER_CRITICAL(&arenaLock);
+    base = buffer ? buffer + skip : nullptr;
+    capacity = size - skip;
+    used = 0;
+    for (size_t i = 0; i < SLOT_COUNT; i++) {
+        blocks[i].data = nullptr;
+        blocks[i].size = 0;
+    }
+    installer = buffer ? owner : nullptr;
+    portEXIT_CRITICAL(&arenaLock);
+}
+
+uint8_t* OtaArena::acquire(Slot slot, size_t size) {
+    if (slot != HEAP && isInstalled()) {
+        portENTER_CRITICAL(&arenaLock);
+        uint8_t* block = carve(slot, size);
+        bool heap = !base.load(); // Uninstalled meanwhile
+        portEXIT_CRITICAL(&arenaLock);
+        if (!heap) {
+            if (!block) failures++;
+            return block;
+        }
+    }
+
+    uint8_t* block = new (std::nothrow) uint8_t[size];
+    if (block) heapAllocations++;
+    return block;
+}
+
+// Under the lock
+uint8_t* OtaArena::carve(Slot slot, size_t size) {
+    uint8_t* start = base.load(std::memory_order_relaxed);
+    if (!start) return nullptr;
+
+    Block& block = blocks[slot];
+    if (block.data && block.size >= size) {
+        return block.data;
+    }
+
+    size_t aligned = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    size_t offset = used;
+    if (block.data && block.data + block.size == start + used) {
+        offset = block.data - start; // Last block carved: grow it in place
+    }
+    if (aligned > capacity - offset) {
+        return nullptr;
+    }
+
+    // A block that was too small stays unused until the next install()
+    block.data = start + offset;
+    block.size = aligned;
+    used = offset + aligned;
+    return block.data;
+}
+
+void OtaArena::release(Slot slot, uint8_t* block) {
+    (void)slot;
+    if (!block) return;
+    portENTER_CRITICAL(&arenaLock);
+    uint8_t* start = base.load(std::memory_order_relaxed);
+    bool owned = start && block >= start && block < start + capacity;
+    portEXIT_CRITICAL(&arenaLock);
+    if (owned) return; // Arena blocks stay with their slot
+    delete[] block;
+}
+
+size_t OtaArena::getSize() {
+    portENTER_CRITICAL(&arenaLock);
+    size_t size = capacity;
+    portEXIT_CRITICAL(&arenaLock);
+    return size;
+}
+
+size_t OtaArena::getUsed() {
+    portENTER_CRITICAL(&arenaLock);
+    size_t size = used;
+    portEXIT_CRITICAL(&arenaLock);
+    return size;
+}
+
+bool OtaArena::createTask(TaskFunction_t entry, const char* name, uint32_t stackSize, void* arg,
+                          UBaseType_t priority, TaskHandle_t* handle, BaseType_t core,
+                          Slot stackSlot, Slot taskSlot) {
+    if (!isInstalled()) {
+        if (xTaskCreatePinnedToCore(entry, name, stackSize, arg, priority, handle, core) != pdPASS) {
+            *handle = nullptr;
+            return false;
+        }
+        heapAllocations += 2; // Stack and TCB
+        return true;
+    }
+
+    // ESP-IDF stack sizes are in bytes
+    uint8_t* stack = acquire(stackSlot, stackSize);
+    uint8_t* task = acquire(taskSlot, sizeof(StaticTask_t));
+    if (!stack || !task) {
+        *handle = nullptr;
+        return false;
+    }
+    *handle = xTaskCreateStaticPinnedToCore(entry, name, stackSize, arg, priority,
+                                            reinterpret_cast<StackType_t*>(stack),
+                                            reinterpret_cast<StaticTask_t*>(task), core);
+    return *handle != nullptr;
+}
@@ -0,0 +1,680 @@
+// Non-blocking DNS/TCP/TLS client used for the download connection
+
+#include "OtaAsyncClient.h"
+#include "OtaArena.h"
+#include <atomic>
+#include <new>
+#include <lwip/sockets.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+#include <mbedtls/version.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/net_sockets.h>
+
+struct OtaTlsContext {
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_entropy_context entropy;
+    mbedtls_x509_crt ca;
+    mbedtls_x509_crt ownCert;
+    mbedtls_pk_context ownKey;
+    int fd;
+};
+
+// ============================================================================
+// POOL
+// ============================================================================
+
+static constexpr size_t alignedSize(size_t size) {
+    return (size + OtaArena::ALIGNMENT - 1) & ~(OtaArena::ALIGNMENT - 1);
+}
+
+// Client object followed by the space for its TLS context
+static const size_t POOL_ENTRY_SIZE = alignedSize(sizeof(OtaAsyncClient)) + alignedSize(sizeof(OtaTlsContext));
+static std::atomic<uint32_t> poolInUse(0); // Bit per entry, claimed with fetch_or so two tasks never share one
+
+// ============================================================================
+// DNS
+// ============================================================================
+
+// lwIP answers from the tcpip thread through a callback, possibly after the
+// requesting client has timed out or been destroyed. Results therefore land in
+// a static slot tagged with a generation number instead of in the client, and
+// answers for an abandoned generation are dropped.
+static std::atomic<uint32_t> dnsSlotGeneration(0); // 0 = slot free
+static std::atomic<bool> dnsSlotDone(false);
+static std::atomic<uint32_t> dnsSlotAddress(0);     // 0 = lookup failed
+static uint32_t dnsLastGeneration = 0;
+
+static void dnsFound(const char* name, const ip_addr_t* ip, void* arg) {
+    (void)name;
+    uint32_t generation = (uint32_t)(uintptr_t)arg;
+    if (dnsSlotGeneration.load() != generation) return;
+
+    uint32_t address = 0;
+    if (ip && IP_IS_V4(ip)) {
+        address = ip4_addr_get_u32(ip_2_ip4(ip));
+    }
+    dnsSlotAddress.store(address);
+    dnsSlotDone.store(true);
+}
+
+static void releaseDnsSlot(uint32_t generation) {
+    uint32_t expected = generation;
+    dnsSlotGeneration.compare_exchange_strong(expected, 0);
+}
+
+// ============================================================================
+// TLS BIO (non-blocking socket)
+// ============================================================================
+
+static int tlsSend(void* ctx, const unsigned char* buf, size_t len) {
+    int fd = *(int*)ctx;
+    int sent = lwip_send(fd, buf, len, MSG_DONTWAIT);
+    if (sent >= 0) return sent;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return MBEDTLS_ERR_SSL_WANT_WRITE;
+    return MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+static int tlsRecv(void* ctx, unsigned char* buf, size_t len) {
+    int fd = *(int*)ctx;
+    int received = lwip_recv(fd, buf, len, MSG_DONTWAIT);
+    if (received > 0) return received;
+    if (received == 0) return MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return MBEDTLS_ERR_SSL_WANT_READ;
+    return MBEDTLS_ERR_NET_RECV_FAILED;
+}
+
+static bool tlsHandshakeOver(const mbedtls_ssl_context* ssl) {
+#if MBEDTLS_VERSION_NUMBER >= 0x03020000
+    return mbedtls_ssl_is_handshake_over((mbedtls_ssl_context*)ssl) != 0;
+#else
+    return ssl->state == MBEDTLS_SSL_HANDSHAKE_OVER;
+#endif
+}
+
+// ============================================================================
+// LIFECYCLE
+// ============================================================================
+
+OtaAsyncClient::OtaAsyncClient()
+    : state(State::IDLE), error(nullptr), errorCode(0),
+      port(0), secure(false), insecure(false), caCert(nullptr), clientCert(nullptr), clientKey(nullptr),
+      trustStore(nullptr), dnsTimeout(5000), tcpTimeout(5000), tlsTimeout(10000),
+      stepStart(0), connectStart(0), connectMillis(0), maxStepMicros(0),
+      tlsStartMicros(0), sessionOffered(false), resumed(false),
+      address(0), dnsGeneration(0), fd(-1), peerClosed(false), peekByte(-1),
+      tls(nullptr), tlsStorage(nullptr), poolIndex(-1) {
+    host[0] = '\0';
+}
+
+OtaAsyncClient* OtaAsyncClient::create() {
+    if (!OtaArena::isInstalled()) {
+        uint8_t* block = OtaArena::acquire(OtaArena::HEAP, sizeof(OtaAsyncClient));
+        return block ? new (block) OtaAsyncClient() : nullptr;
+    }
+
+    uint8_t* pool = OtaArena::acquire(OtaArena::CLIENTS, POOL_SIZE * POOL_ENTRY_SIZE);
+    if (!pool) return nullptr;
+    for (size_t i = 0; i < POOL_SIZE; i++) {
+        uint32_t bit = 1u << i;
+        if (poolInUse.fetch_or(bit) & bit) continue;
+        uint8_t* entry = pool + i * POOL_ENTRY_SIZE;
+        OtaAsyncClient* client = new (entry) OtaAsyncClient();
+        client->tlsStorage = entry + alignedSize(sizeof(OtaAsyncClient));
+        client->poolIndex = (int)i;
+        return client;
+    }
+    return nullptr;
+}
+
+void OtaAsyncClient::destroy(OtaAsyncClient* client) {
+    if (!client) return;
+    int index = client->poolIndex;
+    client->~OtaAsyncClient();
+    if (index >= 0) {
+        poolInUse.fetch_and(~(1u << index));
+    } else {
+        OtaArena::release(OtaArena::HEAP, reinterpret_cast<uint8_t*>(client));
+    }
+}
+
+OtaAsyncClient::~OtaAsyncClient() {
+    stop();
+}
+
+void OtaAsyncClient::setInsecure() {
+    insecure = true;
+    caCert = nullptr;
+}
+
+void OtaAsyncClient::setCACert(const char* pem) {
+    caCert = pem;
+    insecure = false;
+}
+
+void OtaAsyncClient::setCertificate(const char* certPem, const char* keyPem) {
+    clientCert = certPem;
+    clientKey = keyPem;
+}
+
+void OtaAsyncClient::setTimeouts(unsigned long dnsMs, unsigned long tcpMs, unsigned long tlsMs) {
+    dnsTimeout = dnsMs;
+    tcpTimeout = tcpMs;
+    tlsTimeout = tlsMs;
+}
+
+bool OtaAsyncClient::begin(const char* host, uint16_t port, bool secure) {
+    stop();
+
+    size_t hostLength = strlen(host);
+    if (hostLength == 0 || hostLength >= HOST_SIZE) {
+        fail("Invalid host name");
+        return false;
+    }
+    memcpy(this->host, host, hostLength + 1);
+    this->port = port;
+    this->secure = secure;
+
+    error = nullptr;
+    errorCode = 0;
+    maxStepMicros = 0;
+    connectMillis = 0;
+    connectStart = millis();
+
+    return startDns();
+}
+
+// Advance the connect phase by at most one bounded step
+OtaAsyncClient::State OtaAsyncClient::poll() {
+    unsigned long start = micros();
+
+    switch (state) {
+        case State::RESOLVING:
+            checkDns();
+            break;
+        case State::CONNECTING:
+            checkTcp();
+            break;
+        case State::HANDSHAKING:
+            stepTls();
+            break;
+        default:
+            return state;
+    }
+
+    unsigned long elapsed = micros() - start;
+    if (elapsed > maxStepMicros) maxStepMicros = elapsed;
+    return state;
+}
+
+void OtaAsyncClient::stop() {
+    releaseTls();
+    if (fd >= 0) {
+        lwip_close(fd);
+        fd = -1;
+    }
+    if (dnsGeneration != 0) {
+        releaseDnsSlot(dnsGeneration);
+        dnsGeneration = 0;
+    }
+    peerClosed = false;
+    peekByte = -1;
+    if (state != State::FAILED) state = State::IDLE;
+}
+
+void OtaAsyncClient::setState(State next) {
+    state = next;
+    stepStart = millis();
+    if (next == State::CONNECTED) {
+        connectMillis = millis() - connectStart;
+    }
+}
+
+void OtaAsyncClient::fail(const char* message, int code) {
+    releaseTls();
+    if (fd >= 0) {
+        lwip_close(fd);
+        fd = -1;
+    }
+    if (dnsGeneration != 0) {
+        releaseDnsSlot(dnsGeneration);
+        dnsGeneration = 0;
+    }
+    error = message;
+    errorCode = code;
+    state = State::FAILED;
+}
+
+// ============================================================================
+// CONNECT STEPS
+// ============================================================================
+
+bool OtaAsyncClient::startDns() {
+    setState(State::RESOLVING);
+
+    // Literal IPv4 addresses skip the resolver
+    struct in_addr literal;
+    if (lwip_inet_pton(AF_INET, host, &literal) == 1) {
+        address = literal.s_addr;
+        return startTcp();
+    }
+
+    // The slot is shared; if another client holds it, checkDns() retries
+    checkDns();
+    return state != State::FAILED;
+}
+
+void OtaAsyncClient::checkDns() {
+    if (dnsGeneration == 0) {
+        uint32_t generation = ++dnsLastGeneration;
+        if (generation == 0) generation = ++dnsLastGeneration;
+
+        uint32_t expected = 0;
+        if (dnsSlotGeneration.compare_exchange_strong(expected, generation)) {
+            dnsGeneration = generation;
+            dnsSlotDone.store(false);
+            dnsSlotAddress.store(0);
+
+            ip_addr_t resolved;
+            LOCK_TCPIP_CORE();
+            err_t err = dns_gethostbyname(host, &resolved, dnsFound, (void*)(uintptr_t)generation);
+            UNLOCK_TCPIP_CORE();
+
+            if (err == ERR_OK) {
+                // Answered from the lwIP cache
+                releaseDnsSlot(generation);
+                dnsGeneration = 0;
+                if (!IP_IS_V4(&resolved)) {
+                    fail("DNS returned no IPv4 address");
+                    return;
+                }
+                address = ip4_addr_get_u32(ip_2_ip4(&resolved));
+                startTcp();
+                return;
+            }
+            if (err != ERR_INPROGRESS) {
+                fail("DNS lookup failed", err);
+                return;
+            }
+        }
+    } else if (dnsSlotDone.load()) {
+        uint32_t resolved = dnsSlotAddress.load();
+        releaseDnsSlot(dnsGeneration);
+        dnsGeneration = 0;
+
+        if (resolved == 0) {
+            fail("DNS lookup failed");
+            return;
+        }
+        address = resolved;
+        startTcp();
+        return;
+    }
+
+    if (millis() - stepStart > dnsTimeout) {
+        fail("DNS timeout");
+    }
+}
+
+bool OtaAsyncClient::startTcp() {
+    fd = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        fail("Socket allocation failed", errno);
+        return false;
+    }
+
+    int flags = lwip_fcntl(fd, F_GETFL, 0);
+    lwip_fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    int noDelay = 1;
+    lwip_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    struct sockaddr_in remote;
+    memset(&remote, 0, sizeof(remote));
+    remote.sin_family = AF_INET;
+    remote.sin_port = htons(port);
+    remote.sin_addr.s_addr = address;
+
+    setState(State::CONNECTING);
+    int result = lwip_connect(fd, (struct sockaddr*)&remote, sizeof(remote));
+    if (result == 0) {
+        return secure ? startTls() : (setState(State::CONNECTED), true);
+    }
+    if (errno != EINPROGRESS) {
+        fail("TCP connect failed", errno);
+        return false;
+    }
+    return true;
+}
+
+void OtaAsyncClient::checkTcp() {
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(fd, &writable);
+    struct timeval noWait = {0, 0};
+
+    int ready = lwip_select(fd + 1, nullptr, &writable, nullptr, &noWait);
+    if (ready < 0) {
+        fail("TCP connect failed", errno);
+        return;
+    }
+    if (ready == 0) {
+        if (millis() - stepStart > tcpTimeout) fail("TCP connect timeout");
+        return;
+    }
+
+    int socketError = 0;
+    socklen_t length = sizeof(socketError);
+    lwip_getsockopt(fd, SOL_SOCKET, SO_ERROR, &socketError, &length);
+    if (socketError != 0) {
+        fail("TCP connect failed", socketError);
+        return;
+    }
+
+    if (secure) {
+        startTls();
+    } else {
+        setState(State::CONNECTED);
+    }
+}
+
+bool OtaAsyncClient::startTls() {
+    bool verify = !insecure && !(trustStore && trustStore->isInsecure());
+    if (verify && !(trustStore ? trustStore->hasCA() : caCert != nullptr)) {
+        fail("No CA certificate configured");
+        return false;
+    }
+
+    uint8_t* storage = tlsStorage ? tlsStorage : OtaArena::acquire(OtaArena::HEAP, sizeof(OtaTlsContext));
+    tls = storage ? new (storage) OtaTlsContext : nullptr;
+    if (!tls) {
+        fail("Out of memory for TLS context");
+        return false;
+    }
+    tls->fd = fd;
+    tlsStartMicros = micros();
+    sessionOffered = false;
+    resumed = false;
+    mbedtls_ssl_init(&tls->ssl);
+    mbedtls_ssl_config_init(&tls->conf);
+    mbedtls_ctr_drbg_init(&tls->drbg);
+    mbedtls_entropy_init(&tls->entropy);
+    mbedtls_x509_crt_init(&tls->ca);
+    mbedtls_x509_crt_init(&tls->ownCert);
+    mbedtls_pk_init(&tls->ownKey);
+
+    static const char personalization[] = "ota_async_client";
+    int ret = mbedtls_ctr_drbg_seed(&tls->drbg, mbedtls_entropy_func, &tls->entropy,
+                                    (const unsigned char*)personalization, sizeof(personalization) - 1);
+    if (ret != 0) {
+        fail("TLS RNG seed failed", ret);
+        return false;
+    }
+
+    ret = mbedtls_ssl_config_defaults(&tls->conf, MBEDTLS_SSL_IS_CLIENT,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+        fail("TLS config failed", ret);
+        return false;
+    }
+
+    if (!verify) {
+        mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_NONE);
+    } else if (trustStore) {
+        // A chain that needs a CA from the bundle is checked once the handshake is over
+        mbedtls_ssl_conf_ca_chain(&tls->conf, trustStore->getCA(), nullptr);
+        mbedtls_ssl_conf_authmode(&tls->conf, trustStore->hasBundle() ? MBEDTLS_SSL_VERIFY_OPTIONAL
+                                                                      : MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else {
+        ret = mbedtls_x509_crt_parse(&tls->ca, (const unsigned char*)caCert, strlen(caCert) + 1);
+        if (ret != 0) {
+            fail("Invalid CA certificate", ret);
+            return false;
+        }
+        mbedtls_ssl_conf_ca_chain(&tls->conf, &tls->ca, nullptr);
+        mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    }
+    mbedtls_ssl_conf_rng(&tls->conf, mbedtls_ctr_drbg_random, &tls->drbg);
+
+    if (trustStore) {
+        if (trustStore->hasCertificate()) {
+            ret = mbedtls_ssl_conf_own_cert(&tls->conf, trustStore->getCertificate(), trustStore->getKey());
+            if (ret != 0) {
+                fail("Invalid client certificate or key", ret);
+                return false;
+            }
+        }
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        mbedtls_ssl_conf_session_tickets(&tls->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+    } else if (clientCert && clientKey) {
+        ret = mbedtls_x509_crt_parse(&tls->ownCert, (const unsigned char*)clientCert, strlen(clientCert) + 1);
+        if (ret == 0) {
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+            ret = mbedtls_pk_parse_key(&tls->ownKey, (const unsigned char*)clientKey, strlen(clientKey) + 1,
+                                       nullptr, 0, mbedtls_ctr_drbg_random, &tls->drbg);
+#else
+            ret = mbedtls_pk_parse_key(&tls->ownKey, (const unsigned char*)clientKey, strlen(clientKey) + 1,
+                                       nullptr, 0);
+#endif
+        }
+        if (ret == 0) ret = mbedtls_ssl_conf_own_cert(&tls->conf, &tls->ownCert, &tls->ownKey);
+        if (ret != 0) {
+            fail("Invalid client certificate or key", ret);
+            return false;
+        }
+    }
+
+    ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf);
+    if (ret == 0) ret = mbedtls_ssl_set_hostname(&tls->ssl, host);
+    if (ret != 0) {
+        fail("TLS setup failed", ret);
+        return false;
+    }
+    mbedtls_ssl_set_bio(&tls->ssl, &tls->fd, tlsSend, tlsRecv, nullptr);
+    if (trustStore) {
+        sessionOffered = trustStore->offerSession(host, port, verify, &tls->ssl);
+    }
+
+    setState(State::HANDSHAKING);
+    return true;
+}
+
+// One handshake message per poll keeps the longest step to a single
+// public-key operation instead of the whole handshake
+void OtaAsyncClient::stepTls() {
+    int ret = mbedtls_ssl_handshake_step(&tls->ssl);
+
+    if (ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        // A stale session may be what the server refused
+        if (trustStore && sessionOffered) trustStore->forgetSession(host, port);
+        fail("TLS handshake failed", ret);
+        return;
+    }
+    if (tlsHandshakeOver(&tls->ssl)) {
+        if (trustStore) {
+            bool verified = !insecure && !trustStore->isInsecure();
+            resumed = sessionOffered && trustStore->isResumed(host, port, verified, &tls->ssl);
+            // A resumed session was verified when it was made
+            if (verified && !resumed && !trustStore->verifyPeer(host, &tls->ssl)) {
+                fail("Server certificate not trusted", (int)mbedtls_ssl_get_verify_result(&tls->ssl));
+                return;
+            }
+            trustStore->completeHandshake(host, port, verified, &tls->ssl, resumed, micros() - tlsStartMicros);
+        }
+        setState(State::CONNECTED);
+        return;
+    }
+    if (millis() - stepStart > tlsTimeout) {
+        fail("TLS handshake timeout");
+    }
+}
+
+void OtaAsyncClient::releaseTls() {
+    if (!tls) return;
+
+    if (state == State::CONNECTED) {
+        mbedtls_ssl_close_notify(&tls->ssl); // Best effort, never waits
+    }
+    mbedtls_ssl_free(&tls->ssl);
+    mbedtls_ssl_config_free(&tls->conf);
+    mbedtls_ctr_drbg_free(&tls->drbg);
+    mbedtls_entropy_free(&tls->entropy);
+    mbedtls_x509_crt_free(&tls->ca);
+    mbedtls_x509_crt_free(&tls->ownCert);
+    mbedtls_pk_free(&tls->ownKey);
+    uint8_t* storage = reinterpret_cast<uint8_t*>(tls);
+    tls->~OtaTlsContext();
+    if (storage != tlsStorage) {
+        OtaArena::release(OtaArena::HEAP, storage);
+    }
+    tls = nullptr;
+}
+
+// ============================================================================
+// CLIENT INTERFACE
+// ============================================================================
+
+int OtaAsyncClient::connect(IPAddress ip, uint16_t port) {
+    return connect(ip.toString().c_str(), port);
+}
+
+// Blocking compatibility path; the download path uses begin()/poll() instead
+int OtaAsyncClient::connect(const char* host, uint16_t port) {
+    if (!begin(host, port, insecure || caCert != nullptr || trustStore != nullptr)) return 0;
+
+    while (state != State::CONNECTED && state != State::FAILED) {
+        poll();
+        delay(1);
+    }
+    return state == State::CONNECTED ? 1 : 0;
+}
+
+size_t OtaAsyncClient::write(uint8_t value) {
+    return write(&value, 1);
+}
+
+// Writes what the socket takes right now and returns that count; a short
+// count is continued by the caller later, never waited out here
+size_t OtaAsyncClient::write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        int result = send(buffer + written, size - written);
+        if (result <= 0) break;
+        written += result;
+    }
+    return written;
+}
+
+int OtaAsyncClient::send(const uint8_t* buffer, size_t size) {
+    if (state != State::CONNECTED || peerClosed) return -1;
+    if (size == 0) return 0;
+
+    int result;
+    if (tls) {
+        result = mbedtls_ssl_write(&tls->ssl, buffer, size);
+        if (result == MBEDTLS_ERR_SSL_WANT_WRITE || result == MBEDTLS_ERR_SSL_WANT_READ) return 0;
+    } else {
+        result = lwip_send(fd, buffer, size, MSG_DONTWAIT);
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    }
+    if (result < 0) {
+        peerClosed = true;
+        return -1;
+    }
+    return result;
+}
+
+// Returns -1 when no data is ready; end of stream is recorded in peerClosed
+int OtaAsyncClient::rawRead(uint8_t* buffer, size_t size) {
+    if (state != State::CONNECTED || peerClosed) return -1;
+
+    if (tls) {
+        int result = mbedtls_ssl_read(&tls->ssl, buffer, size);
+        if (result > 0) return result;
+        if (result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            peerClosed = true;
+        }
+        return -1;
+    }
+
+    int result = lwip_recv(fd, buffer, size, MSG_DONTWAIT);
+    if (result > 0) return result;
+    if (result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+        peerClosed = true;
+    }
+    return -1;
+}
+
+int OtaAsyncClient::available() {
+    if (state != State::CONNECTED) return 0;
+
+    int pending = peekByte >= 0 ? 1 : 0;
+    if (peerClosed) return pending;
+
+    if (tls) {
+        // A zero-length read pulls the next record into mbedtls without consuming it
+        int result = mbedtls_ssl_read(&tls->ssl, nullptr, 0);
+        if (result < 0 && result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            peerClosed = true;
+        }
+        return pending + (int)mbedtls_ssl_get_bytes_avail(&tls->ssl);
+    }
+
+    int count = 0;
+    if (lwip_ioctl(fd, FIONREAD, &count) < 0) count = 0;
+    if (count == 0) {
+        // Distinguish "nothing yet" from an orderly shutdown
+        uint8_t probe;
+        int result = lwip_recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (result == 0 || (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            peerClosed = true;
+        }
+    }
+    return pending + count;
+}
+
+int OtaAsyncClient::read() {
+    uint8_t value;
+    return read(&value, 1) == 1 ? value : -1;
+}
+
+int OtaAsyncClient::read(uint8_t* buffer, size_t size) {
+    if (size == 0) return 0;
+
+    size_t offset = 0;
+    if (peekByte >= 0) {
+        buffer[0] = (uint8_t)peekByte;
+        peekByte = -1;
+        offset = 1;
+        if (size == 1) return 1;
+    }
+
+    int result = rawRead(buffer + offset, size - offset);
+    if (result < 0) return offset > 0 ? (int)offset : -1;
+    return result + (int)offset;
+}
+
+int OtaAsyncClient::peek() {
+    if (peekByte < 0) {
+        uint8_t value;
+        if (rawRead(&value, 1) == 1) peekByte = value;
+    }
+    return peekByte;
+}
+
+void OtaAsyncClient::flush() {
+    // Writes are not buffered here
+}
+
+uint8_t OtaAsyncClient::connected() {
+    if (state != State::CONNECTED) return 0;
+    if (!peerClosed) return 1;
+    return available() > 0 ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+// CA certificate bundle with a subject-hash index
+
+#include "OtaCertBundle.h"
+#include "OtaArena.h"
+
+static const uint8_t MAGIC[4] = {'O', 'T', 'C', 'B'};
+static const uint8_t FORMAT_VERSION = 1;
+
+static uint32_t readLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+OtaCertBundle::OtaCertBundle() : data(nullptr), size(0), count(0) {}
+
+OtaCertBundle::~OtaCertBundle() {
+    close();
+}
+
+bool OtaCertBundle::attach(const uint8_t* data, size_t size) {
+    close();
+    this->data = data;
+    this->size = size;
+    if (!readHeader()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool OtaCertBundle::open(fs::FS& fs, const char* path) {
+    close();
+    file = fs.open(path, "r");
+    if (!file) return false;
+    size = file.size();
+    if (!readHeader()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void OtaCertBundle::close() {
+    if (file) file.close();
+    data = nullptr;
+    size = 0;
+    count = 0;
+}
+
+bool OtaCertBundle::readHeader() {
+    uint8_t header[HEADER_SIZE];
+    if (!readAt(0, header, sizeof(header))) return false;
+    if (memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || header[4] != FORMAT_VERSION) return false;
+    size_t entries = (size_t)header[6] | (size_t)header[7] << 8;
+    if (HEADER_SIZE + entries * ENTRY_SIZE > size) return false;
+    count = entries;
+    return true;
+}
+
+bool OtaCertBundle::readAt(size_t offset, uint8_t* buffer, size_t length) {
+    if (offset > size || length > size - offset) return false;
+    if (data) {
+        memcpy(buffer, data + offset, length);
+        return true;
+    }
+    return file && file.seek(offset) && file.read(buffer, length) == length;
+}
+
+bool OtaCertBundle::readEntry(size_t index, uint32_t& hash, uint32_t& offset, uint32_t& length) {
+    uint8_t entry[ENTRY_SIZE];
+    if (!readAt(HEADER_SIZE + index * ENTRY_SIZE, entry, sizeof(entry))) return false;
+    hash = readLe32(entry);
+    offset = readLe32(entry + 4);
+    length = readLe32(entry + 8);
+    return offset <= size && length <= size - offset;
+}
+
+uint32_t OtaCertBundle::hashName(const uint8_t* der, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= der[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+size_t OtaCertBundle::load(const uint8_t* subject, size_t subjectLength, mbedtls_x509_crt* chain) {
+    if (count == 0 || !subject) return 0;
+    uint32_t target = hashName(subject, subjectLength);
+
+    // First entry with hash >= target
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        uint32_t hash, offset, length;
+        if (!readEntry(mid, hash, offset, length)) return 0;
+        if (hash < target) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    // Usually one CA; several when names collide or a CA was re-issued
+    size_t added = 0;
+    for (size_t i = low; i < count; i++) {
+        uint32_t hash, offset, length;
+        if (!readEntry(i, hash, offset, length) || hash != target) break;
+        if (data) {
+            // In place: the bundle stays mapped for as long as it is attached
+            if (mbedtls_x509_crt_parse_der_nocopy(chain, data + offset, length) == 0) added++;
+            continue;
+        }
+        // Read one certificate at a time; mbedtls keeps its own copy
+        uint8_t* buffer = length <= MAX_CERT_SIZE ? OtaArena::acquire(OtaArena::HEAP, length) : nullptr;
+        if (!buffer) continue;
+        if (readAt(offset, buffer, length) && mbedtls_x509_crt_parse_der(chain, buffer, length) == 0) added++;
+        OtaArena::release(OtaArena::HEAP, buffer);
+    }
+    return added;
+}
@@ -0,0 +1,390 @@
+// Streaming decompression stage for compressed firmware downloads
+
+#include "OtaDecompressor.h"
+#include "OtaArena.h"
+
+#if __has_include(<rom/miniz.h>)
+#include <rom/miniz.h>
+#else
+#include <esp32/rom/miniz.h>
+#endif
+#if __has_include(<rom/crc.h>)
+#include <rom/crc.h>
+#else
+#include <esp32/rom/crc.h>
+#endif
+
+// gzip header flag bits (RFC 1952)
+static const uint8_t GZIP_FHCRC = 0x02;
+static const uint8_t GZIP_FEXTRA = 0x04;
+static const uint8_t GZIP_FNAME = 0x08;
+static const uint8_t GZIP_FCOMMENT = 0x10;
+
+OtaDecompressor::OtaDecompressor()
+    : type(OtaCompression::NONE), sink(nullptr), context(nullptr), error(nullptr),
+      outputBytes(0), memoryUsage(0), window(nullptr), windowMask(0), windowHead(0),
+      inflator(nullptr), gzState(GzipState::HEADER), gzFlags(0), gzFill(0), gzSkip(0),
+      gzCrc(0), hsState(HsState::TAG), hsWindowBits(0), hsLookaheadBits(0),
+      bitBuffer(0), bitCount(0), symbolBits(0), symbolNonZero(false), backrefOffset(0), backrefCount(0),
+      hsOutput(nullptr), hsOutputFill(0), input(nullptr), inputLength(0) {}
+
+OtaDecompressor::~OtaDecompressor() {
+    end();
+}
+
+bool OtaDecompressor::begin(OtaCompression type, OtaDataSinkFn sink, void* context,
+                            uint8_t windowBits, uint8_t lookaheadBits) {
+    end();
+    this->type = type;
+    this->sink = sink;
+    this->context = context;
+    error = nullptr;
+    outputBytes = 0;
+    windowHead = 0;
+
+    size_t windowSize = 0;
+    switch (type) {
+        case OtaCompression::NONE:
+            return true;
+
+        case OtaCompression::GZIP:
+            windowSize = TINFL_LZ_DICT_SIZE;
+            inflator = reinterpret_cast<tinfl_decompressor*>(
+                OtaArena::acquire(OtaArena::INFLATE_STATE, sizeof(tinfl_decompressor)));
+            if (!inflator) {
+                fail("Out of memory for inflater");
+                return false;
+            }
+            tinfl_init(inflator);
+            gzState = GzipState::HEADER;
+            gzFill = 0;
+            gzSkip = 0;
+            gzCrc = 0;
+            memoryUsage = sizeof(tinfl_decompressor);
+            break;
+
+        case OtaCompression::HEATSHRINK:
+            if (windowBits < 4 || windowBits > 15 || lookaheadBits < 3 || lookaheadBits >= windowBits) {
+                fail("Invalid heatshrink parameters");
+                return false;
+            }
+            windowSize = (size_t)1 << windowBits;
+            hsWindowBits = windowBits;
+            hsLookaheadBits = lookaheadBits;
+            hsState = HsState::TAG;
+            bitBuffer = 0;
+            bitCount = 0;
+            symbolBits = 0;
+            symbolNonZero = false;
+            hsOutput = OtaArena::acquire(OtaArena::INFLATE_OUTPUT, HS_OUTPUT_SIZE);
+            if (!hsOutput) {
+                fail("Out of memory for heatshrink output");
+                return false;
+            }
+            hsOutputFill = 0;
+            memoryUsage = HS_OUTPUT_SIZE;
+            break;
+    }
+
+    // heatshrink expects a zero-filled history for back-references before the start
+    window = OtaArena::acquire(OtaArena::INFLATE_WINDOW, windowSize);
+    if (!window) {
+        fail("Out of memory for decompression window");
+        end();
+        return false;
+    }
+    memset(window, 0, windowSize);
+    windowMask = windowSize - 1;
+    memoryUsage += windowSize;
+    return true;
+}
+
+void OtaDecompressor::end() {
+    OtaArena::release(OtaArena::INFLATE_STATE, reinterpret_cast<uint8_t*>(inflator));
+    inflator = nullptr;
+    OtaArena::release(OtaArena::INFLATE_WINDOW, window);
+    window = nullptr;
+    OtaArena::release(OtaArena::INFLATE_OUTPUT, hsOutput);
+    hsOutput = nullptr;
+    memoryUsage = 0;
+}
+
+bool OtaDecompressor::feed(const uint8_t* data, size_t length) {
+    if (error) return false;
+
+    switch (type) {
+        case OtaCompression::NONE:
+            return emit(data, length);
+
+        case OtaCompression::GZIP:
+            return feedGzip(data, length);
+
+        case OtaCompression::HEATSHRINK:
+            input = data;
+            inputLength = length;
+            return feedHeatshrink() && flushHeatshrink();
+    }
+    return false;
+}
+
+bool OtaDecompressor::isComplete() const {
+    if (error) return false;
+
+    switch (type) {
+        case OtaCompression::GZIP:
+            return gzState == GzipState::DONE;
+        case OtaCompression::HEATSHRINK:
+            // No end marker: the encoder pads the last symbol with zero bits to a
+            // whole byte, so anything else left over means the stream was cut
+            return hsState != HsState::BACKREF_COPY && symbolBits + bitCount < 8 && !symbolNonZero &&
+                   (bitBuffer & ((1u << bitCount) - 1)) == 0;
+        default:
+            return true;
+    }
+}
+
+// ============================================================================
+// GZIP
+// ============================================================================
+
+bool OtaDecompressor::feedGzip(const uint8_t* data, size_t length) {
+    while (length > 0 && !error) {
+        size_t used = 0;
+
+        if (gzState == GzipState::DEFLATE) {
+            used = inflate(data, length);
+        } else if (gzState == GzipState::TRAILER) {
+            used = min(length, (size_t)8 - gzFill);
+            memcpy(gzField + gzFill, data, used);
+            gzFill += used;
+            if (gzFill == 8) {
+                // CRC32 of the uncompressed data, then ISIZE: its length modulo 2^32
+                uint32_t crc = (uint32_t)gzField[0] | ((uint32_t)gzField[1] << 8) |
+                               ((uint32_t)gzField[2] << 16) | ((uint32_t)gzField[3] << 24);
+                uint32_t size = (uint32_t)gzField[4] | ((uint32_t)gzField[5] << 8) |
+                                ((uint32_t)gzField[6] << 16) | ((uint32_t)gzField[7] << 24);
+                if (crc != gzCrc) {
+                    fail("gzip CRC mismatch");
+                } else if (size != (uint32_t)outputBytes) {
+                    fail("gzip size mismatch");
+                }
+                gzState = GzipState::DONE;
+            }
+        } else if (gzState == GzipState::DONE) {
+            return true; // Ignore anything after the first member
+        } else {
+            used = parseGzipHeader(data, length);
+        }
+
+        data += used;
+        length -= used;
+    }
+    return !error;
+}
+
+size_t OtaDecompressor::parseGzipHeader(const uint8_t* data, size_t length) {
+    size_t used = 0;
+
+    switch (gzState) {
+        case GzipState::HEADER:
+            used = min(length, (size_t)10 - gzFill);
+            memcpy(gzField + gzFill, data, used);
+            gzFill += used;
+            if (gzFill < 10) break;
+
+            if (gzField[0] != 0x1f || gzField[1] != 0x8b || gzField[2] != 8) {
+                fail("Not a gzip stream");
+                break;
+            }
+            gzFlags = gzField[3];
+            gzFill = 0;
+            advanceGzipHeader();
+            break;
+
+        case GzipState::EXTRA_LENGTH:
+            used = min(length, (size_t)2 - gzFill);
+            memcpy(gzField + gzFill, data, used);
+            gzFill += used;
+            if (gzFill == 2) {
+                gzSkip = gzField[0] | (gzField[1] << 8);
+                gzState = GzipState::EXTRA;
+                if (gzSkip == 0) advanceGzipHeader();
+            }
+            break;
+
+        case GzipState::EXTRA:
+        case GzipState::HEADER_CRC:
+            used = min(length, gzSkip);
+            gzSkip -= used;
+            if (gzSkip == 0) advanceGzipHeader();
+            break;
+
+        case GzipState::NAME:
+        case GzipState::COMMENT:
+            // Zero-terminated strings
+            while (used < length) {
+                if (data[used++] == 0) {
+                    advanceGzipHeader();
+                    break;
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+    return used;
+}
+
+// Move to the next optional header field that is present
+void OtaDecompressor::advanceGzipHeader() {
+    gzFill = 0;
+    if (gzFlags & GZIP_FEXTRA) {
+        gzFlags &= ~GZIP_FEXTRA;
+        gzState = GzipState::EXTRA_LENGTH;
+    } else if (gzFlags & GZIP_FNAME) {
+        gzFlags &= ~GZIP_FNAME;
+        gzState = GzipState::NAME;
+    } else if (gzFlags & GZIP_FCOMMENT) {
+        gzFlags &= ~GZIP_FCOMMENT;
+        gzState = GzipState::COMMENT;
+    } else if (gzFlags & GZIP_FHCRC) {
+        gzFlags &= ~GZIP_FHCRC;
+        gzSkip = 2;
+        gzState = GzipState::HEADER_CRC;
+    } else {
+        gzState = GzipState::DEFLATE;
+    }
+}
+
+// Raw deflate into the 32 KB circular dictionary, emitting output as it appears
+size_t OtaDecompressor::inflate(const uint8_t* data, size_t length) {
+    size_t consumed = 0;
+
+    for (;;) {
+        size_t inBytes = length - consumed;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - windowHead;
+        tinfl_status status = tinfl_decompress(inflator, data + consumed, &inBytes,
+                                               window, window + windowHead, &outBytes,
+                                               TINFL_FLAG_HAS_MORE_INPUT);
+        consumed += inBytes;
+
+        if (outBytes > 0) {
+            if (!emit(window + windowHead, outBytes)) return consumed;
+            windowHead = (windowHead + outBytes) & windowMask;
+        }
+
+        if (status < TINFL_STATUS_DONE) {
+            fail("Corrupt deflate stream");
+            return consumed;
+        }
+        if (status == TINFL_STATUS_DONE) {
+            gzState = GzipState::TRAILER;
+            gzFill = 0;
+            return consumed;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && consumed == length) {
+            return consumed;
+        }
+        if (inBytes == 0 && outBytes == 0) {
+            return consumed; // No progress possible with this input
+        }
+    }
+}
+
+// ============================================================================
+// HEATSHRINK
+// ============================================================================
+
+bool OtaDecompressor::feedHeatshrink() {
+    uint16_t bits = 0;
+
+    for (;;) {
+        switch (hsState) {
+            case HsState::TAG:
+                if (!getBits(1, bits)) return true;
+                hsState = bits ? HsState::LITERAL : HsState::BACKREF_INDEX;
+                break;
+
+            case HsState::LITERAL:
+                if (!getBits(8, bits)) return true;
+                if (!putByte((uint8_t)bits)) return false;
+                endSymbol();
+                break;
+
+            case HsState::BACKREF_INDEX:
+                if (!getBits(hsWindowBits, bits)) return true;
+                backrefOffset = bits + 1;
+                hsState = HsState::BACKREF_COUNT;
+                break;
+
+            case HsState::BACKREF_COUNT:
+                if (!getBits(hsLookaheadBits, bits)) return true;
+                backrefCount = bits + 1;
+                hsState = HsState::BACKREF_COPY;
+                break;
+
+            case HsState::BACKREF_COPY:
+                while (backrefCount > 0) {
+                    if (!putByte(window[(windowHead - backrefOffset) & windowMask])) return false;
+                    backrefCount--;
+                }
+                endSymbol();
+                break;
+        }
+    }
+}
+
+// MSB-first bit reader that keeps partial state across feed() calls
+bool OtaDecompressor::getBits(uint8_t count, uint16_t& value) {
+    while (bitCount < count) {
+        if (inputLength == 0) return false;
+        bitBuffer = (bitBuffer << 8) | *input++;
+        inputLength--;
+        bitCount += 8;
+    }
+    bitCount -= count;
+    value = (bitBuffer >> bitCount) & ((1u << count) - 1);
+    symbolBits += count;
+    symbolNonZero |= value != 0;
+    return true;
+}
+
+void OtaDecompressor::endSymbol() {
+    hsState = HsState::TAG;
+    symbolBits = 0;
+    symbolNonZero = false;
+}
+
+bool OtaDecompressor::putByte(uint8_t value) {
+    window[windowHead & windowMask] = value;
+    windowHead++;
+    hsOutput[hsOutputFill++] = value;
+    if (hsOutputFill == HS_OUTPUT_SIZE) {
+        return flushHeatshrink();
+    }
+    return true;
+}
+
+bool OtaDecompressor::flushHeatshrink() {
+    if (hsOutputFill == 0) return true;
+    size_t count = hsOutputFill;
+    hsOutputFill = 0;
+    return emit(hsOutput, count);
+}
+
+bool OtaDecompressor::emit(const uint8_t* data, size_t length) {
+    if (!sink(context, data, length)) {
+        fail("Failed to write decompressed data");
+        return false;
+    }
+    if (type == OtaCompression::GZIP) {
+        gzCrc = crc32_le(gzCrc, data, length);
+    }
+    outputBytes += length;
+    return true;
+}
+
+void OtaDecompressor::fail(const char* message) {
+    error = message;
+}
@@ -0,0 +1,174 @@
+// Streaming delta patch applier used for delta (binary diff) updates
+
+#include "OtaDeltaPatcher.h"
+
+static const char PATCH_MAGIC[8] = {'O', 'T', 'A', 'D', 'I', 'F', 'F', '1'};
+
+static uint32_t readLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+OtaDeltaPatcher::OtaDeltaPatcher()
+    : readOld(nullptr), writeNew(nullptr), context(nullptr),
+      state(State::ERROR), error("Not started"), fieldFill(0),
+      oldSize(0), oldPos(0), newSize(0), outputBytes(0),
+      diffRemaining(0), extraRemaining(0), seek(0) {}
+
+void OtaDeltaPatcher::begin(OtaPatchReadFn readOld, OtaPatchWriteFn writeNew, void* context, size_t oldSize) {
+    this->readOld = readOld;
+    this->writeNew = writeNew;
+    this->context = context;
+    this->oldSize = oldSize;
+
+    state = State::HEADER;
+    error = nullptr;
+    fieldFill = 0;
+    oldPos = 0;
+    newSize = 0;
+    outputBytes = 0;
+    diffRemaining = 0;
+    extraRemaining = 0;
+    seek = 0;
+}
+
+// Consume a slice of patch data; returns false once the patch is invalid
+bool OtaDeltaPatcher::feed(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        size_t used = 0;
+
+        switch (state) {
+            case State::HEADER:
+                used = fillField(data, length);
+                if (fieldFill == FIELD_SIZE && !parseHeader()) return false;
+                break;
+
+            case State::CONTROL:
+                used = fillField(data, length);
+                if (fieldFill == FIELD_SIZE && !parseControl()) return false;
+                break;
+
+            case State::DIFF:
+                used = applyDiff(data, length);
+                break;
+
+            case State::EXTRA:
+                used = applyExtra(data, length);
+                break;
+
+            case State::DONE:
+                fail("Trailing data after patch end");
+                return false;
+
+            case State::ERROR:
+                return false;
+        }
+
+        if (state == State::ERROR) return false;
+        data += used;
+        length -= used;
+    }
+    return true;
+}
+
+size_t OtaDeltaPatcher::fillField(const uint8_t* data, size_t length) {
+    size_t take = min(length, FIELD_SIZE - fieldFill);
+    memcpy(field + fieldFill, data, take);
+    fieldFill += take;
+    return take;
+}
+
+bool OtaDeltaPatcher::parseHeader() {
+    fieldFill = 0;
+    if (memcmp(field, PATCH_MAGIC, sizeof(PATCH_MAGIC)) != 0) {
+        fail("Bad patch magic");
+        return false;
+    }
+
+    newSize = readLe32(field + 8);
+    if (newSize == 0) {
+        fail("Empty target image");
+        return false;
+    }
+
+    state = State::CONTROL;
+    return true;
+}
+
+bool OtaDeltaPatcher::parseControl() {
+    fieldFill = 0;
+    diffRemaining = readLe32(field);
+    extraRemaining = readLe32(field + 4);
+    seek = (int32_t)readLe32(field + 8);
+
+    if ((size_t)diffRemaining + extraRemaining > newSize - outputBytes) {
+        fail("Control block exceeds target size");
+        return false;
+    }
+    if ((size_t)oldPos + diffRemaining > oldSize) {
+        fail("Diff reads past end of old image");
+        return false;
+    }
+
+    state = diffRemaining > 0 ? State::DIFF : State::EXTRA;
+    if (diffRemaining == 0 && extraRemaining == 0) {
+        return finishBlock();
+    }
+    return true;
+}
+
+// new[i] = old[oldPos + i] + diff[i]
+size_t OtaDeltaPatcher::applyDiff(const uint8_t* data, size_t length) {
+    size_t step = min(min(length, (size_t)diffRemaining), (size_t)SCRATCH_SIZE);
+
+    if (!readOld(context, oldPos, scratch, step)) {
+        fail("Failed to read old image");
+        return 0;
+    }
+    for (size_t i = 0; i < step; i++) {
+        scratch[i] += data[i];
+    }
+    if (!emit(scratch, step)) return 0;
+
+    oldPos += step;
+    diffRemaining -= step;
+    if (diffRemaining == 0) {
+        state = State::EXTRA;
+        if (extraRemaining == 0) finishBlock();
+    }
+    return step;
+}
+
+size_t OtaDeltaPatcher::applyExtra(const uint8_t* data, size_t length) {
+    size_t step = min(length, (size_t)extraRemaining);
+    if (!emit(data, step)) return 0;
+
+    extraRemaining -= step;
+    if (extraRemaining == 0) finishBlock();
+    return step;
+}
+
+// Apply the seek and move on to the next control block (or finish)
+bool OtaDeltaPatcher::finishBlock() {
+    int64_t target = (int64_t)oldPos + seek;
+    if (target < 0 || target > (int64_t)oldSize) {
+        fail("Seek outside old image");
+        return false;
+    }
+    oldPos = (size_t)target;
+    state = (outputBytes == newSize) ? State::DONE : State::CONTROL;
+    return true;
+}
+
+bool OtaDeltaPatcher::emit(const uint8_t* data, size_t length) {
+    if (!writeNew(context, data, length)) {
+        fail("Failed to write reconstructed image");
+        return false;
+    }
+    outputBytes += length;
+    return true;
+}
+
+void OtaDeltaPatcher::fail(const char* message) {
+    state = State::ERROR;
+    error = message;
+}
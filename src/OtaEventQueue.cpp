@@ -0,0 +1,86 @@
+// Coalescing status/progress event queue
+
+#include "OtaEventQueue.h"
+
+OtaEventQueue::OtaEventQueue()
+    : head(0), count(0), intervalMs(1000), stepPercent(5), lastProgress(0),
+      lastProgressTime(0), dropped(0) {}
+
+void OtaEventQueue::setProgressRate(unsigned long intervalMs, int stepPercent) {
+    this->intervalMs = intervalMs;
+    this->stepPercent = stepPercent;
+}
+
+void OtaEventQueue::push(const OtaEvent& event, unsigned long now) {
+    if (event.type == OtaEventType::PROGRESS) {
+        if (event.progress == lastProgress) return;
+
+        bool due = event.progress >= 100 || event.progress - lastProgress >= stepPercent ||
+                   now - lastProgressTime >= intervalMs;
+        if (!due) return;
+        lastProgress = event.progress;
+        lastProgressTime = now;
+
+        // Not dispatched yet: the newer value replaces it
+        if (count > 0 && tail().type == OtaEventType::PROGRESS) {
+            tail() = event;
+            return;
+        }
+    } else {
+        lastProgress = event.progress;
+        lastProgressTime = now;
+    }
+
+    if (count == CAPACITY) {
+        dropped++;
+        if (!makeRoom(event)) return;
+    }
+    events[(head + count) % CAPACITY] = event;
+    count++;
+}
+
+// Full queue: a waiting progress event goes first, later events move up.
+// Without one, new progress is dropped; only a new transition finding
+// CAPACITY transitions waiting pushes out the oldest of them
+bool OtaEventQueue::makeRoom(const OtaEvent& event) {
+    for (size_t i = 0; i < count; i++) {
+        if (events[(head + i) % CAPACITY].type != OtaEventType::PROGRESS) continue;
+        for (size_t j = i; j + 1 < count; j++) {
+            events[(head + j) % CAPACITY] = events[(head + j + 1) % CAPACITY];
+        }
+        count--;
+        return true;
+    }
+    if (event.type == OtaEventType::PROGRESS) return false;
+
+    head = (head + 1) % CAPACITY;
+    count--;
+    return true;
+}
+
+bool OtaEventQueue::pop(OtaEvent& event) {
+    if (count == 0) return false;
+    event = events[head];
+    head = (head + 1) % CAPACITY;
+    count--;
+    return true;
+}
+
+void OtaEventQueue::clear() {
+    head = 0;
+    count = 0;
+    lastProgress = 0;
+}
+
+const char* OtaEventQueue::statusName(OtaStatus status) {
+    switch (status) {
+        case OtaStatus::IDLE: return "IDLE";
+        case OtaStatus::CHECKING: return "CHECKING";
+        case OtaStatus::DOWNLOADING: return "DOWNLOADING";
+        case OtaStatus::INSTALLING: return "INSTALLING";
+        case OtaStatus::SUCCESS: return "SUCCESS";
+        case OtaStatus::ERROR: return "ERROR";
+        case OtaStatus::ROLLBACK: return "ROLLBACK";
+    }
+    return "UNKNOWN";
+}
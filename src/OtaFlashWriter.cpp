@@ -0,0 +1,195 @@
+// Firmware image writer: Update class or sector-coalesced esp_partition_* backend
+
+#include "OtaFlashWriter.h"
+#include "OtaArena.h"
+#include <Update.h>
+
+// esp_partition_write() needs 16-byte blocks on an encrypted partition
+static const size_t WRITE_ALIGN = 16;
+
+OtaFlashWriter::OtaFlashWriter()
+    : backend(OtaFlashBackend::UPDATE), active(false), lastError(0),
+      partition(nullptr), sector(nullptr), sectorFill(0),
+      flushedBytes(0), erasedBytes(0), imageSize(0),
+      writtenBytes(0), aheadErases(0), inlineErases(0) {}
+
+OtaFlashWriter::~OtaFlashWriter() {
+    abort();
+}
+
+bool OtaFlashWriter::begin(OtaFlashBackend preferred) {
+    abort();
+    lastError = 0;
+    imageSize = 0;
+    writtenBytes = 0;
+    aheadErases = 0;
+    inlineErases = 0;
+
+    if (preferred == OtaFlashBackend::ESP_OTA && beginDirect()) {
+        backend = OtaFlashBackend::ESP_OTA;
+        active = true;
+        return true;
+    }
+
+    backend = OtaFlashBackend::UPDATE;
+    if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
+        lastError = Update.getError();
+        return false;
+    }
+    active = true;
+    return true;
+}
+
+// No esp_ota_begin(): its handle only accepts writes into areas it erased
+// itself, and erasing is ours to schedule. Nothing is erased here.
+bool OtaFlashWriter::beginDirect() {
+    partition = esp_ota_get_next_update_partition(nullptr);
+    if (!partition) return false;
+
+    sector = OtaArena::acquire(OtaArena::FLASH_SECTOR, SECTOR_SIZE);
+    if (!sector) {
+        partition = nullptr;
+        return false;
+    }
+
+    sectorFill = 0;
+    flushedBytes = 0;
+    erasedBytes = 0;
+    return true;
+}
+
+void OtaFlashWriter::setImageSize(size_t size) {
+    imageSize = size;
+}
+
+bool OtaFlashWriter::write(const uint8_t* data, size_t length) {
+    if (!active) return false;
+
+    if (backend == OtaFlashBackend::UPDATE) {
+        if (Update.write(const_cast<uint8_t*>(data), length) != length) {
+            lastError = Update.getError();
+            return false;
+        }
+        writtenBytes += length;
+        return true;
+    }
+
+    size_t remaining = length;
+    while (remaining > 0) {
+        size_t take = min(remaining, SECTOR_SIZE - sectorFill);
+        memcpy(sector + sectorFill, data, take);
+        sectorFill += take;
+        data += take;
+        remaining -= take;
+
+        if (sectorFill == SECTOR_SIZE && !flushSector(SECTOR_SIZE)) {
+            return false;
+        }
+    }
+    writtenBytes += length;
+    return true;
+}
+
+// Program the buffered sector at flushedBytes; only erases if erase-ahead fell behind
+bool OtaFlashWriter::flushSector(size_t length) {
+    if (flushedBytes + length > partition->size) {
+        lastError = ESP_ERR_INVALID_SIZE;
+        return false;
+    }
+
+    if (erasedBytes <= flushedBytes) {
+        if (!eraseSector(flushedBytes)) return false;
+        inlineErases++;
+    }
+
+    size_t padded = (length + WRITE_ALIGN - 1) & ~(WRITE_ALIGN - 1);
+    memset(sector + length, 0xFF, padded - length);
+
+    esp_err_t err = esp_partition_write(partition, flushedBytes, sector, padded);
+    if (err != ESP_OK) {
+        lastError = err;
+        return false;
+    }
+
+    flushedBytes += SECTOR_SIZE;
+    sectorFill = 0;
+    return true;
+}
+
+bool OtaFlashWriter::eraseSector(size_t offset) {
+    esp_err_t err = esp_partition_erase_range(partition, offset, SECTOR_SIZE);
+    if (err != ESP_OK) {
+        lastError = err;
+        return false;
+    }
+    erasedBytes = offset + SECTOR_SIZE;
+    return true;
+}
+
+// Erase up to maxSectors sectors past the write cursor. Errors are left for
+// the write path, which retries the erase inline and reports it.
+bool OtaFlashWriter::eraseAhead(size_t maxSectors) {
+    if (!active || backend != OtaFlashBackend::ESP_OTA) return false;
+
+    size_t limit = eraseLimit();
+    size_t erased = 0;
+    while (erased < maxSectors && erasedBytes < limit) {
+        if (!eraseSector(erasedBytes)) {
+            lastError = 0;
+            break;
+        }
+        erased++;
+        aheadErases++;
+    }
+    return erased > 0;
+}
+
+size_t OtaFlashWriter::eraseLimit() const {
+    size_t limit = imageSize > 0 ? (imageSize + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1)
+                                 : flushedBytes + ERASE_AHEAD_WINDOW;
+    return min(limit, (size_t)partition->size);
+}
+
+bool OtaFlashWriter::end() {
+    if (!active) return false;
+    active = false;
+
+    if (backend == OtaFlashBackend::UPDATE) {
+        if (!Update.end(true)) {
+            lastError = Update.getError();
+            return false;
+        }
+        return true;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (sectorFill > 0 && !flushSector(sectorFill)) {
+        err = lastError;
+    } else {
+        // Verifies the image (header, segments, SHA256 digest) before it selects it
+        err = esp_ota_set_boot_partition(partition);
+    }
+    releaseDirect();
+
+    lastError = err;
+    return err == ESP_OK;
+}
+
+void OtaFlashWriter::abort() {
+    if (active && backend == OtaFlashBackend::UPDATE) {
+        Update.abort();
+    }
+    active = false;
+    releaseDirect();
+}
+
+int OtaFlashWriter::getError() const {
+    return lastError;
+}
+
+void OtaFlashWriter::releaseDirect() {
+    OtaArena::release(OtaArena::FLASH_SECTOR, sector);
+    sector = nullptr;
+    sectorFill = 0;
+    partition = nullptr;
+}
@@ -0,0 +1,313 @@
+// Incremental HTTP/1.1 response parser for firmware downloads
+
+#include "OtaHttpParser.h"
+
+OtaHttpParser::OtaHttpParser() {
+    begin();
+}
+
+void OtaHttpParser::begin() {
+    state = State::STATUS_LINE;
+    error = nullptr;
+    headerBytes = 0;
+    resetResponse();
+}
+
+void OtaHttpParser::resetResponse() {
+    lineLength = 0;
+    lineTruncated = false;
+    statusCode = 0;
+    chunked = false;
+    keepAlive = false;
+    gzipEncoded = false;
+    rangesRefused = false;
+    contentLength = -1;
+    contentRangeValid = false;
+    contentRangeStart = 0;
+    contentRangeTotal = 0;
+    location[0] = '\0';
+    bodyBytes = 0;
+    chunkRemaining = 0;
+    chunkSizeDigits = false;
+}
+
+// ============================================================================
+// HEADERS
+// ============================================================================
+
+size_t OtaHttpParser::feedHeaders(const uint8_t* data, size_t length) {
+    size_t used = 0;
+
+    while (used < length && (state == State::STATUS_LINE || state == State::HEADER_LINE)) {
+        char c = (char)data[used++];
+
+        if (++headerBytes > MAX_HEADER_BYTES) {
+            fail("Response headers too large");
+            break;
+        }
+
+        if (c == '\n') {
+            // Strip the optional CR of CRLF
+            if (lineLength > 0 && line[lineLength - 1] == '\r') lineLength--;
+            line[lineLength] = '\0';
+            if (!processLine()) break;
+            lineLength = 0;
+            lineTruncated = false;
+        } else if (lineLength < LINE_SIZE - 1) {
+            line[lineLength++] = c;
+        } else {
+            lineTruncated = true; // Keep the prefix, drop the rest
+        }
+    }
+    return used;
+}
+
+bool OtaHttpParser::processLine() {
+    if (state == State::STATUS_LINE) {
+        return parseStatusLine();
+    }
+
+    if (lineLength == 0) {
+        finishHeaders();
+        return state != State::ERROR;
+    }
+    return parseHeaderLine();
+}
+
+// "HTTP/1.1 206 Partial Content"
+bool OtaHttpParser::parseStatusLine() {
+    if (lineLength < 12 || strncmp(line, "HTTP/1.", 7) != 0 || line[8] != ' ' ||
+        !isDigit(line[9]) || !isDigit(line[10]) || !isDigit(line[11])) {
+        fail("Malformed status line");
+        return false;
+    }
+
+    statusCode = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+    keepAlive = line[7] != '0'; // HTTP/1.1 defaults to persistent connections
+    state = State::HEADER_LINE;
+    return true;
+}
+
+bool OtaHttpParser::parseHeaderLine() {
+    const char* colon = (const char*)memchr(line, ':', lineLength);
+    if (!colon) {
+        fail("Malformed header line");
+        return false;
+    }
+
+    size_t nameLength = colon - line;
+    const char* value = colon + 1;
+    while (*value == ' ' || *value == '\t') value++;
+
+    if (headerIs(line, nameLength, "Content-Length")) {
+        char* end = nullptr;
+        long long parsed = strtoll(value, &end, 10);
+        if (end == value || parsed < 0) {
+            fail("Invalid Content-Length");
+            return false;
+        }
+        contentLength = parsed;
+    } else if (headerIs(line, nameLength, "Transfer-Encoding")) {
+        chunked = containsToken(value, "chunked");
+    } else if (headerIs(line, nameLength, "Connection")) {
+        if (containsToken(value, "close")) keepAlive = false;
+        else if (containsToken(value, "keep-alive")) keepAlive = true;
+    } else if (headerIs(line, nameLength, "Content-Encoding")) {
+        gzipEncoded = containsToken(value, "gzip");
+    } else if (headerIs(line, nameLength, "Accept-Ranges")) {
+        rangesRefused = containsToken(value, "none");
+    } else if (headerIs(line, nameLength, "Content-Range")) {
+        parseContentRange(value);
+    } else if (headerIs(line, nameLength, "Location")) {
+        size_t valueLength = lineLength - (value - line);
+        if (lineTruncated || valueLength >= LOCATION_SIZE) {
+            fail("Redirect location too long");
+            return false;
+        }
+        memcpy(location, value, valueLength + 1);
+    }
+    return true;
+}
+
+void OtaHttpParser::finishHeaders() {
+    // Interim 1xx responses are followed by the real one
+    if (statusCode >= 100 && statusCode < 200) {
+        resetResponse();
+        state = State::STATUS_LINE;
+        return;
+    }
+
+    if (statusCode == 204 || statusCode == 304) {
+        state = State::DONE;
+    } else if (chunked) {
+        state = State::CHUNK_SIZE;
+    } else if (contentLength >= 0) {
+        state = contentLength == 0 ? State::DONE : State::BODY_IDENTITY;
+    } else {
+        // Body delimited by connection close
+        keepAlive = false;
+        state = State::BODY_IDENTITY;
+    }
+}
+
+// "bytes <start>-<end>/<total|*>"; a malformed, inverted or out-of-total range is ignored
+void OtaHttpParser::parseContentRange(const char* value) {
+    if (strncmp(value, "bytes ", 6) != 0) return;
+
+    // strtoull() also takes signs and spaces, so each number must start with a digit
+    const char* p = value + 6;
+    char* end = nullptr;
+    if (!isDigit(*p)) return;
+    unsigned long long start = strtoull(p, &end, 10);
+    if (*end != '-' || !isDigit(end[1])) return;
+    unsigned long long last = strtoull(end + 1, &end, 10);
+    if (*end != '/' || last < start || last > SIZE_MAX) return;
+
+    unsigned long long total = 0;   // "*": unknown
+    if (end[1] == '*') {
+        end += 2;
+    } else if (isDigit(end[1])) {
+        total = strtoull(end + 1, &end, 10);
+        if (total <= last || total > SIZE_MAX) return;
+    } else {
+        return;
+    }
+    while (*end == ' ' || *end == '\t') end++;
+    if (*end != '\0') return;
+
+    contentRangeStart = (size_t)start;
+    contentRangeTotal = (size_t)total;
+    contentRangeValid = true;
+}
+
+// ============================================================================
+// BODY
+// ============================================================================
+
+size_t OtaHttpParser::decodeBody(uint8_t* data, size_t length) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < length && state != State::DONE && state != State::ERROR) {
+        size_t run = 0;
+
+        if (state == State::BODY_IDENTITY) {
+            run = length - in;
+            if (contentLength >= 0) {
+                run = min(run, (size_t)contentLength - bodyBytes);
+            }
+        } else if (state == State::CHUNK_DATA) {
+            run = min(length - in, chunkRemaining);
+            chunkRemaining -= run;
+            if (chunkRemaining == 0) state = State::CHUNK_DATA_END;
+        } else {
+            processFramingByte(data[in++]);
+            continue;
+        }
+
+        if (out != in) memmove(data + out, data + in, run);
+        in += run;
+        out += run;
+        bodyBytes += run;
+
+        if (state == State::BODY_IDENTITY && contentLength >= 0 && bodyBytes == (size_t)contentLength) {
+            state = State::DONE;
+        }
+    }
+    return out;
+}
+
+size_t OtaHttpParser::maxBodyRead(size_t requested) const {
+    if (state == State::BODY_IDENTITY && contentLength >= 0) {
+        return min(requested, (size_t)contentLength - bodyBytes);
+    }
+    if (state == State::DONE || state == State::ERROR) {
+        return 0;
+    }
+    return requested;
+}
+
+// Chunk header "<hex>[;ext]\r\n", chunk terminator "\r\n", trailers after the last chunk
+void OtaHttpParser::processFramingByte(uint8_t c) {
+    switch (state) {
+        case State::CHUNK_SIZE:
+            if (isxdigit(c)) {
+                if (chunkRemaining > 0x0FFFFFFF) {
+                    fail("Chunk size overflow");
+                    return;
+                }
+                chunkRemaining = (chunkRemaining << 4) |
+                                 (isDigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+                chunkSizeDigits = true;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                state = State::CHUNK_EXTENSION;
+            } else if (c == '\n') {
+                if (!chunkSizeDigits) {
+                    fail("Missing chunk size");
+                    return;
+                }
+                chunkSizeDigits = false;
+                if (chunkRemaining == 0) {
+                    state = State::TRAILER;
+                    lineLength = 0;
+                } else {
+                    state = State::CHUNK_DATA;
+                }
+            } else if (c != '\r') {
+                fail("Malformed chunk size");
+            }
+            break;
+
+        case State::CHUNK_EXTENSION:
+            if (c == '\n') {
+                state = State::CHUNK_SIZE;
+                processFramingByte(c);
+            }
+            break;
+
+        case State::CHUNK_DATA_END:
+            if (c == '\n') {
+                state = State::CHUNK_SIZE;
+                chunkRemaining = 0;
+            } else if (c != '\r') {
+                fail("Missing CRLF after chunk");
+            }
+            break;
+
+        case State::TRAILER:
+            // Trailer headers are ignored; a blank line ends the message
+            if (c == '\n') {
+                if (lineLength == 0) state = State::DONE;
+                lineLength = 0;
+            } else if (c != '\r') {
+                lineLength++;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void OtaHttpParser::fail(const char* message) {
+    state = State::ERROR;
+    error = message;
+}
+
+bool OtaHttpParser::headerIs(const char* line, size_t nameLength, const char* name) {
+    return strlen(name) == nameLength && strncasecmp(line, name, nameLength) == 0;
+}
+
+// Case-insensitive search for a comma/space separated token
+bool OtaHttpParser::containsToken(const char* value, const char* token) {
+    size_t tokenLength = strlen(token);
+    for (const char* p = value; *p; p++) {
+        if (strncasecmp(p, token, tokenLength) == 0) {
+            bool startOk = (p == value) || p[-1] == ',' || p[-1] == ' ' || p[-1] == '\t';
+            char after = p[tokenLength];
+            bool endOk = after == '\0' || after == ',' || after == ' ' || after == ';' || after == '\t';
+            if (startOk && endOk) return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,258 @@
+// Single-pass, in-place JSON tokenizer
+
+#include "OtaJson.h"
+
+long OtaJsonView::toInt() const {
+    size_t i = 0;
+    bool negative = i < length && data[i] == '-';
+    if (negative) i++;
+    long value = 0;
+    for (; i < length && data[i] >= '0' && data[i] <= '9'; i++) {
+        value = value * 10 + (data[i] - '0');
+    }
+    return negative ? -value : value;
+}
+
+OtaJson::OtaJson()
+    : text(nullptr), length(0), pos(0), error(nullptr), errorOffset(0), handler(nullptr), context(nullptr), depth(0) {}
+
+bool OtaJson::parse(char* data, size_t size, OtaJsonHandler callback, void* callbackContext) {
+    text = data;
+    length = size;
+    pos = 0;
+    error = nullptr;
+    errorOffset = 0;
+    handler = callback;
+    context = callbackContext;
+    depth = 0;
+    keys[0] = OtaJsonView();
+
+    if (!parseValue()) return false;
+    skipWhitespace();
+    if (pos < length) return fail("Unexpected data after value");
+    return true;
+}
+
+bool OtaJson::fail(const char* message) {
+    if (!error) {
+        error = message;
+        errorOffset = pos;
+    }
+    return false;
+}
+
+void OtaJson::skipWhitespace() {
+    while (pos < length && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+        pos++;
+    }
+}
+
+bool OtaJson::emit(OtaJsonType type, const OtaJsonView& value) {
+    OtaJsonEvent event;
+    event.type = type;
+    event.depth = depth;
+    event.keys = keys;
+    event.index = depth > 0 && frames[depth].isArray ? frames[depth].count : -1;
+    event.value = value;
+    if (!handler || handler(context, event)) return true;
+    return fail("Stopped by handler");
+}
+
+// Objects and arrays recurse once per level, bounded by MAX_DEPTH
+bool OtaJson::parseValue() {
+    skipWhitespace();
+    if (pos >= length) return fail("Unexpected end of input");
+
+    char c = text[pos];
+    if (c == '{' || c == '[') {
+        bool isArray = c == '[';
+        char close = isArray ? ']' : '}';
+        if (depth >= MAX_DEPTH) return fail("Nesting too deep");
+        if (!emit(isArray ? OtaJsonType::ARRAY : OtaJsonType::OBJECT, OtaJsonView())) return false;
+        pos++;
+
+        depth++;
+        frames[depth].isArray = isArray;
+        frames[depth].count = 0;
+        keys[depth] = OtaJsonView();
+
+        skipWhitespace();
+        if (pos < length && text[pos] == close) {
+            pos++;
+        } else {
+            while (true) {
+                if (!isArray) {
+                    skipWhitespace();
+                    if (pos >= length || text[pos] != '"') return fail("Expected member name");
+                    if (!parseString(keys[depth])) return false;
+                    skipWhitespace();
+                    if (pos >= length || text[pos] != ':') return fail("Expected ':'");
+                    pos++;
+                }
+                if (!parseValue()) return false;
+                frames[depth].count++;
+
+                skipWhitespace();
+                if (pos >= length) return fail("Unexpected end of input");
+                if (text[pos] == ',') {
+                    pos++;
+                    continue;
+                }
+                if (text[pos] != close) return fail(isArray ? "Expected ',' or ']'" : "Expected ',' or '}'");
+                pos++;
+                break;
+            }
+        }
+        depth--;
+        return emit(OtaJsonType::END, OtaJsonView());
+    }
+
+    OtaJsonView value;
+    if (c == '"') {
+        return parseString(value) && emit(OtaJsonType::STRING, value);
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        return parseNumber(value) && emit(OtaJsonType::NUMBER, value);
+    }
+    if (c == 't') return parseLiteral("true", OtaJsonType::BOOLEAN);
+    if (c == 'f') return parseLiteral("false", OtaJsonType::BOOLEAN);
+    if (c == 'n') return parseLiteral("null", OtaJsonType::NULL_VALUE);
+    return fail("Unexpected character");
+}
+
+// Decoded text is written back from the opening quote on; an escape never
+// decodes to more bytes than it occupies, so the write position stays behind
+// the read position and the terminator fits where the closing quote was
+bool OtaJson::parseString(OtaJsonView& view) {
+    pos++; // Opening quote
+    size_t start = pos;
+    size_t out = pos;
+
+    while (true) {
+        if (pos >= length) return fail("Unterminated string");
+        char c = text[pos];
+        if (c == '"') break;
+        if ((uint8_t)c < 0x20) return fail("Control character in string");
+        if (c != '\\') {
+            text[out++] = text[pos++];
+            continue;
+        }
+
+        if (++pos >= length) return fail("Unterminated string");
+        char escape = text[pos++];
+        switch (escape) {
+            case '"':
+            case '\\':
+            case '/': text[out++] = escape; break;
+            case 'b': text[out++] = '\b'; break;
+            case 'f': text[out++] = '\f'; break;
+            case 'n': text[out++] = '\n'; break;
+            case 'r': text[out++] = '\r'; break;
+            case 't': text[out++] = '\t'; break;
+            case 'u': {
+                uint32_t codepoint = 0;
+                for (int i = 0; i < 4; i++) {
+                    int digit = pos < length ? hexValue(text[pos]) : -1;
+                    if (digit < 0) return fail("Invalid \\u escape");
+                    codepoint = (codepoint << 4) | digit;
+                    pos++;
+                }
+                // Surrogate pair: combine with the low half that must follow
+                if (codepoint >= 0xD800 && codepoint <= 0xDBFF && pos + 6 <= length &&
+                    text[pos] == '\\' && text[pos + 1] == 'u') {
+                    uint32_t low = 0;
+                    bool valid = true;
+                    for (int i = 2; i < 6 && valid; i++) {
+                        int digit = hexValue(text[pos + i]);
+                        valid = digit >= 0;
+                        low = (low << 4) | (digit & 0xF);
+                    }
+                    if (valid && low >= 0xDC00 && low <= 0xDFFF) {
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        pos += 6;
+                    }
+                }
+                if (codepoint >= 0xD800 && codepoint <= 0xDFFF) {
+                    codepoint = 0xFFFD; // Unpaired surrogate
+                }
+                out += encodeUtf8(codepoint, text + out);
+                break;
+            }
+            default:
+                return fail("Invalid escape");
+        }
+    }
+
+    text[out] = '\0';
+    pos++; // Closing quote
+    view = OtaJsonView(text + start, out - start);
+    return true;
+}
+
+bool OtaJson::parseNumber(OtaJsonView& view) {
+    size_t start = pos;
+    if (text[pos] == '-') pos++;
+
+    if (pos < length && text[pos] == '0') {
+        pos++;
+    } else if (pos < length && text[pos] >= '1' && text[pos] <= '9') {
+        while (pos < length && text[pos] >= '0' && text[pos] <= '9') pos++;
+    } else {
+        return fail("Invalid number");
+    }
+
+    if (pos < length && text[pos] == '.') {
+        pos++;
+        if (pos >= length || text[pos] < '0' || text[pos] > '9') return fail("Invalid number");
+        while (pos < length && text[pos] >= '0' && text[pos] <= '9') pos++;
+    }
+    if (pos < length && (text[pos] == 'e' || text[pos] == 'E')) {
+        pos++;
+        if (pos < length && (text[pos] == '+' || text[pos] == '-')) pos++;
+        if (pos >= length || text[pos] < '0' || text[pos] > '9') return fail("Invalid number");
+        while (pos < length && text[pos] >= '0' && text[pos] <= '9') pos++;
+    }
+
+    view = OtaJsonView(text + start, pos - start);
+    return true;
+}
+
+bool OtaJson::parseLiteral(const char* literal, OtaJsonType type) {
+    size_t size = strlen(literal);
+    if (length - pos < size || strncmp(text + pos, literal, size) != 0) {
+        return fail("Unexpected character");
+    }
+    OtaJsonView value(text + pos, size);
+    pos += size;
+    return emit(type, value);
+}
+
+size_t OtaJson::encodeUtf8(uint32_t codepoint, char* out) {
+    if (codepoint < 0x80) {
+        out[0] = (char)codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    }
+    if (codepoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (codepoint >> 18));
+    out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+int OtaJson::hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
@@ -0,0 +1,270 @@
+// Deferred binary logging
+// Record layout: length u8, level u8, argc u8, pad u8, millis u32, format
+// pointer, then one tagged value per argument.
+
+#include "OtaLog.h"
+#include <freertos/FreeRTOS.h>
+
+namespace {
+
+const size_t HEADER_SIZE = 8 + sizeof(const char*);
+
+enum ArgTag : uint8_t {
+    TAG_INT32 = 'i',
+    TAG_INT64 = 'I',
+    TAG_DOUBLE = 'd',
+    TAG_STRING = 's'    // Length u8, bytes, NUL
+};
+
+const char* const LEVEL_PREFIX[] = {"", "E ", "W ", "", "D "};
+
+// Serializes producers: updater tasks and the application may all log
+portMUX_TYPE producerLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Append text at line[out], keeping room for the terminator
+void append(char* line, size_t size, size_t& out, const char* text, int length) {
+    if (length <= 0 || out + 1 >= size) return;
+    size_t count = min((size_t)length, size - 1 - out);
+    memcpy(line + out, text, count);
+    out += count;
+}
+
+// snprintf one argument with the caller's flags/width/precision in spec
+template<typename T>
+void appendValue(char* line, size_t size, size_t& out, char* spec, size_t specLength,
+                 const char* conversion, T value) {
+    strcpy(spec + specLength, conversion);
+    if (out + 1 >= size) return;
+    int written = snprintf(line + out, size - out, spec, value);
+    if (written > 0) out += min((size_t)written, size - 1 - out);
+}
+
+} // namespace
+
+OtaRingBuffer OtaLog::ring;
+std::atomic<uint32_t> OtaLog::dropped(0);
+std::atomic<const void*> OtaLog::drainer(nullptr);
+
+OtaLog::Record::Record(uint8_t level, const char* format) : length(HEADER_SIZE) {
+    uint32_t now = millis();
+    bytes[0] = 0;
+    bytes[1] = level;
+    bytes[2] = 0;
+    bytes[3] = 0;
+    memcpy(bytes + 4, &now, sizeof(now));
+    memcpy(bytes + 8, &format, sizeof(format));
+}
+
+bool OtaLog::Record::reserve(size_t count) {
+    if (length + count > RECORD_SIZE) return false;
+    bytes[2]++;
+    return true;
+}
+
+void OtaLog::Record::addInt32(uint32_t value) {
+    if (!reserve(1 + sizeof(value))) return;
+    bytes[length++] = TAG_INT32;
+    memcpy(bytes + length, &value, sizeof(value));
+    length += sizeof(value);
+}
+
+void OtaLog::Record::addInt64(uint64_t value) {
+    if (!reserve(1 + sizeof(value))) return;
+    bytes[length++] = TAG_INT64;
+    memcpy(bytes + length, &value, sizeof(value));
+    length += sizeof(value);
+}
+
+void OtaLog::Record::addDouble(double value) {
+    if (!reserve(1 + sizeof(value))) return;
+    bytes[length++] = TAG_DOUBLE;
+    memcpy(bytes + length, &value, sizeof(value));
+    length += sizeof(value);
+}
+
+void OtaLog::Record::add(const char* value) {
+    if (!value) value = "(null)";
+    if (length + 3 > RECORD_SIZE) return;
+    size_t count = min(strlen(value), RECORD_SIZE - length - 3);
+    reserve(3 + count);
+    bytes[length++] = TAG_STRING;
+    bytes[length++] = (uint8_t)count;
+    memcpy(bytes + length, value, count);
+    length += count;
+    bytes[length++] = '\0';
+}
+
+void OtaLog::Record::add(const void* value) {
+    if (sizeof(value) <= 4) {
+        addInt32((uint32_t)(uintptr_t)value);
+    } else {
+        addInt64((uint64_t)(uintptr_t)value);
+    }
+}
+
+bool OtaLog::begin(size_t bufferSize) {
+    if (ring.isAllocated()) return true;
+    if (bufferSize == 0) return false;
+    return ring.begin(bufferSize);
+}
+
+void OtaLog::commit(Record& record) {
+    record.seal();
+    const uint8_t* data = record.data();
+
+    if (ring.isAllocated()) {
+        portENTER_CRITICAL(&producerLock);
+        bool written = ring.write(data, record.size());
+        portEXIT_CRITICAL(&producerLock);
+        if (!written) {
+            dropped++;
+        }
+        return;
+    }
+
+    // No ring yet (before begin() or allocation failed): print now
+    char line[LINE_SIZE];
+    size_t length = formatRecord(data, record.size(), line, sizeof(line));
+    Serial.write((const uint8_t*)line, length);
+    Serial.write((const uint8_t*)"\r\n", 2);
+}
+
+// First caller becomes the drainer, until it releases the ring
+bool OtaLog::claimDrain(const void* owner) {
+    const void* expected = nullptr;
+    return drainer.compare_exchange_strong(expected, owner) || expected == owner;
+}
+
+void OtaLog::releaseDrain(const void* owner) {
+    const void* expected = owner;
+    drainer.compare_exchange_strong(expected, nullptr);
+}
+
+size_t OtaLog::peekLine(char* line, size_t size, uint8_t* level) {
+    uint8_t record[RECORD_SIZE];
+    if (!ring.peek(record, 1) || !ring.peek(record, record[0])) return 0;
+    if (level) *level = record[1];
+    return formatRecord(record, record[0], line, size);
+}
+
+void OtaLog::pop() {
+    uint8_t length;
+    if (ring.peek(&length, 1)) {
+        ring.commitRead(length);
+    }
+}
+
+// Walk the format string; each conversion is rebuilt without its length
+// modifier and printed with the type that was actually stored
+size_t OtaLog::formatRecord(const uint8_t* record, size_t length, char* line, size_t size) {
+    if (size == 0) return 0;
+    size_t out = 0;
+    const char* format;
+    memcpy(&format, record + 8, sizeof(format));
+    uint8_t level = record[1];
+
+    append(line, size, out, "[OTA] ", 6);
+    if (level <= OTA_LOG_LEVEL_DEBUG) {
+        append(line, size, out, LEVEL_PREFIX[level], strlen(LEVEL_PREFIX[level]));
+    }
+
+    const uint8_t* arg = record + HEADER_SIZE;
+    const uint8_t* end = record + length;
+    char spec[16];
+
+    for (const char* p = format; *p && out + 1 < size; p++) {
+        if (*p != '%') {
+            line[out++] = *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            line[out++] = '%';
+            p++;
+            continue;
+        }
+
+        size_t specLength = 0;
+        spec[specLength++] = '%';
+        p++;
+        while (*p && strchr("-+ #0123456789.", *p)) {
+            if (specLength < sizeof(spec) - 4) spec[specLength++] = *p;
+            p++;
+        }
+        while (*p && strchr("hlLjzt", *p)) p++;
+        char conversion = *p;
+        if (!conversion) break;
+        if (!strchr("diuoxXcsfFeEgGaAp", conversion)) {
+            append(line, size, out, p, 1);
+            continue;
+        }
+
+        if (arg >= end) {
+            append(line, size, out, "?", 1);
+            continue;
+        }
+
+        bool isInteger = strchr("diuoxXc", conversion) != nullptr;
+        bool isSigned = conversion == 'd' || conversion == 'i';
+        char plain[2] = {isSigned ? 'd' : conversion, '\0'};
+        uint8_t tag = *arg++;
+
+        if (tag == TAG_STRING) {
+            const char* text = (const char*)arg + 1;
+            arg += 1 + arg[0] + 1;
+            if (conversion == 's') {
+                appendValue(line, size, out, spec, specLength, "s", text);
+            } else {
+                append(line, size, out, text, strlen(text));
+            }
+        } else if (tag == TAG_DOUBLE) {
+            double value;
+            memcpy(&value, arg, sizeof(value));
+            arg += sizeof(value);
+            if (isInteger) {
+                appendValue(line, size, out, spec, specLength, "lld", (long long)value);
+            } else if (conversion == 's' || conversion == 'p') {
+                appendValue(line, size, out, spec, specLength, "g", value);
+            } else {
+                appendValue(line, size, out, spec, specLength, plain, value);
+            }
+        } else if (tag == TAG_INT32) {
+            uint32_t value;
+            memcpy(&value, arg, sizeof(value));
+            arg += sizeof(value);
+            if (isSigned) {
+                appendValue(line, size, out, spec, specLength, "d", (int)(int32_t)value);
+            } else if (isInteger) {
+                appendValue(line, size, out, spec, specLength, plain, (unsigned)value);
+            } else if (conversion == 'p') {
+                appendValue(line, size, out, spec, specLength, "p", (void*)(uintptr_t)value);
+            } else if (conversion == 's') {
+                appendValue(line, size, out, spec, specLength, "u", (unsigned)value);
+            } else {
+                appendValue(line, size, out, spec, specLength, plain, (double)(int32_t)value);
+            }
+        } else if (tag == TAG_INT64) {
+            uint64_t value;
+            memcpy(&value, arg, sizeof(value));
+            arg += sizeof(value);
+            if (isSigned) {
+                appendValue(line, size, out, spec, specLength, "lld", (long long)value);
+            } else if (conversion == 'c') {
+                appendValue(line, size, out, spec, specLength, "c", (int)value);
+            } else if (isInteger) {
+                char wide[4] = {'l', 'l', conversion, '\0'};
+                appendValue(line, size, out, spec, specLength, wide, (unsigned long long)value);
+            } else if (conversion == 'p') {
+                appendValue(line, size, out, spec, specLength, "p", (void*)(uintptr_t)value);
+            } else if (conversion == 's') {
+                appendValue(line, size, out, spec, specLength, "llu", (unsigned long long)value);
+            } else {
+                appendValue(line, size, out, spec, specLength, plain, (double)(int64_t)value);
+            }
+        } else {
+            break; // Corrupt record
+        }
+    }
+
+    line[out] = '\0';
+    return out;
+}
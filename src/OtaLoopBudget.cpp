@@ -0,0 +1,84 @@
+// Cost model used to size download reads to a loop() time budget
+
+#include "OtaLoopBudget.h"
+
+// Starting estimates until a stage has been measured (ns per byte)
+static const uint32_t DEFAULT_COST_NS[OtaLoopBudget::STAGE_COUNT] = {
+    200,   // RECV: lwIP copy out of the pbuf chain (plus TLS decrypt)
+    100,   // HASH: software SHA256
+    1000   // WRITE: flash program, with sector erases amortized in
+};
+
+// Moving average weight of a new sample: 1 / 2^COST_SHIFT
+static const int COST_SHIFT = 3;
+
+OtaLoopBudget::OtaLoopBudget()
+    : budgetMicros(0), iterationStart(0), iterationBytes(0),
+      iterations(0), overruns(0), budgetedBytes(0) {
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        costNs[i] = DEFAULT_COST_NS[i];
+        measured[i] = false;
+    }
+}
+
+void OtaLoopBudget::startIteration(unsigned long startMicros, unsigned long budgetMicros) {
+    this->budgetMicros = budgetMicros;
+    iterationStart = startMicros;
+    iterationBytes = 0;
+}
+
+void OtaLoopBudget::finishIteration(unsigned long elapsedMicros) {
+    if (budgetMicros == 0) return;
+
+    iterations++;
+    budgetedBytes += iterationBytes;
+    if (elapsedMicros > budgetMicros) {
+        overruns++;
+    }
+}
+
+void OtaLoopBudget::record(Stage stage, size_t bytes, unsigned long micros) {
+    if (bytes == 0) return;
+
+    uint64_t sample = (uint64_t)micros * 1000 / bytes;
+    if (sample > UINT32_MAX) sample = UINT32_MAX;
+
+    if (!measured[stage]) {
+        costNs[stage] = (uint32_t)sample;
+        measured[stage] = true;
+        return;
+    }
+    int64_t delta = (int64_t)sample - costNs[stage];
+    costNs[stage] = (uint32_t)((int64_t)costNs[stage] + delta / (1 << COST_SHIFT));
+}
+
+size_t OtaLoopBudget::nextSlice(size_t maxSlice, bool includeProcessing) const {
+    if (budgetMicros == 0) return maxSlice;
+
+    // Always make some progress on the first slice of a call
+    size_t floor = iterationBytes == 0 ? min(maxSlice, (size_t)MIN_SLICE) : 0;
+
+    unsigned long elapsed = micros() - iterationStart;
+    if (elapsed >= budgetMicros) return floor;
+
+    uint32_t perByte = costNs[RECV];
+    if (includeProcessing) {
+        perByte += costNs[HASH] + costNs[WRITE];
+    }
+    if (perByte == 0) return maxSlice;
+
+    uint64_t affordable = (uint64_t)(budgetMicros - elapsed) * 1000 / perByte;
+    if (affordable >= maxSlice) return maxSlice;
+    if (affordable < MIN_SLICE) return floor; // Not worth another read this call
+    return (size_t)affordable;
+}
+
+size_t OtaLoopBudget::getBytesPerIteration() const {
+    return iterations > 0 ? (size_t)(budgetedBytes / iterations) : 0;
+}
+
+void OtaLoopBudget::resetCounters() {
+    iterations = 0;
+    overruns = 0;
+    budgetedBytes = 0;
+}
@@ -0,0 +1,215 @@
+// Mirror ranking and per-host download statistics
+
+#include "OtaMirrorSet.h"
+#include <Preferences.h>
+
+// Assumed for hosts that have not been measured yet
+static const uint32_t DEFAULT_CONNECT_MS = 1000;
+static const uint32_t DEFAULT_FIRST_BYTE_MS = 500;
+static const uint32_t DEFAULT_BYTES_PER_SECOND = 100000;
+static const size_t DEFAULT_EXPECTED_BYTES = 1024 * 1024;
+
+static const char* STATS_KEY = "stats";
+
+OtaMirrorSet::OtaMirrorSet()
+    : mirrorCount(0), currentIndex(-1), lastExpectedBytes(DEFAULT_EXPECTED_BYTES), useCounter(0) {
+    memset(hosts, 0, sizeof(hosts));
+}
+
+void OtaMirrorSet::clear() {
+    for (size_t i = 0; i < mirrorCount; i++) {
+        mirrors[i].url.clear();
+        mirrors[i].host.clear();
+    }
+    mirrorCount = 0;
+    currentIndex = -1;
+}
+
+bool OtaMirrorSet::add(const char* url, const char* host, uint16_t port) {
+    if (mirrorCount >= MAX_MIRRORS) return false;
+    for (size_t i = 0; i < mirrorCount; i++) {
+        if (mirrors[i].url == url) return false;
+    }
+
+    Mirror& mirror = mirrors[mirrorCount];
+    if (!mirror.url.assign(url) || !mirror.host.assign(host)) return false;
+    mirror.port = port;
+    mirror.stats = findOrAllocHost(hashHost(host, port));
+    mirror.tried = false;
+    order[mirrorCount] = (uint8_t)mirrorCount;
+    mirrorCount++;
+    return true;
+}
+
+bool OtaMirrorSet::isMeasured(size_t index) const {
+    if (index >= mirrorCount) return false;
+    return hosts[mirrors[index].stats].connectMillis != 0;
+}
+
+unsigned long OtaMirrorSet::estimateMillis(size_t index, size_t expectedBytes) const {
+    if (index >= mirrorCount) return 0xFFFFFFFFUL;
+    const HostStats& stats = hosts[mirrors[index].stats];
+    uint32_t connect = stats.connectMillis ? stats.connectMillis : DEFAULT_CONNECT_MS;
+    uint32_t firstByte = stats.firstByteMillis ? stats.firstByteMillis : DEFAULT_FIRST_BYTE_MS;
+    uint32_t bytesPerSecond = stats.bytesPerSecond ? stats.bytesPerSecond : DEFAULT_BYTES_PER_SECOND;
+
+    uint64_t estimate = (uint64_t)connect + firstByte + (uint64_t)expectedBytes * 1000 / bytesPerSecond;
+    // Every recent failure counts as one more full attempt
+    estimate *= 1 + stats.failures;
+    return estimate > 0xFFFFFFFFUL ? 0xFFFFFFFFUL : (unsigned long)estimate;
+}
+
+void OtaMirrorSet::rank(size_t expectedBytes) {
+    lastExpectedBytes = expectedBytes > 0 ? expectedBytes : DEFAULT_EXPECTED_BYTES;
+
+    // Insertion sort, at most MAX_MIRRORS entries
+    for (size_t i = 0; i < mirrorCount; i++) {
+        order[i] = (uint8_t)i;
+    }
+    for (size_t i = 1; i < mirrorCount; i++) {
+        uint8_t candidate = order[i];
+        unsigned long cost = estimateMillis(candidate, lastExpectedBytes);
+        size_t j = i;
+        while (j > 0 && estimateMillis(order[j - 1], lastExpectedBytes) > cost) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = candidate;
+    }
+
+    currentIndex = mirrorCount > 0 ? order[0] : -1;
+}
+
+bool OtaMirrorSet::advance() {
+    if (mirrorCount < 2 || currentIndex < 0) return false;
+    mirrors[currentIndex].tried = true;
+
+    for (size_t i = 0; i < mirrorCount; i++) {
+        if (!mirrors[order[i]].tried) {
+            currentIndex = order[i];
+            return true;
+        }
+    }
+
+    // Every mirror failed once: start over from the best by current stats
+    int previous = currentIndex;
+    for (size_t i = 0; i < mirrorCount; i++) {
+        mirrors[i].tried = false;
+    }
+    rank(lastExpectedBytes);
+    if (currentIndex == previous) {
+        currentIndex = order[1];
+    }
+    return true;
+}
+
+// ============================================================================
+// MEASUREMENTS
+// ============================================================================
+
+void OtaMirrorSet::recordConnect(size_t index, unsigned long millis) {
+    if (index >= mirrorCount) return;
+    HostStats& stats = hosts[mirrors[index].stats];
+    stats.connectMillis = average(stats.connectMillis, max(1UL, millis));
+}
+
+void OtaMirrorSet::recordFirstByte(size_t index, unsigned long millis) {
+    if (index >= mirrorCount) return;
+    HostStats& stats = hosts[mirrors[index].stats];
+    stats.firstByteMillis = average(stats.firstByteMillis, max(1UL, millis));
+}
+
+void OtaMirrorSet::recordTransfer(size_t index, size_t bytes, unsigned long millis) {
+    if (index >= mirrorCount) return;
+    HostStats& stats = hosts[mirrors[index].stats];
+    if (bytes >= MIN_THROUGHPUT_SAMPLE) {
+        uint32_t bytesPerSecond = (uint32_t)((uint64_t)bytes * 1000 / max(1UL, millis));
+        stats.bytesPerSecond = average(stats.bytesPerSecond, max((uint32_t)1, bytesPerSecond));
+    }
+    stats.failures /= 2;
+}
+
+void OtaMirrorSet::recordFailure(size_t index) {
+    if (index >= mirrorCount) return;
+    HostStats& stats = hosts[mirrors[index].stats];
+    if (stats.failures < 0xFF) {
+        stats.failures++;
+    }
+}
+
+// ============================================================================
+// PERSISTENCE (NVS)
+// ============================================================================
+
+bool OtaMirrorSet::load(const char* name) {
+    Preferences prefs;
+    if (!prefs.begin(name, true)) return false;
+
+    HostStats stored[MAX_HOSTS];
+    bool ok = prefs.getBytesLength(STATS_KEY) == sizeof(stored) &&
+              prefs.getBytes(STATS_KEY, stored, sizeof(stored)) == sizeof(stored);
+    prefs.end();
+    if (!ok) return false;
+
+    memcpy(hosts, stored, sizeof(hosts));
+    useCounter = 0;
+    for (size_t i = 0; i < MAX_HOSTS; i++) {
+        useCounter = max(useCounter, hosts[i].lastUsed);
+    }
+
+    // Mirrors added before loading point at the old slots
+    for (size_t i = 0; i < mirrorCount; i++) {
+        mirrors[i].stats = findOrAllocHost(hashHost(mirrors[i].host.c_str(), mirrors[i].port));
+    }
+    return true;
+}
+
+bool OtaMirrorSet::save(const char* name) const {
+    Preferences prefs;
+    if (!prefs.begin(name, false)) return false;
+    bool ok = prefs.putBytes(STATS_KEY, hosts, sizeof(hosts)) == sizeof(hosts);
+    prefs.end();
+    return ok;
+}
+
+// ============================================================================
+// HELPERS
+// ============================================================================
+
+// FNV-1a over "host:port"; 0 is reserved for free slots
+uint32_t OtaMirrorSet::hashHost(const char* host, uint16_t port) {
+    uint32_t hash = 2166136261UL;
+    for (const char* p = host; *p; p++) {
+        hash = (hash ^ (uint8_t)tolower(*p)) * 16777619UL;
+    }
+    hash = (hash ^ (port & 0xFF)) * 16777619UL;
+    hash = (hash ^ (port >> 8)) * 16777619UL;
+    return hash != 0 ? hash : 1;
+}
+
+// Moving average with weight 1/4; the first sample is taken as is
+uint32_t OtaMirrorSet::average(uint32_t previous, uint32_t sample) {
+    if (previous == 0) return sample;
+    return (uint32_t)(((uint64_t)previous * 3 + sample) / 4);
+}
+
+uint8_t OtaMirrorSet::findOrAllocHost(uint32_t hash) {
+    size_t victim = 0;
+    for (size_t i = 0; i < MAX_HOSTS; i++) {
+        if (hosts[i].hostHash == hash) {
+            hosts[i].lastUsed = ++useCounter;
+            return (uint8_t)i;
+        }
+        if (hosts[i].hostHash == 0) {
+            if (hosts[victim].hostHash != 0) victim = i;
+        } else if (hosts[victim].hostHash != 0 && hosts[i].lastUsed < hosts[victim].lastUsed) {
+            victim = i;
+        }
+    }
+
+    // Free slot, or the host unused for the longest time
+    memset(&hosts[victim], 0, sizeof(HostStats));
+    hosts[victim].hostHash = hash;
+    hosts[victim].lastUsed = ++useCounter;
+    return (uint8_t)victim;
+}
@@ -0,0 +1,418 @@
+// Non-blocking MQTT 3.1.1 client
+
+#include "OtaMqttEngine.h"
+
+// Packet types (upper nibble of the fixed header)
+static const uint8_t CONNECT = 0x10;
+static const uint8_t CONNACK = 0x20;
+static const uint8_t PUBLISH = 0x30;
+static const uint8_t PUBACK = 0x40;
+static const uint8_t SUBSCRIBE = 0x82;      // Reserved flags 0010
+static const uint8_t SUBACK = 0x90;
+static const uint8_t UNSUBSCRIBE = 0xA2;
+static const uint8_t UNSUBACK = 0xB0;
+static const uint8_t PINGREQ = 0xC0;
+static const uint8_t PINGRESP = 0xD0;
+static const uint8_t DISCONNECT = 0xE0;
+
+static const uint8_t CONNECT_CLEAN_SESSION = 0x02;
+static const uint8_t CONNECT_PASSWORD = 0x40;
+static const uint8_t CONNECT_USER = 0x80;
+static const uint8_t SUBACK_FAILURE = 0x80;
+
+static size_t lengthBytes(size_t length) {
+    return length < 128 ? 1 : length < 16384 ? 2 : length < 2097152 ? 3 : 4;
+}
+
+OtaMqttEngine::OtaMqttEngine()
+    : client(nullptr), host(nullptr), port(8883), secure(true), insecure(false),
+      caCert(nullptr), clientCert(nullptr), clientKey(nullptr), trustStore(nullptr),
+      keepAlive(15), connectTimeout(15000),
+      callback(nullptr), phase(Phase::IDLE), result(DISCONNECTED), connectStart(0), lastSend(0), lastReceive(0),
+      pingSent(0), pingOutstanding(false), nextPacketId(1),
+      rxBuffer(nullptr), bufferSize(0), rxStage(RxStage::HEADER), rxHeader(0), rxLength(0), rxLengthBytes(0),
+      rxReceived(0), txStart(0), txEnd(0), maxLoopMicros(0), rejectedSubscriptions(0), skippedPackets(0) {
+    setBufferSize(DEFAULT_BUFFER_SIZE);
+}
+
+OtaMqttEngine::~OtaMqttEngine() {
+    OtaAsyncClient::destroy(client);
+    free(rxBuffer);
+}
+
+void OtaMqttEngine::setServer(const char* serverHost, uint16_t serverPort, bool useTls) {
+    host = serverHost;
+    port = serverPort;
+    secure = useTls;
+}
+
+void OtaMqttEngine::setInsecure() {
+    insecure = true;
+    caCert = nullptr;
+}
+
+void OtaMqttEngine::setCACert(const char* pem) {
+    caCert = pem;
+    insecure = false;
+}
+
+void OtaMqttEngine::setCertificate(const char* certPem, const char* keyPem) {
+    clientCert = certPem;
+    clientKey = keyPem;
+}
+
+// A packet being received must still fit
+bool OtaMqttEngine::setBufferSize(uint16_t size) {
+    if (size == 0 || (rxStage == RxStage::BODY && size < rxLength)) return false;
+    uint8_t* resized = (uint8_t*)realloc(rxBuffer, size);
+    if (!resized) return false;
+    rxBuffer = resized;
+    bufferSize = size;
+    return true;
+}
+
+// ============================================================================
+// CONNECTION
+// ============================================================================
+
+bool OtaMqttEngine::connect(const char* clientId, const char* user, const char* password) {
+    disconnect();
+    if (!host || !clientId) {
+        result = CONNECT_FAILED;
+        return false;
+    }
+
+    // CONNECT waits in the send buffer until the socket is up
+    bool hasUser = user && user[0];
+    bool hasPassword = hasUser && password && password[0];
+    size_t body = 10 + 2 + strlen(clientId);
+    if (hasUser) body += 2 + strlen(user);
+    if (hasPassword) body += 2 + strlen(password);
+    if (!beginPacket(CONNECT, body)) {
+        result = CONNECT_FAILED;
+        return false;
+    }
+    putString("MQTT");
+    putByte(4);                             // Protocol level 3.1.1
+    putByte(CONNECT_CLEAN_SESSION | (hasUser ? CONNECT_USER : 0) | (hasPassword ? CONNECT_PASSWORD : 0));
+    putUint16(keepAlive);
+    putString(clientId);
+    if (hasUser) putString(user);
+    if (hasPassword) putString(password);
+
+    if (!client) client = OtaAsyncClient::create();
+    if (!client) {
+        txStart = txEnd = 0;
+        result = CONNECT_FAILED;
+        return false;
+    }
+    if (insecure) {
+        client->setInsecure();
+    } else if (caCert) {
+        client->setCACert(caCert);
+    }
+    client->setCertificate(clientCert, clientKey);
+    client->setTrustStore(trustStore);
+
+    connectStart = millis();
+    phase = Phase::CONNECTING;
+    result = DISCONNECTED;
+    if (!client->begin(host, port, secure)) {
+        fail(CONNECT_FAILED);
+        return false;
+    }
+    return true;
+}
+
+void OtaMqttEngine::disconnect() {
+    if (phase == Phase::CONNECTED && beginPacket(DISCONNECT, 0)) {
+        flush(); // Best effort
+    }
+    if (client) client->stop();
+    phase = Phase::IDLE;
+    result = DISCONNECTED;
+    txStart = txEnd = 0;
+    rxStage = RxStage::HEADER;
+    pingOutstanding = false;
+}
+
+void OtaMqttEngine::fail(int code) {
+    if (client) client->stop();
+    phase = Phase::IDLE;
+    result = code;
+    txStart = txEnd = 0;
+    rxStage = RxStage::HEADER;
+    pingOutstanding = false;
+}
+
+bool OtaMqttEngine::loop() {
+    unsigned long start = micros();
+    unsigned long now = millis();
+
+    switch (phase) {
+        case Phase::IDLE:
+            return false;
+
+        case Phase::CONNECTING: {
+            OtaAsyncClient::State socket = client->poll();
+            if (socket == OtaAsyncClient::State::FAILED) {
+                fail(CONNECT_FAILED);
+            } else if (socket == OtaAsyncClient::State::CONNECTED) {
+                phase = Phase::AWAIT_CONNACK;
+                lastReceive = now;
+                flush();
+            } else if (now - connectStart > connectTimeout) {
+                fail(CONNECTION_TIMEOUT);
+            }
+            break;
+        }
+
+        case Phase::AWAIT_CONNACK:
+        case Phase::CONNECTED:
+            if (!flush() || !receive(now)) {
+                fail(CONNECTION_LOST);
+            } else if (phase == Phase::AWAIT_CONNACK && now - connectStart > connectTimeout) {
+                fail(CONNECTION_TIMEOUT);
+            } else if (phase == Phase::CONNECTED) {
+                checkKeepAlive(now);
+            }
+            break;
+    }
+
+    unsigned long elapsed = micros() - start;
+    if (elapsed > maxLoopMicros) maxLoopMicros = elapsed;
+    return phase == Phase::CONNECTED;
+}
+
+// Ping when either direction has been quiet for the keep-alive interval;
+// a ping still unanswered after another interval means the link is dead
+void OtaMqttEngine::checkKeepAlive(unsigned long now) {
+    if (keepAlive == 0) return;
+    unsigned long interval = keepAlive * 1000UL;
+    if (pingOutstanding) {
+        if (now - pingSent >= interval) fail(CONNECTION_TIMEOUT);
+        return;
+    }
+    if (now - lastSend < interval && now - lastReceive < interval) return;
+
+    if (beginPacket(PINGREQ, 0)) {
+        pingOutstanding = true;
+        pingSent = now;
+        lastSend = now;
+        flush();
+    }
+}
+
+// ============================================================================
+// SENDING
+// ============================================================================
+
+// False when the connection failed; unsent bytes stay queued
+bool OtaMqttEngine::flush() {
+    if (phase == Phase::CONNECTING) return true;
+    while (txStart < txEnd) {
+        int sent = client->send(txBuffer + txStart, txEnd - txStart);
+        if (sent < 0) return false;
+        if (sent == 0) break;
+        txStart += sent;
+    }
+    if (txStart == txEnd) txStart = txEnd = 0;
+    return true;
+}
+
+bool OtaMqttEngine::beginPacket(uint8_t header, size_t bodyLength) {
+    size_t size = 1 + lengthBytes(bodyLength) + bodyLength;
+    if (txEnd + size > SEND_BUFFER_SIZE && txStart > 0) {
+        memmove(txBuffer, txBuffer + txStart, txEnd - txStart);
+        txEnd -= txStart;
+        txStart = 0;
+    }
+    if (txEnd + size > SEND_BUFFER_SIZE) return false;
+
+    putByte(header);
+    size_t remaining = bodyLength;
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        putByte(remaining > 0 ? digit | 0x80 : digit);
+    } while (remaining > 0);
+    return true;
+}
+
+void OtaMqttEngine::putByte(uint8_t value) {
+    txBuffer[txEnd++] = value;
+}
+
+void OtaMqttEngine::putUint16(uint16_t value) {
+    putByte(value >> 8);
+    putByte(value & 0xFF);
+}
+
+void OtaMqttEngine::putBytes(const uint8_t* data, size_t length) {
+    memcpy(txBuffer + txEnd, data, length);
+    txEnd += length;
+}
+
+void OtaMqttEngine::putString(const char* text) {
+    size_t length = strlen(text);
+    putUint16((uint16_t)length);
+    putBytes((const uint8_t*)text, length);
+}
+
+uint16_t OtaMqttEngine::takePacketId() {
+    uint16_t id = nextPacketId++;
+    if (nextPacketId == 0) nextPacketId = 1;
+    return id;
+}
+
+bool OtaMqttEngine::subscribe(const char* filter) {
+    size_t length = strlen(filter);
+    if (phase != Phase::CONNECTED || length == 0 || length > 0xFFFF) return false;
+    if (!beginPacket(SUBSCRIBE, 2 + 2 + length + 1)) return false;
+    putUint16(takePacketId());
+    putString(filter);
+    putByte(0);                             // Requested QoS
+    lastSend = millis();
+    return flush();
+}
+
+bool OtaMqttEngine::unsubscribe(const char* filter) {
+    size_t length = strlen(filter);
+    if (phase != Phase::CONNECTED || length == 0 || length > 0xFFFF) return false;
+    if (!beginPacket(UNSUBSCRIBE, 2 + 2 + length)) return false;
+    putUint16(takePacketId());
+    putString(filter);
+    lastSend = millis();
+    return flush();
+}
+
+bool OtaMqttEngine::publish(const char* topic, const char* payload, bool retained) {
+    return publish(topic, (const uint8_t*)payload, payload ? strlen(payload) : 0, retained);
+}
+
+bool OtaMqttEngine::publish(const char* topic, const uint8_t* payload, size_t length, bool retained) {
+    size_t topicLength = strlen(topic);
+    if (phase != Phase::CONNECTED || topicLength == 0 || topicLength > 0xFFFF) return false;
+    if (!beginPacket(PUBLISH | (retained ? 1 : 0), 2 + topicLength + length)) return false;
+    putString(topic);
+    putBytes(payload, length);
+    lastSend = millis();
+    return flush();
+}
+
+// ============================================================================
+// RECEIVING
+// ============================================================================
+
+// Decodes what has arrived, at most READ_LIMIT bytes and one PUBLISH per
+// call. False when the connection was closed or sent a malformed packet.
+bool OtaMqttEngine::receive(unsigned long now) {
+    size_t budget = READ_LIMIT;
+    while (budget > 0 && phase != Phase::IDLE) {
+        if (rxStage == RxStage::HEADER || rxStage == RxStage::LENGTH) {
+            int value = client->read();
+            if (value < 0) break;
+            budget--;
+            if (rxStage == RxStage::HEADER) {
+                rxHeader = (uint8_t)value;
+                rxLength = 0;
+                rxLengthBytes = 0;
+                rxStage = RxStage::LENGTH;
+                continue;
+            }
+            rxLength |= (uint32_t)(value & 0x7F) << (7 * rxLengthBytes++);
+            if (value & 0x80) {
+                if (rxLengthBytes == 4) return false;   // Remaining length has at most 4 bytes
+                continue;
+            }
+            rxReceived = 0;
+            if (rxLength > bufferSize) {
+                skippedPackets++;
+                rxStage = RxStage::SKIP;
+                continue;
+            }
+            rxStage = RxStage::BODY;
+            continue;
+        }
+
+        // Body: read straight into the buffer, or drop when it does not fit
+        if (rxReceived < rxLength) {
+            uint8_t discard[64];
+            size_t wanted = min((size_t)(rxLength - rxReceived), budget);
+            uint8_t* target = rxBuffer + rxReceived;
+            if (rxStage == RxStage::SKIP) {
+                target = discard;
+                wanted = min(wanted, sizeof(discard));
+            }
+            int count = client->read(target, wanted);
+            if (count <= 0) break;
+            rxReceived += count;
+            budget -= count;
+            if (rxReceived < rxLength) continue;
+        }
+
+        // Packet complete
+        lastReceive = now;
+        bool delivered = rxStage == RxStage::BODY && (rxHeader & 0xF0) == PUBLISH;
+        if (rxStage == RxStage::BODY) handlePacket(now);
+        rxStage = RxStage::HEADER;
+        if (delivered) break;
+    }
+    return phase == Phase::IDLE || client->connected();
+}
+
+void OtaMqttEngine::handlePacket(unsigned long now) {
+    switch (rxHeader & 0xF0) {
+        case CONNACK:
+            if (phase != Phase::AWAIT_CONNACK || rxLength < 2) break;
+            if (rxBuffer[1] != 0) {
+                fail(rxBuffer[1]);
+            } else {
+                phase = Phase::CONNECTED;
+                result = CONNECTED;
+                lastSend = now;
+                pingOutstanding = false;
+            }
+            break;
+
+        case PUBLISH:
+            handlePublish();
+            break;
+
+        case SUBACK:
+            for (uint32_t i = 2; i < rxLength; i++) {
+                if (rxBuffer[i] == SUBACK_FAILURE) rejectedSubscriptions++;
+            }
+            break;
+
+        case PINGRESP:
+            pingOutstanding = false;
+            break;
+
+        case UNSUBACK:
+        case PUBACK:
+        default:
+            break;
+    }
+}
+
+// Topic and payload are handed out in place; the topic is moved one byte
+// down over its length field to make room for the terminating NUL
+void OtaMqttEngine::handlePublish() {
+    if (rxLength < 2) return;
+    uint8_t qos = (rxHeader >> 1) & 0x03;
+    size_t topicLength = (rxBuffer[0] << 8) | rxBuffer[1];
+    size_t payloadStart = 2 + topicLength + (qos > 0 ? 2 : 0);
+    if (payloadStart > rxLength) return;
+
+    if (qos == 1 && beginPacket(PUBACK, 2)) {
+        putBytes(rxBuffer + 2 + topicLength, 2);
+        flush();
+    }
+
+    memmove(rxBuffer, rxBuffer + 2, topicLength);
+    rxBuffer[topicLength] = '\0';
+    if (callback) {
+        callback((char*)rxBuffer, rxBuffer + payloadStart, rxLength - payloadStart);
+    }
+}
@@ -0,0 +1,124 @@
+// Sliding-window reassembly for firmware published over MQTT
+
+#include "OtaMqttTransfer.h"
+#include "OtaArena.h"
+
+static uint32_t readLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+OtaMqttTransfer::OtaMqttTransfer()
+    : slots(nullptr), chunkSize(0), window(0), nextIndex(0), totalChunks(0),
+      lastChunkTime(0), duplicates(0), error(nullptr) {}
+
+OtaMqttTransfer::~OtaMqttTransfer() {
+    end();
+}
+
+bool OtaMqttTransfer::begin(size_t chunkSize, size_t window) {
+    end();
+    if (chunkSize == 0 || chunkSize > 0xFFFF || window == 0 || window > MAX_WINDOW) {
+        fail("Invalid chunk size or window");
+        return false;
+    }
+
+    slots = OtaArena::acquire(OtaArena::MQTT_CHUNKS, chunkSize * window);
+    if (!slots) {
+        fail("Out of memory for chunk window");
+        return false;
+    }
+
+    this->chunkSize = chunkSize;
+    this->window = window;
+    for (size_t i = 0; i < MAX_WINDOW; i++) {
+        slotIndex[i] = EMPTY_SLOT;
+        slotLength[i] = 0;
+    }
+    nextIndex = 0;
+    totalChunks = 0;
+    duplicates = 0;
+    error = nullptr;
+    lastChunkTime = millis();
+    return true;
+}
+
+void OtaMqttTransfer::end() {
+    OtaArena::release(OtaArena::MQTT_CHUNKS, slots);
+    slots = nullptr;
+}
+
+bool OtaMqttTransfer::onChunk(const uint8_t* payload, size_t length) {
+    if (!slots || error) return false;
+
+    if (length <= HEADER_SIZE) {
+        fail("Chunk too short");
+        return false;
+    }
+
+    uint32_t index = readLe32(payload);
+    uint32_t total = readLe32(payload + 4);
+    size_t dataLength = length - HEADER_SIZE;
+
+    if (total == 0 || (totalChunks != 0 && total != totalChunks)) {
+        fail("Inconsistent chunk count");
+        return false;
+    }
+    if (index >= total) {
+        fail("Chunk index out of range");
+        return false;
+    }
+    // Only the last chunk may be short
+    if (dataLength > chunkSize || (index + 1 < total && dataLength != chunkSize)) {
+        fail("Chunk size does not match the negotiated size");
+        return false;
+    }
+    totalChunks = total;
+
+    size_t slot = index % window;
+    if (index < nextIndex || index >= nextIndex + window || slotIndex[slot] == index) {
+        duplicates++;
+        return true;
+    }
+
+    memcpy(slots + slot * chunkSize, payload + HEADER_SIZE, dataLength);
+    slotIndex[slot] = index;
+    slotLength[slot] = (uint16_t)dataLength;
+    lastChunkTime = millis();
+    return true;
+}
+
+const uint8_t* OtaMqttTransfer::peekReady(size_t& length) const {
+    length = 0;
+    if (!slots) return nullptr;
+
+    size_t slot = nextIndex % window;
+    if (slotIndex[slot] != nextIndex) return nullptr;
+
+    length = slotLength[slot];
+    return slots + slot * chunkSize;
+}
+
+void OtaMqttTransfer::releaseReady() {
+    size_t slot = nextIndex % window;
+    if (slotIndex[slot] != nextIndex) return;
+
+    slotIndex[slot] = EMPTY_SLOT;
+    nextIndex++;
+}
+
+size_t OtaMqttTransfer::collectMissing(uint32_t* indexes, size_t max) const {
+    uint32_t end = nextIndex + window;
+    if (totalChunks > 0 && end > totalChunks) end = totalChunks;
+
+    size_t count = 0;
+    for (uint32_t index = nextIndex; index < end && count < max; index++) {
+        if (slotIndex[index % window] != index) {
+            indexes[count++] = index;
+        }
+    }
+    return count;
+}
+
+void OtaMqttTransfer::fail(const char* message) {
+    error = message;
+}
@@ -0,0 +1,113 @@
+// Streaming PEM to DER conversion
+
+#include "OtaPemDecoder.h"
+
+static const char BEGIN_MARK[] = "-----BEGIN ";
+static const char END_MARK[] = "-----END ";
+static const char DASHES[] = "-----";
+
+OtaPemDecoder::OtaPemDecoder(Stream& input, uint8_t* output, size_t capacity)
+    : input(input), output(output), capacity(capacity), length(0), chunkPos(0), chunkLen(0),
+      lineLen(0), lineStart(true), boundary(false), inBlock(false), padded(false), bits(0), bitCount(0) {
+    label[0] = '\0';
+}
+
+OtaPemDecoder::Result OtaPemDecoder::next() {
+    while (true) {
+        if (chunkPos == chunkLen) {
+            // Bounded by available() so a Stream's read timeout never applies
+            int available = input.available();
+            chunkLen = available > 0 ? input.readBytes(chunk, min((size_t)available, sizeof(chunk))) : 0;
+            chunkPos = 0;
+            if (chunkLen == 0) {
+                // A last boundary line without its newline
+                Result result = boundary ? endLine() : Result::END;
+                boundary = false;
+                if (result == Result::END && inBlock) {
+                    inBlock = false;
+                    return Result::ERROR;   // Truncated block
+                }
+                return result;
+            }
+        }
+
+        char c = chunk[chunkPos++];
+        if (c == '\n' || c == '\r') {
+            Result result = boundary ? endLine() : Result::END;
+            lineStart = true;
+            boundary = false;
+            lineLen = 0;
+            if (result != Result::END) return result;
+            continue;
+        }
+        if (lineStart && c == '-') boundary = true;
+        lineStart = false;
+
+        if (boundary) {
+            if (lineLen < LINE_SIZE - 1) line[lineLen++] = c;
+        } else if (inBlock && !decode(c)) {
+            inBlock = false;
+            return Result::ERROR;
+        }
+    }
+}
+
+OtaPemDecoder::Result OtaPemDecoder::endLine() {
+    line[lineLen] = '\0';
+    lineLen = 0;
+    size_t beginLength = sizeof(BEGIN_MARK) - 1;
+    size_t endLength = sizeof(END_MARK) - 1;
+
+    if (strncmp(line, BEGIN_MARK, beginLength) == 0) {
+        // Label up to the closing dashes
+        const char* start = line + beginLength;
+        const char* close = strstr(start, DASHES);
+        size_t labelLength = close ? (size_t)(close - start) : strlen(start);
+        if (labelLength > MAX_LABEL) labelLength = MAX_LABEL;
+        memcpy(label, start, labelLength);
+        label[labelLength] = '\0';
+        inBlock = true;
+        padded = false;
+        length = 0;
+        bits = 0;
+        bitCount = 0;
+        return Result::END;
+    }
+    if (inBlock && strncmp(line, END_MARK, endLength) == 0) {
+        inBlock = false;
+        // Leftover bits are padding; a whole unused sextet is not
+        return bitCount >= 6 ? Result::ERROR : Result::BLOCK;
+    }
+    return inBlock ? Result::ERROR : Result::END;
+}
+
+bool OtaPemDecoder::decode(char c) {
+    int value;
+    if (c >= 'A' && c <= 'Z') {
+        value = c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+        value = c - 'a' + 26;
+    } else if (c >= '0' && c <= '9') {
+        value = c - '0' + 52;
+    } else if (c == '+') {
+        value = 62;
+    } else if (c == '/') {
+        value = 63;
+    } else if (c == '=') {
+        padded = true;
+        return true;
+    } else {
+        // Whitespace is fine; anything else (encrypted PEM headers too) is not
+        return c == ' ' || c == '\t';
+    }
+    if (padded) return false;   // Data after padding
+
+    bits = (bits << 6) | (uint32_t)value;
+    bitCount += 6;
+    if (bitCount >= 8) {
+        bitCount -= 8;
+        if (length >= capacity) return false;
+        output[length++] = (uint8_t)(bits >> bitCount);
+    }
+    return true;
+}
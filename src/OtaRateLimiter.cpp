@@ -0,0 +1,43 @@
+// Token bucket bandwidth limiter
+
+#include "OtaRateLimiter.h"
+
+static const int64_t MICROS_PER_SECOND = 1000000;
+static const unsigned long MAX_REFILL_MICROS = 10000000; // Keeps elapsed * rate within 64 bits
+
+OtaRateLimiter::OtaRateLimiter() : rate(UNLIMITED), burst(0), credit(0), lastRefill(0) {}
+
+void OtaRateLimiter::configure(uint32_t bytesPerSecond, size_t burstBytes) {
+    rate = bytesPerSecond;
+    burst = burstBytes > 0 ? burstBytes : 1;
+    int64_t cap = (int64_t)burst * MICROS_PER_SECOND;
+    if (credit > cap) credit = cap;
+}
+
+void OtaRateLimiter::refill(unsigned long nowMicros) {
+    unsigned long elapsed = nowMicros - lastRefill;
+    lastRefill = nowMicros;
+    if (elapsed > MAX_REFILL_MICROS) elapsed = MAX_REFILL_MICROS;
+
+    int64_t cap = (int64_t)burst * MICROS_PER_SECOND;
+    credit += (int64_t)elapsed * rate;
+    if (credit > cap) credit = cap;
+}
+
+size_t OtaRateLimiter::allowance(unsigned long nowMicros, size_t maxBytes) {
+    if (rate == UNLIMITED) return maxBytes;
+    refill(nowMicros);
+    if (credit < MICROS_PER_SECOND) return 0;
+    uint64_t bytes = (uint64_t)(credit / MICROS_PER_SECOND);
+    return bytes < maxBytes ? (size_t)bytes : maxBytes;
+}
+
+void OtaRateLimiter::consume(size_t bytes) {
+    if (rate == UNLIMITED) return;
+    credit -= (int64_t)bytes * MICROS_PER_SECOND;
+}
+
+void OtaRateLimiter::reset(unsigned long nowMicros) {
+    credit = (int64_t)burst * MICROS_PER_SECOND;
+    lastRefill = nowMicros;
+}
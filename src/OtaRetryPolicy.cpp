@@ -0,0 +1,130 @@
+// Retry backoff and per-host circuit breaker
+
+#include "OtaRetryPolicy.h"
+
+OtaRetryPolicy::OtaRetryPolicy()
+    : baseDelay(1000), maxDelay(60000), lastDelay(0), nextAttempt(0), failures(0) {}
+
+void OtaRetryPolicy::setDelays(unsigned long baseMs, unsigned long maxMs) {
+    baseDelay = baseMs > 0 ? baseMs : 1;
+    maxDelay = maxMs > baseDelay ? maxMs : baseDelay;
+}
+
+unsigned long OtaRetryPolicy::recordFailure(unsigned long now) {
+    // delay = min(max, random(base, 3 * previous)), starting from base
+    unsigned long previous = lastDelay > 0 ? lastDelay : baseDelay;
+    unsigned long upper = previous > maxDelay / 3 ? maxDelay : previous * 3;
+    unsigned long delay = baseDelay;
+    if (upper > baseDelay) {
+        delay += esp_random() % (upper - baseDelay + 1);
+    }
+    if (delay > maxDelay) delay = maxDelay;
+
+    lastDelay = delay;
+    nextAttempt = now + delay;
+    if (failures < 0xFFFF) failures++;
+    return delay;
+}
+
+void OtaRetryPolicy::recordSuccess() {
+    lastDelay = 0;
+    failures = 0;
+}
+
+bool OtaRetryPolicy::canAttempt(unsigned long now) const {
+    return failures == 0 || (long)(now - nextAttempt) >= 0;
+}
+
+OtaCircuitBreaker::OtaCircuitBreaker() : threshold(3), cooldown(60000) {
+    for (size_t i = 0; i < MAX_HOSTS; i++) {
+        entries[i].used = false;
+    }
+}
+
+void OtaCircuitBreaker::configure(uint8_t failureThreshold, unsigned long cooldownMs) {
+    threshold = failureThreshold;
+    cooldown = cooldownMs;
+}
+
+// FNV-1a, case-insensitive like host names
+uint32_t OtaCircuitBreaker::hashHost(const char* host) {
+    uint32_t h = 2166136261u;
+    for (const char* p = host; *p; p++) {
+        h = (h ^ (uint8_t)tolower((uint8_t)*p)) * 16777619u;
+    }
+    return h;
+}
+
+int OtaCircuitBreaker::find(const char* host) const {
+    uint32_t hash = hashHost(host);
+    for (size_t i = 0; i < MAX_HOSTS; i++) {
+        if (entries[i].used && entries[i].hash == hash) return (int)i;
+    }
+    return -1;
+}
+
+OtaCircuitBreaker::Entry& OtaCircuitBreaker::findOrAlloc(const char* host, unsigned long now) {
+    int index = find(host);
+    if (index < 0) {
+        // Free slot, else the closed entry unused for longest, else the oldest one
+        index = 0;
+        for (size_t i = 0; i < MAX_HOSTS; i++) {
+            if (!entries[i].used) {
+                index = (int)i;
+                break;
+            }
+            const Entry& best = entries[index];
+            bool closer = entries[i].state == State::CLOSED && best.state != State::CLOSED;
+            bool older = (entries[i].state == State::CLOSED) == (best.state == State::CLOSED) &&
+                         (long)(entries[i].lastUsed - best.lastUsed) < 0;
+            if (closer || older) index = (int)i;
+        }
+        entries[index] = {hashHost(host), 0, now, 0, State::CLOSED, true};
+    }
+    entries[index].lastUsed = now;
+    return entries[index];
+}
+
+bool OtaCircuitBreaker::allow(const char* host, unsigned long now) {
+    if (threshold == 0) return true;
+    int index = find(host);
+    if (index < 0) return true;
+    Entry& entry = entries[index];
+    if (entry.state == State::OPEN) {
+        if ((long)(now - entry.openUntil) < 0) return false;
+        entry.state = State::HALF_OPEN; // Cooldown over: one trial attempt
+    }
+    return true;
+}
+
+void OtaCircuitBreaker::recordSuccess(const char* host) {
+    int index = find(host);
+    if (index < 0) return;
+    entries[index].failures = 0;
+    entries[index].state = State::CLOSED;
+}
+
+bool OtaCircuitBreaker::recordFailure(const char* host, unsigned long now) {
+    if (threshold == 0) return false;
+    Entry& entry = findOrAlloc(host, now);
+    if (entry.failures < 0xFF) entry.failures++;
+    if (entry.state == State::HALF_OPEN || (entry.state == State::CLOSED && entry.failures >= threshold)) {
+        entry.state = State::OPEN;
+        entry.openUntil = now + cooldown;
+        return true;
+    }
+    return false;
+}
+
+OtaCircuitBreaker::State OtaCircuitBreaker::getState(const char* host, unsigned long now) const {
+    int index = find(host);
+    if (index < 0) return State::CLOSED;
+    const Entry& entry = entries[index];
+    if (entry.state == State::OPEN && (long)(now - entry.openUntil) >= 0) return State::HALF_OPEN;
+    return entry.state;
+}
+
+unsigned long OtaCircuitBreaker::getOpenUntil(const char* host) const {
+    int index = find(host);
+    return index >= 0 && entries[index].state == State::OPEN ? entries[index].openUntil : 0;
+}
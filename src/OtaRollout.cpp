@@ -0,0 +1,37 @@
+// Staged rollout cohorts and start delays
+
+#include "OtaRollout.h"
+
+static const uint8_t SALT_COHORT = 1;
+static const uint8_t SALT_DELAY = 2;
+
+// FNV-1a over salt, seed and identity, then the murmur3 finalizer so that
+// identities differing in one byte (neighbouring MACs) land far apart
+uint32_t OtaRollout::hash(uint8_t salt, const uint8_t* id, size_t idLength, const char* seed, size_t seedLength) {
+    uint32_t h = 2166136261u;
+    h = (h ^ salt) * 16777619u;
+    for (size_t i = 0; i < seedLength; i++) {
+        h = (h ^ (uint8_t)seed[i]) * 16777619u;
+    }
+    h = (h ^ 0) * 16777619u; // Separator: seed "ab" + id "c" differs from seed "a" + id "bc"
+    for (size_t i = 0; i < idLength; i++) {
+        h = (h ^ id[i]) * 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+uint8_t OtaRollout::cohort(const uint8_t* id, size_t idLength, const char* seed, size_t seedLength) {
+    return (uint8_t)(hash(SALT_COHORT, id, idLength, seed, seedLength) % 100);
+}
+
+uint32_t OtaRollout::startDelay(const uint8_t* id, size_t idLength, const char* seed, size_t seedLength,
+                                uint32_t windowMs) {
+    if (windowMs == 0) return 0;
+    return (uint32_t)((uint64_t)hash(SALT_DELAY, id, idLength, seed, seedLength) * windowMs >> 32);
+}
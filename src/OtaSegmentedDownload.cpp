@@ -0,0 +1,369 @@
+// Ranged download over several concurrent connections with in-order read-back
+
+#include "OtaSegmentedDownload.h"
+#include "OtaArena.h"
+
+static const size_t HEADER_BYTES_PER_POLL = 256;   // Header bytes parsed per lane per poll()
+
+OtaSegmentedDownload::OtaSegmentedDownload()
+    : laneCount(0), slots(nullptr), blockSize(0), port(0), secure(false), trustStore(nullptr), verify(false),
+      totalBytes(0), cursor(0), nextBlock(0), pollLane(0), reconnects(0),
+      dnsTimeout(5000), tcpTimeout(5000), tlsTimeout(10000), stallTimeout(30000),
+      error(nullptr) {
+    for (size_t i = 0; i < MAX_CONNECTIONS; i++) {
+        lanes[i].client = nullptr;
+        lanes[i].state = LaneState::IDLE;
+        lanes[i].slot = nullptr;
+    }
+}
+
+OtaSegmentedDownload::~OtaSegmentedDownload() {
+    end();
+}
+
+size_t OtaSegmentedDownload::blockSizeFor(size_t connections, size_t memoryCap) {
+    if (connections == 0) connections = 1;
+    size_t size = (memoryCap / connections) & ~(MIN_BLOCK_SIZE - 1);
+    return size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : size;
+}
+
+void OtaSegmentedDownload::setTimeouts(unsigned long dnsMs, unsigned long tcpMs, unsigned long tlsMs,
+                                       unsigned long stallMs) {
+    dnsTimeout = dnsMs;
+    tcpTimeout = tcpMs;
+    tlsTimeout = tlsMs;
+    stallTimeout = stallMs;
+}
+
+void OtaSegmentedDownload::setTrustStore(OtaTrustStore* store, bool verify) {
+    trustStore = store;
+    this->verify = verify;
+}
+
+bool OtaSegmentedDownload::begin(const char* host, uint16_t port, const char* path, bool secure,
+                                 size_t start, size_t totalBytes, size_t blockSize, size_t connections,
+                                 OtaAsyncClient* firstClient, const OtaHttpParser* firstParser) {
+    end();
+    error = nullptr;
+
+    if (blockSize == 0 || start >= totalBytes) {
+        OtaAsyncClient::destroy(firstClient);
+        fail("Invalid segment range");
+        return false;
+    }
+
+    // No more lanes than blocks, then as many as fit in memory
+    size_t blocks = (totalBytes - start + blockSize - 1) / blockSize;
+    connections = max((size_t)1, min(connections, min(blocks, (size_t)MAX_CONNECTIONS)));
+    for (; connections > 0 && !slots; connections--) {
+        slots = OtaArena::acquire(OtaArena::SEGMENT_BLOCKS, connections * blockSize);
+        if (slots) laneCount = connections;
+    }
+    if (!slots) {
+        OtaAsyncClient::destroy(firstClient);
+        fail("Out of memory for segment buffers");
+        return false;
+    }
+
+    if (!this->host.assign(host) || !this->path.assign(path)) {
+        OtaArena::release(OtaArena::SEGMENT_BLOCKS, slots);
+        slots = nullptr;
+        laneCount = 0;
+        OtaAsyncClient::destroy(firstClient);
+        fail("Host or path too long");
+        return false;
+    }
+    this->port = port;
+    this->secure = secure;
+    this->blockSize = blockSize;
+    this->totalBytes = totalBytes;
+    cursor = start;
+    nextBlock = start;
+    pollLane = 0;
+    reconnects = 0;
+
+    for (size_t i = 0; i < laneCount; i++) {
+        Lane& lane = lanes[i];
+        lane.client = nullptr;
+        lane.slot = slots + i * blockSize;
+        lane.received = 0;
+        lane.state = LaneState::IDLE;
+    }
+
+    size_t first = 0;
+    if (firstClient && firstParser) {
+        // Response to the first block already on its way
+        Lane& lane = lanes[0];
+        lane.client = firstClient;
+        lane.parser = *firstParser;
+        lane.blockStart = start;
+        lane.blockEnd = min(start + blockSize, totalBytes);
+        lane.lastProgress = millis();
+        lane.state = LaneState::BODY;
+        nextBlock = lane.blockEnd;
+        first = 1;
+    } else {
+        OtaAsyncClient::destroy(firstClient);
+    }
+
+    for (size_t i = first; i < laneCount && !error; i++) {
+        assignBlock(lanes[i]);
+    }
+    return error == nullptr;
+}
+
+void OtaSegmentedDownload::end() {
+    for (size_t i = 0; i < MAX_CONNECTIONS; i++) {
+        closeLane(lanes[i]);
+        lanes[i].state = LaneState::IDLE;
+        lanes[i].slot = nullptr;
+    }
+    OtaArena::release(OtaArena::SEGMENT_BLOCKS, slots);
+    slots = nullptr;
+    laneCount = 0;
+}
+
+// ============================================================================
+// LANES
+// ============================================================================
+
+size_t OtaSegmentedDownload::poll(size_t maxBytes) {
+    if (!slots || error) return 0;
+
+    size_t total = 0;
+    for (size_t i = 0; i < laneCount && !error; i++) {
+        total += pollLaneState(lanes[(pollLane + i) % laneCount], maxBytes - total);
+    }
+    pollLane = (pollLane + 1) % laneCount;
+    return total;
+}
+
+size_t OtaSegmentedDownload::pollLaneState(Lane& lane, size_t maxBytes) {
+    switch (lane.state) {
+        case LaneState::IDLE:
+        case LaneState::DONE:
+            return 0;
+
+        case LaneState::CONNECTING: {
+            OtaAsyncClient::State state = lane.client->poll();
+            if (state == OtaAsyncClient::State::CONNECTED) {
+                requestBlock(lane);
+            } else if (state == OtaAsyncClient::State::FAILED) {
+                fail(lane.client->getError());
+            }
+            return 0;
+        }
+
+        case LaneState::REQUEST:
+            sendRequest(lane);
+            return 0;
+
+        case LaneState::HEADERS: {
+            size_t budget = HEADER_BYTES_PER_POLL;
+            while (budget-- > 0 && !lane.parser.headersComplete() && !lane.parser.hasError()) {
+                int c = lane.client->read();
+                if (c < 0) {
+                    if (!lane.client->connected()) {
+                        fail("Segment connection closed");
+                    }
+                    break;
+                }
+                uint8_t byteValue = (uint8_t)c;
+                lane.parser.feedHeaders(&byteValue, 1);
+                lane.lastProgress = millis();
+            }
+
+            if (lane.parser.hasError()) {
+                fail(lane.parser.getError());
+            } else if (lane.parser.headersComplete()) {
+                // Anything but the exact requested range would corrupt the image
+                size_t rangeTotal = lane.parser.getContentRangeTotal();
+                if (lane.parser.getStatusCode() != 206 || !lane.parser.hasContentRange() ||
+                    lane.parser.getContentRangeStart() != lane.blockStart ||
+                    (rangeTotal > 0 && rangeTotal != totalBytes) || lane.parser.isGzipEncoded()) {
+                    fail("Unexpected segment response");
+                } else {
+                    lane.state = LaneState::BODY;
+                }
+            } else if (millis() - lane.lastProgress > stallTimeout) {
+                fail("Segment headers timed out");
+            }
+            return 0;
+        }
+
+        case LaneState::BODY: {
+            size_t space = (lane.blockEnd - lane.blockStart) - lane.received;
+            size_t available = lane.client->available();
+            if (available == 0 || maxBytes == 0) {
+                if (available == 0 && !lane.client->connected()) {
+                    fail("Segment connection closed");
+                } else if (available > 0) {
+                    lane.lastProgress = millis(); // Held back by the caller, not stalled
+                } else if (millis() - lane.lastProgress > stallTimeout) {
+                    fail("Segment stalled");
+                }
+                return 0;
+            }
+
+            // A full slot can still have chunked framing left to read
+            uint8_t scratch[16];
+            uint8_t* destination = space > 0 ? lane.slot + lane.received : scratch;
+            size_t toRead = lane.parser.maxBodyRead(min(available, min(maxBytes, space > 0 ? space : sizeof(scratch))));
+            if (toRead == 0) return 0;
+            int bytesRead = lane.client->read(destination, toRead);
+            if (bytesRead <= 0) return 0;
+
+            // Strips chunked framing in place, should a server use it for a range
+            size_t bodyLength = lane.parser.decodeBody(destination, bytesRead);
+            if (lane.parser.hasError()) {
+                fail(lane.parser.getError());
+                return bytesRead;
+            }
+            if (bodyLength > space) {
+                fail("Segment longer than requested");
+                return bytesRead;
+            }
+            lane.received += bodyLength;
+            lane.lastProgress = millis();
+
+            if (lane.parser.isBodyComplete()) {
+                if (lane.received != lane.blockEnd - lane.blockStart) {
+                    fail("Segment shorter than requested");
+                } else {
+                    lane.state = LaneState::DONE;
+                    if (cursor >= lane.blockEnd) {
+                        assignBlock(lane); // Already read back while the framing was pending
+                    }
+                }
+            }
+            return bytesRead;
+        }
+    }
+    return 0;
+}
+
+// Give the lane the next block, on its current connection when it is reusable
+void OtaSegmentedDownload::assignBlock(Lane& lane) {
+    if (nextBlock >= totalBytes) {
+        closeLane(lane);
+        lane.state = LaneState::IDLE;
+        return;
+    }
+
+    lane.blockStart = nextBlock;
+    lane.blockEnd = min(nextBlock + blockSize, totalBytes);
+    lane.received = 0;
+    nextBlock = lane.blockEnd;
+
+    if (lane.client && lane.parser.isBodyComplete() && lane.parser.isKeepAlive() && lane.client->connected()) {
+        requestBlock(lane);
+    } else {
+        if (lane.client) reconnects++;
+        connectLane(lane);
+    }
+}
+
+void OtaSegmentedDownload::connectLane(Lane& lane) {
+    closeLane(lane);
+    lane.client = OtaAsyncClient::create();
+    if (!lane.client) {
+        fail("No client available for segment");
+        return;
+    }
+    if (secure) {
+        lane.client->setTrustStore(trustStore);
+        if (!verify) lane.client->setInsecure();
+    }
+    lane.client->setTimeouts(dnsTimeout, tcpTimeout, tlsTimeout);
+    lane.state = LaneState::CONNECTING;
+    lane.lastProgress = millis();
+
+    if (!lane.client->begin(host.c_str(), port, secure)) {
+        fail(lane.client->getError());
+    }
+}
+
+void OtaSegmentedDownload::requestBlock(Lane& lane) {
+    lane.requestSent = 0;
+    lane.state = LaneState::REQUEST;
+    lane.lastProgress = millis();
+    sendRequest(lane);
+}
+
+// Sends what the socket takes of the block's request. The request is rebuilt
+// from the lane on each call rather than kept per lane; REQUEST continues it
+void OtaSegmentedDownload::sendRequest(Lane& lane) {
+    OtaFixedString<OTA_MAX_URL_LENGTH + OTA_MAX_HOST_LENGTH + 96> request;
+    request.appendf("GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%u-%u\r\nConnection: keep-alive\r\n\r\n",
+                    path.c_str(), host.c_str(), (unsigned)lane.blockStart, (unsigned)(lane.blockEnd - 1));
+
+    while (lane.requestSent < request.length()) {
+        int sent = lane.client->send((const uint8_t*)request.c_str() + lane.requestSent,
+                                     request.length() - lane.requestSent);
+        if (sent < 0) {
+            fail("Segment request failed");
+            return;
+        }
+        if (sent == 0) {
+            if (millis() - lane.lastProgress > stallTimeout) fail("Segment request timed out");
+            return;
+        }
+        lane.requestSent += sent;
+        lane.lastProgress = millis();
+    }
+
+    lane.parser.begin();
+    lane.state = LaneState::HEADERS;
+    lane.lastProgress = millis();
+}
+
+void OtaSegmentedDownload::closeLane(Lane& lane) {
+    if (lane.client) {
+        lane.client->stop();
+        OtaAsyncClient::destroy(lane.client);
+        lane.client = nullptr;
+    }
+}
+
+// ============================================================================
+// IN-ORDER READ-BACK
+// ============================================================================
+
+OtaSegmentedDownload::Lane* OtaSegmentedDownload::cursorLane() const {
+    for (size_t i = 0; i < laneCount; i++) {
+        const Lane& lane = lanes[i];
+        if (lane.state != LaneState::IDLE && lane.blockStart <= cursor && cursor < lane.blockEnd) {
+            return const_cast<Lane*>(&lane);
+        }
+    }
+    return nullptr;
+}
+
+const uint8_t* OtaSegmentedDownload::peek(size_t& length) const {
+    length = 0;
+    Lane* lane = cursorLane();
+    if (!lane) return nullptr;
+
+    size_t offset = cursor - lane->blockStart;
+    if (lane->received <= offset) return nullptr;
+
+    length = lane->received - offset;
+    return lane->slot + offset;
+}
+
+void OtaSegmentedDownload::consume(size_t length) {
+    Lane* lane = cursorLane();
+    if (!lane) return;
+
+    cursor += length;
+    // Block fully read back: its slot is free for the next block
+    if (cursor >= lane->blockEnd && lane->state == LaneState::DONE) {
+        assignBlock(*lane);
+    }
+}
+
+void OtaSegmentedDownload::fail(const char* message) {
+    if (!error) {
+        error = message ? message : "Segment download failed";
+    }
+}
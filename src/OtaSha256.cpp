@@ -0,0 +1,290 @@
+// SHA-256 for image verification: software, mbedtls/peripheral or offloaded
+
+#include "OtaSha256.h"
+
+static const uint32_t OFFLOAD_STACK = 3072;
+static const UBaseType_t OFFLOAD_PRIORITY = 1;
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+OtaSha256::OtaSha256()
+    : backend(OtaHashBackend::HARDWARE), active(false), softLength(0), softFill(0),
+      offloadTask(nullptr), offloadInputDone(false), offloadRunning(false) {}
+
+OtaSha256::~OtaSha256() {
+    end();
+}
+
+const char* OtaSha256::backendName(OtaHashBackend backend) {
+    switch (backend) {
+        case OtaHashBackend::SOFTWARE: return "software";
+        case OtaHashBackend::HARDWARE: return "hardware";
+        case OtaHashBackend::OFFLOAD:  return "offload";
+    }
+    return "unknown";
+}
+
+bool OtaSha256::begin(OtaHashBackend backend, int offloadCore) {
+    end();
+    this->backend = backend;
+
+    if (backend == OtaHashBackend::SOFTWARE) {
+        softStart();
+        active = true;
+        return true;
+    }
+
+    mbedtls_sha256_init(&mbedtlsContext);
+    mbedtls_sha256_starts(&mbedtlsContext, 0);
+    active = true;
+
+    if (backend == OtaHashBackend::OFFLOAD && !startOffload(offloadCore)) {
+        this->backend = OtaHashBackend::HARDWARE;
+    }
+    return true;
+}
+
+void OtaSha256::update(const uint8_t* data, size_t length) {
+    if (!active) return;
+
+    switch (backend) {
+        case OtaHashBackend::SOFTWARE:
+            softUpdate(data, length);
+            break;
+
+        case OtaHashBackend::HARDWARE:
+            mbedtls_sha256_update(&mbedtlsContext, data, length);
+            break;
+
+        case OtaHashBackend::OFFLOAD:
+            while (length > 0) {
+                size_t contiguous = 0;
+                uint8_t* dst = offloadBuffer.writePtr(contiguous);
+                if (contiguous == 0) {
+                    // Hasher is behind: let it catch up
+                    xTaskNotifyGive(offloadTask);
+                    taskYIELD();
+                    continue;
+                }
+                size_t take = min(length, contiguous);
+                memcpy(dst, data, take);
+                offloadBuffer.commitWrite(take);
+                data += take;
+                length -= take;
+            }
+            xTaskNotifyGive(offloadTask);
+            break;
+    }
+}
+
+bool OtaSha256::finish(uint8_t digest[DIGEST_SIZE]) {
+    if (!active) return false;
+
+    if (backend == OtaHashBackend::SOFTWARE) {
+        softFinish(digest);
+    } else {
+        if (backend == OtaHashBackend::OFFLOAD) {
+            stopOffload(); // Returns once everything in the ring is hashed
+        }
+        mbedtls_sha256_finish(&mbedtlsContext, digest);
+        mbedtls_sha256_free(&mbedtlsContext);
+    }
+    active = false;
+    return true;
+}
+
+void OtaSha256::end() {
+    if (!active) return;
+
+    if (backend != OtaHashBackend::SOFTWARE) {
+        stopOffload();
+        mbedtls_sha256_free(&mbedtlsContext);
+    }
+    active = false;
+}
+
+// ============================================================================
+// OFFLOAD
+// ============================================================================
+
+bool OtaSha256::startOffload(int core) {
+    if (!offloadBuffer.begin(OFFLOAD_BUFFER_SIZE, OtaArena::HASH_BUFFER)) {
+        return false;
+    }
+    if (core < 0) {
+        core = xPortGetCoreID() == 0 ? 1 : 0;
+    }
+
+    offloadInputDone.store(false);
+    offloadRunning.store(true);
+
+    if (!OtaArena::createTask(offloadTaskEntry, "ota_sha256", OFFLOAD_STACK, this, OFFLOAD_PRIORITY,
+                              &offloadTask, core, OtaArena::HASH_STACK, OtaArena::HASH_TASK)) {
+        offloadRunning.store(false);
+        offloadBuffer.end();
+        return false;
+    }
+    return true;
+}
+
+void OtaSha256::stopOffload() {
+    if (!offloadTask) return;
+
+    // The task drains the ring (at most OFFLOAD_BUFFER_SIZE bytes) and exits
+    offloadInputDone.store(true, std::memory_order_release);
+    xTaskNotifyGive(offloadTask);
+    while (offloadRunning.load(std::memory_order_acquire)) {
+        delay(1);
+    }
+
+    vTaskDelete(offloadTask);
+    offloadTask = nullptr;
+    offloadBuffer.end();
+}
+
+void OtaSha256::offloadTaskEntry(void* arg) {
+    static_cast<OtaSha256*>(arg)->runOffload();
+
+    // Park until the owner deletes this task
+    for (;;) {
+        vTaskDelay(portMAX_DELAY);
+    }
+}
+
+void OtaSha256::runOffload() {
+    for (;;) {
+        size_t contiguous = 0;
+        const uint8_t* data = offloadBuffer.readPtr(contiguous);
+
+        if (contiguous == 0) {
+            if (offloadInputDone.load(std::memory_order_acquire) && offloadBuffer.used() == 0) {
+                break;
+            }
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        mbedtls_sha256_update(&mbedtlsContext, data, contiguous);
+        offloadBuffer.commitRead(contiguous);
+    }
+
+    offloadRunning.store(false, std::memory_order_release);
+}
+
+// ============================================================================
+// SOFTWARE (FIPS 180-4)
+// ============================================================================
+
+void OtaSha256::softStart() {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(softState, initial, sizeof(initial));
+    softLength = 0;
+    softFill = 0;
+}
+
+void OtaSha256::softUpdate(const uint8_t* data, size_t length) {
+    softLength += length;
+
+    if (softFill > 0) {
+        size_t take = min(length, sizeof(softBlock) - softFill);
+        memcpy(softBlock + softFill, data, take);
+        softFill += take;
+        data += take;
+        length -= take;
+        if (softFill < sizeof(softBlock)) return;
+        softTransform(softState, softBlock);
+        softFill = 0;
+    }
+
+    // Whole blocks straight from the caller's buffer
+    while (length >= sizeof(softBlock)) {
+        softTransform(softState, data);
+        data += sizeof(softBlock);
+        length -= sizeof(softBlock);
+    }
+
+    memcpy(softBlock, data, length);
+    softFill = length;
+}
+
+void OtaSha256::softFinish(uint8_t digest[DIGEST_SIZE]) {
+    uint64_t bitLength = softLength * 8;
+
+    softBlock[softFill++] = 0x80;
+    if (softFill > 56) {
+        memset(softBlock + softFill, 0, sizeof(softBlock) - softFill);
+        softTransform(softState, softBlock);
+        softFill = 0;
+    }
+    memset(softBlock + softFill, 0, 56 - softFill);
+    for (int i = 0; i < 8; i++) {
+        softBlock[63 - i] = (uint8_t)(bitLength >> (8 * i));
+    }
+    softTransform(softState, softBlock);
+
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t)(softState[i] >> 24);
+        digest[4 * i + 1] = (uint8_t)(softState[i] >> 16);
+        digest[4 * i + 2] = (uint8_t)(softState[i] >> 8);
+        digest[4 * i + 3] = (uint8_t)softState[i];
+    }
+}
+
+void OtaSha256::softTransform(uint32_t state[8], const uint8_t block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) |
+               ((uint32_t)block[4 * i + 2] << 8) | (uint32_t)block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+        uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
@@ -0,0 +1,334 @@
+// MQTT topic router: level trie with '+' and '#' wildcards
+
+#include "OtaTopicRouter.h"
+
+OtaTopicRouter::OtaTopicRouter()
+    : client(nullptr), engine(nullptr), labelsUsed(0), dispatching(0), prunePending(false), wasConnected(false) {
+    for (size_t i = 0; i < MAX_NODES; i++) {
+        nodes[i].used = false;
+    }
+    // Root: the empty prefix every filter starts from
+    nodes[0] = {0, 0, NONE, NONE, NONE, NONE, true};
+    for (size_t i = 0; i < MAX_HANDLERS; i++) {
+        handlers[i].handler = nullptr;
+        handlers[i].node = NONE;
+        handlers[i].next = NONE;
+    }
+}
+
+void OtaTopicRouter::attach(PubSubClient& mqtt) {
+    client = &mqtt;
+    engine = nullptr;
+    client->setCallback([this](char* topic, uint8_t* payload, unsigned int length) {
+        dispatch(topic, payload, length);
+    });
+}
+
+void OtaTopicRouter::attach(OtaMqttEngine& mqtt) {
+    engine = &mqtt;
+    client = nullptr;
+    engine->setCallback([this](char* topic, uint8_t* payload, unsigned int length) {
+        dispatch(topic, payload, length);
+    });
+}
+
+bool OtaTopicRouter::isConnected() {
+    return engine ? engine->connected() : client && client->connected();
+}
+
+bool OtaTopicRouter::publish(const char* topic, const char* payload) {
+    if (engine) return engine->publish(topic, payload);
+    return client && client->publish(topic, payload);
+}
+
+uint16_t OtaTopicRouter::getBufferSize() {
+    if (engine) return engine->getBufferSize();
+    return client ? client->getBufferSize() : 0;
+}
+
+bool OtaTopicRouter::setBufferSize(uint16_t size) {
+    if (engine) return engine->setBufferSize(size);
+    return client && client->setBufferSize(size);
+}
+
+void OtaTopicRouter::sendSubscribe(const char* filter) {
+    if (engine) {
+        engine->subscribe(filter);
+    } else {
+        client->subscribe(filter);
+    }
+}
+
+void OtaTopicRouter::sendUnsubscribe(const char* filter) {
+    if (engine) {
+        engine->unsubscribe(filter);
+    } else {
+        client->unsubscribe(filter);
+    }
+}
+
+// '+' and '#' must fill a whole level, and '#' must be the last one
+bool OtaTopicRouter::validFilter(const char* filter) {
+    if (!filter || !filter[0]) return false;
+    for (const char* p = filter; *p; p++) {
+        if (*p != '+' && *p != '#') continue;
+        bool levelStart = p == filter || p[-1] == '/';
+        bool levelEnd = p[1] == '\0' || p[1] == '/';
+        if (!levelStart || !levelEnd) return false;
+        if (*p == '#' && p[1] != '\0') return false;
+    }
+    return true;
+}
+
+uint8_t OtaTopicRouter::findChild(uint8_t parent, const char* level, size_t length) const {
+    for (uint8_t child = nodes[parent].firstChild; child != NONE; child = nodes[child].nextSibling) {
+        if (nodes[child].labelLength == length && memcmp(labels + nodes[child].label, level, length) == 0) {
+            return child;
+        }
+    }
+    return NONE;
+}
+
+uint8_t OtaTopicRouter::addChild(uint8_t parent, const char* level, size_t length) {
+    if (length > 0xFF || labelsUsed + length > LABEL_SPACE) return NONE;
+    for (uint8_t i = 1; i < MAX_NODES; i++) {
+        if (nodes[i].used) continue;
+        memcpy(labels + labelsUsed, level, length);
+        nodes[i] = {(uint16_t)labelsUsed, (uint8_t)length, parent, NONE, nodes[parent].firstChild, NONE, true};
+        nodes[parent].firstChild = i;
+        labelsUsed += length;
+        return i;
+    }
+    return NONE;
+}
+
+uint8_t OtaTopicRouter::findNode(const char* filter) const {
+    uint8_t node = 0;
+    const char* level = filter;
+    while (node != NONE) {
+        const char* slash = strchr(level, '/');
+        size_t length = slash ? (size_t)(slash - level) : strlen(level);
+        node = findChild(node, level, length);
+        if (!slash) break;
+        level = slash + 1;
+    }
+    return node;
+}
+
+bool OtaTopicRouter::isActive(uint8_t node) const {
+    for (uint8_t h = nodes[node].firstHandler; h != NONE; h = handlers[h].next) {
+        if (handlers[h].handler) return true;
+    }
+    return false;
+}
+
+bool OtaTopicRouter::subscribe(const char* filter, OtaTopicHandler handler, void* context) {
+    if (!handler || !validFilter(filter)) return false;
+
+    uint8_t slot = NONE;
+    for (uint8_t i = 0; i < MAX_HANDLERS && slot == NONE; i++) {
+        if (handlers[i].node == NONE) slot = i;
+    }
+    if (slot == NONE) return false;
+
+    uint8_t node = 0;
+    const char* level = filter;
+    while (true) {
+        const char* slash = strchr(level, '/');
+        size_t length = slash ? (size_t)(slash - level) : strlen(level);
+        uint8_t child = findChild(node, level, length);
+        if (child == NONE) child = addChild(node, level, length);
+        if (child == NONE) {
+            // Out of nodes or label space: drop the levels added so far
+            if (dispatching) {
+                prunePending = true;
+            } else {
+                prune();
+            }
+            return false;
+        }
+        node = child;
+        if (!slash) break;
+        level = slash + 1;
+    }
+
+    // Append, so handlers of a filter run in subscription order
+    uint8_t* link = &nodes[node].firstHandler;
+    while (*link != NONE) {
+        Handler& existing = handlers[*link];
+        if (existing.handler == handler && existing.context == context) return true;
+        link = &existing.next;
+    }
+    bool first = !isActive(node);
+    handlers[slot] = {handler, context, node, NONE};
+    *link = slot;
+
+    if (first && isConnected()) {
+        sendSubscribe(filter);
+    }
+    return true;
+}
+
+void OtaTopicRouter::unsubscribe(const char* filter, OtaTopicHandler handler, void* context) {
+    if (!validFilter(filter)) return;
+    uint8_t node = findNode(filter);
+    if (node == NONE) return;
+
+    for (uint8_t h = nodes[node].firstHandler; h != NONE; h = handlers[h].next) {
+        if (handlers[h].handler == handler && handlers[h].context == context) {
+            handlers[h].handler = nullptr; // Unlinked by prune()
+            break;
+        }
+    }
+    if (!isActive(node) && isConnected()) {
+        sendUnsubscribe(filter);
+    }
+
+    // A dispatch in progress may still be walking this node
+    if (dispatching) {
+        prunePending = true;
+    } else {
+        prune();
+    }
+}
+
+bool OtaTopicRouter::loop() {
+    if (!client && !engine) return false;
+    if (engine) engine->loop(); // Also completes a connect started with engine->connect()
+    bool connected = isConnected();
+    if (connected && !wasConnected) {
+        resubscribe();
+    }
+    wasConnected = connected;
+    return connected && (engine || client->loop());
+}
+
+void OtaTopicRouter::resubscribe() {
+    if (!isConnected()) return;
+    char filter[LABEL_SPACE + 1];
+    for (uint8_t i = 1; i < MAX_NODES; i++) {
+        if (nodes[i].used && isActive(i) && buildFilter(i, filter, sizeof(filter))) {
+            sendSubscribe(filter);
+        }
+    }
+}
+
+size_t OtaTopicRouter::dispatch(const char* topic, uint8_t* payload, unsigned int length) {
+    if (!topic) return 0;
+    dispatching++;
+    size_t count = match(0, topic, topic, payload, length);
+    dispatching--;
+    if (dispatching == 0 && prunePending) {
+        prunePending = false;
+        prune();
+    }
+    return count;
+}
+
+// node matches the topic up to level; level is nullptr once every level is used
+size_t OtaTopicRouter::match(uint8_t node, const char* topic, const char* level, uint8_t* payload,
+                             unsigned int length) {
+    size_t count = 0;
+    if (!level) {
+        count += callHandlers(node, topic, payload, length);
+        // "a/#" also matches "a"
+        for (uint8_t child = nodes[node].firstChild; child != NONE; child = nodes[child].nextSibling) {
+            if (nodes[child].labelLength == 1 && labels[nodes[child].label] == '#') {
+                count += callHandlers(child, topic, payload, length);
+            }
+        }
+        return count;
+    }
+
+    const char* slash = strchr(level, '/');
+    size_t levelLength = slash ? (size_t)(slash - level) : strlen(level);
+    const char* next = slash ? slash + 1 : nullptr;
+    // Wildcards at the first level do not match "$SYS"-style topics
+    bool wildcards = node != 0 || level[0] != '$';
+
+    for (uint8_t child = nodes[node].firstChild; child != NONE; child = nodes[child].nextSibling) {
+        const char* label = labels + nodes[child].label;
+        if (nodes[child].labelLength == 1 && (label[0] == '+' || label[0] == '#')) {
+            if (!wildcards) continue;
+            count += label[0] == '#' ? callHandlers(child, topic, payload, length)
+                                     : match(child, topic, next, payload, length);
+        } else if (nodes[child].labelLength == levelLength && memcmp(label, level, levelLength) == 0) {
+            count += match(child, topic, next, payload, length);
+        }
+    }
+    return count;
+}
+
+size_t OtaTopicRouter::callHandlers(uint8_t node, const char* topic, uint8_t* payload, unsigned int length) {
+    size_t count = 0;
+    for (uint8_t h = nodes[node].firstHandler; h != NONE; h = handlers[h].next) {
+        if (handlers[h].handler) {
+            handlers[h].handler(topic, payload, length, handlers[h].context);
+            count++;
+        }
+    }
+    return count;
+}
+
+// Frees removed handlers, then nodes left without handlers and children
+void OtaTopicRouter::prune() {
+    for (uint8_t i = 0; i < MAX_NODES; i++) {
+        if (!nodes[i].used) continue;
+        uint8_t* link = &nodes[i].firstHandler;
+        while (*link != NONE) {
+            Handler& entry = handlers[*link];
+            if (entry.handler) {
+                link = &entry.next;
+            } else {
+                uint8_t next = entry.next;
+                entry.node = NONE;
+                entry.next = NONE;
+                *link = next;
+            }
+        }
+    }
+
+    bool removed = true;
+    while (removed) {
+        removed = false;
+        for (uint8_t i = 1; i < MAX_NODES; i++) {
+            if (nodes[i].used && nodes[i].firstChild == NONE && nodes[i].firstHandler == NONE) {
+                removeNode(i);
+                removed = true;
+            }
+        }
+    }
+}
+
+void OtaTopicRouter::removeNode(uint8_t node) {
+    uint8_t* link = &nodes[nodes[node].parent].firstChild;
+    while (*link != node) link = &nodes[*link].nextSibling;
+    *link = nodes[node].nextSibling;
+
+    // Close the gap in the label space
+    uint16_t start = nodes[node].label;
+    uint8_t length = nodes[node].labelLength;
+    memmove(labels + start, labels + start + length, labelsUsed - start - length);
+    labelsUsed -= length;
+    for (uint8_t i = 1; i < MAX_NODES; i++) {
+        if (nodes[i].used && nodes[i].label > start) nodes[i].label -= length;
+    }
+    nodes[node].used = false;
+}
+
+bool OtaTopicRouter::buildFilter(uint8_t node, char* filter, size_t size) const {
+    size_t total = 0;
+    for (uint8_t n = node; n != 0; n = nodes[n].parent) {
+        total += nodes[n].labelLength + (nodes[n].parent != 0 ? 1 : 0);
+    }
+    if (total >= size) return false;
+
+    filter[total] = '\0';
+    size_t end = total;
+    for (uint8_t n = node; n != 0; n = nodes[n].parent) {
+        end -= nodes[n].labelLength;
+        memcpy(filter + end, labels + nodes[n].label, nodes[n].labelLength);
+        if (nodes[n].parent != 0) filter[--end] = '/';
+    }
+    return true;
+}
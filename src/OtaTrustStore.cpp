@@ -0,0 +1,233 @@
+// Shared TLS trust store and session cache
+
+#include "OtaTrustStore.h"
+#include <mbedtls/version.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+
+// Session fields are private in mbed TLS 3
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+  #define OTA_TLS_FIELD(member) MBEDTLS_PRIVATE(member)
+#else
+  #define OTA_TLS_FIELD(member) member
+#endif
+
+OtaTrustStore::OtaTrustStore()
+    : bundle(nullptr), caLoaded(false), certLoaded(false), insecure(false), useCounter(0),
+      fullHandshakes(0), resumedHandshakes(0), fullMicros(0), resumedMicros(0) {
+    mbedtls_x509_crt_init(&ca);
+    mbedtls_x509_crt_init(&ownCert);
+    mbedtls_pk_init(&ownKey);
+    for (size_t i = 0; i < MAX_SESSIONS; i++) {
+        entries[i].used = false;
+        mbedtls_ssl_session_init(&entries[i].session);
+    }
+}
+
+OtaTrustStore::~OtaTrustStore() {
+    clearSessions();
+    mbedtls_x509_crt_free(&ca);
+    mbedtls_x509_crt_free(&ownCert);
+    mbedtls_pk_free(&ownKey);
+}
+
+bool OtaTrustStore::setCACert(const char* pem) {
+    clearCA();
+    caLoaded = pem && mbedtls_x509_crt_parse(&ca, (const unsigned char*)pem, strlen(pem) + 1) == 0;
+    return caLoaded;
+}
+
+bool OtaTrustStore::setCertificate(const char* certPem, const char* keyPem) {
+    clearCertificate();
+    if (!certPem || !keyPem) return false;
+    if (mbedtls_x509_crt_parse(&ownCert, (const unsigned char*)certPem, strlen(certPem) + 1) != 0) return false;
+    certLoaded = parseKey((const unsigned char*)keyPem, strlen(keyPem) + 1);
+    return certLoaded;
+}
+
+void OtaTrustStore::clearCA() {
+    mbedtls_x509_crt_free(&ca);
+    mbedtls_x509_crt_init(&ca);
+    caLoaded = false;
+    clearSessions(); // Verified against the old CA
+}
+
+bool OtaTrustStore::addCA(const uint8_t* der, size_t length) {
+    if (mbedtls_x509_crt_parse_der(&ca, der, length) != 0) return false;
+    caLoaded = true;
+    return true;
+}
+
+void OtaTrustStore::clearCertificate() {
+    mbedtls_x509_crt_free(&ownCert);
+    mbedtls_pk_free(&ownKey);
+    mbedtls_x509_crt_init(&ownCert);
+    mbedtls_pk_init(&ownKey);
+    certLoaded = false;
+    clearSessions(); // Sessions carry the client identity they were made with
+}
+
+bool OtaTrustStore::addCertificate(const uint8_t* der, size_t length) {
+    return mbedtls_x509_crt_parse_der(&ownCert, der, length) == 0;
+}
+
+bool OtaTrustStore::setKey(const uint8_t* der, size_t length) {
+    mbedtls_pk_free(&ownKey);
+    mbedtls_pk_init(&ownKey);
+    certLoaded = ownCert.version != 0 && parseKey(der, length);
+    return certLoaded;
+}
+
+void OtaTrustStore::setBundle(OtaCertBundle* bundle) {
+    this->bundle = bundle;
+    clearSessions();
+}
+
+bool OtaTrustStore::parseKey(const unsigned char* key, size_t length) {
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+    // Key parsing takes an RNG in mbed TLS 3 (blinding)
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    int ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, nullptr, 0);
+    if (ret == 0) ret = mbedtls_pk_parse_key(&ownKey, key, length, nullptr, 0, mbedtls_ctr_drbg_random, &drbg);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+    return ret == 0;
+#else
+    return mbedtls_pk_parse_key(&ownKey, key, length, nullptr, 0) == 0;
+#endif
+}
+
+// ============================================================================
+// SESSION CACHE
+// ============================================================================
+
+// FNV-1a, case-insensitive like host names
+uint32_t OtaTrustStore::hashHost(const char* host) {
+    uint32_t hash = 2166136261u;
+    for (const char* p = host; *p; p++) {
+        hash ^= (uint8_t)tolower((unsigned char)*p);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+OtaTrustStore::Entry* OtaTrustStore::find(const char* host, uint16_t port, bool verified) {
+    uint32_t hash = hashHost(host);
+    for (size_t i = 0; i < MAX_SESSIONS; i++) {
+        Entry& entry = entries[i];
+        if (entry.used && entry.hostHash == hash && entry.port == port && entry.verified == verified) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool OtaTrustStore::offerSession(const char* host, uint16_t port, bool verified, mbedtls_ssl_context* ssl) {
+    Entry* entry = find(host, port, verified);
+    if (!entry) return false;
+    entry->lastUse = ++useCounter;
+    return mbedtls_ssl_set_session(ssl, &entry->session) == 0;
+}
+
+bool OtaTrustStore::isResumed(const char* host, uint16_t port, bool verified, const mbedtls_ssl_context* ssl) {
+    Entry* entry = find(host, port, verified);
+    if (!entry) return false;
+
+    // A resumed handshake keeps the session ID that was offered
+    const mbedtls_ssl_session* current = ssl->OTA_TLS_FIELD(session);
+    const mbedtls_ssl_session& cached = entry->session;
+    size_t idLength = cached.OTA_TLS_FIELD(id_len);
+    return current && idLength > 0 && current->OTA_TLS_FIELD(id_len) == idLength &&
+           memcmp(current->OTA_TLS_FIELD(id), cached.OTA_TLS_FIELD(id), idLength) == 0;
+}
+
+bool OtaTrustStore::verifyPeer(const char* host, const mbedtls_ssl_context* ssl) {
+    if (mbedtls_ssl_get_verify_result(ssl) == 0) return true;   // Chained to the CA certificate
+    if (!hasBundle()) return false;
+
+    // The CA that issued the last certificate the server sent
+    const mbedtls_x509_crt* peer = mbedtls_ssl_get_peer_cert(ssl);
+    if (!peer) return false;
+    const mbedtls_x509_crt* top = peer;
+    while (top->next && top->next->version != 0) top = top->next;
+
+    mbedtls_x509_crt issuers;
+    mbedtls_x509_crt_init(&issuers);
+    uint32_t flags = 0;
+    bool trusted = bundle->load(top->issuer_raw.p, top->issuer_raw.len, &issuers) > 0 &&
+                   mbedtls_x509_crt_verify(const_cast<mbedtls_x509_crt*>(peer), &issuers, nullptr, host,
+                                           &flags, nullptr, nullptr) == 0;
+    mbedtls_x509_crt_free(&issuers);
+    return trusted;
+}
+
+void OtaTrustStore::completeHandshake(const char* host, uint16_t port, bool verified, mbedtls_ssl_context* ssl,
+                                      bool resumed, unsigned long micros) {
+    if (resumed) {
+        resumedHandshakes++;
+        resumedMicros += micros;
+    } else {
+        fullHandshakes++;
+        fullMicros += micros;
+    }
+
+    // Keep the newest session; reuse the least recently used entry when full
+    Entry* entry = find(host, port, verified);
+    if (!entry) {
+        entry = &entries[0];
+        for (size_t i = 0; i < MAX_SESSIONS; i++) {
+            if (!entries[i].used) {
+                entry = &entries[i];
+                break;
+            }
+            if (entries[i].lastUse < entry->lastUse) entry = &entries[i];
+        }
+    }
+    mbedtls_ssl_session_free(&entry->session);
+    mbedtls_ssl_session_init(&entry->session);
+    entry->used = mbedtls_ssl_get_session(ssl, &entry->session) == 0;
+    entry->hostHash = hashHost(host);
+    entry->port = port;
+    entry->verified = verified;
+    entry->lastUse = ++useCounter;
+}
+
+void OtaTrustStore::forgetSession(const char* host, uint16_t port) {
+    for (int verified = 0; verified < 2; verified++) {
+        Entry* entry = find(host, port, verified != 0);
+        if (entry) {
+            mbedtls_ssl_session_free(&entry->session);
+            mbedtls_ssl_session_init(&entry->session);
+            entry->used = false;
+        }
+    }
+}
+
+void OtaTrustStore::clearSessions() {
+    for (size_t i = 0; i < MAX_SESSIONS; i++) {
+        mbedtls_ssl_session_free(&entries[i].session);
+        mbedtls_ssl_session_init(&entries[i].session);
+        entries[i].used = false;
+    }
+}
+
+// ============================================================================
+// STATISTICS
+// ============================================================================
+
+unsigned long OtaTrustStore::getFullHandshakeMicros() const {
+    return fullHandshakes > 0 ? (unsigned long)(fullMicros / fullHandshakes) : 0;
+}
+
+unsigned long OtaTrustStore::getResumedHandshakeMicros() const {
+    return resumedHandshakes > 0 ? (unsigned long)(resumedMicros / resumedHandshakes) : 0;
+}
+
+uint64_t OtaTrustStore::getSavedMicros() const {
+    unsigned long full = getFullHandshakeMicros();
+    unsigned long resumed = getResumedHandshakeMicros();
+    return full > resumed ? (uint64_t)resumedHandshakes * (full - resumed) : 0;
+}
@@ -0,0 +1,38 @@
+// Semantic version precedence
+
+#include "OtaVersion.h"
+
+// Identifiers are compared left to right: numeric ones numerically, others in
+// ASCII order, numeric below alphanumeric; a shorter list that matches so far
+// ranks lower
+int OtaVersion::comparePrerelease(const OtaVersion& other) const {
+    const char* a = text + preStart;
+    const char* aEnd = a + preLength;
+    const char* b = other.text + other.preStart;
+    const char* bEnd = b + other.preLength;
+
+    while (true) {
+        const char* aId = a;
+        const char* bId = b;
+        while (a < aEnd && *a != '.') a++;
+        while (b < bEnd && *b != '.') b++;
+        size_t aLength = a - aId;
+        size_t bLength = b - bId;
+        bool aNumeric = isNumeric(aId, 0, aLength);
+        bool bNumeric = isNumeric(bId, 0, bLength);
+
+        if (aNumeric != bNumeric) return aNumeric ? -1 : 1;
+        if (aNumeric && aLength != bLength) {
+            return aLength < bLength ? -1 : 1; // No leading zeros: longer is larger
+        }
+        int order = memcmp(aId, bId, aLength < bLength ? aLength : bLength);
+        if (order != 0) return order < 0 ? -1 : 1;
+        if (aLength != bLength) return aLength < bLength ? -1 : 1;
+
+        if (a == aEnd || b == bEnd) {
+            return a == aEnd ? (b == bEnd ? 0 : -1) : 1;
+        }
+        a++;
+        b++;
+    }
+}
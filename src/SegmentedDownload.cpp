@@ -0,0 +1,125 @@
+// Segmented download for ESP32OtaMqtt
+// With segmentConnections > 1 the first request asks for one block only
+// ("Range: bytes=S-E"). A 206 answer reveals the image size and range support;
+// the connection then becomes the first lane of an OtaSegmentedDownload that
+// fetches the remaining blocks over further connections. Blocks are read back
+// in order into the same hash and flash path as a single-stream download, so
+// resume, verification and delta/decompression work unchanged. A 200 answer
+// (no range support) continues as a normal single-stream download.
+
+#include "ESP32OtaMqtt.h"
+
+// Segmented mode is only used for byte-stable responses
+bool ESP32OtaMqtt::useSegments() const {
+    return config.segmentConnections > 1 && !config.acceptGzipEncoding;
+}
+
+size_t ESP32OtaMqtt::segmentBlockSize() const {
+    return OtaSegmentedDownload::blockSizeFor(config.segmentConnections, config.segmentMemory);
+}
+
+// Hand the connection that received the first block's headers to the lanes
+bool ESP32OtaMqtt::startSegmentedDownload() {
+    bool secure = false;
+    OtaHostString host;
+    OtaUrlString path;
+    int port = 0;
+    if (!parseUrl(downloadUrl.c_str(), secure, host, port, path)) {
+        reportError("Invalid URL protocol");
+        return false;
+    }
+
+    OtaAsyncClient* first = downloadClient;
+    downloadClient = nullptr;
+    downloadClientReusable = false;
+
+    segments.setTimeouts(config.dnsTimeout, config.tcpConnectTimeout, config.tlsHandshakeTimeout,
+                         config.downloadTimeout);
+    segments.setTrustStore(&trustStore, verifyDownloadServer());
+    if (!segments.begin(host.c_str(), (uint16_t)port, path.c_str(), secure, downloadedBytes, totalBytes,
+                        segmentBlockSize(), config.segmentConnections, first, &httpParser)) {
+        reportError(String("Segmented download failed: ") + segments.getError());
+        segments.end();
+        return false;
+    }
+
+    OTA_LOGI("Segmented download: %u connections, %u byte blocks",
+             (unsigned)segments.getLaneCount(), (unsigned)segmentBlockSize());
+    return true;
+}
+
+bool ESP32OtaMqtt::processSegmentedDownload() {
+    // Same overall limit as the single-stream path
+    if (millis() - downloadStartTime > config.downloadTimeout) {
+        if (isDownloadInterrupted()) {
+            OTA_LOGW("Download timeout, will resume");
+        } else {
+            reportError("Download timeout");
+            cleanupDownload();
+        }
+        return false;
+    }
+
+    // Receive: fixed mode allows chunkSize bytes per connection and call
+    size_t recvQuota = loopBudget.isEnabled()
+        ? loopBudget.nextSlice(config.segmentMemory, false)
+        : config.chunkSize * segments.getLaneCount();
+    unsigned long recvStart = micros();
+    size_t bytesRead = segments.poll(bandwidth.allowance(recvStart, recvQuota));
+    if (bytesRead > 0) {
+        bandwidth.consume(bytesRead);
+        loopBudget.record(OtaLoopBudget::RECV, bytesRead, micros() - recvStart);
+        loopBudget.addBytes(bytesRead);
+    }
+
+    if (segments.hasError()) {
+        // Leaves downloadedBytes at the in-order position, so the retry resumes there
+        OTA_LOGW("Segment error: %s", segments.getError());
+        segments.end();
+        return false;
+    }
+
+    // Read back in order
+    bool consumed = false;
+    size_t length = 0;
+    const uint8_t* data;
+    while ((data = segments.peek(length)) != nullptr) {
+        size_t slice = loopBudget.nextSlice(length, true);
+        if (slice == 0) break;
+
+        unsigned long consumeStart = micros();
+        stageHashMicros = 0;
+        measureStages = loopBudget.isEnabled();
+        bool ok = consumeDownloadData(data, slice);
+        measureStages = false;
+        if (!ok) {
+            reportWriteError(flashWriter.getError());
+            cleanupDownload();
+            return false;
+        }
+        unsigned long consumeMicros = micros() - consumeStart;
+        loopBudget.record(OtaLoopBudget::HASH, slice, stageHashMicros);
+        loopBudget.record(OtaLoopBudget::WRITE, slice, consumeMicros - min(consumeMicros, stageHashMicros));
+
+        segments.consume(slice);
+        downloadedBytes += slice;
+        consumed = true;
+    }
+
+    if (consumed) {
+        if (totalBytes > 0) {
+            int progress = (downloadedBytes * 100) / totalBytes;
+            updateStatus(OtaStatus::DOWNLOADING, progress);
+        }
+        yieldIfNeeded();
+    } else if (bytesRead == 0) {
+        eraseAheadWhileIdle();
+    }
+
+    if (segments.isComplete()) {
+        OTA_LOGI("Segmented download complete (%u reconnects)", (unsigned)segments.getReconnects());
+        segments.end();
+        return false; // Signal completion
+    }
+    return true; // Continue downloading
+}
@@ -0,0 +1,98 @@
+// Sources: src/OtaDecompressor.cpp src/OtaArena.cpp
+// Libraries: -lz
+// Compressed size, decoder RAM and decode speed for a firmware-like image,
+// fed in 1460 byte slices as it arrives from the socket.
+//   gzip:       level 9; on the host zlib stands in for the ROM tinfl, so its
+//               speed is only indicative of the framing and CRC overhead, and its
+//               RAM includes the shim's zlib pool instead of the ~11 KB tinfl state
+//   heatshrink: the library's own decoder, window/lookahead bits as in the
+//               manifest's compression_window / compression_lookahead
+
+#include "OtaDecompressor.h"
+#include "heatshrink_encode.h"
+#include <chrono>
+#include <zlib.h>
+
+typedef std::vector<uint8_t> Bytes;
+
+static const size_t IMAGE_SIZE = 256 * 1024;
+static const size_t SLICE = 1460;
+static const int RUNS = 20;
+static const uint8_t HEATSHRINK_PARAMS[][2] = {{8, 4}, {10, 5}, {11, 6}};
+
+// Code-like bytes (opcodes with varying operands), then a string table and zero padding
+static Bytes makeImage() {
+    Bytes image(IMAGE_SIZE, 0);
+    uint32_t state = 17;
+    size_t code = IMAGE_SIZE * 3 / 4;
+    for (size_t i = 0; i < code; i++) {
+        state = state * 1103515245u + 12345u;
+        image[i] = (i % 4 == 3) ? (uint8_t)(state >> 16) : (uint8_t)(0x30 + (state >> 28) % 4 + i % 4);
+    }
+    static const char* const STRINGS[] = {"mqtt connect failed", "ota: download started", "wifi: reconnecting",
+                                          "sensor %d read error", "heap free %u"};
+    for (size_t pos = code, n = 0; pos < IMAGE_SIZE - 64; n++) {
+        const char* text = STRINGS[n % 5];
+        memcpy(image.data() + pos, text, strlen(text) + 1);
+        pos += strlen(text) + 1 + n % 7;
+        if (pos > code + IMAGE_SIZE / 8) break;
+    }
+    return image;
+}
+
+static Bytes gzipCompress(const Bytes& data) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, 9, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY);
+    Bytes out(deflateBound(&stream, data.size()));
+    stream.next_in = const_cast<uint8_t*>(data.data());
+    stream.avail_in = (uInt)data.size();
+    stream.next_out = out.data();
+    stream.avail_out = (uInt)out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+static bool discard(void* context, const uint8_t* data, size_t length) {
+    *static_cast<size_t*>(context) += length;
+    return true;
+}
+
+static void run(const char* name, OtaCompression type, const Bytes& input, uint8_t windowBits = 8,
+                uint8_t lookaheadBits = 4) {
+    size_t output = 0;
+    size_t memory = 0;
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < RUNS; run++) {
+        OtaDecompressor decompressor;
+        output = 0;
+        decompressor.begin(type, discard, &output, windowBits, lookaheadBits);
+        memory = decompressor.getMemoryUsage();
+        for (size_t pos = 0; pos < input.size(); pos += SLICE) {
+            decompressor.feed(input.data() + pos, min(SLICE, input.size() - pos));
+        }
+        ok = ok && decompressor.isComplete() && output == IMAGE_SIZE;
+    }
+    double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-16s %8u  %5.1f%%  %6u  %8.1f MB/s%s\n", name, (unsigned)input.size(), 100.0 * input.size() / IMAGE_SIZE,
+           (unsigned)memory, IMAGE_SIZE * (double)RUNS / micros, ok ? "" : "  (decode failed)");
+}
+
+int main() {
+    Bytes image = makeImage();
+    printf("%u KB image, %u byte slices, %d runs\n", (unsigned)(IMAGE_SIZE / 1024), (unsigned)SLICE, RUNS);
+    printf("%-16s %8s  %6s  %6s  %13s\n", "format", "bytes", "ratio", "RAM", "decode");
+    run("none", OtaCompression::NONE, image);
+    run("gzip -9", OtaCompression::GZIP, gzipCompress(image));
+    for (const auto& params : HEATSHRINK_PARAMS) {
+        char name[32];
+        snprintf(name, sizeof(name), "heatshrink %u/%u", params[0], params[1]);
+        HeatshrinkStream stream = heatshrinkEncode(image.data(), image.size(), params[0], params[1]);
+        run(name, OtaCompression::HEATSHRINK, stream.bytes, params[0], params[1]);
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+// Sources: src/OtaHttpParser.cpp
+// Response header parsing and chunked body decoding.
+//   headers: the previous loop (one String per line read up to '\n', trimmed,
+//            then a substring per header value) against OtaHttpParser, on a
+//            CDN-style 206 response of about 660 bytes
+//   body:    OtaHttpParser stripping chunked framing in place, for chunk sizes
+//            from 256 bytes to 16 KB, read in 1460 byte TCP segments
+
+#include "OtaHttpParser.h"
+#include <chrono>
+#include <vector>
+
+static const int HEADER_RUNS = 100000;
+static const size_t BODY_SIZE = 4 << 20;
+static const size_t SEGMENT = 1460;
+static const size_t CHUNK_SIZES[] = {256, 1024, 4096, 16384};
+
+static const char* const RESPONSE =
+    "HTTP/1.1 206 Partial Content\r\n"
+    "Date: Fri, 16 Oct 2026 12:00:00 GMT\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Length: 1048576\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Range: bytes 524288-1572863/1572864\r\n"
+    "Accept-Ranges: bytes\r\n"
+    "ETag: \"5f3c2a9e-180000\"\r\n"
+    "Last-Modified: Thu, 15 Oct 2026 09:30:00 GMT\r\n"
+    "Cache-Control: public, max-age=31536000, immutable\r\n"
+    "Age: 3600\r\n"
+    "Via: 1.1 varnish, 1.1 cdn-edge-fra3\r\n"
+    "X-Cache: HIT, HIT\r\n"
+    "X-Cache-Hits: 12, 4\r\n"
+    "X-Served-By: cache-fra19134-FRA, cache-fra19171-FRA\r\n"
+    "X-Timer: S1760616000.123456,VS0,VE1\r\n"
+    "Strict-Transport-Security: max-age=63072000; includeSubDomains; preload\r\n"
+    "Server: cdn\r\n"
+    "X-Request-Id: 7f8d9c2b-4e1a-4b3c-9d2e-1a2b3c4d5e6f\r\n"
+    "\r\n";
+
+// Previous headerValue(), on std::string
+static bool headerValue(const std::string& line, const char* name, std::string& value) {
+    size_t nameLength = strlen(name);
+    if (line.length() <= nameLength || line[nameLength] != ':') return false;
+    if (strncasecmp(line.c_str(), name, nameLength) != 0) return false;
+    size_t start = line.find_first_not_of(" \t", nameLength + 1);
+    value = start == std::string::npos ? std::string() : line.substr(start);
+    return true;
+}
+
+// Previous readStringUntil('\n') loop; returns the status code
+static int parseWithStrings(const char* response, size_t length, long& contentLength) {
+    int statusCode = 0;
+    bool statusLine = true;
+    size_t pos = 0;
+    while (pos < length) {
+        std::string line;
+        while (pos < length && response[pos] != '\n') line += response[pos++];
+        pos++;
+        size_t end = line.find_last_not_of(" \t\r");
+        line.erase(end == std::string::npos ? 0 : end + 1);
+
+        if (statusLine) {
+            size_t space = line.find(' ');
+            if (space != std::string::npos) statusCode = atoi(line.substr(space + 1).c_str());
+            statusLine = false;
+            continue;
+        }
+
+        std::string value;
+        if (headerValue(line, "Content-Length", value)) {
+            contentLength = atol(value.c_str());
+        } else if (headerValue(line, "Content-Range", value) || headerValue(line, "Content-Encoding", value) ||
+                   headerValue(line, "Accept-Ranges", value)) {
+            // Values unused here: the lookups are what the previous loop paid for
+        }
+        if (line.empty()) break;
+    }
+    return statusCode;
+}
+
+static double elapsedMicros(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void benchHeaders() {
+    size_t length = strlen(RESPONSE);
+    long contentLength = 0;
+    int status = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < HEADER_RUNS; run++) {
+        status += parseWithStrings(RESPONSE, length, contentLength);
+    }
+    double stringMicros = elapsedMicros(start) / HEADER_RUNS;
+
+    OtaHttpParser parser;
+    size_t used = 0;
+    start = std::chrono::steady_clock::now();
+    for (int run = 0; run < HEADER_RUNS; run++) {
+        parser.begin();
+        used += parser.feedHeaders((const uint8_t*)RESPONSE, length);
+    }
+    double parserMicros = elapsedMicros(start) / HEADER_RUNS;
+
+    printf("Headers, %u bytes, %d runs\n", (unsigned)length, HEADER_RUNS);
+    printf("  string lines   %7.3f us  (status %d, Content-Length %ld)\n", stringMicros, status / HEADER_RUNS,
+           contentLength);
+    printf("  OtaHttpParser  %7.3f us  (status %d, Content-Length %u, range %u/%u)\n", parserMicros,
+           parser.getStatusCode(), (unsigned)parser.getContentLength(), (unsigned)parser.getContentRangeStart(),
+           (unsigned)parser.getContentRangeTotal());
+    if (used != length * HEADER_RUNS) printf("  (parser stopped early: %s)\n", parser.getError());
+}
+
+static void benchChunked(size_t chunkSize) {
+    std::string stream = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+    for (size_t pos = 0; pos < BODY_SIZE; pos += chunkSize) {
+        char header[16];
+        snprintf(header, sizeof(header), "%x\r\n", (unsigned)min(chunkSize, BODY_SIZE - pos));
+        stream += header;
+        stream.append(min(chunkSize, BODY_SIZE - pos), (char)('a' + pos / chunkSize % 26));
+        stream += "\r\n";
+    }
+    stream += "0\r\n\r\n";
+
+    std::vector<uint8_t> buffer(SEGMENT);
+    OtaHttpParser parser;
+    size_t body = 0;
+    auto start = std::chrono::steady_clock::now();
+    size_t pos = 0;
+    while (pos < stream.size() && !parser.isBodyComplete() && !parser.hasError()) {
+        size_t length = min(SEGMENT, stream.size() - pos);
+        memcpy(buffer.data(), stream.data() + pos, length);
+        pos += length;
+        size_t used = parser.headersComplete() ? 0 : parser.feedHeaders(buffer.data(), length);
+        if (parser.headersComplete()) body += parser.decodeBody(buffer.data() + used, length - used);
+    }
+    double micros = elapsedMicros(start);
+
+    printf("  %5u byte chunks  %7.1f MB/s%s\n", (unsigned)chunkSize, BODY_SIZE / micros,
+           body == BODY_SIZE && parser.isBodyComplete() ? "" : "  (body mismatch)");
+}
+
+int main() {
+    benchHeaders();
+    printf("Chunked body, %u MB in %u byte reads (memcpy included)\n", (unsigned)(BODY_SIZE >> 20),
+           (unsigned)SEGMENT);
+    for (size_t chunkSize : CHUNK_SIZES) {
+        benchChunked(chunkSize);
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Sources: src/OtaLog.cpp src/OtaArena.cpp
+// What a log call costs the code that logs, deferred into the ring, against
+// formatting the same line at the call (as printing right away must), and
+// what the drain later pays per line to turn records back into text. The
+// ring is drained after every 1000 calls, before it fills, outside the timed
+// loop; a last run keeps it full to time the drop path.
+
+#include "OtaLog.h"
+#include <chrono>
+
+static const int CALLS = 2000000;
+
+typedef std::chrono::steady_clock Clock;
+
+static double nanosSince(Clock::time_point start, int calls) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / calls;
+}
+
+static size_t drainAll() {
+    char line[OtaLog::LINE_SIZE];
+    size_t lines = 0;
+    while (OtaLog::peekLine(line, sizeof(line)) > 0) {
+        OtaLog::pop();
+        lines++;
+    }
+    return lines;
+}
+
+int main() {
+    static const size_t RING_SIZE = 64 * 1024;
+    OtaLog::begin(RING_SIZE);
+    int claim;
+    OtaLog::claimDrain(&claim);
+    const char* host = "fw.example.com";
+
+    // Deferred: record the arguments; drain between batches, untimed
+    double logNanos = 0;
+    double drainNanos = 0;
+    size_t drained = 0;
+    for (int done = 0; done < CALLS;) {
+        int batch = 1000;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < batch; i++) {
+            OTA_LOGI("Downloaded %u/%u bytes from %s (%.1f KB/s)", (unsigned)(done + i), 1048576u, host, 87.5);
+        }
+        logNanos += nanosSince(start, 1);
+        start = Clock::now();
+        drained += drainAll();
+        drainNanos += nanosSince(start, 1);
+        done += batch;
+    }
+
+    // Formatting at the call instead
+    char line[OtaLog::LINE_SIZE];
+    size_t total = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < CALLS; i++) {
+        total += snprintf(line, sizeof(line), "[OTA] Downloaded %u/%u bytes from %s (%.1f KB/s)", (unsigned)i,
+                          1048576u, host, 87.5);
+    }
+    double formatNanos = nanosSince(start, CALLS);
+
+    // Ring full: every call is dropped
+    while (OtaLog::getDropped() == 0) OTA_LOGI("fill %d", 0);
+    start = Clock::now();
+    for (int i = 0; i < CALLS; i++) {
+        OTA_LOGI("Downloaded %u/%u bytes from %s (%.1f KB/s)", (unsigned)i, 1048576u, host, 87.5);
+    }
+    double dropNanos = nanosSince(start, CALLS);
+    drainAll();
+
+    printf("%d calls, 4 arguments, %u KB ring\n", CALLS, (unsigned)(RING_SIZE / 1024));
+    printf("%-28s %8.1f ns\n", "deferred log call", logNanos / CALLS);
+    printf("%-28s %8.1f ns\n", "snprintf at the call", formatNanos);
+    printf("%-28s %8.1f ns\n", "drain, per line", drainNanos / drained);
+    printf("%-28s %8.1f ns\n", "dropped call (ring full)", dropNanos);
+    printf("(%u lines drained, %u bytes formatted)\n", (unsigned)drained, (unsigned)total);
+    return 0;
+}
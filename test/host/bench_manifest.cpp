@@ -0,0 +1,140 @@
+// Sources: src/OtaJson.cpp
+// Host version of examples/manifest_benchmark: time to extract the manifest
+// fields from update messages of growing size.
+//   string:    the previous parser (payload copied into a string one char at
+//              a time, then one find scan and substring per field)
+//   tokenizer: OtaJson, one in-place pass over the payload
+// std::string grows geometrically where the Arduino String reallocates on
+// every append, so the string column understates the device's copy cost.
+// "version" comes last, after the nested one the previous parser picks up.
+
+#include "OtaJson.h"
+#include <chrono>
+#include <vector>
+
+static const int RUNS = 200;
+static const size_t NOTE_COUNTS[] = {4, 32, 128, 1024, 8192};    // Release note entries per message
+
+static const char* const KEYS[] = {
+    "version", "firmware_url", "checksum", "command", "patch_url", "base_version", "compression",
+    "compression_window", "compression_lookahead", "checksum_scope", "image_size"
+};
+static const size_t KEY_COUNT = sizeof(KEYS) / sizeof(KEYS[0]);
+
+// Previous extractJsonValue(), on std::string
+static std::string extractJsonValue(const std::string& json, const std::string& key) {
+    size_t keyIndex = json.find("\"" + key + "\"");
+    if (keyIndex == std::string::npos) return "";
+    size_t colonIndex = json.find(":", keyIndex);
+    if (colonIndex == std::string::npos) return "";
+    size_t startIndex = colonIndex + 1;
+    while (startIndex < json.length() && isspace((unsigned char)json[startIndex])) startIndex++;
+    if (startIndex >= json.length()) return "";
+    if (json[startIndex] != '"') {
+        size_t endIndex = startIndex;
+        while (endIndex < json.length() && json[endIndex] != ',' && json[endIndex] != '}' &&
+               !isspace((unsigned char)json[endIndex])) {
+            endIndex++;
+        }
+        return json.substr(startIndex, endIndex - startIndex);
+    }
+    startIndex++;
+    size_t endIndex = json.find("\"", startIndex);
+    if (endIndex == std::string::npos) return "";
+    return json.substr(startIndex, endIndex - startIndex);
+}
+
+struct Fields {
+    OtaJsonView values[KEY_COUNT];
+};
+
+static bool onValue(void* context, const OtaJsonEvent& event) {
+    if (event.depth != 1 || event.type == OtaJsonType::OBJECT || event.type == OtaJsonType::ARRAY ||
+        event.type == OtaJsonType::END) {
+        return true;
+    }
+    Fields& fields = *static_cast<Fields*>(context);
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        if (event.key() == KEYS[i]) {
+            fields.values[i] = event.value;
+            break;
+        }
+    }
+    return true;
+}
+
+static std::string buildMessage(size_t notes) {
+    std::string message = "{\"command\":\"update\",\"release_notes\":[";
+    for (size_t i = 0; i < notes; i++) {
+        if (i > 0) message += ",";
+        message += "{\"id\":" + std::to_string(i) + ",\"text\":\"Fixed \\\"version\\\" handling in module " +
+                   std::to_string(i) + "\",\"tags\":[\"fix\",\"core\"]}";
+    }
+    message += "],\"metadata\":{\"build\":{\"version\":\"ignored\",\"host\":\"ci-7\"},\"size\":1048576},"
+               "\"firmware_url\":\"https://releases.example.com/firmware-1.4.0.bin\","
+               "\"mirrors\":[\"https://cdn1.example.com/fw.bin\",\"https://cdn2.example.com/fw.bin\"],"
+               "\"checksum\":\"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855\","
+               "\"compression\":\"gzip\",\"image_size\":1048576,\"version\":\"1.4.0\"}";
+    return message;
+}
+
+static unsigned long elapsedMicros(std::chrono::steady_clock::time_point start) {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+static void runBenchmark(size_t notes) {
+    std::string message = buildMessage(notes);
+    const char* payload = message.data();     // Message bytes as they arrive from the MQTT client
+    size_t length = message.length();
+    std::vector<char> work(length);           // Copy parsed in place by the tokenizer
+
+    unsigned long stringMicros = 0;
+    size_t stringFound = 0;
+    std::string stringVersion;
+    for (int run = 0; run < RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        std::string copy;
+        for (size_t i = 0; i < length; i++) {
+            copy += payload[i];
+        }
+        stringFound = 0;
+        for (size_t i = 0; i < KEY_COUNT; i++) {
+            if (!extractJsonValue(copy, KEYS[i]).empty()) stringFound++;
+        }
+        stringMicros += elapsedMicros(start);
+        stringVersion = extractJsonValue(copy, "version");
+    }
+
+    // The copy stands in for a fresh MQTT payload and is not timed
+    unsigned long tokenizerMicros = 0;
+    size_t tokenizerFound = 0;
+    bool valid = true;
+    std::string tokenizerVersion;
+    for (int run = 0; run < RUNS; run++) {
+        memcpy(work.data(), payload, length);
+        Fields fields;
+        OtaJson json;
+        auto start = std::chrono::steady_clock::now();
+        valid = json.parse(work.data(), length, onValue, &fields);
+        tokenizerMicros += elapsedMicros(start);
+        tokenizerFound = 0;
+        for (size_t i = 0; i < KEY_COUNT; i++) {
+            if (!fields.values[i].isEmpty()) tokenizerFound++;
+        }
+        tokenizerVersion = std::string(fields.values[0].data, fields.values[0].length);
+    }
+
+    printf("%7u  %9.1f us  %9.1f us  %2u/%2u  %s/%s%s\n", (unsigned)length, (double)stringMicros / RUNS,
+           (double)tokenizerMicros / RUNS, (unsigned)stringFound, (unsigned)tokenizerFound,
+           stringVersion.c_str(), tokenizerVersion.c_str(), valid ? "" : "  (parse error)");
+}
+
+int main() {
+    printf("Manifest parsing, %d runs each\n", RUNS);
+    printf("  bytes     string     tokenizer   fields  version (string/tokenizer)\n");
+    for (size_t notes : NOTE_COUNTS) {
+        runBenchmark(notes);
+    }
+    return 0;
+}
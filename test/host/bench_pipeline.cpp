@@ -0,0 +1,213 @@
+// Sources: src/OtaArena.cpp
+// Download throughput of the serial path against pipelinedDownload, with
+// stand-ins for the download client and Update.
+//   serial:    loop() reads 1 KB, hashes and writes it before reading again
+//   pipelined: loop() reads into OtaRingBuffer while the flash writer drains
+//              it in 4 KB slices on the other core and erases ahead when idle
+// Both cores run on a simulated clock, so results do not depend on the host.
+// The link delivers at its rate while the receive window has room; once the
+// window is full, new data only arrives an RTT after the next read. The cost
+// constants below are assumptions for an ESP32 over TLS, not measurements.
+
+#include "OtaRingBuffer.h"
+#include <vector>
+
+static const size_t IMAGE_SIZE = 1536 * 1024;
+static const size_t SECTOR_SIZE = 4096;
+static const size_t RING_SIZE = 16384;           // OtaConfig::pipelineBufferSize default
+static const size_t SERIAL_READ = 1024;          // Serial path stack buffer
+static const size_t WRITER_SLICE = 4096;         // PIPELINE_WRITE_SLICE
+
+static const double ERASE_MICROS = 25000;        // One 4 KB sector
+static const double PROGRAM_MICROS_PER_BYTE = 2.0;
+static const double HASH_MICROS_PER_BYTE = 0.1;
+static const double RECV_MICROS_PER_BYTE = 0.5;  // TLS record decryption and copy
+static const double READ_OVERHEAD_MICROS = 30;
+static const double LOOP_IDLE_MICROS = 500;      // loop() pass with nothing to read
+static const double WRITER_POLL_MICROS = 100;    // Notification latency
+
+struct Link {
+    const char* name;
+    double bytesPerMicro;
+    size_t window;
+    double rttMicros;
+};
+
+static const Link LINKS[] = {
+    {"1 MB/s, 5 ms RTT", 1.0, 5744, 5000},
+    {"250 KB/s, 40 ms RTT", 0.25, 5744, 40000},
+    {"60 KB/s, 120 ms RTT", 0.06, 5744, 120000},
+};
+
+// Socket with a receive window, read at non-decreasing times
+class StandInClient {
+public:
+    StandInClient(const std::vector<uint8_t>& image, const Link& link)
+        : image(image), link(link), arrived(0), consumed(0), lastUpdate(0), resumeAt(0), zeroWindow(false) {
+        // The sender keeps at most one window in flight per round trip
+        rate = min(link.bytesPerMicro, link.window / link.rttMicros);
+    }
+
+    size_t available(double now) {
+        update(now);
+        return (size_t)arrived - consumed;
+    }
+
+    size_t read(double now, uint8_t* buffer, size_t length) {
+        length = min(length, available(now));
+        memcpy(buffer, image.data() + consumed, length);
+        consumed += length;
+        if (zeroWindow && length > 0) {
+            zeroWindow = false;
+            resumeAt = now + link.rttMicros;   // Window update out, new data back
+        }
+        return length;
+    }
+
+    bool finished() const { return consumed == image.size(); }
+
+private:
+    const std::vector<uint8_t>& image;
+    Link link;
+    double rate;
+    double arrived;
+    size_t consumed;
+    double lastUpdate;
+    double resumeAt;
+    bool zeroWindow;
+
+    void update(double now) {
+        double from = max(lastUpdate, resumeAt);
+        if (!zeroWindow && now > from) {
+            double limit = min((double)(consumed + link.window), (double)image.size());
+            arrived = min(arrived + rate * (now - from), limit);
+            if (arrived >= consumed + link.window) zeroWindow = true;
+        }
+        lastUpdate = max(lastUpdate, now);
+    }
+};
+
+// Update.write() with sector erases on first touch; returns the time it took
+class StandInUpdate {
+public:
+    StandInUpdate() : erasedBytes(0) {}
+
+    double write(const uint8_t* data, size_t length) {
+        double micros = length * (PROGRAM_MICROS_PER_BYTE + HASH_MICROS_PER_BYTE);
+        size_t end = written.size() + length;
+        while (erasedBytes < end) {
+            erasedBytes += SECTOR_SIZE;
+            micros += ERASE_MICROS;
+        }
+        written.insert(written.end(), data, data + length);
+        return micros;
+    }
+
+    // OtaFlashWriter::eraseAhead(1); 0 when everything is erased
+    double eraseAhead() {
+        if (erasedBytes >= IMAGE_SIZE) return 0;
+        erasedBytes += SECTOR_SIZE;
+        return ERASE_MICROS;
+    }
+
+    std::vector<uint8_t> written;
+
+private:
+    size_t erasedBytes;
+};
+
+static double readCost(size_t length) {
+    return READ_OVERHEAD_MICROS + length * RECV_MICROS_PER_BYTE;
+}
+
+static double runSerial(const std::vector<uint8_t>& image, const Link& link, bool& ok) {
+    StandInClient client(image, link);
+    StandInUpdate update;
+    uint8_t buffer[SERIAL_READ];
+    double now = 0;
+    while (!client.finished()) {
+        size_t length = client.read(now, buffer, sizeof(buffer));
+        if (length == 0) {
+            now += LOOP_IDLE_MICROS;
+            continue;
+        }
+        now += readCost(length);
+        now += update.write(buffer, length);
+    }
+    ok = update.written == image;
+    return now;
+}
+
+// Reader and writer each keep their own clock; the one behind runs its next
+// step, whose result becomes visible to the other when the step ends
+static double runPipelined(const std::vector<uint8_t>& image, const Link& link, bool& ok) {
+    StandInClient client(image, link);
+    StandInUpdate update;
+    OtaRingBuffer ring;
+    ring.begin(RING_SIZE);
+
+    double readerTime = 0;
+    double writerTime = 0;
+    size_t pendingWrite = 0;     // Read into the ring, published at readerTime
+    size_t pendingRead = 0;      // Written to flash, released at writerTime
+    bool producerDone = false;
+    bool writerDone = false;
+
+    while (!writerDone) {
+        if (!producerDone && readerTime <= writerTime) {
+            ring.commitWrite(pendingWrite);
+            pendingWrite = 0;
+            if (client.finished()) {
+                producerDone = true;
+                continue;
+            }
+            size_t contiguous = 0;
+            uint8_t* dst = ring.writePtr(contiguous);
+            size_t length = client.read(readerTime, dst, contiguous);
+            readerTime += length ? readCost(length) : LOOP_IDLE_MICROS;
+            pendingWrite = length;
+        } else {
+            ring.commitRead(pendingRead);
+            pendingRead = 0;
+            size_t contiguous = 0;
+            const uint8_t* data = ring.readPtr(contiguous);
+            if (contiguous == 0) {
+                if (producerDone) {
+                    writerDone = true;
+                    continue;
+                }
+                // Nothing to write: erase ahead, or wait for the reader's notification
+                double erase = update.eraseAhead();
+                writerTime += erase ? erase : WRITER_POLL_MICROS;
+                continue;
+            }
+            size_t slice = min(contiguous, WRITER_SLICE);
+            writerTime += update.write(data, slice);
+            pendingRead = slice;
+        }
+    }
+    ok = update.written == image;
+    return max(readerTime, writerTime);
+}
+
+int main() {
+    std::vector<uint8_t> image(IMAGE_SIZE);
+    for (size_t i = 0; i < IMAGE_SIZE; i++) image[i] = (uint8_t)(i * 131 + (i >> 9));
+
+    double flashMicros = IMAGE_SIZE * (PROGRAM_MICROS_PER_BYTE + HASH_MICROS_PER_BYTE) +
+                         IMAGE_SIZE / SECTOR_SIZE * ERASE_MICROS;
+    printf("%u KB image, flash alone %.1f s (%.0f KB/s)\n", (unsigned)(IMAGE_SIZE / 1024), flashMicros / 1e6,
+           IMAGE_SIZE / 1.024 / flashMicros * 1000);
+    printf("%-22s %18s %18s %10s\n", "link", "serial", "pipelined", "bound");
+    for (const Link& link : LINKS) {
+        bool serialOk = false;
+        bool pipelinedOk = false;
+        double serial = runSerial(image, link, serialOk);
+        double pipelined = runPipelined(image, link, pipelinedOk);
+        double linkMicros = IMAGE_SIZE / min(link.bytesPerMicro, link.window / link.rttMicros);
+        printf("%-22s %7.1f s %4.0f KB/s %7.1f s %4.0f KB/s %8.1f s%s\n", link.name, serial / 1e6,
+               IMAGE_SIZE / 1.024 / serial * 1000, pipelined / 1e6, IMAGE_SIZE / 1.024 / pipelined * 1000,
+               max(linkMicros, flashMicros) / 1e6, serialOk && pipelinedOk ? "" : "  (image mismatch)");
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+// Sources: src/OtaSha256.cpp src/OtaArena.cpp
+// Libraries: -lcrypto
+// SHA-256 throughput of the SOFTWARE backend against the mbedtls shim, at
+// the slice sizes the download path hands to the hasher (chunkSize default,
+// serial read buffer, pipeline writer slice). On the host the shim is
+// OpenSSL, which uses the CPU's SHA extensions where present (SHA-NI, ARMv8
+// crypto), so the second column is the CPU-extension figure for this
+// machine. The ESP32 targets have no such instructions; there HARDWARE is
+// the SHA peripheral, measured by examples/hash_benchmark.
+
+#include "OtaSha256.h"
+#include <chrono>
+
+static const size_t TOTAL_BYTES = 64 * 1024 * 1024;
+static const size_t SLICE_SIZES[] = {512, 1024, 4096};
+
+static double megabytesPerSecond(OtaHashBackend backend, const uint8_t* buffer, size_t slice) {
+    OtaSha256 sha;
+    sha.begin(backend);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < TOTAL_BYTES; done += slice) {
+        sha.update(buffer, slice);
+    }
+    uint8_t digest[OtaSha256::DIGEST_SIZE];
+    sha.finish(digest);
+    double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return TOTAL_BYTES / micros;
+}
+
+int main() {
+    static uint8_t buffer[4096];
+    for (size_t i = 0; i < sizeof(buffer); i++) buffer[i] = (uint8_t)(i * 131);
+
+    printf("%u MB per run\n", (unsigned)(TOTAL_BYTES >> 20));
+    printf("%6s  %14s  %14s\n", "slice", "software", "mbedtls shim");
+    for (size_t slice : SLICE_SIZES) {
+        double software = megabytesPerSecond(OtaHashBackend::SOFTWARE, buffer, slice);
+        double reference = megabytesPerSecond(OtaHashBackend::HARDWARE, buffer, slice);
+        printf("%6u  %9.1f MB/s  %9.1f MB/s\n", (unsigned)slice, software, reference);
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+#pragma once
+// OtaAsyncClient over an in-memory socket, for tests that link the classes
+// built on it (OtaMqttEngine). Include it in exactly one translation unit.
+// The test plays the peer through fakeSocket: it queues the bytes the client
+// will read and inspects the bytes the client sent.
+// For classes holding several connections at once (OtaSegmentedDownload) a
+// test sets fakeServer instead: every client then gets its own socket, reset
+// by begin(), and the hook is called with it whenever the client looks for
+// data, to answer what the client has sent so far.
+
+#include "OtaAsyncClient.h"
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+struct FakeSocket {
+    std::deque<uint8_t> toClient;       // Bytes the peer has sent
+    std::vector<uint8_t> fromClient;    // Bytes the client has sent
+    size_t sendRoom;                    // Bytes send() still accepts
+    int connectPolls;                   // poll() calls until CONNECTED
+    bool refuse;                        // The connect fails
+    bool closed;                        // The peer closed after toClient
+    int begins;
+    int pollsLeft;
+    int connection;                     // 1 for the first connection made (fakeServer only)
+
+    void reset() {
+        toClient.clear();
+        fromClient.clear();
+        sendRoom = (size_t)-1;
+        connectPolls = 1;
+        refuse = false;
+        closed = false;
+        begins = 0;
+        pollsLeft = 0;
+        connection = 0;
+    }
+};
+
+static FakeSocket fakeSocket;
+static std::function<void(FakeSocket&)> fakeServer;
+static std::map<const OtaAsyncClient*, FakeSocket> fakeSockets;
+static int fakeConnections;
+
+static FakeSocket& socketOf(const OtaAsyncClient* client) {
+    return fakeServer ? fakeSockets[client] : fakeSocket;
+}
+
+// Lets the server answer before the client reads
+static FakeSocket& servedSocketOf(const OtaAsyncClient* client) {
+    FakeSocket& socket = socketOf(client);
+    if (fakeServer) fakeServer(socket);
+    return socket;
+}
+
+OtaAsyncClient::OtaAsyncClient()
+    : state(State::IDLE), error(nullptr), errorCode(0), port(0), secure(false), insecure(false),
+      caCert(nullptr), clientCert(nullptr), clientKey(nullptr), trustStore(nullptr),
+      dnsTimeout(0), tcpTimeout(0), tlsTimeout(0), stepStart(0), connectStart(0), connectMillis(0),
+      maxStepMicros(0), tlsStartMicros(0), sessionOffered(false), resumed(false), address(0),
+      dnsGeneration(0), fd(-1), peerClosed(false), peekByte(-1), tls(nullptr), tlsStorage(nullptr),
+      poolIndex(-1) {
+    host[0] = '\0';
+}
+
+OtaAsyncClient::~OtaAsyncClient() {
+    fakeSockets.erase(this);
+}
+
+OtaAsyncClient* OtaAsyncClient::create() {
+    return new OtaAsyncClient();
+}
+
+void OtaAsyncClient::destroy(OtaAsyncClient* client) {
+    delete client;
+}
+
+void OtaAsyncClient::setInsecure() { insecure = true; }
+void OtaAsyncClient::setCACert(const char* pem) { caCert = pem; }
+void OtaAsyncClient::setCertificate(const char* certPem, const char* keyPem) {
+    clientCert = certPem;
+    clientKey = keyPem;
+}
+void OtaAsyncClient::setTimeouts(unsigned long dnsMs, unsigned long tcpMs, unsigned long tlsMs) {
+    dnsTimeout = dnsMs;
+    tcpTimeout = tcpMs;
+    tlsTimeout = tlsMs;
+}
+
+bool OtaAsyncClient::begin(const char* name, uint16_t serverPort, bool useTls) {
+    if (fakeServer) {
+        fakeSockets[this].reset();
+        fakeSockets[this].connection = ++fakeConnections;
+    }
+    FakeSocket& socket = servedSocketOf(this);
+    socket.begins++;
+    snprintf(host, sizeof(host), "%s", name);
+    port = serverPort;
+    secure = useTls;
+    socket.pollsLeft = socket.connectPolls;
+    state = State::CONNECTING;
+    return true;
+}
+
+OtaAsyncClient::State OtaAsyncClient::poll() {
+    if (state != State::CONNECTING) return state;
+    FakeSocket& socket = socketOf(this);
+    if (socket.refuse) {
+        state = State::FAILED;
+        error = "Connection refused";
+    } else if (--socket.pollsLeft <= 0) {
+        state = State::CONNECTED;
+    }
+    return state;
+}
+
+int OtaAsyncClient::connect(IPAddress, uint16_t) { return 0; }
+int OtaAsyncClient::connect(const char*, uint16_t) { return 0; }
+
+size_t OtaAsyncClient::write(uint8_t value) {
+    return write(&value, 1);
+}
+
+size_t OtaAsyncClient::write(const uint8_t* buffer, size_t size) {
+    int sent = send(buffer, size);
+    return sent > 0 ? sent : 0;
+}
+
+int OtaAsyncClient::send(const uint8_t* buffer, size_t size) {
+    FakeSocket& socket = socketOf(this);
+    if (state != State::CONNECTED || socket.closed) return -1;
+    size_t count = min(size, socket.sendRoom);
+    socket.fromClient.insert(socket.fromClient.end(), buffer, buffer + count);
+    socket.sendRoom -= count;
+    return (int)count;
+}
+
+int OtaAsyncClient::available() {
+    return state == State::CONNECTED ? (int)servedSocketOf(this).toClient.size() : 0;
+}
+
+int OtaAsyncClient::read() {
+    uint8_t value;
+    return read(&value, 1) == 1 ? value : -1;
+}
+
+int OtaAsyncClient::read(uint8_t* buffer, size_t size) {
+    if (state != State::CONNECTED) return -1;
+    FakeSocket& socket = servedSocketOf(this);
+    if (socket.toClient.empty()) return -1;
+    size_t count = min(size, socket.toClient.size());
+    for (size_t i = 0; i < count; i++) {
+        buffer[i] = socket.toClient.front();
+        socket.toClient.pop_front();
+    }
+    return (int)count;
+}
+
+int OtaAsyncClient::peek() {
+    return available() ? socketOf(this).toClient.front() : -1;
+}
+
+void OtaAsyncClient::flush() {}
+
+void OtaAsyncClient::stop() {
+    state = State::IDLE;
+}
+
+uint8_t OtaAsyncClient::connected() {
+    if (state != State::CONNECTED) return 0;
+    FakeSocket& socket = servedSocketOf(this);
+    return !(socket.closed && socket.toClient.empty());
+}
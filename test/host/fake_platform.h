@@ -0,0 +1,89 @@
+#pragma once
+// Flash, OTA partitions and the Update class for tests that link the whole
+// updater. Include it in exactly one translation unit. Both partitions are
+// plain memory: writes need no erase, and fakeFlash records what happened.
+
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <string.h>
+#include <vector>
+
+struct FakeFlash {
+    static const size_t PARTITION_SIZE = 256 * 1024;
+
+    esp_partition_t next;
+    esp_partition_t running;
+    std::vector<uint8_t> nextData;
+    std::vector<uint8_t> runningData;
+    int bootSelections;
+
+    FakeFlash()
+        : next{0x110000, PARTITION_SIZE, "ota_1", false}, running{0x10000, PARTITION_SIZE, "ota_0", false} {
+        reset();
+    }
+
+    void reset() {
+        nextData.assign(PARTITION_SIZE, 0xFF);
+        runningData.assign(PARTITION_SIZE, 0xFF);
+        bootSelections = 0;
+    }
+
+    std::vector<uint8_t>* data(const esp_partition_t* partition) {
+        return partition == &next ? &nextData : partition == &running ? &runningData : nullptr;
+    }
+};
+
+static FakeFlash fakeFlash;
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+    std::vector<uint8_t>* data = fakeFlash.data(partition);
+    if (!data || offset + size > data->size()) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, data->data() + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size) {
+    std::vector<uint8_t>* data = fakeFlash.data(partition);
+    if (!data || offset + size > data->size()) return ESP_ERR_INVALID_SIZE;
+    memcpy(data->data() + offset, src, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    std::vector<uint8_t>* data = fakeFlash.data(partition);
+    if (!data || offset + size > data->size()) return ESP_ERR_INVALID_SIZE;
+    memset(data->data() + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t*) {
+    return &fakeFlash.next;
+}
+
+const esp_partition_t* esp_ota_get_running_partition() {
+    return &fakeFlash.running;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    if (partition != &fakeFlash.next) return ESP_ERR_INVALID_ARG;
+    fakeFlash.bootSelections++;
+    return ESP_OK;
+}
+
+// The Update class writes into the same partition
+UpdateClass Update;
+static size_t updateOffset = 0;
+bool UpdateClass::begin(size_t) {
+    updateOffset = 0;
+    return true;
+}
+size_t UpdateClass::write(uint8_t* data, size_t length) {
+    if (esp_partition_write(&fakeFlash.next, updateOffset, data, length) != ESP_OK) return 0;
+    updateOffset += length;
+    return length;
+}
+bool UpdateClass::end(bool) {
+    return esp_ota_set_boot_partition(&fakeFlash.next) == ESP_OK;
+}
+void UpdateClass::abort() {}
+uint8_t UpdateClass::getError() { return 0; }
@@ -0,0 +1,80 @@
+#pragma once
+// Reference heatshrink encoder for the host tests and benchmarks: greedy
+// LZSS with the bit layout of the heatshrink CLI. A literal is a 1 bit and
+// the byte; a back-reference is a 0 bit, offset - 1 in windowBits bits and
+// length - 1 in lookaheadBits bits. The last byte is padded with zero bits.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+struct HeatshrinkStream {
+    std::vector<uint8_t> bytes;
+    std::vector<size_t> symbolEnds;     // Bit offset after each symbol
+};
+
+class HeatshrinkBitWriter {
+public:
+    explicit HeatshrinkBitWriter(HeatshrinkStream& stream) : stream(stream), bits(0), count(0), position(0) {}
+
+    void put(uint32_t value, int width) {
+        for (int i = width - 1; i >= 0; i--) {
+            bits = (uint8_t)((bits << 1) | ((value >> i) & 1));
+            position++;
+            if (++count == 8) {
+                stream.bytes.push_back(bits);
+                count = 0;
+            }
+        }
+    }
+
+    void endSymbol() { stream.symbolEnds.push_back(position); }
+
+    void finish() {
+        if (count > 0) stream.bytes.push_back((uint8_t)(bits << (8 - count)));
+        count = 0;
+    }
+
+private:
+    HeatshrinkStream& stream;
+    uint8_t bits;
+    int count;
+    size_t position;
+};
+
+inline HeatshrinkStream heatshrinkEncode(const uint8_t* data, size_t length, int windowBits, int lookaheadBits) {
+    HeatshrinkStream stream;
+    HeatshrinkBitWriter writer(stream);
+    size_t window = (size_t)1 << windowBits;
+    size_t maxLength = (size_t)1 << lookaheadBits;
+    size_t breakEven = (1 + windowBits + lookaheadBits) / 9 + 1;   // Shortest match cheaper than literals
+
+    for (size_t pos = 0; pos < length;) {
+        size_t bestLength = 0;
+        size_t bestOffset = 0;
+        size_t limit = length - pos < maxLength ? length - pos : maxLength;
+        size_t farthest = pos < window ? pos : window;
+        for (size_t offset = 1; offset <= farthest && bestLength < limit; offset++) {
+            size_t n = 0;
+            while (n < limit && data[pos + n - offset] == data[pos + n]) n++;
+            if (n > bestLength) {
+                bestLength = n;
+                bestOffset = offset;
+            }
+        }
+
+        if (bestLength >= breakEven) {
+            writer.put(0, 1);
+            writer.put((uint32_t)(bestOffset - 1), windowBits);
+            writer.put((uint32_t)(bestLength - 1), lookaheadBits);
+            pos += bestLength;
+        } else {
+            writer.put(1, 1);
+            writer.put(data[pos], 8);
+            pos++;
+        }
+        writer.endSymbol();
+    }
+    writer.finish();
+    return stream;
+}
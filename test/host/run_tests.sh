@@ -0,0 +1,40 @@
+#!/bin/sh
+# Builds and runs every test/host/test_*.cpp with the host compiler.
+# Each test names the library sources it needs on a "// Sources:" line, and
+# any host libraries to link on a "// Libraries:" line.
+#   test/host/run_tests.sh               all tests
+#   test/host/run_tests.sh spsc_queue    one test
+#   SANITIZE=thread test/host/run_tests.sh spsc_queue
+#   test/host/run_tests.sh bench_manifest   one benchmark, built with -O2
+# Benchmarks (test/host/bench_*.cpp) only run when named.
+set -e
+cd "$(dirname "$0")/../.."
+CXX=${CXX:-g++}
+OUT=${OUT:-build/host-tests}
+FLAGS="-std=gnu++11 -Wall -Wextra -Wno-unused-parameter -g -Itest/host/shims -Iinclude -pthread"
+if [ -n "$SANITIZE" ]; then FLAGS="$FLAGS -fsanitize=$SANITIZE"; fi
+mkdir -p "$OUT"
+
+case "$1" in
+bench_*)
+    sources=$(sed -n 's|^// Sources:||p' "test/host/$1.cpp")
+    libraries=$(sed -n 's|^// Libraries:||p' "test/host/$1.cpp")
+    $CXX $FLAGS -O2 "test/host/$1.cpp" $sources $libraries -o "$OUT/$1"
+    exec "$OUT/$1"
+    ;;
+esac
+
+failed=0
+for test in test/host/test_*.cpp; do
+    name=$(basename "$test" .cpp)
+    if [ -n "$1" ] && [ "$name" != "test_$1" ]; then continue; fi
+    sources=$(sed -n 's|^// Sources:||p' "$test")
+    libraries=$(sed -n 's|^// Libraries:||p' "$test")
+    if ! $CXX $FLAGS "$test" $sources $libraries -o "$OUT/$name"; then
+        echo "$name: build failed"
+        failed=1
+        continue
+    fi
+    "$OUT/$name" || failed=1
+done
+exit $failed
@@ -0,0 +1,151 @@
+#pragma once
+// Host stand-in for the parts of the Arduino core the pure library classes use
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using std::min;
+using std::max;
+
+// Simulated clock in microseconds; tests move it forward themselves, also
+// while a host task reads it
+inline std::atomic<unsigned long>& hostClockMicros() {
+    static std::atomic<unsigned long> now(0);
+    return now;
+}
+inline unsigned long micros() { return hostClockMicros().load(); }
+inline unsigned long millis() { return hostClockMicros().load() / 1000; }
+// Time does not pass, but another thread may run
+inline void delay(unsigned long) { std::this_thread::yield(); }
+inline void yield() { std::this_thread::yield(); }
+inline bool isDigit(int c) { return isdigit(c) != 0; }
+inline uint32_t esp_random() { return (uint32_t)rand(); }
+
+typedef uint8_t byte;
+
+#ifndef constrain
+#define constrain(amount, low, high) ((amount) < (low) ? (low) : ((amount) > (high) ? (high) : (amount)))
+#endif
+
+// Only what the tested classes touch
+class String {
+public:
+    String() {}
+    String(const char* text) : value(text ? text : "") {}
+    String(const std::string& text) : value(text) {}
+    explicit String(int number) : value(std::to_string(number)) {}
+    explicit String(unsigned number) : value(std::to_string(number)) {}
+    explicit String(long number) : value(std::to_string(number)) {}
+    explicit String(unsigned long number) : value(std::to_string(number)) {}
+    const char* c_str() const { return value.c_str(); }
+    unsigned length() const { return value.size(); }
+    bool isEmpty() const { return value.empty(); }
+    char operator[](unsigned index) const { return index < value.size() ? value[index] : '\0'; }
+    int indexOf(char c, unsigned from = 0) const { return position(value.find(c, from)); }
+    int indexOf(const String& text, unsigned from = 0) const { return position(value.find(text.value, from)); }
+    int lastIndexOf(char c) const { return position(value.rfind(c)); }
+    String substring(unsigned from) const { return from < value.size() ? String(value.substr(from)) : String(); }
+    String substring(unsigned from, unsigned to) const {
+        return from < to && from < value.size() ? String(value.substr(from, to - from)) : String();
+    }
+    long toInt() const { return atol(value.c_str()); }
+    bool reserve(unsigned size) { value.reserve(size); return true; }
+    bool operator==(const String& other) const { return value == other.value; }
+    bool operator!=(const String& other) const { return value != other.value; }
+    bool operator==(const char* other) const { return value == (other ? other : ""); }
+    bool operator!=(const char* other) const { return !(*this == other); }
+    String& operator+=(const String& other) { value += other.value; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a.value + b.value); }
+
+private:
+    std::string value;
+
+    static int position(size_t found) { return found == std::string::npos ? -1 : (int)found; }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) { return 0; }
+    virtual size_t write(const uint8_t* buffer, size_t length) {
+        size_t count = 0;
+        while (count < length && write(buffer[count])) count++;
+        return count;
+    }
+    size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    size_t print(const String& text) { return print(text.c_str()); }
+    size_t println(const char* text) { return print(text) + print("\r\n"); }
+    size_t println(const String& text) { return println(text.c_str()); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    size_t readBytes(char* buffer, size_t length) {
+        size_t count = 0;
+        int c;
+        while (count < length && (c = read()) >= 0) buffer[count++] = (char)c;
+        return count;
+    }
+    size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+};
+
+class IPAddress {
+public:
+    IPAddress() : address(0) {}
+    explicit IPAddress(uint32_t address) : address(address) {}
+    operator uint32_t() const { return address; }
+
+private:
+    uint32_t address;
+};
+
+// Keeps what is written, so tests can look at the log output
+class HardwareSerial : public Stream {
+public:
+    size_t write(uint8_t value) override { output += (char)value; return 1; }
+    size_t write(const uint8_t* buffer, size_t length) override {
+        output.append((const char*)buffer, length);
+        return length;
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    int availableForWrite() { return 128; }
+    void begin(unsigned long) {}
+
+    std::string output;
+};
+
+// One Serial for every translation unit, as on the device
+inline HardwareSerial& hostSerial() {
+    static HardwareSerial serial;
+    return serial;
+}
+#define Serial hostSerial()
+
+class EspClass {
+public:
+    void restart() { restarts++; }
+    uint32_t getFreeHeap() { return 128 * 1024; }
+    uint32_t getMinFreeHeap() { return 128 * 1024; }
+    uint64_t getEfuseMac() { return 0x010000C40A24ULL; }
+
+    int restarts = 0;
+};
+
+inline EspClass& hostEsp() {
+    static EspClass esp;
+    return esp;
+}
+#define ESP hostEsp()
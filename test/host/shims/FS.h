@@ -0,0 +1,26 @@
+#pragma once
+// Files are not used by the host tests; only the types are needed
+#include <Arduino.h>
+
+namespace fs {
+class File : public Stream {
+public:
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    size_t read(uint8_t*, size_t) { return 0; }
+    bool seek(uint32_t) { return false; }
+    size_t size() const { return 0; }
+    void close() {}
+    operator bool() const { return false; }
+};
+
+class FS {
+public:
+    File open(const char*, const char* = "r") { return File(); }
+    File open(const String&, const char* = "r") { return File(); }
+    bool exists(const char*) { return false; }
+};
+}
+using fs::File;
+using fs::FS;
@@ -0,0 +1,41 @@
+#pragma once
+// NVS stand-in: one process-wide map of namespace/key to bytes
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+class Preferences {
+public:
+    static std::map<std::string, std::vector<uint8_t> >& storage() {
+        static std::map<std::string, std::vector<uint8_t> > values;
+        return values;
+    }
+
+    bool begin(const char* name, bool readOnly = false, const char* partition = nullptr) {
+        space = name;
+        this->readOnly = readOnly;
+        return true;
+    }
+    void end() {}
+
+    size_t getBytesLength(const char* key) {
+        auto it = storage().find(space + "/" + key);
+        return it == storage().end() ? 0 : it->second.size();
+    }
+    size_t getBytes(const char* key, void* buffer, size_t maxLength) {
+        auto it = storage().find(space + "/" + key);
+        if (it == storage().end() || it->second.size() > maxLength) return 0;
+        memcpy(buffer, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+    size_t putBytes(const char* key, const void* value, size_t length) {
+        if (readOnly) return 0;
+        const uint8_t* bytes = static_cast<const uint8_t*>(value);
+        storage()[space + "/" + key].assign(bytes, bytes + length);
+        return length;
+    }
+
+private:
+    std::string space;
+    bool readOnly = false;
+};
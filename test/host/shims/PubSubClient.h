@@ -0,0 +1,60 @@
+#pragma once
+// Host stand-in for PubSubClient: records what is sent, and tests deliver
+// messages through the installed callback
+
+#include <Arduino.h>
+#include <Client.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient {
+public:
+    PubSubClient() {}
+    PubSubClient(Client&) {}
+
+    PubSubClient& setServer(const char*, uint16_t) { return *this; }
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE) { this->callback = callback; return *this; }
+    PubSubClient& setClient(Client&) { return *this; }
+    bool setBufferSize(uint16_t size) { bufferSize = size; return true; }
+    uint16_t getBufferSize() { return bufferSize; }
+
+    bool connect(const char*) { isConnected = true; return true; }
+    bool connect(const char*, const char*, const char*) { isConnected = true; return true; }
+    void disconnect() { isConnected = false; }
+    bool connected() { return isConnected; }
+    bool loop() {
+        if (onLoop) onLoop();
+        return isConnected;
+    }
+    int state() { return isConnected ? 0 : -1; }
+
+    bool subscribe(const char* filter) { subscribed.push_back(filter); return isConnected; }
+    bool subscribe(const char* filter, uint8_t) { return subscribe(filter); }
+    bool unsubscribe(const char* filter) { unsubscribed.push_back(filter); return isConnected; }
+    bool publish(const char* topic, const char*) { published.push_back(topic); return isConnected; }
+    bool publish(const char* topic, const uint8_t*, unsigned int) { published.push_back(topic); return isConnected; }
+    bool publish(const char* topic, const uint8_t*, unsigned int, bool) { published.push_back(topic); return isConnected; }
+    bool beginPublish(const char* topic, unsigned int, bool) { published.push_back(topic); return isConnected; }
+    size_t write(const uint8_t*, size_t length) { return length; }
+    int endPublish() { return 1; }
+
+    // Hands a message to the callback as the broker connection would
+    void deliver(const char* topic, const char* payload) {
+        std::string name(topic);
+        std::string body(payload);
+        if (callback) callback(&name[0], (uint8_t*)&body[0], body.size());
+    }
+
+    bool isConnected = false;
+    uint16_t bufferSize = 256;
+    std::vector<std::string> subscribed;
+    std::vector<std::string> unsubscribed;
+    std::vector<std::string> published;
+    std::function<void()> onLoop;       // Runs in loop(), on the caller's thread
+
+private:
+    std::function<void(char*, uint8_t*, unsigned int)> callback;
+};
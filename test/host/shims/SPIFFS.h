@@ -0,0 +1,9 @@
+#pragma once
+#include <FS.h>
+
+class SPIFFSFS : public fs::FS {
+public:
+    bool begin(bool = false) { return false; }
+};
+
+static SPIFFSFS SPIFFS __attribute__((unused));
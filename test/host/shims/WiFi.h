@@ -0,0 +1,38 @@
+#pragma once
+// Host stand-in for the ESP32 WiFi library: the station is always connected
+// and no socket ever opens
+
+#include <Arduino.h>
+#include <Client.h>
+
+class WiFiClient : public Client {
+public:
+    int connect(IPAddress, uint16_t) override { return 0; }
+    int connect(const char*, uint16_t) override { return 0; }
+    size_t write(uint8_t) override { return 0; }
+    size_t write(const uint8_t*, size_t) override { return 0; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int read(uint8_t*, size_t) override { return -1; }
+    int peek() override { return -1; }
+    void flush() override {}
+    void stop() override {}
+    uint8_t connected() override { return 0; }
+    operator bool() override { return false; }
+    int fd() const { return -1; }
+    void setNoDelay(bool) {}
+};
+
+class WiFiClass {
+public:
+    bool isConnected() { return true; }
+    String macAddress() { return "24:0A:C4:00:00:01"; }
+    uint8_t* macAddress(uint8_t* mac) {
+        static const uint8_t address[6] = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01};
+        memcpy(mac, address, sizeof(address));
+        return mac;
+    }
+    int hostByName(const char*, IPAddress&) { return 0; }
+};
+
+static WiFiClass WiFi __attribute__((unused));
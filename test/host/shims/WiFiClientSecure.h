@@ -0,0 +1,14 @@
+#pragma once
+#include <WiFi.h>
+
+class WiFiClientSecure : public WiFiClient {
+public:
+    void setInsecure() {}
+    void setCACert(const char*) {}
+    void setCertificate(const char*) {}
+    void setPrivateKey(const char*) {}
+    void setHandshakeTimeout(unsigned long) {}
+    bool loadCACert(Stream&, size_t) { return false; }
+    bool loadCertificate(Stream&, size_t) { return false; }
+    bool loadPrivateKey(Stream&, size_t) { return false; }
+};
@@ -0,0 +1,25 @@
+#pragma once
+// A fixed 256 KB heap that never changes: the memory statistics are not
+// under test on the host
+#include <stddef.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+typedef struct {
+    size_t total_free_bytes;
+    size_t total_allocated_bytes;
+    size_t largest_free_block;
+    size_t minimum_free_bytes;
+    size_t allocated_blocks;
+    size_t free_blocks;
+    size_t total_blocks;
+} multi_heap_info_t;
+
+inline size_t heap_caps_get_total_size(unsigned) { return 256 * 1024; }
+inline size_t heap_caps_get_free_size(unsigned) { return 128 * 1024; }
+inline size_t heap_caps_get_minimum_free_size(unsigned) { return 128 * 1024; }
+inline size_t heap_caps_get_largest_free_block(unsigned) { return 64 * 1024; }
+inline void heap_caps_get_info(multi_heap_info_t* info, unsigned) {
+    *info = {128 * 1024, 128 * 1024, 64 * 1024, 128 * 1024, 0, 0, 0};
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include "esp_partition.h"
+
+// Defined by the test that links against them
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+const esp_partition_t* esp_ota_get_running_partition();
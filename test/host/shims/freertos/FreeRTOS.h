@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+typedef void (*TaskFunction_t)(void*);
+typedef struct { uint8_t opaque[344]; } StaticTask_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+
+// Spinlock in place of the ESP32 critical section (interrupts are not masked)
+#include <atomic>
+typedef struct { std::atomic_flag flag; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {ATOMIC_FLAG_INIT}
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) {
+    while (mux->flag.test_and_set(std::memory_order_acquire)) {}
+}
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+    mux->flag.clear(std::memory_order_release);
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "FreeRTOS.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Tasks are off by default: creation fails, and the classes under test fall
+// back to inline work. A test that wants the real concurrency sets
+// hostTasks().enabled; tasks then run on std::threads. Delays and notify
+// waits take real time, in milliseconds per tick, and a task that is deleted
+// ends at its next one.
+struct HostTasks {
+    bool enabled = false;
+};
+
+inline HostTasks& hostTasks() {
+    static HostTasks tasks;
+    return tasks;
+}
+
+struct HostTask {
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    uint32_t notifications = 0;
+    bool deleted = false;
+};
+
+struct HostTaskDeleted {};
+
+inline HostTask*& hostCurrentTask() {
+    static thread_local HostTask* current = nullptr;
+    return current;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t entry, const char*, uint32_t, void* arg, UBaseType_t,
+                                          TaskHandle_t* handle, BaseType_t) {
+    if (!hostTasks().enabled) return pdFAIL;
+    HostTask* task = new HostTask();
+    *handle = task;
+    task->thread = std::thread([task, entry, arg]() {
+        hostCurrentTask() = task;
+        try {
+            entry(arg);
+        } catch (const HostTaskDeleted&) {
+        }
+    });
+    return pdPASS;
+}
+
+inline TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t entry, const char* name, uint32_t stackSize,
+                                                  void* arg, UBaseType_t priority, StackType_t*, StaticTask_t*,
+                                                  BaseType_t core) {
+    TaskHandle_t handle = nullptr;
+    return xTaskCreatePinnedToCore(entry, name, stackSize, arg, priority, &handle, core) == pdPASS ? handle : nullptr;
+}
+
+// The application's loop task, for the main thread
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+    static HostTask mainTask;
+    return hostCurrentTask() ? hostCurrentTask() : &mainTask;
+}
+
+inline void vTaskDelete(TaskHandle_t handle) {
+    HostTask* task = static_cast<HostTask*>(handle);
+    if (!task) return;
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->deleted = true;
+    }
+    task->wake.notify_all();
+    task->thread.join();
+    delete task;
+}
+
+// Waits until predicate holds or ticks have passed; a deleted task ends here
+template<typename Predicate>
+inline void hostTaskWait(TickType_t ticks, Predicate predicate) {
+    HostTask* task = hostCurrentTask();
+    if (!task) {
+        if (hostTasks().enabled) std::this_thread::sleep_for(std::chrono::milliseconds(ticks == portMAX_DELAY ? 1 : ticks));
+        return;
+    }
+    std::unique_lock<std::mutex> guard(task->lock);
+    auto done = [task, &predicate]() { return task->deleted || predicate(task); };
+    if (ticks == portMAX_DELAY) {
+        task->wake.wait(guard, done);
+    } else {
+        task->wake.wait_for(guard, std::chrono::milliseconds(ticks), done);
+    }
+    if (task->deleted) throw HostTaskDeleted();
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+    hostTaskWait(ticks, [](HostTask*) { return false; });
+}
+
+inline void xTaskNotifyGive(TaskHandle_t handle) {
+    HostTask* task = static_cast<HostTask*>(handle);
+    if (!task) return;
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->notifications++;
+    }
+    task->wake.notify_all();
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    hostTaskWait(ticks, [](HostTask* task) { return task->notifications > 0; });
+    HostTask* task = hostCurrentTask();
+    if (!task) return 0;
+    std::lock_guard<std::mutex> guard(task->lock);
+    uint32_t count = task->notifications;
+    task->notifications = clearOnExit ? 0 : (count > 0 ? count - 1 : 0);
+    return count;
+}
+
+inline BaseType_t xPortGetCoreID() { return 1; }
+#define taskYIELD() std::this_thread::yield()
@@ -0,0 +1,18 @@
+#pragma once
+#include <stddef.h>
+
+typedef struct {
+    unsigned counter;
+} mbedtls_ctr_drbg_context;
+
+inline void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* drbg) { drbg->counter = 0; }
+inline void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context*) {}
+inline int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context*, int (*)(void*, unsigned char*, size_t), void*,
+                                 const unsigned char*, size_t) {
+    return 0;
+}
+inline int mbedtls_ctr_drbg_random(void* context, unsigned char* output, size_t length) {
+    mbedtls_ctr_drbg_context* drbg = (mbedtls_ctr_drbg_context*)context;
+    for (size_t i = 0; i < length; i++) output[i] = (unsigned char)(drbg->counter++ * 2654435761u >> 24);
+    return 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <stddef.h>
+
+typedef struct {
+    void* opaque;
+} mbedtls_pk_context;
+
+inline void mbedtls_pk_init(mbedtls_pk_context* pk) { pk->opaque = nullptr; }
+inline void mbedtls_pk_free(mbedtls_pk_context*) {}
+inline int mbedtls_pk_parse_key(mbedtls_pk_context*, const unsigned char*, size_t, const unsigned char*, size_t) {
+    return -1;
+}
@@ -0,0 +1,30 @@
+#pragma once
+// mbedtls SHA-256 on top of OpenSSL's libcrypto (link with -lcrypto), so the
+// HARDWARE backend has an independent reference implementation on the host
+#include <stddef.h>
+#include <openssl/evp.h>
+
+typedef struct {
+    EVP_MD_CTX* md;
+} mbedtls_sha256_context;
+
+inline void mbedtls_sha256_init(mbedtls_sha256_context* context) {
+    context->md = EVP_MD_CTX_new();
+}
+
+inline void mbedtls_sha256_free(mbedtls_sha256_context* context) {
+    EVP_MD_CTX_free(context->md);
+    context->md = nullptr;
+}
+
+inline int mbedtls_sha256_starts(mbedtls_sha256_context* context, int is224) {
+    return EVP_DigestInit_ex(context->md, is224 ? EVP_sha224() : EVP_sha256(), nullptr) == 1 ? 0 : -1;
+}
+
+inline int mbedtls_sha256_update(mbedtls_sha256_context* context, const unsigned char* input, size_t length) {
+    return EVP_DigestUpdate(context->md, input, length) == 1 ? 0 : -1;
+}
+
+inline int mbedtls_sha256_finish(mbedtls_sha256_context* context, unsigned char output[32]) {
+    return EVP_DigestFinal_ex(context->md, output, nullptr) == 1 ? 0 : -1;
+}
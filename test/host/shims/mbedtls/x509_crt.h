@@ -0,0 +1,30 @@
+#pragma once
+// The host tests never parse certificates or run TLS: parsing fails, and
+// nothing is ever trusted
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct mbedtls_x509_buf {
+    int tag;
+    size_t len;
+    unsigned char* p;
+} mbedtls_x509_buf;
+
+typedef struct mbedtls_x509_crt {
+    mbedtls_x509_buf raw;
+    mbedtls_x509_buf subject_raw;
+    mbedtls_x509_buf issuer_raw;
+    struct mbedtls_x509_crt* next;
+    int version;
+} mbedtls_x509_crt;
+
+inline void mbedtls_x509_crt_init(mbedtls_x509_crt* crt) { *crt = mbedtls_x509_crt(); }
+inline void mbedtls_x509_crt_free(mbedtls_x509_crt*) {}
+inline int mbedtls_x509_crt_parse(mbedtls_x509_crt*, const unsigned char*, size_t) { return -1; }
+inline int mbedtls_x509_crt_parse_der(mbedtls_x509_crt*, const unsigned char*, size_t) { return -1; }
+inline int mbedtls_x509_crt_parse_der_nocopy(mbedtls_x509_crt*, const unsigned char*, size_t) { return -1; }
+inline int mbedtls_x509_crt_verify(mbedtls_x509_crt*, mbedtls_x509_crt*, void*, const char*, uint32_t* flags,
+                                   int (*)(void*, mbedtls_x509_crt*, int, uint32_t*), void*) {
+    *flags = 1;
+    return -1;
+}
@@ -0,0 +1,8 @@
+#pragma once
+// Host stand-in for the ROM CRC32: same polynomial and chaining as zlib's
+#include <stdint.h>
+#include <zlib.h>
+
+inline uint32_t crc32_le(uint32_t crc, uint8_t const* buf, uint32_t len) {
+    return (uint32_t)crc32(crc, buf, len);
+}
@@ -0,0 +1,83 @@
+#pragma once
+// Host stand-in for the ROM tinfl decoder, on top of zlib's raw inflate.
+// zlib keeps its own window, so output only has to land where tinfl would put
+// it. Its allocations come from a pool inside the decompressor, which the
+// library treats as plain memory it never tears down.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <zlib.h>
+
+typedef unsigned char mz_uint8;
+typedef uint32_t mz_uint32;
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+typedef enum {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct tinfl_decompressor_tag {
+    z_stream stream;
+    bool done;
+    size_t poolUsed;
+    alignas(16) unsigned char pool[48 * 1024];
+} tinfl_decompressor;
+
+inline voidpf tinflPoolAlloc(voidpf opaque, uInt items, uInt size) {
+    tinfl_decompressor* r = static_cast<tinfl_decompressor*>(opaque);
+    size_t bytes = ((size_t)items * size + 15) & ~(size_t)15;
+    if (bytes > sizeof(r->pool) - r->poolUsed) return Z_NULL;
+    r->poolUsed += bytes;
+    return r->pool + r->poolUsed - bytes;
+}
+
+inline void tinflPoolFree(voidpf, voidpf) {}
+
+inline void tinfl_init(tinfl_decompressor* r) {
+    memset(&r->stream, 0, sizeof(r->stream));
+    r->stream.zalloc = tinflPoolAlloc;
+    r->stream.zfree = tinflPoolFree;
+    r->stream.opaque = r;
+    r->done = false;
+    r->poolUsed = 0;
+    inflateInit2(&r->stream, -15);
+}
+
+inline tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* pIn_buf_next, size_t* pIn_buf_size,
+                                     mz_uint8*, mz_uint8* pOut_buf_next, size_t* pOut_buf_size,
+                                     const mz_uint32 decomp_flags) {
+    if (r->done) {
+        *pIn_buf_size = 0;
+        *pOut_buf_size = 0;
+        return TINFL_STATUS_DONE;
+    }
+    r->stream.next_in = const_cast<mz_uint8*>(pIn_buf_next);
+    r->stream.avail_in = (uInt)*pIn_buf_size;
+    r->stream.next_out = pOut_buf_next;
+    r->stream.avail_out = (uInt)*pOut_buf_size;
+    int rc = inflate(&r->stream, Z_NO_FLUSH);
+    *pIn_buf_size -= r->stream.avail_in;
+    *pOut_buf_size -= r->stream.avail_out;
+
+    if (rc == Z_STREAM_END) {
+        r->done = true;
+        return TINFL_STATUS_DONE;
+    }
+    if (rc != Z_OK && rc != Z_BUF_ERROR) return TINFL_STATUS_FAILED;
+    if (r->stream.avail_out == 0) return TINFL_STATUS_HAS_MORE_OUTPUT;
+    return (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+}
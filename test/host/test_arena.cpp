@@ -0,0 +1,97 @@
+// Sources: src/OtaArena.cpp
+// OtaArena: slots carved once and handed out again, requests that do not fit,
+// heap fallback without an arena, and several threads allocating at once (the
+// updater task, the pipeline writer and the application all do). Run with
+// SANITIZE=thread to check the locking as well.
+
+#include "OtaArena.h"
+#include "test_check.h"
+#include <thread>
+#include <vector>
+
+static uint8_t buffer[4096 + OtaArena::ALIGNMENT];
+
+static void testSlots() {
+    int owner = 0;
+    OtaArena::install(buffer + 1, 4096, &owner);   // Misaligned on purpose
+    CHECK(OtaArena::isInstalledBy(&owner));
+    CHECK(!OtaArena::isInstalledBy(nullptr));
+    CHECK_EQ(OtaArena::getSize(), 4096 + 1 - OtaArena::ALIGNMENT);
+    CHECK_EQ(OtaArena::getUsed(), 0);
+
+    uint8_t* sector = OtaArena::acquire(OtaArena::FLASH_SECTOR, 1000);
+    CHECK(sector != nullptr);
+    CHECK_EQ((uintptr_t)sector % OtaArena::ALIGNMENT, 0);
+    CHECK_EQ(OtaArena::getUsed(), 1000);
+    OtaArena::release(OtaArena::FLASH_SECTOR, sector);
+    CHECK(OtaArena::acquire(OtaArena::FLASH_SECTOR, 800) == sector);   // Same block again
+    CHECK(OtaArena::acquire(OtaArena::FLASH_SECTOR, 1500) == sector);  // Last block grows in place
+    CHECK_EQ(OtaArena::getUsed(), 1504);
+
+    uint8_t* window = OtaArena::acquire(OtaArena::INFLATE_WINDOW, 2000);
+    CHECK(window == sector + 1504);
+    uint32_t failures = OtaArena::getFailures();
+    CHECK(OtaArena::acquire(OtaArena::INFLATE_OUTPUT, 1000) == nullptr);
+    CHECK_EQ(OtaArena::getFailures(), failures + 1);
+
+    // HEAP requests never come from the arena
+    uint32_t allocations = OtaArena::getHeapAllocations();
+    uint8_t* heap = OtaArena::acquire(OtaArena::HEAP, 100);
+    CHECK(heap != nullptr);
+    CHECK(heap < buffer || heap >= buffer + sizeof(buffer));
+    CHECK_EQ(OtaArena::getHeapAllocations(), allocations + 1);
+    OtaArena::release(OtaArena::HEAP, heap);
+
+    // Another updater may replace it; going back to the heap forgets the owner
+    int other = 0;
+    OtaArena::install(buffer, sizeof(buffer), &other);
+    CHECK(OtaArena::isInstalledBy(&other));
+    CHECK_EQ(OtaArena::getUsed(), 0);
+    OtaArena::install(nullptr, 0, &other);
+    CHECK(!OtaArena::isInstalled());
+    CHECK(!OtaArena::isInstalledBy(&other));
+    uint8_t* block = OtaArena::acquire(OtaArena::FLASH_SECTOR, 64);
+    CHECK(block != nullptr);
+    CHECK_EQ(OtaArena::getHeapAllocations(), allocations + 2);
+    OtaArena::release(OtaArena::FLASH_SECTOR, block);
+}
+
+// Each thread owns one slot, as the updater's tasks do, and they allocate,
+// read the counters and free heap blocks at the same time
+static void testThreads() {
+    OtaArena::install(buffer, sizeof(buffer), &buffer);
+    const OtaArena::Slot slots[] = {OtaArena::PIPELINE_BUFFER, OtaArena::HASH_BUFFER, OtaArena::MQTT_CHUNKS,
+                                    OtaArena::SEGMENT_BLOCKS};
+    uint8_t* blocks[4] = {nullptr, nullptr, nullptr, nullptr};
+    uint32_t allocations = OtaArena::getHeapAllocations();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([t, &slots, &blocks]() {
+            for (int i = 0; i < 2000; i++) {
+                uint8_t* block = OtaArena::acquire(slots[t], 256 + (i % 4) * 64);
+                if (!blocks[t]) blocks[t] = block;
+                if (block != blocks[t]) blocks[t] = nullptr;  // Must stay the same block
+                OtaArena::release(OtaArena::HEAP, OtaArena::acquire(OtaArena::HEAP, 16));
+                (void)OtaArena::getUsed();
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+    // Every slot ended up with its own block of the largest size
+    for (int t = 0; t < 4; t++) {
+        CHECK(blocks[t] != nullptr);
+        for (int u = 0; u < t; u++) {
+            CHECK(blocks[t] + 448 <= blocks[u] || blocks[u] + 448 <= blocks[t]);
+        }
+    }
+    CHECK(OtaArena::getUsed() <= OtaArena::getSize());
+    CHECK_EQ(OtaArena::getHeapAllocations(), allocations + 4 * 2000);
+    OtaArena::install(nullptr, 0, nullptr);
+}
+
+int main() {
+    testSlots();
+    testThreads();
+    return checkReport("arena");
+}
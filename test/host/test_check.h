@@ -0,0 +1,31 @@
+#pragma once
+// Minimal assertions for the host tests: count failures, report, exit code
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+static int checkCount = 0;
+
+#define CHECK(condition) do { \
+    checkCount++; \
+    if (!(condition)) { \
+        checkFailures++; \
+        printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+    } \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+    checkCount++; \
+    long long actualValue = (long long)(actual); \
+    long long expectedValue = (long long)(expected); \
+    if (actualValue != expectedValue) { \
+        checkFailures++; \
+        printf("%s:%d: CHECK_EQ failed: %s = %lld, expected %lld\n", __FILE__, __LINE__, #actual, \
+               actualValue, expectedValue); \
+    } \
+} while (0)
+
+static inline int checkReport(const char* name) {
+    printf("%s: %d checks, %d failed\n", name, checkCount, checkFailures);
+    return checkFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+// Sources: src/BandwidthShaping.cpp src/DownloadPipeline.cpp src/ESP32OtaMqtt.cpp src/EngineTask.cpp src/MirrorSelection.cpp src/MqttChunkTransfer.cpp src/NonBlockingHelpers.cpp src/OtaArena.cpp src/OtaCertBundle.cpp src/OtaDecompressor.cpp src/OtaDeltaPatcher.cpp src/OtaEventQueue.cpp src/OtaFlashWriter.cpp src/OtaHttpParser.cpp src/OtaJson.cpp src/OtaLog.cpp src/OtaLoopBudget.cpp src/OtaMirrorSet.cpp src/OtaMqttEngine.cpp src/OtaMqttTransfer.cpp src/OtaPemDecoder.cpp src/OtaRateLimiter.cpp src/OtaRetryPolicy.cpp src/OtaRollout.cpp src/OtaSegmentedDownload.cpp src/OtaSha256.cpp src/OtaTopicRouter.cpp src/OtaTrustStore.cpp src/OtaVersion.cpp src/SegmentedDownload.cpp
+// Libraries: -lz -lcrypto
+// The running version the updater compares offers against, on the whole
+// updater: it must not depend on text the application later overwrites (a
+// buffer behind setCurrentVersion(OtaVersion), the config it passed), must
+// follow every way of setting it, and a version too long to hold ranks below
+// every offer. Pre-releases of one release are offered, since only they
+// compare the text rather than the packed number.
+
+#include "ESP32OtaMqtt.h"
+#include "fake_async_client.h"
+#include "fake_platform.h"
+#include "test_check.h"
+#include <cstring>
+#include <string>
+
+static std::string lastStatus;
+
+static void onStatus(const String& status, int) {
+    lastStatus = status.c_str();
+}
+
+// True when the updater takes the offered version as newer than its own.
+// The download is refused, so the updater is idle again afterwards.
+static bool isNewer(ESP32OtaMqtt& updater, PubSubClient& mqtt, const char* version) {
+    std::string manifest = std::string("{\"command\":\"update\",\"version\":\"") + version +
+                           "\",\"firmware_url\":\"http://fw.example.com/fw.bin\",\"checksum\":\"" +
+                           std::string(64, 'a') + "\"}";
+    lastStatus.clear();
+    mqtt.deliver("devices/1/ota", manifest.c_str());
+    updater.loop(); // Delivers the status event
+    bool newer = lastStatus == "DOWNLOADING";
+    for (int i = 0; newer && i < 100000 && lastStatus != "ERROR"; i++) {
+        updater.loop();
+        hostClockMicros() += 1000;
+    }
+    CHECK(lastStatus != "DOWNLOADING");
+    return newer;
+}
+
+int main() {
+    fakeSocket.refuse = true;
+    WiFiClientSecure wifi;
+    PubSubClient mqtt;
+    ESP32OtaMqtt updater(wifi, mqtt, "devices/1/ota");
+    OtaConfig config;
+    config.logBufferSize = 0;
+    config.maxRetries = 0;
+    config.currentVersion = "1.4.0-rc.5";
+    updater.setConfig(config);
+    updater.onStatusUpdate(onStatus);
+    CHECK(updater.begin());
+    for (int i = 0; i < 100 && !mqtt.connected(); i++) updater.loop();
+    CHECK(mqtt.connected());
+
+    CHECK(isNewer(updater, mqtt, "1.4.0-rc.6"));
+    CHECK(!isNewer(updater, mqtt, "1.4.0-rc.4"));
+    CHECK(!isNewer(updater, mqtt, "1.4.0-rc.5"));
+
+    // The application reuses the config it passed: the updater keeps its own
+    config.currentVersion = "1.4.0-rc.1";
+    config.currentVersion += "0";
+    CHECK(isNewer(updater, mqtt, "1.4.0-rc.6"));
+    CHECK(!isNewer(updater, mqtt, "1.4.0-rc.4"));
+
+    // A version parsed from a buffer that is then overwritten
+    char text[32];
+    strcpy(text, "1.4.0-rc.20");
+    updater.setCurrentVersion(OtaVersion::parse(text));
+    strcpy(text, "1.4.0-rc.1");
+    CHECK(!isNewer(updater, mqtt, "1.4.0-rc.19"));
+    CHECK(isNewer(updater, mqtt, "1.4.0-rc.21"));
+    CHECK(updater.getCurrentVersion() == "1.4.0-rc.20");
+
+    // Through setCurrentVersion(String), from a temporary
+    updater.setCurrentVersion(String((std::string("1.4.0-rc.") + "30").c_str()));
+    CHECK(!isNewer(updater, mqtt, "1.4.0-rc.29"));
+    CHECK(isNewer(updater, mqtt, "1.4.0-rc.31"));
+
+    // Longer than OTA_MAX_VERSION_LENGTH: not valid, so every offer is newer
+    std::string tooLong = "9.0.0-" + std::string(OTA_MAX_VERSION_LENGTH, 'x');
+    updater.setCurrentVersion(String(tooLong.c_str()));
+    CHECK(isNewer(updater, mqtt, "1.0.0"));
+    std::string longest = "9.0.0-" + std::string(OTA_MAX_VERSION_LENGTH - 6, 'x');
+    updater.setCurrentVersion(String(longest.c_str()));
+    CHECK(!isNewer(updater, mqtt, "1.0.0"));
+    CHECK(isNewer(updater, mqtt, "9.0.0"));
+
+    return checkReport("current_version");
+}
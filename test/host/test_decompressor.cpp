@@ -0,0 +1,213 @@
+// Sources: src/OtaDecompressor.cpp src/OtaArena.cpp
+// Libraries: -lz
+// gzip streams from zlib and heatshrink streams from the reference encoder
+// decompress to the original in slices of any size. A gzip trailer whose
+// CRC32 or ISIZE does not match is rejected, and a heatshrink stream cut
+// anywhere but a padded symbol boundary is not complete.
+
+#include "OtaDecompressor.h"
+#include "heatshrink_encode.h"
+#include "test_check.h"
+#include <zlib.h>
+
+typedef std::vector<uint8_t> Bytes;
+
+static bool collect(void* context, const uint8_t* data, size_t length) {
+    Bytes* out = static_cast<Bytes*>(context);
+    out->insert(out->end(), data, data + length);
+    return true;
+}
+
+// Code-like bytes: short repeated sequences with varying operands
+static Bytes makeImage(size_t size, uint32_t seed) {
+    Bytes image(size);
+    uint32_t state = seed;
+    for (size_t i = 0; i < size; i++) {
+        state = state * 1103515245u + 12345u;
+        image[i] = (i % 4 == 3) ? (uint8_t)(state >> 16) : (uint8_t)(0x30 + i % 4);
+    }
+    return image;
+}
+
+static Bytes gzipCompress(const Bytes& data, int level, bool headerFields = false) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY);
+    gz_header header;
+    memset(&header, 0, sizeof(header));
+    Bytes extra = {'O', 'T', 4, 0, 1, 2, 3, 4};
+    if (headerFields) {
+        header.extra = extra.data();
+        header.extra_len = (uInt)extra.size();
+        header.name = (Bytef*)"firmware.bin";
+        header.comment = (Bytef*)"build 1.4.0";
+        header.hcrc = 1;
+        deflateSetHeader(&stream, &header);
+    }
+    Bytes out(deflateBound(&stream, data.size()) + 64);
+    stream.next_in = const_cast<uint8_t*>(data.data());
+    stream.avail_in = (uInt)data.size();
+    stream.next_out = out.data();
+    stream.avail_out = (uInt)out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+static bool decompress(OtaCompression type, const Bytes& input, size_t slice, Bytes& out,
+                       OtaDecompressor& decompressor, uint8_t windowBits = 8, uint8_t lookaheadBits = 4) {
+    out.clear();
+    if (!decompressor.begin(type, collect, &out, windowBits, lookaheadBits)) return false;
+    for (size_t pos = 0; pos < input.size(); pos += slice) {
+        if (!decompressor.feed(input.data() + pos, min(slice, input.size() - pos))) return false;
+    }
+    return true;
+}
+
+static void testGzip() {
+    static const size_t SLICES[] = {1, 7, 1460, 65536, 1 << 22};
+    Bytes image = makeImage(300000, 3);
+    Bytes stored = gzipCompress(image, 0);
+    Bytes packed = gzipCompress(image, 9, true);
+
+    for (const Bytes* input : {&stored, &packed}) {
+        for (size_t slice : SLICES) {
+            OtaDecompressor decompressor;
+            Bytes out;
+            CHECK(decompress(OtaCompression::GZIP, *input, slice, out, decompressor));
+            CHECK(decompressor.isComplete());
+            CHECK(out == image);
+            CHECK_EQ(decompressor.getOutputBytes(), image.size());
+        }
+    }
+
+    // Trailer: CRC32 at size - 8, ISIZE at size - 4
+    OtaDecompressor decompressor;
+    Bytes out;
+    Bytes bad = packed;
+    bad[bad.size() - 8] ^= 0x01;
+    CHECK(!decompress(OtaCompression::GZIP, bad, 4096, out, decompressor));
+    CHECK(decompressor.getError() && strcmp(decompressor.getError(), "gzip CRC mismatch") == 0);
+    CHECK(!decompressor.isComplete());
+
+    bad = packed;
+    bad[bad.size() - 4] ^= 0x01;
+    CHECK(!decompress(OtaCompression::GZIP, bad, 4096, out, decompressor));
+    CHECK(decompressor.getError() && strcmp(decompressor.getError(), "gzip size mismatch") == 0);
+
+    // A flipped byte inside a stored block still inflates; only the CRC catches it
+    bad = stored;
+    bad[bad.size() / 2] ^= 0x40;
+    CHECK(!decompress(OtaCompression::GZIP, bad, 1460, out, decompressor));
+    CHECK(decompressor.getError() && strcmp(decompressor.getError(), "gzip CRC mismatch") == 0);
+    CHECK_EQ(out.size(), image.size());
+
+    bad = packed;
+    bad[1] = 0x8c;
+    CHECK(!decompress(OtaCompression::GZIP, bad, 4096, out, decompressor));
+    CHECK(decompressor.getError() && strcmp(decompressor.getError(), "Not a gzip stream") == 0);
+
+    // Cut anywhere, including inside the trailer: not complete, no error
+    static const size_t CUTS[] = {5, 20, 1000, 8, 4, 1};
+    for (size_t fromEnd : CUTS) {
+        Bytes cut(packed.begin(), packed.end() - fromEnd);
+        CHECK(decompress(OtaCompression::GZIP, cut, 1460, out, decompressor));
+        CHECK(!decompressor.isComplete());
+        CHECK(!decompressor.hasError());
+    }
+}
+
+// Byte counts at which a cut stream ends on a symbol boundary followed only by zero padding
+static std::vector<bool> completeCuts(const HeatshrinkStream& stream) {
+    std::vector<bool> complete(stream.bytes.size() + 1, false);
+    complete[0] = true;
+    for (size_t end : stream.symbolEnds) {
+        size_t cut = (end + 7) / 8;
+        bool zero = true;
+        for (size_t bit = end; bit < cut * 8; bit++) {
+            if (stream.bytes[bit / 8] & (0x80 >> (bit % 8))) zero = false;
+        }
+        if (zero) complete[cut] = true;
+    }
+    return complete;
+}
+
+static void testHeatshrink() {
+    static const uint8_t PARAMS[][2] = {{4, 3}, {8, 4}, {10, 5}, {12, 11}};
+    static const size_t SLICES[] = {1, 3, 256, 1 << 20};
+    Bytes image = makeImage(12000, 11);
+    Bytes text(4000);
+    for (size_t i = 0; i < text.size(); i++) text[i] = "firmware update over mqtt "[i % 26];
+    image.insert(image.end(), text.begin(), text.end());
+
+    for (const auto& params : PARAMS) {
+        HeatshrinkStream stream = heatshrinkEncode(image.data(), image.size(), params[0], params[1]);
+        CHECK(stream.bytes.size() < image.size());
+        for (size_t slice : SLICES) {
+            OtaDecompressor decompressor;
+            Bytes out;
+            CHECK(decompress(OtaCompression::HEATSHRINK, stream.bytes, slice, out, decompressor, params[0], params[1]));
+            CHECK(decompressor.isComplete());
+            CHECK(out == image);
+        }
+
+        // Every shorter stream is complete exactly when it ends on a padded symbol boundary
+        std::vector<bool> expected = completeCuts(stream);
+        int wrong = 0;
+        for (size_t cut = 0; cut < stream.bytes.size(); cut++) {
+            OtaDecompressor decompressor;
+            Bytes out;
+            Bytes prefix(stream.bytes.begin(), stream.bytes.begin() + cut);
+            CHECK(decompress(OtaCompression::HEATSHRINK, prefix, 64, out, decompressor, params[0], params[1]));
+            if (decompressor.isComplete() != expected[cut] && wrong++ < 3) {
+                printf("  heatshrink %u/%u cut at %u: complete = %d\n", params[0], params[1], (unsigned)cut,
+                       decompressor.isComplete());
+            }
+        }
+        CHECK_EQ(wrong, 0);
+    }
+
+    // Three literals are 27 bits: cut after 3 bytes, the third is half read
+    const uint8_t abc[] = {'a', 'b', 'c'};
+    HeatshrinkStream stream = heatshrinkEncode(abc, 3, 8, 4);
+    CHECK_EQ(stream.bytes.size(), 4);
+    OtaDecompressor decompressor;
+    Bytes out;
+    Bytes cut(stream.bytes.begin(), stream.bytes.begin() + 3);
+    CHECK(decompress(OtaCompression::HEATSHRINK, cut, 1, out, decompressor));
+    CHECK(!decompressor.isComplete());
+    CHECK(decompress(OtaCompression::HEATSHRINK, stream.bytes, 1, out, decompressor));
+    CHECK(decompressor.isComplete());
+    CHECK_EQ(out.size(), 3);
+
+    // Nonzero padding is not something the encoder writes
+    Bytes padded = stream.bytes;
+    padded.back() |= 0x01;
+    CHECK(decompress(OtaCompression::HEATSHRINK, padded, 1, out, decompressor));
+    CHECK(!decompressor.isComplete());
+
+    CHECK(!decompressor.begin(OtaCompression::HEATSHRINK, collect, &out, 8, 8));
+    CHECK(strcmp(decompressor.getError(), "Invalid heatshrink parameters") == 0);
+}
+
+static bool refuse(void*, const uint8_t*, size_t) {
+    return false;
+}
+
+static void testSinkFailure() {
+    Bytes image = makeImage(5000, 1);
+    Bytes packed = gzipCompress(image, 6);
+    OtaDecompressor decompressor;
+    CHECK(decompressor.begin(OtaCompression::GZIP, refuse, nullptr));
+    CHECK(!decompressor.feed(packed.data(), packed.size()));
+    CHECK(strcmp(decompressor.getError(), "Failed to write decompressed data") == 0);
+    CHECK(!decompressor.isComplete());
+}
+
+int main() {
+    testGzip();
+    testHeatshrink();
+    testSinkFailure();
+    return checkReport("decompressor");
+}
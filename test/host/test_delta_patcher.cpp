@@ -0,0 +1,211 @@
+// Sources: src/OtaDeltaPatcher.cpp
+// Round trip: tools/gen_delta_patch.py builds a patch between two images,
+// OtaDeltaPatcher rebuilds the new one from it, fed in slices of several
+// sizes as it would arrive from the network. Then malformed patches, each of
+// which must stop the patcher with an error instead of writing past an image.
+
+#include "OtaDeltaPatcher.h"
+#include "test_check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Images {
+    const Bytes* old;
+    Bytes rebuilt;
+    bool failRead;
+};
+
+static bool readOld(void* context, size_t offset, uint8_t* buffer, size_t length) {
+    Images* images = static_cast<Images*>(context);
+    if (images->failRead || offset + length > images->old->size()) return false;
+    memcpy(buffer, images->old->data() + offset, length);
+    return true;
+}
+
+static bool writeNew(void* context, const uint8_t* data, size_t length) {
+    Images* images = static_cast<Images*>(context);
+    images->rebuilt.insert(images->rebuilt.end(), data, data + length);
+    return true;
+}
+
+// Feeds patch in slices of sliceSize; false when the patcher rejected it
+static bool applyPatch(const Bytes& old, const Bytes& patch, size_t sliceSize, Bytes& rebuilt,
+                       OtaDeltaPatcher& patcher, bool failRead = false) {
+    Images images = {&old, Bytes(), failRead};
+    patcher.begin(readOld, writeNew, &images, old.size());
+    bool ok = true;
+    for (size_t pos = 0; pos < patch.size() && ok; pos += sliceSize) {
+        ok = patcher.feed(patch.data() + pos, min(sliceSize, patch.size() - pos));
+    }
+    rebuilt = images.rebuilt;
+    return ok && patcher.isComplete();
+}
+
+// Code-like bytes: short repeated sequences with varying operands
+static Bytes makeImage(size_t size, uint32_t seed) {
+    Bytes image(size);
+    uint32_t state = seed;
+    for (size_t i = 0; i < size; i++) {
+        state = state * 1103515245u + 12345u;
+        image[i] = (i % 4 == 3) ? (uint8_t)(state >> 16) : (uint8_t)(0x30 + i % 4);
+    }
+    return image;
+}
+
+static bool writeFile(const std::string& path, const Bytes& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && ok;
+}
+
+static Bytes readFile(const std::string& path) {
+    Bytes data;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return data;
+    uint8_t buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + count);
+    fclose(file);
+    return data;
+}
+
+static Bytes generatePatch(const Bytes& old, const Bytes& image) {
+    char dir[] = "/tmp/ota_delta_XXXXXX";
+    if (!mkdtemp(dir)) return Bytes();
+    std::string base(dir);
+    std::string command = "python3 tools/gen_delta_patch.py " + base + "/old.bin " + base + "/new.bin -o " +
+                          base + "/update.patch > /dev/null";
+    Bytes patch;
+    if (writeFile(base + "/old.bin", old) && writeFile(base + "/new.bin", image) && system(command.c_str()) == 0) {
+        patch = readFile(base + "/update.patch");
+    }
+    std::string cleanup = "rm -rf " + base;
+    if (system(cleanup.c_str()) != 0) printf("delta_patcher: could not remove %s\n", dir);
+    return patch;
+}
+
+static void testRoundTrip() {
+    Bytes old = makeImage(200000, 1);
+    Bytes image(old);
+    image.insert(image.begin() + 1000, 300, 0xAA);                           // Inserted code
+    image.erase(image.begin() + 50000, image.begin() + 54000);               // Removed function
+    for (size_t i = 70000; i < 150000; i += 997) image[i] ^= 0x04;          // Shifted addresses
+    Bytes moved(old.begin() + 120000, old.begin() + 130000);
+    image.insert(image.end(), moved.begin(), moved.end());                   // Relocated block
+    Bytes tail = makeImage(3000, 7);
+    image.insert(image.end(), tail.begin(), tail.end());                     // New data
+
+    Bytes patch = generatePatch(old, image);
+    CHECK(patch.size() > 12);
+    if (patch.size() <= 12) return;
+    CHECK(memcmp(patch.data(), "OTADIFF1", 8) == 0);
+
+    static const size_t SLICES[] = {1, 7, 12, 13, 256, 257, 1460, 65536, 1 << 20};
+    for (size_t slice : SLICES) {
+        OtaDeltaPatcher patcher;
+        Bytes rebuilt;
+        CHECK(applyPatch(old, patch, slice, rebuilt, patcher));
+        CHECK(rebuilt == image);
+        CHECK_EQ(patcher.getNewSize(), image.size());
+        CHECK_EQ(patcher.getOutputBytes(), image.size());
+    }
+
+    // Unrelated images still round trip, through extra bytes
+    Bytes other = makeImage(5000, 99);
+    patch = generatePatch(old, other);
+    OtaDeltaPatcher patcher;
+    Bytes rebuilt;
+    CHECK(applyPatch(old, patch, 100, rebuilt, patcher));
+    CHECK(rebuilt == other);
+}
+
+static void putLe32(Bytes& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static Bytes header(uint32_t newSize) {
+    Bytes patch = {'O', 'T', 'A', 'D', 'I', 'F', 'F', '1'};
+    putLe32(patch, newSize);
+    return patch;
+}
+
+static void control(Bytes& patch, uint32_t diffLength, uint32_t extraLength, int32_t seek) {
+    putLe32(patch, diffLength);
+    putLe32(patch, extraLength);
+    putLe32(patch, (uint32_t)seek);
+}
+
+static void expectError(const Bytes& old, const Bytes& patch, const char* error, bool failRead = false) {
+    static const size_t SLICES[] = {1, 5, 4096};
+    for (size_t slice : SLICES) {
+        OtaDeltaPatcher patcher;
+        Bytes rebuilt;
+        CHECK(!applyPatch(old, patch, slice, rebuilt, patcher, failRead));
+        CHECK(patcher.hasError());
+        CHECK(rebuilt.size() <= patcher.getNewSize());
+        if (!patcher.getError() || strcmp(patcher.getError(), error) != 0) {
+            CHECK(!"unexpected error");
+            printf("  expected \"%s\", got \"%s\"\n", error, patcher.getError() ? patcher.getError() : "(none)");
+        }
+    }
+}
+
+static void testMalformed() {
+    Bytes old(64, 0x11);
+
+    Bytes patch = header(16);
+    patch[7] = '2';
+    expectError(old, patch, "Bad patch magic");
+
+    expectError(old, header(0), "Empty target image");
+
+    patch = header(16);
+    control(patch, 8, 9, 0);
+    expectError(old, patch, "Control block exceeds target size");
+
+    patch = header(100);
+    control(patch, 65, 0, 0);
+    expectError(old, patch, "Diff reads past end of old image");
+
+    patch = header(16);
+    control(patch, 4, 0, -5);
+    patch.insert(patch.end(), 4, 0);
+    expectError(old, patch, "Seek outside old image");
+
+    patch = header(16);
+    control(patch, 4, 0, 61);
+    patch.insert(patch.end(), 4, 0);
+    expectError(old, patch, "Seek outside old image");
+
+    patch = header(4);
+    control(patch, 0, 4, 0);
+    patch.insert(patch.end(), 5, 0x22);
+    expectError(old, patch, "Trailing data after patch end");
+
+    patch = header(4);
+    control(patch, 4, 0, 0);
+    patch.insert(patch.end(), 4, 0);
+    expectError(old, patch, "Failed to read old image", true);
+
+    // A patch cut short is not complete
+    patch = header(8);
+    control(patch, 4, 4, 0);
+    patch.insert(patch.end(), 6, 1);
+    OtaDeltaPatcher patcher;
+    Bytes rebuilt;
+    CHECK(!applyPatch(old, patch, 3, rebuilt, patcher));
+    CHECK(!patcher.hasError());
+    CHECK(!patcher.isComplete());
+    CHECK_EQ(rebuilt.size(), 6);
+}
+
+int main() {
+    testRoundTrip();
+    testMalformed();
+    return checkReport("delta_patcher");
+}
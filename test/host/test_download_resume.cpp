@@ -0,0 +1,198 @@
+// Sources: src/BandwidthShaping.cpp src/DownloadPipeline.cpp src/ESP32OtaMqtt.cpp src/EngineTask.cpp src/MirrorSelection.cpp src/MqttChunkTransfer.cpp src/NonBlockingHelpers.cpp src/OtaArena.cpp src/OtaCertBundle.cpp src/OtaDecompressor.cpp src/OtaDeltaPatcher.cpp src/OtaEventQueue.cpp src/OtaFlashWriter.cpp src/OtaHttpParser.cpp src/OtaJson.cpp src/OtaLog.cpp src/OtaLoopBudget.cpp src/OtaMirrorSet.cpp src/OtaMqttEngine.cpp src/OtaMqttTransfer.cpp src/OtaPemDecoder.cpp src/OtaRateLimiter.cpp src/OtaRetryPolicy.cpp src/OtaRollout.cpp src/OtaSegmentedDownload.cpp src/OtaSha256.cpp src/OtaTopicRouter.cpp src/OtaTrustStore.cpp src/OtaVersion.cpp src/SegmentedDownload.cpp
+// Libraries: -lz -lcrypto
+// Resuming an interrupted download with a Range request, on the whole
+// updater: the retry asks for the byte after the last one kept, a 206 from
+// exactly there finishes the image, a 206 from anywhere else or for another
+// file size fails the attempt, and a 200 restarts the image from byte 0.
+// The flashed image and getResumeBytesSaved() are checked each time, through
+// the Update class and with directFlashWrites.
+
+#include "ESP32OtaMqtt.h"
+#include "fake_async_client.h"
+#include "fake_platform.h"
+#include "test_check.h"
+#include <cstring>
+#include <openssl/sha.h>
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+enum class Reply {
+    CUT,            // 200 or 206 as asked, closed after cutAt more body bytes
+    RANGE,          // 206 from the requested byte
+    WRONG_START,    // 206 from 100 bytes before the requested byte
+    WRONG_TOTAL,    // 206 naming another file size
+    IGNORE_RANGE    // 200 with the whole image
+};
+
+// Answers each request with the next scripted reply; the last one repeats
+struct ImageServer {
+    Bytes image;
+    std::vector<Reply> script;
+    size_t cutAt;
+    std::vector<long> ranges;       // Requested start per request, -1 without Range
+
+    void serve(FakeSocket& socket) {
+        static const char END[] = "\r\n\r\n";
+        Bytes& sent = socket.fromClient;
+        Bytes::iterator found = std::search(sent.begin(), sent.end(), END, END + 4);
+        if (found == sent.end()) return;
+        std::string request(sent.begin(), found + 4);
+        sent.erase(sent.begin(), found + 4);
+
+        unsigned first = 0;
+        const char* range = strstr(request.c_str(), "Range: bytes=");
+        bool ranged = range && sscanf(range, "Range: bytes=%u-", &first) == 1;
+        ranges.push_back(ranged ? (long)first : -1);
+        Reply reply = script[std::min(ranges.size(), script.size()) - 1];
+
+        size_t start = ranged ? first : 0, end = image.size(), total = image.size();
+        bool partial = ranged && reply != Reply::IGNORE_RANGE;
+        if (reply == Reply::IGNORE_RANGE) start = 0;
+        if (reply == Reply::WRONG_START) start -= 100;
+        if (reply == Reply::WRONG_TOTAL) total += 4096;
+        if (reply == Reply::CUT) end = std::min(end, start + cutAt);
+
+        char headers[256];
+        if (partial) {
+            snprintf(headers, sizeof(headers),
+                     "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %u-%u/%u\r\nContent-Length: %u\r\n"
+                     "Connection: close\r\n\r\n",
+                     (unsigned)start, (unsigned)(image.size() - 1), (unsigned)total, (unsigned)(image.size() - start));
+        } else {
+            snprintf(headers, sizeof(headers),
+                     "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+                     (unsigned)image.size());
+        }
+        socket.toClient.insert(socket.toClient.end(), headers, headers + strlen(headers));
+        socket.toClient.insert(socket.toClient.end(), image.begin() + start, image.begin() + end);
+        socket.closed = true;
+    }
+};
+
+static ImageServer server;
+static bool directFlashWrites;
+static std::vector<std::string> statuses;
+static std::vector<std::string> errors;
+
+static void onStatus(const String& status, int) {
+    statuses.push_back(status.c_str());
+}
+
+static void onError(const String& error, int) {
+    errors.push_back(error.c_str());
+}
+
+static std::string sha256Hex(const Bytes& data) {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(data.data(), data.size(), digest);
+    char hex[2 * SHA256_DIGEST_LENGTH + 1];
+    for (size_t i = 0; i < sizeof(digest); i++) snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+    return hex;
+}
+
+// Runs one forced update through the script on a fresh updater; true when
+// it succeeded. saved is getResumeBytesSaved() at the end.
+static bool update(const std::vector<Reply>& script, size_t cutAt, size_t& saved) {
+    server.image.resize(150000);
+    for (size_t i = 0; i < server.image.size(); i++) server.image[i] = (uint8_t)(rand() >> 4);
+    server.script = script;
+    server.cutAt = cutAt;
+    server.ranges.clear();
+    statuses.clear();
+    errors.clear();
+    fakeFlash.reset();
+    fakeServer = [](FakeSocket& socket) { server.serve(socket); };
+
+    WiFiClientSecure wifi;
+    PubSubClient mqtt;
+    ESP32OtaMqtt updater(wifi, mqtt, "devices/1/ota");
+    OtaConfig config;
+    config.logBufferSize = 0;
+    config.retryBaseDelay = 10;
+    config.retryMaxDelay = 10;
+    config.maxRetries = 3;
+    config.directFlashWrites = directFlashWrites;
+    updater.setConfig(config);
+    updater.onStatusUpdate(onStatus);
+    updater.onError(onError);
+    CHECK(updater.begin());
+
+    CHECK(updater.forceUpdate("2.0.0", "http://fw.example.com/fw.bin", sha256Hex(server.image).c_str()));
+    for (int i = 0; i < 200000; i++) {
+        updater.loop();
+        hostClockMicros() += 1000;
+        if (!statuses.empty() && (statuses.back() == "SUCCESS" || statuses.back() == "ERROR")) break;
+    }
+    saved = updater.getResumeBytesSaved();
+    return !statuses.empty() && statuses.back() == "SUCCESS";
+}
+
+static bool flashed() {
+    return std::equal(server.image.begin(), server.image.end(), fakeFlash.nextData.begin());
+}
+
+static bool hasError(const char* text) {
+    for (size_t i = 0; i < errors.size(); i++) {
+        if (errors[i] == text) return true;
+    }
+    return false;
+}
+
+static void testResume() {
+    size_t saved;
+
+    // Cut at 60000 bytes: the retry continues where the kept bytes end
+    CHECK(update({Reply::CUT, Reply::RANGE}, 60000, saved));
+    CHECK(flashed());
+    CHECK_EQ(fakeFlash.bootSelections, 1);
+    CHECK_EQ(server.ranges.size(), 2);
+    if (server.ranges.size() == 2) {
+        CHECK_EQ(server.ranges[0], -1);
+        CHECK(server.ranges[1] > 0 && server.ranges[1] <= 60000);
+        CHECK_EQ(saved, (size_t)server.ranges[1]);
+    }
+
+    // Cut twice: the savings add up
+    CHECK(update({Reply::CUT, Reply::CUT, Reply::RANGE}, 50000, saved));
+    CHECK(flashed());
+    CHECK_EQ(server.ranges.size(), 3);
+    if (server.ranges.size() == 3) {
+        CHECK(server.ranges[1] > 0 && server.ranges[2] > server.ranges[1]);
+        CHECK_EQ(saved, (size_t)(server.ranges[1] + server.ranges[2]));
+    }
+
+    // 200 to the Range request: the image restarts from byte 0 on that response
+    CHECK(update({Reply::CUT, Reply::IGNORE_RANGE}, 60000, saved));
+    CHECK(flashed());
+    CHECK_EQ(server.ranges.size(), 2);
+    if (server.ranges.size() == 2) CHECK(server.ranges[1] > 0);
+    CHECK_EQ(saved, 0);
+
+    // A 206 starting elsewhere would misplace every byte after it: the
+    // attempt fails, and the next starts over without a Range
+    CHECK(update({Reply::CUT, Reply::WRONG_START, Reply::RANGE}, 60000, saved));
+    CHECK(hasError("Content-Range mismatch on resume"));
+    CHECK(flashed());
+    CHECK_EQ(server.ranges.size(), 3);
+    if (server.ranges.size() == 3) CHECK_EQ(server.ranges[2], -1);
+    CHECK_EQ(saved, 0);
+
+    // Likewise a 206 for a file of another size
+    CHECK(update({Reply::CUT, Reply::WRONG_TOTAL, Reply::RANGE}, 60000, saved));
+    CHECK(hasError("Content-Range mismatch on resume"));
+    CHECK(flashed());
+    CHECK_EQ(server.ranges.size(), 3);
+    if (server.ranges.size() == 3) CHECK_EQ(server.ranges[2], -1);
+}
+
+int main() {
+    srand(3);
+    directFlashWrites = false;
+    testResume();
+    directFlashWrites = true;
+    testResume();
+    fakeServer = nullptr;
+    return checkReport("download_resume");
+}
@@ -0,0 +1,147 @@
+// Sources: src/BandwidthShaping.cpp src/DownloadPipeline.cpp src/ESP32OtaMqtt.cpp src/EngineTask.cpp src/MirrorSelection.cpp src/MqttChunkTransfer.cpp src/NonBlockingHelpers.cpp src/OtaArena.cpp src/OtaCertBundle.cpp src/OtaDecompressor.cpp src/OtaDeltaPatcher.cpp src/OtaEventQueue.cpp src/OtaFlashWriter.cpp src/OtaHttpParser.cpp src/OtaJson.cpp src/OtaLog.cpp src/OtaLoopBudget.cpp src/OtaMirrorSet.cpp src/OtaMqttEngine.cpp src/OtaMqttTransfer.cpp src/OtaPemDecoder.cpp src/OtaRateLimiter.cpp src/OtaRetryPolicy.cpp src/OtaRollout.cpp src/OtaSegmentedDownload.cpp src/OtaSha256.cpp src/OtaTopicRouter.cpp src/OtaTrustStore.cpp src/OtaVersion.cpp src/SegmentedDownload.cpp
+// Libraries: -lz -lcrypto
+// The updater with runInTask, its task on a std::thread: commands, config
+// and events go through the queues, callbacks run on the application's
+// thread, a full command queue is refused instead of dropped silently, and
+// a config set meanwhile still reaches the task. Run with SANITIZE=thread to
+// check that the two sides share nothing else.
+
+#include "ESP32OtaMqtt.h"
+#include "fake_async_client.h"
+#include "fake_platform.h"
+#include "test_check.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::vector<std::string> statuses;
+static std::vector<std::string> errors;
+static bool callbackOffThread = false;
+static std::thread::id applicationThread;
+
+static void onStatus(const String& status, int) {
+    if (std::this_thread::get_id() != applicationThread) callbackOffThread = true;
+    statuses.push_back(status.c_str());
+}
+
+static void onError(const String& error, int) {
+    if (std::this_thread::get_id() != applicationThread) callbackOffThread = true;
+    errors.push_back(error.c_str());
+}
+
+static int count(const char* status) {
+    int total = 0;
+    for (size_t i = 0; i < statuses.size(); i++) total += statuses[i] == status;
+    return total;
+}
+
+// Holds the task inside an iteration (in mqttClient.loop()), after it took
+// its commands, so the test can fill the queues meanwhile
+struct Gate {
+    std::mutex lock;
+    std::condition_variable wake;
+    bool closed = false;
+    bool parked = false;
+
+    void pass() {
+        std::unique_lock<std::mutex> guard(lock);
+        if (!closed) return;
+        parked = true;
+        wake.notify_all();
+        wake.wait(guard, [this]() { return !closed; });
+        parked = false;
+    }
+
+    void close() {
+        std::unique_lock<std::mutex> guard(lock);
+        closed = true;
+        wake.wait(guard, [this]() { return parked; });
+    }
+
+    void open() {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = false;
+        wake.notify_all();
+    }
+};
+
+static Gate gate;
+
+// Runs the application's loop() until condition holds or a second has passed
+template<typename Condition>
+static bool runUntil(ESP32OtaMqtt& updater, Condition condition) {
+    for (int i = 0; i < 1000; i++) {
+        updater.loop();
+        if (condition()) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+static void testTaskQueues() {
+    WiFiClientSecure wifi;
+    PubSubClient mqtt;
+    mqtt.onLoop = []() { gate.pass(); };
+    {
+        ESP32OtaMqtt updater(wifi, mqtt, "devices/1/ota");
+        OtaConfig config;
+        config.runInTask = true;
+        config.logBufferSize = 0;
+        updater.setConfig(config);
+        updater.onStatusUpdate(onStatus);
+        updater.onError(onError);
+        CHECK(updater.begin());
+
+        // Commands run in the task; their events come back through loop()
+        CHECK(updater.checkForUpdates());
+        CHECK(runUntil(updater, []() { return count("IDLE") >= 1; }));
+        CHECK_EQ(count("CHECKING"), 1);
+
+        // Errors found by the task reach the error callback
+        std::string longUrl = "https://example.com/" + std::string(400, 'a');
+        CHECK(updater.forceUpdate("2.0.0", longUrl.c_str(), ""));
+        CHECK(runUntil(updater, []() { return !errors.empty(); }));
+        CHECK(!errors.empty() && errors[0] == "Update field too long");
+
+        // With the task held, four commands fit and the fifth is refused
+        gate.close();
+        uint32_t dropped = updater.getDroppedCommands();
+        for (int i = 0; i < 4; i++) CHECK(updater.checkForUpdates());
+        CHECK(!updater.checkForUpdates());
+        CHECK(!updater.forceUpdate("2.0.0", "https://example.com/fw.bin", ""));
+        CHECK_EQ(updater.getDroppedCommands(), dropped + 2);
+
+        // Configs do not use the command queue, and the last one is never
+        // dropped: two fit, the third waits in the application
+        updater.setMaxRetries(5);
+        updater.setDownloadTimeout(90000);
+        updater.setCheckInterval(50);
+        CHECK_EQ(updater.getConfig().checkInterval, 50);
+        CHECK_EQ(updater.getDroppedCommands(), dropped + 2);
+        gate.open();
+
+        CHECK(runUntil(updater, []() { return count("IDLE") >= 5; }));
+        CHECK_EQ(count("CHECKING"), 5);
+
+        // The 50 ms interval reached the task: once the clock passes it, the
+        // task checks by itself (with the default 30 s it would not)
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        updater.loop();
+        CHECK_EQ(count("CHECKING"), 5);
+        hostClockMicros() += 100000;
+        CHECK(runUntil(updater, []() { return count("CHECKING") >= 6; }));
+        CHECK(!callbackOffThread);
+    }
+    // The destructor stopped the task; nothing runs on its thread anymore
+    mqtt.onLoop = nullptr;
+}
+
+int main() {
+    applicationThread = std::this_thread::get_id();
+    hostTasks().enabled = true;
+    testTaskQueues();
+    return checkReport("engine_task");
+}
@@ -0,0 +1,103 @@
+// Sources: src/OtaEventQueue.cpp
+// A full OtaEventQueue makes room by dropping progress, never a status
+// change or error while progress is waiting, and keeps the events in order.
+
+#include "OtaEventQueue.h"
+#include "test_check.h"
+
+static OtaEvent status(OtaStatus value, int progress = 0) {
+    OtaEvent event = {OtaEventType::STATUS, value, progress, 0, 0, 0};
+    return event;
+}
+
+static OtaEvent progress(int percent) {
+    OtaEvent event = {OtaEventType::PROGRESS, OtaStatus::DOWNLOADING, percent, 0, 0, 0};
+    return event;
+}
+
+static OtaEvent error(int code) {
+    OtaEvent event = {OtaEventType::ERROR, OtaStatus::ERROR, 0, code, 0, 0};
+    return event;
+}
+
+static void testProgressEvictedFirst() {
+    OtaEventQueue queue;
+    queue.setProgressRate(0, 1);
+    unsigned long now = 0;
+
+    // S P S P ... fills the queue with progress between the transitions
+    queue.push(status(OtaStatus::CHECKING), now);
+    queue.push(status(OtaStatus::DOWNLOADING), now);
+    for (int i = 1; i <= 3; i++) {
+        queue.push(progress(i * 10), now);
+        queue.push(error(i), now);
+    }
+    CHECK_EQ(queue.getDropped(), 0);
+
+    // Two more transitions push out the two oldest progress events
+    queue.push(status(OtaStatus::INSTALLING), now);
+    queue.push(status(OtaStatus::SUCCESS), now);
+    CHECK_EQ(queue.getDropped(), 2);
+
+    OtaEvent event;
+    const OtaEventType expected[] = {OtaEventType::STATUS, OtaEventType::STATUS, OtaEventType::ERROR,
+                                     OtaEventType::ERROR, OtaEventType::PROGRESS, OtaEventType::ERROR,
+                                     OtaEventType::STATUS, OtaEventType::STATUS};
+    for (OtaEventType type : expected) {
+        CHECK(queue.pop(event));
+        CHECK(event.type == type);
+        if (event.type == OtaEventType::PROGRESS) CHECK_EQ(event.progress, 30);
+    }
+    CHECK(event.status == OtaStatus::SUCCESS);
+    CHECK(!queue.pop(event));
+}
+
+static void testProgressRefusedWhenFullOfTransitions() {
+    OtaEventQueue queue;
+    queue.setProgressRate(0, 1);
+    for (size_t i = 0; i < OtaEventQueue::CAPACITY; i++) {
+        queue.push(error((int)i), 0);
+    }
+    queue.push(progress(50), 0);
+    CHECK_EQ(queue.getDropped(), 1);
+
+    OtaEvent event;
+    for (size_t i = 0; i < OtaEventQueue::CAPACITY; i++) {
+        CHECK(queue.pop(event));
+        CHECK(event.type == OtaEventType::ERROR);
+        CHECK_EQ(event.errorCode, (int)i);
+    }
+    CHECK(!queue.pop(event));
+
+    // Only a transition beyond CAPACITY transitions gives up the oldest one
+    for (size_t i = 0; i <= OtaEventQueue::CAPACITY; i++) {
+        queue.push(error((int)i), 0);
+    }
+    CHECK_EQ(queue.getDropped(), 2);
+    CHECK(queue.pop(event));
+    CHECK_EQ(event.errorCode, 1);
+}
+
+static void testProgressCoalesced() {
+    OtaEventQueue queue;
+    queue.setProgressRate(1000, 5);
+    queue.push(status(OtaStatus::DOWNLOADING), 0);
+    queue.push(progress(2), 10);     // Neither the step nor the interval
+    queue.push(progress(5), 20);
+    queue.push(progress(12), 30);    // Replaces the waiting 5
+    queue.push(progress(13), 1100);  // Interval passed
+    OtaEvent event;
+    CHECK(queue.pop(event));
+    CHECK(event.type == OtaEventType::STATUS);
+    CHECK(queue.pop(event));
+    CHECK_EQ(event.progress, 13);
+    CHECK(!queue.pop(event));
+    CHECK_EQ(queue.getDropped(), 0);
+}
+
+int main() {
+    testProgressEvictedFirst();
+    testProgressRefusedWhenFullOfTransitions();
+    testProgressCoalesced();
+    return checkReport("event_queue");
+}
@@ -0,0 +1,175 @@
+// Sources: src/OtaFlashWriter.cpp src/OtaArena.cpp
+// Records the erase/write pattern of OtaFlashWriter against a simulated
+// partition: flash bits can only be cleared, so a write into a sector that
+// was not erased since its last write corrupts it and is counted.
+
+#include "OtaFlashWriter.h"
+#include <Update.h>
+#include <esp_partition.h>
+#include "test_check.h"
+#include <string.h>
+#include <vector>
+
+static const size_t PARTITION_SIZE = 16 * OtaFlashWriter::SECTOR_SIZE;
+
+static esp_partition_t partition = {0x110000, PARTITION_SIZE, "ota_1", false};
+static std::vector<uint8_t> flash(PARTITION_SIZE, 0x00);
+static std::vector<bool> erased(PARTITION_SIZE / OtaFlashWriter::SECTOR_SIZE, false);
+static std::vector<std::string> operations;
+static int unerasedWrites = 0;
+static int misalignedWrites = 0;
+static int bootSelections = 0;
+
+esp_err_t esp_partition_read(const esp_partition_t*, size_t offset, void* dst, size_t size) {
+    memcpy(dst, flash.data() + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* target, size_t offset, const void* src, size_t size) {
+    if (target != &partition || offset + size > PARTITION_SIZE) return ESP_ERR_INVALID_SIZE;
+    if (offset % 16 != 0 || size % 16 != 0) misalignedWrites++;
+    operations.push_back("W" + std::to_string(offset / OtaFlashWriter::SECTOR_SIZE));
+    const uint8_t* data = (const uint8_t*)src;
+    for (size_t i = 0; i < size; i++) {
+        size_t s = (offset + i) / OtaFlashWriter::SECTOR_SIZE;
+        if (!erased[s]) {
+            unerasedWrites++;
+            break;
+        }
+        flash[offset + i] &= data[i];
+    }
+    erased[offset / OtaFlashWriter::SECTOR_SIZE] = false;   // Written: needs an erase before the next write
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t*, size_t offset, size_t size) {
+    if (offset % OtaFlashWriter::SECTOR_SIZE != 0 || size % OtaFlashWriter::SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t s = offset / OtaFlashWriter::SECTOR_SIZE; s < (offset + size) / OtaFlashWriter::SECTOR_SIZE; s++) {
+        operations.push_back("E" + std::to_string(s));
+        memset(flash.data() + s * OtaFlashWriter::SECTOR_SIZE, 0xFF, OtaFlashWriter::SECTOR_SIZE);
+        erased[s] = true;
+    }
+    return ESP_OK;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t*) {
+    return &partition;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t*) {
+    bootSelections++;
+    return ESP_OK;
+}
+
+UpdateClass Update;
+bool UpdateClass::begin(size_t) { return true; }
+size_t UpdateClass::write(uint8_t*, size_t length) { return length; }
+bool UpdateClass::end(bool) { return true; }
+void UpdateClass::abort() {}
+uint8_t UpdateClass::getError() { return 0; }
+
+static void resetFlash() {
+    std::fill(flash.begin(), flash.end(), 0x00);
+    std::fill(erased.begin(), erased.end(), false);
+    operations.clear();
+    unerasedWrites = 0;
+    misalignedWrites = 0;
+    bootSelections = 0;
+}
+
+static std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++) image[i] = (uint8_t)(i * 7 + (i >> 8));
+    return image;
+}
+
+// Writes image in uneven slices, calling eraseAhead between them when idleErases > 0
+static bool writeImage(OtaFlashWriter& writer, const std::vector<uint8_t>& image, size_t idleErases) {
+    static const size_t SLICES[] = {1, 700, 1460, 3, 4096, 2048};
+    size_t pos = 0;
+    for (size_t i = 0; pos < image.size(); i++) {
+        size_t length = min(SLICES[i % 6], image.size() - pos);
+        if (!writer.write(image.data() + pos, length)) return false;
+        pos += length;
+        if (idleErases > 0) writer.eraseAhead(idleErases);
+    }
+    return true;
+}
+
+static void testInlineErase() {
+    resetFlash();
+    OtaFlashWriter writer;
+    CHECK(writer.begin(OtaFlashBackend::ESP_OTA));
+    CHECK(writer.getBackend() == OtaFlashBackend::ESP_OTA);
+    CHECK(operations.empty());                  // begin() erases nothing
+
+    std::vector<uint8_t> image = makeImage(5 * OtaFlashWriter::SECTOR_SIZE + 100);
+    CHECK(writeImage(writer, image, 0));
+    CHECK(writer.end());
+
+    CHECK_EQ(unerasedWrites, 0);
+    CHECK_EQ(misalignedWrites, 0);
+    CHECK_EQ(writer.getInlineErases(), 6);
+    CHECK_EQ(writer.getAheadErases(), 0);
+    CHECK_EQ(bootSelections, 1);
+    CHECK(memcmp(flash.data(), image.data(), image.size()) == 0);
+    // Every sector is erased right before it is written
+    std::vector<std::string> expected;
+    for (int s = 0; s < 6; s++) {
+        expected.push_back("E" + std::to_string(s));
+        expected.push_back("W" + std::to_string(s));
+    }
+    CHECK(operations == expected);
+}
+
+static void testEraseAhead() {
+    resetFlash();
+    OtaFlashWriter writer;
+    CHECK(writer.begin(OtaFlashBackend::ESP_OTA));
+    std::vector<uint8_t> image = makeImage(7 * OtaFlashWriter::SECTOR_SIZE + 1);
+    writer.setImageSize(image.size());
+    CHECK(writer.eraseAhead(2));
+    CHECK(writeImage(writer, image, 2));
+    CHECK(writer.end());
+
+    CHECK_EQ(unerasedWrites, 0);
+    CHECK_EQ(misalignedWrites, 0);
+    CHECK_EQ(writer.getInlineErases(), 0);
+    CHECK_EQ(writer.getAheadErases(), 8);      // Bounded by the image size
+    CHECK(memcmp(flash.data(), image.data(), image.size()) == 0);
+    // Short last sector: padded to 16 bytes with erased flash
+    CHECK_EQ(flash[image.size()], 0xFF);
+    CHECK_EQ(erased[8], false);
+    CHECK(std::find(operations.begin(), operations.end(), "E8") == operations.end());
+}
+
+static void testUnknownSizeWindow() {
+    resetFlash();
+    OtaFlashWriter writer;
+    CHECK(writer.begin(OtaFlashBackend::ESP_OTA));
+    writer.eraseAhead(100);
+    CHECK_EQ(writer.getAheadErases(), OtaFlashWriter::ERASE_AHEAD_WINDOW / OtaFlashWriter::SECTOR_SIZE);
+    writer.abort();
+    CHECK_EQ(bootSelections, 0);
+}
+
+static void testOversizedImage() {
+    resetFlash();
+    OtaFlashWriter writer;
+    CHECK(writer.begin(OtaFlashBackend::ESP_OTA));
+    std::vector<uint8_t> image = makeImage(PARTITION_SIZE + 1);
+    CHECK(!writeImage(writer, image, 1) || !writer.end());
+    CHECK_EQ(writer.getError(), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(unerasedWrites, 0);
+    CHECK_EQ(bootSelections, 0);
+}
+
+int main() {
+    testInlineErase();
+    testEraseAhead();
+    testUnknownSizeWindow();
+    testOversizedImage();
+    return checkReport("flash_writer");
+}
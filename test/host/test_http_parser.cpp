@@ -0,0 +1,232 @@
+// Sources: src/OtaHttpParser.cpp
+// Corpus of raw responses in test/host/corpus/http, each with the summary
+// the parser must produce: chunked framing, 1xx and keep-alive sequences,
+// redirects, oversized headers and bad Content-Range values among them.
+// Every response must also parse the same when the stream is split at any
+// byte (a CRLF split across two reads included), and mutated copies of the
+// corpus must parse the same however they are sliced.
+
+#include "OtaHttpParser.h"
+#include "test_check.h"
+#include <dirent.h>
+#include <map>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static const char* const CORPUS_DIR = "test/host/corpus/http";
+
+static const std::map<std::string, std::string> EXPECTED = {
+    {"identity.http", "200 keep-alive complete body=hello world"},
+    {"identity_lowercase.http", "200 close complete body=abcde"},
+    {"identity_until_close.http", "200 close incomplete body=body until the connection closes"},
+    {"keep_alive_pipelined.http", "200 keep-alive complete body=firs | 200 keep-alive complete body=second"},
+    {"chunked.http", "200 chunked keep-alive complete body=hello world0123456789"},
+    {"chunked_lf_only.http", "200 chunked gzip keep-alive complete body=abc" + std::string(31, 'x')},
+    {"chunked_bad_size.http", "200 chunked keep-alive error=Malformed chunk size body=hello"},
+    {"chunked_missing_size.http", "200 chunked keep-alive error=Missing chunk size body="},
+    {"chunked_missing_crlf.http", "200 chunked keep-alive error=Missing CRLF after chunk body=hello"},
+    {"chunked_overflow.http", "200 chunked keep-alive error=Chunk size overflow body="},
+    {"chunked_truncated.http", "200 chunked keep-alive incomplete body=half"},
+    {"continue_100.http", "200 keep-alive complete body=abc"},
+    {"no_content_204.http", "204 keep-alive complete body="},
+    {"not_found_404.http", "404 keep-alive complete body=not found"},
+    {"redirect_302.http", "302 keep-alive location=https://cdn.example.com/fw/1.4.0.bin complete body="},
+    {"redirect_location_too_long.http", "301 keep-alive error=Redirect location too long body="},
+    {"range_206.http", "206 keep-alive range=100/1000 complete body=0123456789"},
+    {"range_unknown_total.http", "206 keep-alive range=0/* complete body=abcd"},
+    {"range_inverted.http", "206 keep-alive complete body="},
+    {"range_past_total.http", "206 keep-alive complete body="},
+    {"range_unsatisfied.http", "416 keep-alive complete body="},
+    {"range_open_end.http", "206 keep-alive complete body="},
+    {"range_negative.http", "206 keep-alive complete body="},
+    {"range_wrong_unit.http", "206 keep-alive complete body="},
+    {"range_trailing_garbage.http", "206 keep-alive complete body="},
+    {"long_header_line.http", "200 keep-alive complete body=ok"},
+    {"headers_too_large.http", "200 keep-alive error=Response headers too large body="},
+    {"bad_status_line.http", "0 close error=Malformed status line body="},
+    {"bad_status_code.http", "0 close error=Malformed status line body="},
+    {"bad_header_line.http", "200 keep-alive error=Malformed header line body="},
+    {"bad_content_length.http", "200 keep-alive error=Invalid Content-Length body="},
+};
+
+static uint32_t randomState = 5;
+static uint32_t nextRandom(uint32_t range) {
+    randomState = randomState * 1103515245u + 12345u;
+    return (randomState >> 8) % range;
+}
+
+static std::string describe(const OtaHttpParser& parser, const std::string& body) {
+    std::string summary = std::to_string(parser.getStatusCode());
+    if (parser.isChunked()) summary += " chunked";
+    if (parser.isGzipEncoded()) summary += " gzip";
+    summary += parser.isKeepAlive() ? " keep-alive" : " close";
+    if (parser.hasContentRange()) {
+        summary += " range=" + std::to_string(parser.getContentRangeStart()) + "/" +
+                   (parser.getContentRangeTotal() ? std::to_string(parser.getContentRangeTotal()) : "*");
+    }
+    if (parser.isRedirect()) summary += std::string(" location=") + parser.getLocation();
+    summary += parser.hasError() ? std::string(" error=") + parser.getError()
+             : parser.isBodyComplete() ? " complete" : " incomplete";
+    return summary + " body=" + body;
+}
+
+// Feeds input the way the download client reads it: firstSlice bytes, then
+// slices of slice bytes (random sizes for 0), never reading past what
+// maxBodyRead() allows. A complete keep-alive response is followed by the
+// next one on the same stream.
+static std::string run(const Bytes& input, size_t firstSlice, size_t slice) {
+    OtaHttpParser parser;
+    std::string summary;
+    std::string body;
+    size_t pos = 0;
+    size_t next = firstSlice;
+
+    while (pos < input.size() && !parser.hasError()) {
+        if (parser.isBodyComplete()) {
+            if (!parser.isKeepAlive()) break;
+            summary += describe(parser, body) + " | ";
+            body.clear();
+            parser.begin();
+        }
+
+        size_t length = min(next, input.size() - pos);
+        next = slice ? slice : 1 + nextRandom(64);
+        Bytes buffer(input.begin() + pos, input.begin() + pos + length);
+
+        size_t used = 0;
+        if (!parser.headersComplete()) used = parser.feedHeaders(buffer.data(), length);
+        size_t bodyRead = 0;
+        if (parser.headersComplete() && !parser.isBodyComplete()) {
+            bodyRead = parser.maxBodyRead(length - used);
+            size_t decoded = parser.decodeBody(buffer.data() + used, bodyRead);
+            CHECK(decoded <= bodyRead);
+            body.append((const char*)buffer.data() + used, decoded);
+        }
+        pos += used + bodyRead;
+    }
+
+    CHECK_EQ(body.size(), parser.getBodyBytes());
+    summary += describe(parser, body);
+    if (pos < input.size() && !parser.hasError()) summary += " rest=" + std::to_string(input.size() - pos);
+    return summary;
+}
+
+static Bytes readFile(const std::string& path) {
+    Bytes data;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return data;
+    uint8_t buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + count);
+    fclose(file);
+    return data;
+}
+
+static std::map<std::string, Bytes> loadCorpus() {
+    std::map<std::string, Bytes> corpus;
+    DIR* dir = opendir(CORPUS_DIR);
+    CHECK(dir != nullptr);
+    if (!dir) return corpus;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name[0] != '.') corpus[name] = readFile(std::string(CORPUS_DIR) + "/" + name);
+    }
+    closedir(dir);
+    return corpus;
+}
+
+static void expectSummary(const std::string& name, const std::string& summary, const std::string& expected,
+                          const char* how) {
+    if (summary != expected) {
+        CHECK(!"corpus summary");
+        printf("  %s (%s):\n    got      %s\n    expected %s\n", name.c_str(), how, summary.c_str(),
+               expected.c_str());
+    }
+}
+
+static void testCorpus(const std::map<std::string, Bytes>& corpus) {
+    for (const auto& expected : EXPECTED) {
+        if (!corpus.count(expected.first)) {
+            CHECK(!"corpus file missing");
+            printf("  %s\n", expected.first.c_str());
+        }
+    }
+
+    for (const auto& file : corpus) {
+        const std::string& name = file.first;
+        const Bytes& input = file.second;
+        auto expected = EXPECTED.find(name);
+        if (expected == EXPECTED.end()) {
+            CHECK(!"corpus file without an expected summary");
+            printf("  %s: %s\n", name.c_str(), run(input, input.size(), input.size()).c_str());
+            continue;
+        }
+
+        expectSummary(name, run(input, input.size(), input.size()), expected->second, "whole");
+        expectSummary(name, run(input, 1, 1), expected->second, "byte by byte");
+        for (size_t cut = 1; cut < input.size(); cut++) {
+            std::string summary = run(input, cut, input.size());
+            if (summary != expected->second) {
+                expectSummary(name, summary, expected->second, ("split at " + std::to_string(cut)).c_str());
+                break;
+            }
+        }
+    }
+}
+
+// Mutated responses: whatever the parser makes of them, it must make the same
+// of every slicing, and never report more body than it was given
+static void testMutations(const std::map<std::string, Bytes>& corpus) {
+    static const uint8_t INTERESTING[] = {'\r', '\n', ':', ';', ' ', '0', '9', 'f', 'x', '-', '/', '*', 0x00, 0xFF};
+    int mismatches = 0;
+    for (const auto& file : corpus) {
+        for (int n = 0; n < 300; n++) {
+            Bytes input = file.second;
+            int edits = 1 + nextRandom(4);
+            for (int e = 0; e < edits && !input.empty(); e++) {
+                size_t at = nextRandom(input.size());
+                uint8_t value = nextRandom(2) ? INTERESTING[nextRandom(sizeof(INTERESTING))] : (uint8_t)nextRandom(256);
+                switch (nextRandom(4)) {
+                    case 0: input[at] = value; break;
+                    case 1: input.insert(input.begin() + at, value); break;
+                    case 2: input.erase(input.begin() + at); break;
+                    default: input.resize(at); break;
+                }
+            }
+
+            std::string whole = run(input, input.size(), input.size());
+            std::string bytes = run(input, 1, 1);
+            std::string sliced = run(input, 1 + nextRandom(64), 0);
+            if (whole != bytes || whole != sliced) {
+                if (mismatches++ < 3) {
+                    printf("  %s mutation %d:\n    whole  %s\n    bytes  %s\n    sliced %s\n", file.first.c_str(), n,
+                           whole.c_str(), bytes.c_str(), sliced.c_str());
+                }
+            }
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+}
+
+static void testReuse() {
+    // begin() forgets the previous response entirely
+    OtaHttpParser parser;
+    const char* first = "HTTP/1.1 302 Found\r\nLocation: /a\r\nTransfer-Encoding: chunked\r\n\r\n";
+    CHECK_EQ(parser.feedHeaders((const uint8_t*)first, strlen(first)), strlen(first));
+    CHECK(parser.isRedirect());
+    parser.begin();
+    const char* second = "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n";
+    parser.feedHeaders((const uint8_t*)second, strlen(second));
+    CHECK(!parser.isRedirect());
+    CHECK(!parser.isChunked());
+    CHECK_EQ(parser.maxBodyRead(100), 1);
+}
+
+int main() {
+    std::map<std::string, Bytes> corpus = loadCorpus();
+    testCorpus(corpus);
+    testMutations(corpus);
+    testReuse();
+    return checkReport("http_parser");
+}
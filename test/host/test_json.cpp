@@ -0,0 +1,296 @@
+// Sources: src/OtaJson.cpp
+// OtaJson: escapes and surrogate pairs decoded in place, the error cases of
+// RFC 8259 with their offsets, then random documents that are serialized,
+// parsed back through the event stream and compared with the original.
+// Every strict prefix of a document must be rejected.
+
+#include "OtaJson.h"
+#include "test_check.h"
+#include <string>
+#include <vector>
+
+// Events flattened into one line each, for comparing whole documents
+struct Recorder {
+    std::vector<std::string> events;
+    int stopAfter;
+};
+
+static bool record(void* context, const OtaJsonEvent& event) {
+    Recorder& recorder = *static_cast<Recorder*>(context);
+    static const char* const TYPES[] = {"S", "N", "B", "0", "{", "[", "}"};
+    std::string line = std::to_string(event.depth) + TYPES[(int)event.type];
+    if (event.depth > 0) {
+        line += event.index >= 0 ? "#" + std::to_string(event.index)
+                                 : "." + std::string(event.key().data, event.key().length);
+    }
+    line += "=" + std::string(event.value.data, event.value.length);
+    recorder.events.push_back(line);
+    return recorder.stopAfter < 0 || (int)recorder.events.size() < recorder.stopAfter;
+}
+
+static bool parse(const std::string& text, Recorder& recorder, OtaJson& json) {
+    std::vector<char> buffer(text.begin(), text.end());
+    buffer.push_back('\0');   // Past length, not parsed
+    return json.parse(buffer.data(), text.size(), record, &recorder);
+}
+
+// Value of a document that is a single string
+static std::string decodeString(const std::string& text, bool& ok) {
+    Recorder recorder = {{}, -1};
+    OtaJson json;
+    ok = parse(text, recorder, json) && recorder.events.size() == 1;
+    return ok ? recorder.events[0].substr(3) : std::string();
+}
+
+static void expectString(const std::string& text, const std::string& decoded) {
+    bool ok;
+    std::string value = decodeString(text, ok);
+    if (!ok || value != decoded) {
+        CHECK(!"string decoding");
+        printf("  %s\n", text.c_str());
+    }
+}
+
+static void testEscapes() {
+    expectString("\"plain\"", "plain");
+    expectString("\"\"", "");
+    expectString("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", "\"\\/\b\f\n\r\t");
+    expectString("\"\\u0041\\u00e9\\u20AC\"", "A\xC3\xA9\xE2\x82\xAC");
+    expectString("\"\\u0000x\"", std::string("\0x", 2));
+    expectString("\"caf\xC3\xA9 \xF0\x9F\x98\x80\"", "caf\xC3\xA9 \xF0\x9F\x98\x80");     // Raw UTF-8 passes through
+    expectString("\"\\uD83D\\uDE00\"", "\xF0\x9F\x98\x80");                               // Surrogate pair
+    expectString("\"\\udbff\\udfff\"", "\xF4\x8F\xBF\xBF");                               // Highest code point
+    expectString("\"\\uD800\\uDC00\"", "\xF0\x90\x80\x80");                               // Lowest
+    expectString("\"\\uD83D\"", "\xEF\xBF\xBD");                                          // Lone high
+    expectString("\"\\uDE00x\"", "\xEF\xBF\xBDx");                                        // Lone low
+    expectString("\"\\uD83D\\u0041\"", "\xEF\xBF\xBD" "A");                               // High, then no low
+    expectString("\"\\uD83D\\uD83D\\uDE00\"", "\xEF\xBF\xBD\xF0\x9F\x98\x80");            // High, then a pair
+    expectString("\"\\uD83Dx\\uDE00\"", "\xEF\xBF\xBDx\xEF\xBF\xBD");
+
+    // Decoded in place: the terminator replaces the closing quote
+    char buffer[] = "{\"k\\u0041\":\"v\\n\"}";
+    Recorder recorder = {{}, -1};
+    OtaJson json;
+    CHECK(json.parse(buffer, strlen(buffer), record, &recorder));
+    CHECK_EQ(recorder.events.size(), 3);
+    CHECK(recorder.events[1] == "1S.kA=v\n");
+    CHECK(strcmp(buffer + 2, "kA") == 0);
+}
+
+static void expectError(const std::string& text, const char* error, size_t offset) {
+    Recorder recorder = {{}, -1};
+    OtaJson json;
+    bool ok = parse(text, recorder, json);
+    if (ok || !json.getError() || strcmp(json.getError(), error) != 0 || json.getErrorOffset() != offset) {
+        CHECK(!"error case");
+        printf("  %s: %s at %u\n", text.c_str(), ok ? "accepted" : json.getError(), (unsigned)json.getErrorOffset());
+    }
+}
+
+static void testErrors() {
+    expectError("", "Unexpected end of input", 0);
+    expectError("   ", "Unexpected end of input", 3);
+    expectError("{\"a\":1,}", "Expected member name", 7);
+    expectError("[1,]", "Unexpected character", 3);
+    expectError("[1 2]", "Expected ',' or ']'", 3);
+    expectError("{\"a\" 1}", "Expected ':'", 5);
+    expectError("{\"a\":1 \"b\":2}", "Expected ',' or '}'", 7);
+    expectError("{a:1}", "Expected member name", 1);
+    expectError("{\"a\":1", "Unexpected end of input", 6);
+    expectError("\"abc", "Unterminated string", 4);
+    expectError("\"abc\\", "Unterminated string", 5);
+    expectError("\"a\nb\"", "Control character in string", 2);
+    expectError("\"\\x\"", "Invalid escape", 3);
+    expectError("\"\\u12G4\"", "Invalid \\u escape", 5);
+    expectError("\"\\u12\"", "Invalid \\u escape", 5);
+    expectError("01", "Unexpected data after value", 1);
+    expectError("-", "Invalid number", 1);
+    expectError("-a", "Invalid number", 1);
+    expectError("1.", "Invalid number", 2);
+    expectError("1.e5", "Invalid number", 2);
+    expectError("1e", "Invalid number", 2);
+    expectError("1e+", "Invalid number", 3);
+    expectError("+1", "Unexpected character", 0);
+    expectError(".5", "Unexpected character", 0);
+    expectError("tru", "Unexpected character", 0);
+    expectError("nul", "Unexpected character", 0);
+    expectError("True", "Unexpected character", 0);
+    expectError("[] x", "Unexpected data after value", 3);
+    expectError("'a'", "Unexpected character", 0);
+    expectError("[\"a\"", "Unexpected end of input", 4);
+
+    // MAX_DEPTH levels of nesting parse, one more does not
+    std::string deep = std::string(OtaJson::MAX_DEPTH, '[') + std::string(OtaJson::MAX_DEPTH, ']');
+    Recorder recorder = {{}, -1};
+    OtaJson json;
+    CHECK(parse(deep, recorder, json));
+    expectError("[" + deep + "]", "Nesting too deep", OtaJson::MAX_DEPTH);
+
+    // A handler can stop the parse
+    recorder = {{}, 2};
+    CHECK(!parse("[1,2,3]", recorder, json));
+    CHECK(strcmp(json.getError(), "Stopped by handler") == 0);
+    CHECK_EQ(recorder.events.size(), 2);
+}
+
+static uint32_t randomState = 99;
+static uint32_t nextRandom(uint32_t range) {
+    randomState = randomState * 1103515245u + 12345u;
+    return (randomState >> 8) % range;
+}
+
+static std::string utf8(uint32_t codepoint) {
+    char out[4];
+    if (codepoint < 0x80) return std::string(1, (char)codepoint);
+    if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return std::string(out, 2);
+    }
+    if (codepoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return std::string(out, 3);
+    }
+    out[0] = (char)(0xF0 | (codepoint >> 18));
+    out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (codepoint & 0x3F));
+    return std::string(out, 4);
+}
+
+static std::string hex4(uint32_t value) {
+    char out[8];
+    snprintf(out, sizeof(out), nextRandom(2) ? "\\u%04x" : "\\u%04X", value);
+    return out;
+}
+
+// Random string: its JSON text (escapes chosen at random) and its decoded value
+static void randomString(std::string& json, std::string& value) {
+    json = "\"";
+    value.clear();
+    size_t count = nextRandom(12);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t kind = nextRandom(6);
+        uint32_t codepoint = kind == 0 ? nextRandom(0x20)                                  // Control
+                           : kind == 1 ? 0x10000 + nextRandom(0x100000)                      // Astral
+                           : kind == 2 ? 0x80 + nextRandom(0xD800 - 0x80)                    // BMP
+                           : kind == 3 ? (uint32_t)"\"\\/"[nextRandom(3)]
+                           : 0x20 + nextRandom(0x5F);                                        // Printable
+        value += utf8(codepoint);
+        bool escape = codepoint < 0x20 || codepoint == '"' || codepoint == '\\' || nextRandom(3) == 0;
+        if (!escape) {
+            json += utf8(codepoint);
+        } else if (codepoint >= 0x10000) {
+            uint32_t offset = codepoint - 0x10000;
+            json += hex4(0xD800 + (offset >> 10)) + hex4(0xDC00 + (offset & 0x3FF));
+        } else if (codepoint < 0x80 && strchr("\"\\/", (int)codepoint) && codepoint != 0 && nextRandom(2)) {
+            json += std::string("\\") + (char)codepoint;
+        } else {
+            const char* shortForm = codepoint == '\b' ? "\\b" : codepoint == '\f' ? "\\f" : codepoint == '\n' ? "\\n"
+                                  : codepoint == '\r' ? "\\r" : codepoint == '\t' ? "\\t" : nullptr;
+            json += shortForm && nextRandom(2) ? std::string(shortForm) : hex4(codepoint);
+        }
+    }
+    json += "\"";
+}
+
+static std::string whitespace() {
+    static const char* const SPACES[] = {"", "", "", " ", "\n", "\t", "\r\n  "};
+    return SPACES[nextRandom(7)];
+}
+
+// Appends the document for a random value and the events a correct parser reports
+static void randomValue(std::string& json, std::vector<std::string>& events, int depth, const std::string& where) {
+    static const char* const NUMBERS[] = {"0", "-0", "7", "-12", "3.25", "1e5", "-2.5E-3", "10e+2", "123456789012"};
+    uint32_t kind = depth >= 4 ? nextRandom(4) : nextRandom(6);
+    std::string prefix = std::to_string(depth);
+    json += whitespace();
+    if (kind == 0) {
+        std::string text, value;
+        randomString(text, value);
+        json += text;
+        events.push_back(prefix + "S" + where + "=" + value);
+    } else if (kind == 1) {
+        const char* number = NUMBERS[nextRandom(9)];
+        json += number;
+        events.push_back(prefix + "N" + where + "=" + number);
+    } else if (kind == 2) {
+        const char* literal = nextRandom(2) ? "true" : "false";
+        json += literal;
+        events.push_back(prefix + "B" + where + "=" + literal);
+    } else if (kind == 3) {
+        json += "null";
+        events.push_back(prefix + "0" + where + "=null");
+    } else {
+        bool isArray = kind == 4;
+        json += isArray ? "[" : "{";
+        events.push_back(prefix + (isArray ? "[" : "{") + where + "=");
+        size_t count = nextRandom(5);
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0) json += whitespace() + ",";
+            std::string child;
+            if (isArray) {
+                child = "#" + std::to_string(i);
+            } else {
+                std::string key, name;
+                randomString(key, name);
+                json += whitespace() + key + whitespace() + ":";
+                child = "." + name;
+            }
+            randomValue(json, events, depth + 1, child);
+        }
+        json += whitespace() + (isArray ? "]" : "}");
+        events.push_back(prefix + "}" + where + "=");
+    }
+    json += whitespace();
+}
+
+static void testRoundTrip() {
+    int mismatches = 0;
+    int acceptedPrefixes = 0;
+    for (int n = 0; n < 2000; n++) {
+        std::string json;
+        std::vector<std::string> expected;
+        randomValue(json, expected, 0, "");
+
+        Recorder recorder = {{}, -1};
+        OtaJson parser;
+        if (!parse(json, recorder, parser) || recorder.events != expected) {
+            if (mismatches++ < 3) printf("  round trip failed: %s (%s)\n", json.c_str(), parser.getError());
+            continue;
+        }
+
+        // A document cut anywhere before the end of its top-level container is incomplete
+        size_t first = json.find_first_not_of(" \t\r\n");
+        size_t last = json.find_last_not_of(" \t\r\n");
+        if (json[first] != '[' && json[first] != '{') continue;
+        size_t step = max((size_t)1, (last - first) / 200);
+        for (size_t cut = first; cut <= last; cut += step) {
+            Recorder partial = {{}, -1};
+            if (parse(json.substr(0, cut), partial, parser)) acceptedPrefixes++;
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+    CHECK_EQ(acceptedPrefixes, 0);
+}
+
+static void testViews() {
+    CHECK_EQ(OtaJsonView("1234x", 5).toInt(), 1234);
+    CHECK_EQ(OtaJsonView("-42", 3).toInt(), -42);
+    CHECK_EQ(OtaJsonView("12", 1).toInt(), 1);
+    CHECK_EQ(OtaJsonView("abc", 3).toInt(), 0);
+    CHECK(OtaJsonView("gzipped", 4) == "gzip");
+    CHECK(OtaJsonView("gzip", 4) != "gzipped");
+    CHECK(OtaJsonView("gz", 2) != "gzip");
+    CHECK(OtaJsonView().isEmpty());
+}
+
+int main() {
+    testEscapes();
+    testErrors();
+    testRoundTrip();
+    testViews();
+    return checkReport("json");
+}
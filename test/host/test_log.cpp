@@ -0,0 +1,308 @@
+// Sources: src/OtaLog.cpp src/OtaArena.cpp
+// OtaLog: records printed at once before begin(), then deferred into the
+// ring. Formatting is compared with snprintf for every conversion, flag,
+// width and precision, random ones included, along with the cases snprintf
+// has no answer for: missing arguments, cut strings, full records and
+// mismatched types. Then ring overflow and the drop count, wrap-around,
+// the drain claim, and four tasks logging while a fifth drains.
+
+#define OTA_LOG_LEVEL OTA_LOG_LEVEL_DEBUG
+#include "OtaLog.h"
+#include "test_check.h"
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdarg>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What formatRecord() must produce for these arguments: "[OTA] " then
+// snprintf of the same format
+static std::string expected(const char* format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return std::string("[OTA] ") + text;
+}
+
+template<typename... Args>
+static std::string formatted(const char* format, const Args&... args) {
+    OtaLog::Record record(OTA_LOG_LEVEL_INFO, format);
+    int expand[] = {0, (record.add(args), 0)...};
+    (void)expand;
+    record.seal();
+    char line[OtaLog::LINE_SIZE];
+    size_t length = OtaLog::formatRecord(record.data(), record.size(), line, sizeof(line));
+    CHECK_EQ(length, strlen(line));
+    return line;
+}
+
+#define CHECK_FORMAT(format, ...) CHECK(formatted(format, __VA_ARGS__) == expected(format, __VA_ARGS__))
+
+// ============================================================================
+// IMMEDIATE OUTPUT
+// ============================================================================
+
+static void testImmediate() {
+    CHECK(!OtaLog::isBuffered());
+    Serial.output.clear();
+    OTA_LOGE("failed: %s (%d)", "timeout", -3);
+    OTA_LOGW("retry %u", 2u);
+    OTA_LOGI("idle");
+    OTA_LOGD("%d%%", 50);
+    CHECK(Serial.output == "[OTA] E failed: timeout (-3)\r\n[OTA] W retry 2\r\n[OTA] idle\r\n[OTA] D 50%\r\n");
+    CHECK(!OtaLog::begin(0));
+    CHECK(!OtaLog::isBuffered());
+}
+
+// ============================================================================
+// FORMATTING
+// ============================================================================
+
+static void testConversions() {
+    CHECK_FORMAT("%d %i %d", INT_MIN, -1, INT_MAX);
+    CHECK_FORMAT("%u %x %X %o", UINT_MAX, 0xBEEFu, 0xBEEFu, 8u);
+    CHECK_FORMAT("[%5d|%-5d|%05d|%+d|% d]", 42, 42, 42, 42, 42);
+    CHECK_FORMAT("%08X %#x %#o", 0xABCu, 255u, 8u);
+    CHECK_FORMAT("%c%c", 'o', 'k');
+    CHECK_FORMAT("%lld %llu %llx", LLONG_MIN, ULLONG_MAX, 0x123456789ABCDEFULL);
+    CHECK_FORMAT("%ld %lu", LONG_MIN, ULONG_MAX);
+    CHECK_FORMAT("%zu bytes", (size_t)123456);
+    CHECK_FORMAT("%hu %hhu", (unsigned short)65535, (unsigned char)200);
+    CHECK_FORMAT("%f %.3f %10.2f %-10.1f|", 3.14159, 2.71828, -1.5, 0.25);
+    CHECK_FORMAT("%e %E %g %G", 1e-10, 6.02e23, 0.0001, 1e20);
+    CHECK_FORMAT("%a", 1.0);
+    CHECK_FORMAT("%.0f %f", DBL_MAX / 1e300, -0.0);
+    CHECK_FORMAT("%s|%8s|%-8s|%.2s", "text", "right", "left", "cut");
+    CHECK_FORMAT("%p", (const void*)0x1234);
+    CHECK_FORMAT("%d %s %u %.1f %c", -7, "mixed", 7u, 7.5, 'x');
+    CHECK_FORMAT("100%% done%s", "");
+    CHECK(formatted("no arguments") == "[OTA] no arguments");
+
+    // Strings are copied into the record, so temporaries are safe
+    std::string* temporary = new std::string("gone soon");
+    OtaLog::Record record(OTA_LOG_LEVEL_INFO, "%s");
+    record.add(temporary->c_str());
+    record.seal();
+    delete temporary;
+    char line[OtaLog::LINE_SIZE];
+    OtaLog::formatRecord(record.data(), record.size(), line, sizeof(line));
+    CHECK(std::string(line) == "[OTA] gone soon");
+    CHECK(formatted("%s", (const char*)nullptr) == "[OTA] (null)");
+    CHECK(formatted("%s", String("string")) == "[OTA] string");
+}
+
+// Random specs against snprintf, each with an argument of its own type
+static void testRandomSpecs() {
+    static const char FLAGS[] = "-+ #0";
+    static const char INTEGER[] = "diuxXo";
+    static const char FLOATING[] = "feEgG";
+    for (int i = 0; i < 20000; i++) {
+        std::string spec = "<%";
+        for (int f = rand() % 3; f > 0; f--) spec += FLAGS[rand() % 5];
+        if (rand() % 2) spec += std::to_string(rand() % 20);
+        if (rand() % 2) spec += "." + std::to_string(rand() % 12);
+        int kind = rand() % 4;
+        if (kind == 0) {
+            spec += INTEGER[rand() % 6];
+            spec += ">";
+            int value = (int)((unsigned)rand() * 2654435761u);
+            CHECK_FORMAT(spec.c_str(), value);
+        } else if (kind == 1) {
+            spec += "ll";
+            spec += INTEGER[rand() % 6];
+            spec += ">";
+            long long value = (long long)(((unsigned long long)rand() << 33) ^ ((unsigned long long)rand() << 2));
+            CHECK_FORMAT(spec.c_str(), value);
+        } else if (kind == 2) {
+            spec += FLOATING[rand() % 5];
+            spec += ">";
+            double value = (rand() - RAND_MAX / 2) * pow(10.0, rand() % 40 - 20);
+            CHECK_FORMAT(spec.c_str(), value);
+        } else {
+            spec += "s>";
+            std::string text(rand() % 30, 'a' + rand() % 26);
+            CHECK_FORMAT(spec.c_str(), text.c_str());
+        }
+    }
+}
+
+static void testLimits() {
+    // A missing argument prints "?"; an unknown conversion prints itself
+    CHECK(formatted("%d and %d", 1) == "[OTA] 1 and ?");
+    CHECK(formatted("%y%d", 3) == "[OTA] y3");
+    CHECK(formatted("trailing %") == "[OTA] trailing ");
+
+    // Mismatched types print what was stored
+    CHECK(formatted("%s", 42) == "[OTA] 42");
+    CHECK(formatted("%d", "text") == "[OTA] text");
+    CHECK(formatted("%f", 2) == "[OTA] 2.000000");
+    CHECK(formatted("%d", 2.9) == "[OTA] 2");
+
+    // Long strings are cut to what fits in the record
+    std::string longText(300, 'z');
+    std::string line = formatted("%s", longText.c_str());
+    size_t room = OtaLog::RECORD_SIZE - (8 + sizeof(const char*)) - 3;
+    CHECK(line == "[OTA] " + std::string(room, 'z'));
+
+    // Arguments past a full record print "?"
+    line = formatted("%lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld",
+                     1LL, 2LL, 3LL, 4LL, 5LL, 6LL, 7LL, 8LL, 9LL, 10LL, 11LL, 12LL, 13LL, 14LL);
+    size_t fit = (OtaLog::RECORD_SIZE - (8 + sizeof(const char*))) / 9;
+    std::string want = "[OTA]";
+    for (size_t i = 1; i <= 14; i++) want += " " + (i <= fit ? std::to_string(i) : std::string("?"));
+    CHECK(line == want);
+
+    // Lines are cut at LINE_SIZE, and any smaller buffer
+    std::string wide = formatted("%100s%100s", "a", "b");
+    CHECK_EQ(wide.size(), OtaLog::LINE_SIZE - 1);
+    CHECK(wide == expected("%100s%100s", "a", "b").substr(0, OtaLog::LINE_SIZE - 1));
+    OtaLog::Record record(OTA_LOG_LEVEL_WARN, "%s=%d");
+    record.add("value");
+    record.add(12345);
+    record.seal();
+    for (size_t size = 0; size < 24; size++) {
+        char small[24];
+        memset(small, '#', sizeof(small));
+        size_t length = OtaLog::formatRecord(record.data(), record.size(), small, size);
+        if (size == 0) {
+            CHECK_EQ(length, 0);
+            CHECK_EQ(small[0], '#');
+            continue;
+        }
+        CHECK_EQ(length, std::min(size - 1, strlen("[OTA] W value=12345")));
+        CHECK(std::string(small, length) == std::string("[OTA] W value=12345").substr(0, length));
+        CHECK_EQ(small[length], '\0');
+    }
+}
+
+// ============================================================================
+// RING
+// ============================================================================
+
+static int drainer;
+
+// Drains every record as text, in order
+static std::vector<std::string> drain() {
+    std::vector<std::string> lines;
+    char line[OtaLog::LINE_SIZE];
+    while (OtaLog::peekLine(line, sizeof(line)) > 0) {
+        lines.push_back(line);
+        OtaLog::pop();
+    }
+    return lines;
+}
+
+static void testRing() {
+    CHECK(OtaLog::begin(200));      // Rounded up to 256
+    CHECK(OtaLog::begin(4096));     // Already allocated: unchanged
+    CHECK(OtaLog::isBuffered());
+
+    OtaLog::Record probe(OTA_LOG_LEVEL_INFO, "n=%d");
+    probe.add(0);
+    size_t fit = 256 / probe.size();
+
+    // Deferred: nothing printed, and what does not fit is counted
+    Serial.output.clear();
+    uint32_t dropped = OtaLog::getDropped();
+    for (int i = 0; i < 20; i++) OTA_LOGI("n=%d", i);
+    CHECK(Serial.output.empty());
+    CHECK_EQ(OtaLog::getDropped(), dropped + 20 - fit);
+
+    // One drainer at a time
+    int other;
+    CHECK(OtaLog::claimDrain(&drainer));
+    CHECK(OtaLog::claimDrain(&drainer));
+    CHECK(!OtaLog::claimDrain(&other));
+    OtaLog::releaseDrain(&other);
+    CHECK(!OtaLog::claimDrain(&other));
+
+    uint8_t level = 0;
+    char line[OtaLog::LINE_SIZE];
+    CHECK(OtaLog::peekLine(line, sizeof(line), &level) > 0);
+    CHECK_EQ(level, OTA_LOG_LEVEL_INFO);
+    std::vector<std::string> lines = drain();
+    CHECK_EQ(lines.size(), fit);
+    for (size_t i = 0; i < lines.size(); i++) CHECK(lines[i] == "[OTA] n=" + std::to_string(i));
+    CHECK_EQ(OtaLog::peekLine(line, sizeof(line)), 0);
+    OtaLog::pop();                  // Nothing to pop: harmless
+
+    // Drained in time, records of every size wrap around the ring intact
+    dropped = OtaLog::getDropped();
+    for (int i = 0; i < 2000; i++) {
+        std::string text(rand() % 60, 'a' + i % 26);
+        OTA_LOGW("%d:%s", i, text.c_str());
+        lines = drain();
+        CHECK_EQ(lines.size(), 1);
+        if (lines.size() == 1) CHECK(lines[0] == "[OTA] W " + std::to_string(i) + ":" + text);
+    }
+    CHECK_EQ(OtaLog::getDropped(), dropped);
+
+    OtaLog::releaseDrain(&drainer);
+    CHECK(OtaLog::claimDrain(&other));
+    OtaLog::releaseDrain(&other);
+}
+
+// Four tasks log while a fifth drains: every record arrives whole and in
+// each task's order, or is counted as dropped
+static void testConcurrentProducers() {
+    static const int PRODUCERS = 4;
+    static const int PER_PRODUCER = 20000;
+    uint32_t droppedBefore = OtaLog::getDropped();
+    std::atomic<int> running(PRODUCERS);
+    std::vector<std::thread> producers;
+    for (int t = 0; t < PRODUCERS; t++) {
+        producers.emplace_back([t, &running]() {
+            for (int i = 0; i < PER_PRODUCER; i++) {
+                OTA_LOGI("task %d record %d %s", t, i, "payload");
+                if (i % 64 == 0) std::this_thread::yield();
+            }
+            running--;
+        });
+    }
+
+    CHECK(OtaLog::claimDrain(&drainer));
+    int next[PRODUCERS] = {0};
+    size_t received = 0, malformed = 0, outOfOrder = 0;
+    char line[OtaLog::LINE_SIZE];
+    for (;;) {
+        bool done = running.load() == 0;
+        if (OtaLog::peekLine(line, sizeof(line)) == 0) {
+            if (done) break;
+            std::this_thread::yield();
+            continue;
+        }
+        int task, record;
+        char payload[16];
+        if (sscanf(line, "[OTA] task %d record %d %15s", &task, &record, payload) != 3 || task < 0 ||
+            task >= PRODUCERS || strcmp(payload, "payload") != 0) {
+            malformed++;
+        } else {
+            if (record < next[task]) outOfOrder++;
+            next[task] = record + 1;
+        }
+        received++;
+        OtaLog::pop();
+    }
+    OtaLog::releaseDrain(&drainer);
+    for (size_t i = 0; i < producers.size(); i++) producers[i].join();
+
+    CHECK_EQ(malformed, 0);
+    CHECK_EQ(outOfOrder, 0);
+    CHECK_EQ(received + (OtaLog::getDropped() - droppedBefore), (size_t)PRODUCERS * PER_PRODUCER);
+    CHECK(received > 0);
+}
+
+int main() {
+    srand(13);
+    testImmediate();
+    testConversions();
+    testRandomSpecs();
+    testLimits();
+    testRing();
+    testConcurrentProducers();
+    return checkReport("log");
+}
@@ -0,0 +1,91 @@
+// Sources: src/OtaMirrorSet.cpp
+// OtaMirrorSet ranks mirrors by their hosts' measurements, fails over in rank
+// order, keeps the stats across clear() and NVS, and ignores indexes outside
+// the list, such as current() after clear().
+
+#include "OtaMirrorSet.h"
+#include "test_check.h"
+
+static void addThree(OtaMirrorSet& set) {
+    CHECK(set.add("https://a.example/fw.bin", "a.example", 443));
+    CHECK(set.add("https://b.example/fw.bin", "b.example", 443));
+    CHECK(set.add("http://c.example/fw.bin", "c.example", 80));
+}
+
+static void testRanking() {
+    OtaMirrorSet set;
+    addThree(set);
+    CHECK(!set.add("https://a.example/fw.bin", "a.example", 443)); // Duplicate URL
+    CHECK_EQ(set.current(), -1);
+
+    // b connects fast and streams fast; c is slow; a failed before
+    set.recordConnect(1, 40);
+    set.recordFirstByte(1, 30);
+    set.recordTransfer(1, 500000, 1000);
+    set.recordConnect(2, 900);
+    set.recordTransfer(2, 100000, 10000);
+    set.recordConnect(0, 40);
+    set.recordFailure(0);
+    set.recordFailure(0);
+    set.rank(1000000);
+    CHECK_EQ(set.current(), 1);
+    CHECK(set.isMeasured(1));
+
+    // Failover visits every mirror once, then starts over
+    CHECK(set.advance());
+    int second = set.current();
+    CHECK(second == 0 || second == 2);
+    CHECK(set.advance());
+    CHECK(set.current() != second && set.current() != 1);
+    CHECK(set.advance());
+    CHECK(set.current() >= 0 && set.current() < 3);
+}
+
+static void testOutOfRange() {
+    OtaMirrorSet set;
+    addThree(set);
+    set.rank(0);
+    set.clear();
+    CHECK_EQ(set.current(), -1);
+    CHECK_EQ(set.count(), 0);
+
+    // current() = -1 converts to the largest size_t; nothing is read or written
+    CHECK(strcmp(set.getUrl(set.current()), "") == 0);
+    CHECK(strcmp(set.getHost(set.current()), "") == 0);
+    CHECK_EQ(set.getPort(set.current()), 0);
+    CHECK(!set.isMeasured(set.current()));
+    set.recordConnect(set.current(), 10);
+    set.recordFirstByte(set.current(), 10);
+    set.recordTransfer(set.current(), 100000, 10);
+    set.recordFailure(set.current());
+    CHECK(!set.advance());
+
+    CHECK(set.add("https://a.example/fw.bin", "a.example", 443));
+    CHECK(strcmp(set.getUrl(1), "") == 0);
+    CHECK(!set.isMeasured(0));
+}
+
+static void testPersistence() {
+    OtaMirrorSet set;
+    addThree(set);
+    set.recordConnect(2, 25);
+    set.recordTransfer(2, 1000000, 500);
+    CHECK(set.save("test_mirrors"));
+
+    // A new set (after the reboot) starts ranked by the stored history
+    OtaMirrorSet restored;
+    CHECK(restored.load("test_mirrors"));
+    addThree(restored);
+    CHECK(restored.isMeasured(2));
+    CHECK(!restored.isMeasured(0));
+    restored.rank(1000000);
+    CHECK_EQ(restored.current(), 2);
+    CHECK(!restored.load("missing"));
+}
+
+int main() {
+    testRanking();
+    testOutOfRange();
+    testPersistence();
+    return checkReport("mirror_set");
+}
@@ -0,0 +1,352 @@
+// Sources: src/OtaMqttEngine.cpp
+// OtaMqttEngine against a scripted broker on the in-memory socket: the
+// encoding of every packet it sends, decoding of packets that arrive in
+// pieces, QoS 1 acknowledgements, oversized and malformed packets, and the
+// keep-alive and connect timeouts on the simulated clock.
+
+#include "OtaMqttEngine.h"
+#include "fake_async_client.h"
+#include "test_check.h"
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static void advance(unsigned long ms) {
+    hostClockMicros() += ms * 1000;
+}
+
+// Fixed header with the remaining length, then the body
+static Bytes packet(uint8_t header, const Bytes& body) {
+    Bytes out(1, header);
+    size_t remaining = body.size();
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        out.push_back(remaining > 0 ? digit | 0x80 : digit);
+    } while (remaining > 0);
+    out.insert(out.end(), body.begin(), body.end());
+    return out;
+}
+
+static void putString(Bytes& body, const std::string& text) {
+    body.push_back((uint8_t)(text.size() >> 8));
+    body.push_back((uint8_t)text.size());
+    body.insert(body.end(), text.begin(), text.end());
+}
+
+static Bytes publishPacket(const std::string& topic, const std::string& payload, int qos = 0, uint16_t id = 0) {
+    Bytes body;
+    putString(body, topic);
+    if (qos > 0) {
+        body.push_back((uint8_t)(id >> 8));
+        body.push_back((uint8_t)id);
+    }
+    body.insert(body.end(), payload.begin(), payload.end());
+    return packet(0x30 | (qos << 1), body);
+}
+
+static void brokerSends(const Bytes& bytes) {
+    fakeSocket.toClient.insert(fakeSocket.toClient.end(), bytes.begin(), bytes.end());
+}
+
+// Takes the next packet the client sent; header 0 when there is none
+static Bytes clientSent(uint8_t& header) {
+    Bytes& sent = fakeSocket.fromClient;
+    header = 0;
+    if (sent.size() < 2) return Bytes();
+    size_t length = 0, shift = 0, at = 1;
+    while (sent[at] & 0x80) {
+        length |= (sent[at] & 0x7F) << shift;
+        shift += 7;
+        at++;
+    }
+    length |= sent[at] << shift;
+    at++;
+    header = sent[0];
+    Bytes body(sent.begin() + at, sent.begin() + at + length);
+    sent.erase(sent.begin(), sent.begin() + at + length);
+    return body;
+}
+
+struct Received {
+    std::vector<std::string> topics;
+    std::vector<std::string> payloads;
+};
+
+static Received received;
+
+static void onMessage(char* topic, uint8_t* payload, unsigned int length) {
+    received.topics.push_back(topic);
+    received.payloads.push_back(std::string((const char*)payload, length));
+}
+
+// Connects through CONNACK; the CONNECT packet is left in fromClient
+static void connect(OtaMqttEngine& engine, const char* user = nullptr, const char* password = nullptr) {
+    fakeSocket.reset();
+    received = Received();
+    engine.setServer("broker.example", 8883, true);
+    engine.setCallback(onMessage);
+    CHECK(engine.connect("dev-1", user, password));
+    CHECK(engine.isConnecting());
+    fakeSocket.connectPolls = 2;
+    engine.loop();
+    engine.loop();
+    CHECK(fakeSocket.fromClient.size() > 0);    // CONNECT sent once the socket is up
+    brokerSends(packet(0x20, Bytes{0x00, 0x00}));
+    CHECK(engine.loop());
+    CHECK(engine.connected());
+    CHECK_EQ(engine.state(), OtaMqttEngine::CONNECTED);
+}
+
+// ============================================================================
+// ENCODING
+// ============================================================================
+
+static void testConnectPacket() {
+    OtaMqttEngine engine;
+    engine.setKeepAlive(30);
+    connect(engine, "user", "secret");
+    uint8_t header;
+    Bytes body = clientSent(header);
+    CHECK_EQ(header, 0x10);
+    Bytes expected;
+    putString(expected, "MQTT");
+    expected.push_back(4);                  // Protocol level
+    expected.push_back(0x02 | 0x80 | 0x40); // Clean session, user, password
+    expected.push_back(0);
+    expected.push_back(30);                 // Keep-alive
+    putString(expected, "dev-1");
+    putString(expected, "user");
+    putString(expected, "secret");
+    CHECK(body == expected);
+    CHECK(fakeSocket.fromClient.empty());
+
+    // A password without a user is not sent
+    OtaMqttEngine plain;
+    connect(plain, nullptr, "secret");
+    body = clientSent(header);
+    CHECK_EQ(body[7], 0x02);
+}
+
+static void testOutgoingPackets() {
+    OtaMqttEngine engine;
+    connect(engine);
+    uint8_t header;
+    clientSent(header);
+
+    CHECK(engine.subscribe("ota/+/update"));
+    Bytes body = clientSent(header);
+    CHECK_EQ(header, 0x82);
+    Bytes expected{0x00, 0x01};
+    putString(expected, "ota/+/update");
+    expected.push_back(0);                  // QoS 0
+    CHECK(body == expected);
+
+    CHECK(engine.unsubscribe("ota/+/update"));
+    body = clientSent(header);
+    CHECK_EQ(header, 0xA2);
+    expected = Bytes{0x00, 0x02};           // Next packet ID
+    putString(expected, "ota/+/update");
+    CHECK(body == expected);
+
+    // A payload over 127 bytes needs a two-byte remaining length
+    std::string payload(200, 'p');
+    CHECK(engine.publish("ota/status", payload.c_str(), true));
+    CHECK_EQ(fakeSocket.fromClient[1], (2 + 10 + 200) % 128 | 0x80);
+    CHECK_EQ(fakeSocket.fromClient[2], (2 + 10 + 200) / 128);
+    body = clientSent(header);
+    CHECK_EQ(header, 0x31);                 // Retained
+    expected.clear();
+    putString(expected, "ota/status");
+    expected.insert(expected.end(), payload.begin(), payload.end());
+    CHECK(body == expected);
+
+    // Refused: not connected, empty topic, or more than the send buffer
+    CHECK(!engine.publish("", "x"));
+    std::string huge(OtaMqttEngine::SEND_BUFFER_SIZE, 'h');
+    CHECK(!engine.publish("ota/status", huge.c_str()));
+
+    // A socket that takes nothing keeps the packet queued until it does
+    fakeSocket.sendRoom = 0;
+    CHECK(engine.publish("ota/status", "later"));
+    CHECK(fakeSocket.fromClient.empty());
+    fakeSocket.sendRoom = 3;
+    CHECK(engine.loop());
+    CHECK_EQ(fakeSocket.fromClient.size(), 3);
+    fakeSocket.sendRoom = (size_t)-1;
+    CHECK(engine.loop());
+    body = clientSent(header);
+    CHECK_EQ(header, 0x30);
+    CHECK_EQ(body.size(), 2 + 10 + 5);
+
+    engine.disconnect();
+    body = clientSent(header);
+    CHECK_EQ(header, 0xE0);
+    CHECK(!engine.connected());
+    CHECK(!engine.subscribe("ota/#"));
+}
+
+// ============================================================================
+// DECODING
+// ============================================================================
+
+static void testIncomingPackets() {
+    OtaMqttEngine engine;
+    connect(engine);
+    uint8_t header;
+    clientSent(header);
+
+    // Delivered with a terminated topic, however the bytes arrive
+    Bytes message = publishPacket("ota/dev-1/update", "{\"version\":\"2.0\"}");
+    for (size_t i = 0; i < message.size(); i++) {
+        fakeSocket.toClient.push_back(message[i]);
+        CHECK(engine.loop());
+    }
+    CHECK_EQ(received.topics.size(), 1);
+    CHECK(received.topics[0] == "ota/dev-1/update");
+    CHECK(received.payloads[0] == "{\"version\":\"2.0\"}");
+
+    // One PUBLISH per loop()
+    brokerSends(publishPacket("a", "1"));
+    brokerSends(publishPacket("b", "2"));
+    CHECK(engine.loop());
+    CHECK_EQ(received.topics.size(), 2);
+    CHECK(engine.loop());
+    CHECK_EQ(received.topics.size(), 3);
+    CHECK(received.topics[2] == "b");
+
+    // QoS 1 is acknowledged with its packet ID, and the ID is not payload
+    brokerSends(publishPacket("q", "data", 1, 0x1234));
+    CHECK(engine.loop());
+    CHECK(received.payloads.back() == "data");
+    Bytes body = clientSent(header);
+    CHECK_EQ(header, 0x40);
+    CHECK(body == (Bytes{0x12, 0x34}));
+
+    // Larger than the receive buffer: skipped, and the next one still arrives
+    CHECK(engine.setBufferSize(64));
+    brokerSends(publishPacket("big", std::string(300, 'x')));
+    brokerSends(publishPacket("small", "ok"));
+    CHECK(engine.loop());
+    CHECK(engine.loop());
+    CHECK_EQ(engine.getSkippedPackets(), 1);
+    CHECK(received.topics.back() == "small");
+
+    // SUBACK failure codes are counted
+    brokerSends(packet(0x90, Bytes{0x00, 0x01, 0x00, 0x80, 0x80}));
+    CHECK(engine.loop());
+    CHECK_EQ(engine.getRejectedSubscriptions(), 2);
+
+    // A remaining length of more than four bytes is malformed
+    brokerSends(Bytes{0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x01});
+    CHECK(!engine.loop());
+    CHECK_EQ(engine.state(), OtaMqttEngine::CONNECTION_LOST);
+}
+
+static void testRefusedConnect() {
+    OtaMqttEngine engine;
+    fakeSocket.reset();
+    engine.setServer("broker.example", 8883, true);
+    CHECK(engine.connect("dev-1"));
+    engine.loop();
+    brokerSends(packet(0x20, Bytes{0x00, 0x05}));  // Not authorized
+    CHECK(!engine.loop());
+    CHECK_EQ(engine.state(), 5);
+
+    fakeSocket.reset();
+    fakeSocket.refuse = true;
+    CHECK(engine.connect("dev-1"));
+    CHECK(!engine.loop());
+    CHECK_EQ(engine.state(), OtaMqttEngine::CONNECT_FAILED);
+
+    // No CONNACK within the connect timeout
+    fakeSocket.reset();
+    engine.setConnectTimeout(1000);
+    CHECK(engine.connect("dev-1"));
+    engine.loop();
+    advance(500);
+    CHECK(!engine.loop());
+    CHECK(engine.isConnecting());
+    advance(600);
+    CHECK(!engine.loop());
+    CHECK_EQ(engine.state(), OtaMqttEngine::CONNECTION_TIMEOUT);
+
+    // The peer closing the connection
+    OtaMqttEngine closed;
+    connect(closed);
+    fakeSocket.closed = true;
+    CHECK(!closed.loop());
+    CHECK_EQ(closed.state(), OtaMqttEngine::CONNECTION_LOST);
+}
+
+// ============================================================================
+// KEEP-ALIVE
+// ============================================================================
+
+static void testKeepAlive() {
+    OtaMqttEngine engine;
+    engine.setKeepAlive(10);
+    connect(engine);
+    uint8_t header;
+    clientSent(header);
+
+    // Quiet for the interval in both directions: PINGREQ, answered in time
+    advance(9999);
+    CHECK(engine.loop());
+    CHECK(fakeSocket.fromClient.empty());
+    advance(1);
+    CHECK(engine.loop());
+    clientSent(header);
+    CHECK_EQ(header, 0xC0);
+    advance(5000);
+    brokerSends(packet(0xD0, Bytes()));
+    CHECK(engine.loop());
+
+    // Only receiving is not enough: the broker must hear from us as well
+    for (int i = 0; i < 10; i++) {
+        advance(1000);
+        brokerSends(publishPacket("t", "x"));
+        CHECK(engine.loop());
+    }
+    clientSent(header);
+    CHECK_EQ(header, 0xC0);
+    brokerSends(packet(0xD0, Bytes()));
+    CHECK(engine.loop());
+
+    // Likewise only sending: with nothing arriving it still pings
+    for (int i = 0; i < 10; i++) {
+        advance(1000);
+        CHECK(engine.publish("ota/status", "x"));
+        clientSent(header);
+        CHECK_EQ(header, 0x30);
+        CHECK(engine.loop());
+    }
+    clientSent(header);
+    CHECK_EQ(header, 0xC0);
+
+    // No PINGRESP for another interval: the link is dead
+    advance(9999);
+    CHECK(engine.loop());
+    advance(1);
+    CHECK(!engine.loop());
+    CHECK_EQ(engine.state(), OtaMqttEngine::CONNECTION_TIMEOUT);
+
+    // Keep-alive 0 never pings
+    OtaMqttEngine quiet;
+    quiet.setKeepAlive(0);
+    connect(quiet);
+    clientSent(header);
+    advance(3600000);
+    CHECK(quiet.loop());
+    CHECK(fakeSocket.fromClient.empty());
+}
+
+int main() {
+    testConnectPacket();
+    testOutgoingPackets();
+    testIncomingPackets();
+    testRefusedConnect();
+    testKeepAlive();
+    return checkReport("mqtt_engine");
+}
@@ -0,0 +1,222 @@
+// Sources: src/OtaMqttTransfer.cpp src/OtaArena.cpp
+// Reassembly of numbered MQTT chunks: a simulated publisher follows the
+// <topic>/req protocol of tools/mqtt_chunk_publisher.py while the broker
+// reorders, duplicates and drops chunks. The image must come out whole and
+// in order, with the short last chunk, through selective re-requests.
+
+#include "OtaMqttTransfer.h"
+#include "test_check.h"
+#include <algorithm>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static uint32_t randomState = 12345;
+static uint32_t nextRandom() {
+    randomState = randomState * 1103515245u + 12345u;
+    return randomState >> 8;
+}
+
+static Bytes makeImage(size_t size) {
+    Bytes image(size);
+    for (size_t i = 0; i < size; i++) image[i] = (uint8_t)nextRandom();
+    return image;
+}
+
+static void putLe32(Bytes& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static Bytes makeChunk(const Bytes& image, size_t chunkSize, uint32_t index, uint32_t total) {
+    Bytes chunk;
+    putLe32(chunk, index);
+    putLe32(chunk, total);
+    size_t start = index * chunkSize;
+    size_t end = min(start + chunkSize, image.size());
+    chunk.insert(chunk.end(), image.begin() + start, image.begin() + end);
+    return chunk;
+}
+
+// Pulls every ready chunk, as processMqttTransfer() does
+static void consume(OtaMqttTransfer& transfer, Bytes& output) {
+    size_t length;
+    const uint8_t* data;
+    while ((data = transfer.peekReady(length)) != nullptr) {
+        output.insert(output.end(), data, data + length);
+        transfer.releaseReady();
+    }
+}
+
+struct Result {
+    Bytes output;
+    size_t published;
+    size_t selectiveRequests;
+};
+
+// Publisher answers plain requests with the unsent part of the window and
+// selective ones with the listed chunks; the network reorders them, repeats
+// some and loses lossPercent of them
+static Result transferImage(const Bytes& image, size_t chunkSize, size_t window, uint32_t lossPercent) {
+    Result result = {Bytes(), 0, 0};
+    OtaMqttTransfer transfer;
+    CHECK(transfer.begin(chunkSize, window));
+    uint32_t total = (uint32_t)((image.size() + chunkSize - 1) / chunkSize);
+
+    std::vector<uint32_t> inFlight;
+    uint32_t sentUpTo = 0;
+    uint32_t requestedNext = 0;
+    auto request = [&](bool selective) {
+        uint32_t next = transfer.getNextIndex();
+        if (selective) {
+            uint32_t missing[OtaMqttTransfer::MAX_WINDOW];
+            size_t count = transfer.collectMissing(missing, OtaMqttTransfer::MAX_WINDOW);
+            inFlight.insert(inFlight.end(), missing, missing + count);
+            result.selectiveRequests++;
+        } else {
+            uint32_t end = min((uint32_t)(next + window), total);
+            for (uint32_t index = max(next, sentUpTo); index < end; index++) inFlight.push_back(index);
+            sentUpTo = max(sentUpTo, end);
+        }
+        requestedNext = next;
+    };
+
+    request(false);
+    for (int rounds = 0; !transfer.isComplete() && rounds < 100000; rounds++) {
+        if (inFlight.empty()) {
+            request(true); // Timeout: nothing arrives any more
+            continue;
+        }
+        size_t pick = nextRandom() % inFlight.size();
+        uint32_t index = inFlight[pick];
+        inFlight.erase(inFlight.begin() + pick);
+        if (nextRandom() % 100 < lossPercent) continue;
+
+        Bytes chunk = makeChunk(image, chunkSize, index, total);
+        CHECK(transfer.onChunk(chunk.data(), chunk.size()));
+        result.published++;
+        if (nextRandom() % 10 == 0) {
+            CHECK(transfer.onChunk(chunk.data(), chunk.size())); // Duplicate
+            result.published++;
+        }
+
+        consume(transfer, result.output);
+        if (transfer.getNextIndex() - requestedNext >= max((size_t)1, window / 2)) request(false);
+    }
+    CHECK(!transfer.hasError());
+    CHECK(transfer.isComplete());
+    CHECK_EQ(transfer.getTotalChunks(), total);
+    return result;
+}
+
+static void testReassembly() {
+    // Short last chunk, no loss: only reordering and duplicates
+    Bytes image = makeImage(100 * 1024 + 333);
+    Result result = transferImage(image, 1024, 8, 0);
+    CHECK(result.output == image);
+    CHECK_EQ(result.selectiveRequests, 0);
+
+    // Losses are recovered with selective re-requests
+    result = transferImage(image, 1024, 8, 20);
+    CHECK(result.output == image);
+    CHECK(result.selectiveRequests > 0);
+
+    // Window 1, maximum window, exact multiple of the chunk size, one chunk
+    Bytes exact = makeImage(64 * 256);
+    CHECK(transferImage(exact, 256, 1, 10).output == exact);
+    CHECK(transferImage(exact, 256, OtaMqttTransfer::MAX_WINDOW, 30).output == exact);
+    Bytes tiny = makeImage(5);
+    CHECK(transferImage(tiny, 1024, 8, 0).output == tiny);
+}
+
+static void testWindowAndDuplicates() {
+    Bytes image = makeImage(10 * 128 + 1);
+    OtaMqttTransfer transfer;
+    CHECK(transfer.begin(128, 4));
+
+    // Out of order within the window: nothing is ready until chunk 0 arrives
+    Bytes chunk = makeChunk(image, 128, 2, 11);
+    CHECK(transfer.onChunk(chunk.data(), chunk.size()));
+    size_t length = 0;
+    CHECK(transfer.peekReady(length) == nullptr);
+    uint32_t missing[OtaMqttTransfer::MAX_WINDOW];
+    CHECK_EQ(transfer.collectMissing(missing, OtaMqttTransfer::MAX_WINDOW), 3);
+    CHECK_EQ(missing[0], 0);
+    CHECK_EQ(missing[1], 1);
+    CHECK_EQ(missing[2], 3);
+    CHECK_EQ(transfer.collectMissing(missing, 2), 2);
+
+    // Beyond the window, a repeat, and a chunk below the next index are dropped
+    chunk = makeChunk(image, 128, 4, 11);
+    CHECK(transfer.onChunk(chunk.data(), chunk.size()));
+    chunk = makeChunk(image, 128, 2, 11);
+    CHECK(transfer.onChunk(chunk.data(), chunk.size()));
+    CHECK_EQ(transfer.getDuplicates(), 2);
+
+    Bytes output;
+    for (uint32_t index : {1u, 0u}) {
+        chunk = makeChunk(image, 128, index, 11);
+        CHECK(transfer.onChunk(chunk.data(), chunk.size()));
+    }
+    consume(transfer, output);
+    CHECK_EQ(transfer.getNextIndex(), 3);
+    CHECK_EQ(output.size(), 3 * 128);
+    chunk = makeChunk(image, 128, 1, 11);
+    CHECK(transfer.onChunk(chunk.data(), chunk.size()));
+    CHECK_EQ(transfer.getDuplicates(), 3);
+
+    // The window now reaches chunk 6; collectMissing stops at the last chunk
+    for (uint32_t index = 3; index < 11; index++) {
+        chunk = makeChunk(image, 128, index, 11);
+        CHECK(transfer.onChunk(chunk.data(), chunk.size()));
+        consume(transfer, output);
+    }
+    CHECK(transfer.isComplete());
+    CHECK(output == image);
+    CHECK_EQ(transfer.collectMissing(missing, OtaMqttTransfer::MAX_WINDOW), 0);
+}
+
+static void expectFailure(const Bytes& chunk, const char* error, uint32_t firstTotal = 0) {
+    OtaMqttTransfer transfer;
+    CHECK(transfer.begin(128, 4));
+    if (firstTotal > 0) {
+        Bytes first;
+        putLe32(first, 0);
+        putLe32(first, firstTotal);
+        first.resize(first.size() + 128);
+        CHECK(transfer.onChunk(first.data(), first.size()));
+    }
+    CHECK(!transfer.onChunk(chunk.data(), chunk.size()));
+    CHECK(transfer.hasError());
+    CHECK(strcmp(transfer.getError(), error) == 0);
+    CHECK(!transfer.onChunk(chunk.data(), chunk.size())); // Stays failed
+}
+
+static Bytes rawChunk(uint32_t index, uint32_t total, size_t dataLength) {
+    Bytes chunk;
+    putLe32(chunk, index);
+    putLe32(chunk, total);
+    chunk.resize(chunk.size() + dataLength, 0x5A);
+    return chunk;
+}
+
+static void testMalformed() {
+    expectFailure(rawChunk(0, 4, 0), "Chunk too short");
+    expectFailure(rawChunk(0, 0, 128), "Inconsistent chunk count");
+    expectFailure(rawChunk(1, 5, 128), "Inconsistent chunk count", 4);
+    expectFailure(rawChunk(4, 4, 128), "Chunk index out of range");
+    expectFailure(rawChunk(1, 4, 127), "Chunk size does not match the negotiated size");  // Short, not last
+    expectFailure(rawChunk(3, 4, 129), "Chunk size does not match the negotiated size");  // Last, too long
+
+    OtaMqttTransfer transfer;
+    CHECK(!transfer.begin(0, 4));
+    CHECK(!transfer.begin(128, 0));
+    CHECK(!transfer.begin(128, OtaMqttTransfer::MAX_WINDOW + 1));
+    CHECK(!transfer.begin(0x10000, 1));
+}
+
+int main() {
+    testReassembly();
+    testWindowAndDuplicates();
+    testMalformed();
+    return checkReport("mqtt_transfer");
+}
@@ -0,0 +1,168 @@
+// Sources: src/OtaRateLimiter.cpp
+// OtaRateLimiter on a simulated clock: the sustained rate under random
+// polling, the burst cap after idling, allowance() rounding down without
+// losing the remainder, debt from overrun, rate changes, and the clock
+// wrapping around.
+
+#include "OtaRateLimiter.h"
+#include "test_check.h"
+#include <climits>
+#include <cstdlib>
+
+static const unsigned long SECOND = 1000000;
+
+// Moves everything it is allowed to for `seconds`, polling at random
+// intervals of up to maxStepMicros. Returns the bytes moved.
+static uint64_t drain(OtaRateLimiter& limiter, unsigned long& now, unsigned long seconds,
+                      unsigned long maxStepMicros, size_t maxBytes) {
+    uint64_t moved = 0;
+    unsigned long end = now + seconds * SECOND;
+    while (now != end) {
+        unsigned long step = 1 + rand() % maxStepMicros;
+        if (end - now < step) step = end - now;
+        now += step;
+        size_t bytes = limiter.allowance(now, maxBytes);
+        CHECK(bytes <= maxBytes);
+        limiter.consume(bytes);
+        moved += bytes;
+    }
+    return moved;
+}
+
+static void testSustainedRate() {
+    static const uint32_t RATES[] = {1, 3, 7, 1000, 48000, 1000000};
+    for (size_t i = 0; i < sizeof(RATES) / sizeof(RATES[0]); i++) {
+        for (unsigned long maxStep = 1000; maxStep <= 1000000; maxStep *= 10) {
+            // Polled often enough that no single step earns more than a burst
+            if ((uint64_t)RATES[i] * maxStep > 512 * (uint64_t)SECOND) continue;
+            OtaRateLimiter limiter;
+            limiter.configure(RATES[i], 512);
+            unsigned long now = 5 * SECOND;
+            limiter.reset(now);
+            CHECK_EQ(limiter.allowance(now, 4096), 512);
+            limiter.consume(512);
+            // Exactly the rate: rounding down per call must not lose the
+            // fractions between calls
+            uint64_t moved = drain(limiter, now, 20, maxStep, 4096);
+            uint64_t expected = (uint64_t)RATES[i] * 20;
+            CHECK(moved <= expected);
+            CHECK(moved + 1 >= expected);
+        }
+    }
+}
+
+static void testBurstCap() {
+    OtaRateLimiter limiter;
+    limiter.configure(1000, 300);
+    unsigned long now = 0;
+    limiter.reset(now);
+    CHECK_EQ(limiter.allowance(now, 10000), 300);
+    limiter.consume(300);
+    CHECK_EQ(limiter.allowance(now, 10000), 0);
+
+    // Idle far longer than the burst takes to refill: still one burst
+    now += 3600 * SECOND;
+    CHECK_EQ(limiter.allowance(now, 10000), 300);
+    CHECK_EQ(limiter.allowance(now, 100), 100);
+
+    // Lowering the burst drops the credit above it; raising it does not add any
+    limiter.configure(1000, 50);
+    CHECK_EQ(limiter.allowance(now, 10000), 50);
+    limiter.configure(1000, 5000);
+    CHECK_EQ(limiter.allowance(now, 10000), 50);
+    now += 2 * SECOND;
+    CHECK_EQ(limiter.allowance(now, 10000), 2050);
+
+    // A burst of 0 still lets single bytes through
+    limiter.configure(1000, 0);
+    CHECK_EQ(limiter.getBurst(), 1);
+    CHECK_EQ(limiter.allowance(now, 10000), 1);
+}
+
+static void testRounding() {
+    OtaRateLimiter limiter;
+    limiter.configure(3, 100);
+    unsigned long now = 0;
+    limiter.reset(now);
+    limiter.consume(100);
+
+    // One byte takes 333333.33 microseconds at 3 bytes/s
+    CHECK_EQ(limiter.allowance(now + 333333, 100), 0);
+    CHECK_EQ(limiter.allowance(now + 333334, 100), 1);
+    CHECK_EQ(limiter.allowance(now + 666666, 100), 1);
+    CHECK_EQ(limiter.allowance(now + 666667, 100), 2);
+    CHECK_EQ(limiter.allowance(now + SECOND, 100), 3);
+
+    // Polled every microsecond, the fractions add up to exactly the rate
+    OtaRateLimiter slow;
+    slow.configure(1, 1);
+    now = 0;
+    slow.reset(now);
+    slow.consume(1);
+    uint64_t moved = 0;
+    for (unsigned long t = 1; t <= 3 * SECOND; t++) {
+        size_t bytes = slow.allowance(t, 10);
+        slow.consume(bytes);
+        moved += bytes;
+        if (t == 3 * SECOND - 1) CHECK_EQ(moved, 2);
+    }
+    CHECK_EQ(moved, 3);
+}
+
+static void testDebt() {
+    OtaRateLimiter limiter;
+    limiter.configure(100, 100);
+    unsigned long now = 0;
+    limiter.reset(now);
+
+    // 350 bytes arrived against 100 of credit: 2.5 seconds to pay off
+    limiter.consume(350);
+    CHECK_EQ(limiter.allowance(now + 2500000 - 1, 1000), 0);
+    CHECK_EQ(limiter.allowance(now + 2510000, 1000), 1);
+    CHECK_EQ(limiter.allowance(now + 4000000, 1000), 100);
+}
+
+static void testRateChanges() {
+    OtaRateLimiter limiter;
+    CHECK(!limiter.isLimited());
+    CHECK_EQ(limiter.allowance(0, 12345), 12345);
+    limiter.consume(1u << 30);
+    CHECK_EQ(limiter.allowance(0, 12345), 12345);
+
+    // Rate 0 pauses without losing the credit already there
+    unsigned long now = 0;
+    limiter.configure(1000, 200);
+    CHECK(limiter.isLimited());
+    limiter.reset(now);
+    limiter.consume(150);
+    limiter.configure(0, 200);
+    now += 60 * SECOND;
+    CHECK_EQ(limiter.allowance(now, 1000), 50);
+    limiter.configure(1000, 200);
+    now += SECOND / 10;
+    CHECK_EQ(limiter.allowance(now, 1000), 150);
+
+    limiter.configure(OtaRateLimiter::UNLIMITED, 200);
+    CHECK_EQ(limiter.allowance(now, 1000), 1000);
+}
+
+static void testClockWrap() {
+    OtaRateLimiter limiter;
+    limiter.configure(1000, 1000);
+    unsigned long now = ULONG_MAX - SECOND / 2;
+    limiter.reset(now);
+    limiter.consume(1000);
+    now += SECOND;              // Wraps
+    CHECK_EQ(limiter.allowance(now, 5000), 1000);
+}
+
+int main() {
+    srand(7);
+    testSustainedRate();
+    testBurstCap();
+    testRounding();
+    testDebt();
+    testRateChanges();
+    testClockWrap();
+    return checkReport("rate_limiter");
+}
@@ -0,0 +1,228 @@
+// Sources: src/OtaRetryPolicy.cpp
+// OtaRetryPolicy: decorrelated jitter stays in [base, 3 * previous] and
+// under the cap, grows to the cap over consecutive failures, spreads
+// clients that fail together, and resets on success. OtaCircuitBreaker:
+// closed to open at the threshold, half-open after the cooldown, closed
+// again on a successful trial, and the host table's eviction order.
+
+#include "OtaRetryPolicy.h"
+#include "test_check.h"
+#include <climits>
+#include <set>
+
+// ============================================================================
+// RETRY POLICY
+// ============================================================================
+
+static void testJitterBounds() {
+    OtaRetryPolicy policy;
+    policy.setDelays(500, 30000);
+    for (int run = 0; run < 2000; run++) {
+        unsigned long previous = 500;
+        for (int failure = 0; failure < 12; failure++) {
+            unsigned long delay = policy.recordFailure(0);
+            CHECK(delay >= 500);
+            CHECK(delay <= 30000);
+            CHECK(delay <= previous * 3);
+            previous = delay;
+        }
+        policy.recordSuccess();
+    }
+}
+
+static void testGrowthAndCap() {
+    // Mean delay of the nth consecutive failure over many clients
+    static const int RUNS = 4000;
+    double mean[12] = {0};
+    unsigned long longest = 0;
+    for (int run = 0; run < RUNS; run++) {
+        OtaRetryPolicy policy;
+        policy.setDelays(1000, 60000);
+        for (int failure = 0; failure < 12; failure++) {
+            unsigned long delay = policy.recordFailure(0);
+            mean[failure] += (double)delay / RUNS;
+            if (delay > longest) longest = delay;
+        }
+    }
+    // First delay uniform in [1000, 3000]
+    CHECK(mean[0] > 1900 && mean[0] < 2100);
+    // Growing about 1.5x while far below the cap
+    for (int failure = 1; failure < 5; failure++) CHECK(mean[failure] > mean[failure - 1] * 1.3);
+    // Then spanning [base, max]: a third of the cap on average, up to the cap
+    CHECK(mean[11] > 15000 && mean[11] < 25000);
+    CHECK(longest > 57000 && longest <= 60000);
+
+    // A cap close to the top of the range must not overflow 3 * previous
+    OtaRetryPolicy wide;
+    wide.setDelays(1, ULONG_MAX - 1);
+    for (int failure = 0; failure < 100; failure++) {
+        unsigned long delay = wide.recordFailure(0);
+        CHECK(delay >= 1 && delay <= ULONG_MAX - 1);
+    }
+    wide.setDelays(ULONG_MAX / 2, ULONG_MAX - 1);
+    size_t aboveBase = 0;
+    for (int failure = 0; failure < 100; failure++) {
+        unsigned long delay = wide.recordFailure(0);
+        CHECK(delay >= ULONG_MAX / 2);
+        if (delay > ULONG_MAX / 2) aboveBase++;
+    }
+    CHECK(aboveBase > 90);
+}
+
+static void testSpread() {
+    // Clients failing together: by the third failure they are spread out
+    std::set<unsigned long> thirdDelays;
+    for (int client = 0; client < 1000; client++) {
+        OtaRetryPolicy policy;
+        policy.setDelays(1000, 600000);
+        policy.recordFailure(0);
+        policy.recordFailure(0);
+        thirdDelays.insert(policy.recordFailure(0));
+    }
+    CHECK(thirdDelays.size() > 900);
+}
+
+static void testScheduling() {
+    OtaRetryPolicy policy;
+    policy.setDelays(100, 100);
+    CHECK(policy.canAttempt(0));
+    CHECK_EQ(policy.getNextAttempt(), 0);
+    CHECK_EQ(policy.getFailures(), 0);
+
+    // Base equal to the cap: a fixed delay
+    unsigned long now = ULONG_MAX - 50;
+    CHECK_EQ(policy.recordFailure(now), 100);
+    CHECK_EQ(policy.getFailures(), 1);
+    CHECK_EQ(policy.getNextAttempt(), now + 100);
+    CHECK(!policy.canAttempt(now));
+    CHECK(!policy.canAttempt(now + 99));   // Across the millis() wrap
+    CHECK(policy.canAttempt(now + 100));
+    CHECK(policy.canAttempt(now + 5000));
+
+    policy.recordSuccess();
+    CHECK(policy.canAttempt(now));
+    CHECK_EQ(policy.getFailures(), 0);
+    CHECK_EQ(policy.getNextAttempt(), 0);
+
+    // Success forgets the grown delay
+    policy.setDelays(100, 1000000);
+    for (int i = 0; i < 20; i++) policy.recordFailure(0);
+    policy.recordSuccess();
+    CHECK(policy.recordFailure(0) <= 300);
+
+    // Nonsense settings are clamped: base at least 1, cap at least base
+    policy.setDelays(0, 0);
+    policy.recordSuccess();
+    CHECK_EQ(policy.recordFailure(0), 1);
+    policy.setDelays(5000, 10);
+    CHECK_EQ(policy.recordFailure(0), 5000);
+}
+
+// ============================================================================
+// CIRCUIT BREAKER
+// ============================================================================
+
+typedef OtaCircuitBreaker::State State;
+
+static void testBreakerStates() {
+    OtaCircuitBreaker breaker;
+    breaker.configure(3, 1000);
+    const char* host = "fw.example.com";
+    unsigned long now = 5000;
+
+    CHECK(breaker.allow(host, now));
+    CHECK(!breaker.recordFailure(host, now));
+    CHECK(!breaker.recordFailure(host, now));
+    CHECK(breaker.getState(host, now) == State::CLOSED);
+    CHECK(breaker.allow(host, now));
+    CHECK_EQ(breaker.getOpenUntil(host), 0);
+
+    // Third consecutive failure opens it for the cooldown
+    CHECK(breaker.recordFailure(host, now));
+    CHECK(breaker.getState(host, now) == State::OPEN);
+    CHECK_EQ(breaker.getOpenUntil(host), 6000);
+    CHECK(!breaker.allow(host, now + 999));
+    CHECK(!breaker.allow("FW.Example.COM", now + 999));  // Host names are case-insensitive
+    CHECK(breaker.allow("other.example.com", now + 999));
+
+    // Cooldown over: half-open, one trial whose failure reopens it at once
+    CHECK(breaker.getState(host, now + 1000) == State::HALF_OPEN);
+    CHECK(breaker.allow(host, now + 1000));
+    CHECK(breaker.getState(host, now + 1000) == State::HALF_OPEN);
+    CHECK_EQ(breaker.getOpenUntil(host), 0);
+    CHECK(breaker.recordFailure(host, now + 1200));
+    CHECK(breaker.getState(host, now + 1200) == State::OPEN);
+    CHECK_EQ(breaker.getOpenUntil(host), 7200);
+    CHECK(!breaker.allow(host, now + 2000));
+
+    // A successful trial closes it and forgets the failures
+    CHECK(breaker.allow(host, now + 2200));
+    breaker.recordSuccess(host);
+    CHECK(breaker.getState(host, now + 2200) == State::CLOSED);
+    CHECK(!breaker.recordFailure(host, now + 2300));
+    CHECK(!breaker.recordFailure(host, now + 2300));
+    CHECK(breaker.allow(host, now + 2300));
+
+    // A success between failures restarts the count
+    breaker.recordSuccess(host);
+    CHECK(!breaker.recordFailure(host, now + 2400));
+    CHECK(!breaker.recordFailure(host, now + 2400));
+    CHECK(breaker.recordFailure(host, now + 2400));
+
+    // Cooldown across the millis() wrap
+    OtaCircuitBreaker wrapping;
+    wrapping.configure(1, 1000);
+    now = ULONG_MAX - 100;
+    CHECK(wrapping.recordFailure(host, now));
+    CHECK(!wrapping.allow(host, now + 999));
+    CHECK(wrapping.allow(host, now + 1000));
+
+    // Threshold 0 disables it
+    OtaCircuitBreaker disabled;
+    disabled.configure(0, 1000);
+    for (int i = 0; i < 10; i++) CHECK(!disabled.recordFailure(host, 0));
+    CHECK(disabled.allow(host, 0));
+    CHECK(disabled.getState(host, 0) == State::CLOSED);
+}
+
+static void testBreakerTable() {
+    static const char* const HOSTS[] = {"h0", "h1", "h2", "h3", "h4", "h5", "h6", "h7", "h8", "h9"};
+    OtaCircuitBreaker breaker;
+    breaker.configure(2, 100000);
+
+    // Seven open circuits and one closed host with a failure on record
+    for (int i = 0; i < 7; i++) {
+        breaker.recordFailure(HOSTS[i], i);
+        CHECK(breaker.recordFailure(HOSTS[i], i));
+    }
+    breaker.recordFailure(HOSTS[7], 7);
+
+    // A new host takes the closed entry; open circuits are kept
+    CHECK(!breaker.recordFailure(HOSTS[8], 8));
+    for (int i = 0; i < 7; i++) CHECK(!breaker.allow(HOSTS[i], 10));
+    CHECK(!breaker.recordFailure(HOSTS[7], 11));    // Its earlier failure was forgotten
+    CHECK(breaker.getState(HOSTS[7], 11) == State::CLOSED);
+    CHECK(breaker.getState(HOSTS[8], 11) == State::CLOSED);  // And h8's in turn
+
+    // All open: the least recently used is reused
+    OtaCircuitBreaker full;
+    full.configure(1, 100000);
+    for (int i = 0; i < 8; i++) CHECK(full.recordFailure(HOSTS[i], 100 + i));
+    full.recordFailure(HOSTS[0], 200);              // h0 used again: h1 is now oldest
+    CHECK(full.recordFailure(HOSTS[9], 300));
+    CHECK(!full.allow(HOSTS[0], 300));
+    CHECK(full.allow(HOSTS[1], 300));
+    for (int i = 2; i < 8; i++) CHECK(!full.allow(HOSTS[i], 300));
+    CHECK(!full.allow(HOSTS[9], 300));
+}
+
+int main() {
+    srand(11);
+    testJitterBounds();
+    testGrowthAndCap();
+    testSpread();
+    testScheduling();
+    testBreakerStates();
+    testBreakerTable();
+    return checkReport("retry_policy");
+}
@@ -0,0 +1,140 @@
+// Sources: src/OtaRollout.cpp
+// OtaRollout over a fleet of sequential MAC addresses: cohorts spread
+// evenly, every percentage takes that share of the fleet, raising the
+// percentage only adds devices, and start delays stay inside the jitter
+// window and are spread evenly across it, independently of the cohort.
+
+#include "OtaRollout.h"
+#include "test_check.h"
+#include <cstring>
+#include <vector>
+
+static const size_t FLEET = 100000;
+static const char SEED[] = "release-2.4.0";
+
+// Sequential MACs from one vendor prefix, as a production batch would have
+static void macOf(size_t device, uint8_t* mac) {
+    mac[0] = 0x24;
+    mac[1] = 0x0A;
+    mac[2] = 0xC4;
+    mac[3] = (uint8_t)(device >> 16);
+    mac[4] = (uint8_t)(device >> 8);
+    mac[5] = (uint8_t)device;
+}
+
+static uint8_t cohortOf(size_t device, const char* seed = SEED) {
+    uint8_t mac[6];
+    macOf(device, mac);
+    return OtaRollout::cohort(mac, sizeof(mac), seed, strlen(seed));
+}
+
+static uint32_t delayOf(size_t device, uint32_t windowMs) {
+    uint8_t mac[6];
+    macOf(device, mac);
+    return OtaRollout::startDelay(mac, sizeof(mac), SEED, strlen(SEED), windowMs);
+}
+
+static void testCohorts() {
+    std::vector<size_t> perCohort(100, 0);
+    size_t sameAsNeighbour = 0;
+    uint8_t previous = 0;
+    for (size_t device = 0; device < FLEET; device++) {
+        uint8_t cohort = cohortOf(device);
+        CHECK(cohort < 100);
+        CHECK_EQ(cohort, cohortOf(device));
+        perCohort[cohort]++;
+        if (device > 0 && cohort == previous) sameAsNeighbour++;
+        previous = cohort;
+    }
+    // 1000 expected per cohort; the standard deviation is about 31
+    for (size_t c = 0; c < 100; c++) {
+        CHECK(perCohort[c] > 850 && perCohort[c] < 1150);
+    }
+    // MACs one apart are no more alike than any two devices
+    CHECK(sameAsNeighbour > 800 && sameAsNeighbour < 1200);
+
+    // Another seed reshuffles the fleet: half and half is a quarter
+    size_t inBoth = 0;
+    for (size_t device = 0; device < FLEET; device++) {
+        if (OtaRollout::isIncluded(cohortOf(device), 50) &&
+            OtaRollout::isIncluded(cohortOf(device, "release-2.5.0"), 50)) {
+            inBoth++;
+        }
+    }
+    CHECK(inBoth > 24000 && inBoth < 26000);
+}
+
+static void testPercentages() {
+    std::vector<uint8_t> cohorts(FLEET);
+    for (size_t device = 0; device < FLEET; device++) cohorts[device] = cohortOf(device);
+
+    std::vector<bool> wasIncluded(FLEET, false);
+    for (int percent = 0; percent <= 100; percent++) {
+        size_t included = 0;
+        for (size_t device = 0; device < FLEET; device++) {
+            bool in = OtaRollout::isIncluded(cohorts[device], (uint8_t)percent);
+            // Nobody who was in drops out as the rollout widens
+            if (wasIncluded[device]) CHECK(in);
+            wasIncluded[device] = in;
+            if (in) included++;
+        }
+        size_t expected = FLEET / 100 * percent;
+        CHECK(included + 800 > expected && included < expected + 800);
+        if (percent == 0) CHECK_EQ(included, 0);
+        if (percent == 100) CHECK_EQ(included, FLEET);
+    }
+    // Above 100 is everyone
+    CHECK(OtaRollout::isIncluded(99, 255));
+}
+
+static void testStartDelay() {
+    static const uint32_t WINDOWS[] = {1, 7, 1000, 3600000, 0xFFFFFFFFu};
+    for (size_t w = 0; w < sizeof(WINDOWS) / sizeof(WINDOWS[0]); w++) {
+        uint32_t window = WINDOWS[w];
+        std::vector<size_t> perTenth(10, 0);
+        uint64_t sum = 0, earlySum = 0;
+        size_t early = 0;
+        for (size_t device = 0; device < FLEET; device++) {
+            uint32_t delay = delayOf(device, window);
+            CHECK(delay < window);
+            CHECK_EQ(delay, delayOf(device, window));
+            sum += delay;
+            if (window >= 10) perTenth[(uint64_t)delay * 10 / window]++;
+            if (cohortOf(device) < 10) {
+                earlySum += delay;
+                early++;
+            }
+        }
+        if (window == 1) {
+            CHECK_EQ(sum, 0);
+            continue;
+        }
+        // Mean halfway through the window, for the first cohorts as well
+        double mean = (double)sum / FLEET / (window - 1);
+        double earlyMean = (double)earlySum / early / (window - 1);
+        CHECK(mean > 0.49 && mean < 0.51);
+        CHECK(earlyMean > 0.47 && earlyMean < 0.53);
+        for (size_t t = 0; t < 10 && window >= 10; t++) {
+            CHECK(perTenth[t] > 9500 && perTenth[t] < 10500);
+        }
+    }
+    CHECK_EQ(delayOf(1234, 0), 0);
+}
+
+// Moving bytes between the seed and the identity changes the hash
+static void testSeedSeparation() {
+    const uint8_t c[] = {'c'};
+    const uint8_t bc[] = {'b', 'c'};
+    CHECK(OtaRollout::startDelay(c, 1, "ab", 2, 0xFFFFFFFFu) !=
+          OtaRollout::startDelay(bc, 2, "a", 1, 0xFFFFFFFFu));
+    CHECK(OtaRollout::startDelay(c, 1, "", 0, 0xFFFFFFFFu) !=
+          OtaRollout::startDelay(nullptr, 0, "c", 1, 0xFFFFFFFFu));
+}
+
+int main() {
+    testCohorts();
+    testPercentages();
+    testStartDelay();
+    testSeedSeparation();
+    return checkReport("rollout");
+}
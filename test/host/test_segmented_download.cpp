@@ -0,0 +1,354 @@
+// Sources: src/OtaSegmentedDownload.cpp src/OtaHttpParser.cpp src/OtaArena.cpp
+// OtaSegmentedDownload against a scripted range server, one fake socket per
+// lane. Block planning: the ranges requested tile the file exactly once, no
+// lane runs more than its slot ahead of the read cursor, and connections
+// are reused under keep-alive. Reassembly: random block sizes, lane counts,
+// start offsets, trickled and chunked responses and read sizes must give
+// back the file byte for byte. Then every response the download must refuse.
+
+#include "OtaSegmentedDownload.h"
+#include "OtaArena.h"
+#include "fake_async_client.h"
+#include "test_check.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+typedef std::vector<uint8_t> Bytes;
+
+enum class Fault {
+    NONE,
+    WRONG_START,    // Content-Range one byte off
+    WHOLE_FILE,     // 200 with the whole file
+    WRONG_TOTAL,    // Content-Range names another file size
+    GZIP,           // Content-Encoding: gzip
+    SHORT_BODY,     // Content-Length 10 bytes short
+    LONG_BODY,      // Content-Length 10 bytes over
+    CLOSE_EARLY,    // Connection closed halfway through the body
+    SILENT,         // Never answers
+    REFUSE          // Connections refused
+};
+
+struct Range {
+    size_t start;
+    size_t end;     // Exclusive
+    int connection;
+};
+
+// Answers Range requests for `image`, releasing at most `trickle` bytes of
+// each connection's responses per call. The fault applies to the requests
+// after the first faultFrom.
+struct RangeServer {
+    Bytes image;
+    bool keepAlive;
+    bool chunked;
+    size_t trickle;
+    Fault fault;
+    size_t faultFrom;
+    size_t readBack;            // Bytes the test has read back so far, from the file start
+    size_t aheadLimit;          // Furthest a request may end past readBack
+    std::vector<Range> requests;
+    std::map<int, std::deque<uint8_t> > pending;
+
+    void serve(FakeSocket& socket) {
+        socket.refuse = fault == Fault::REFUSE;
+        socket.connectPolls = 1 + socket.connection % 3;
+        std::deque<uint8_t>& queue = pending[socket.connection];
+
+        static const char END[] = "\r\n\r\n";
+        Bytes& sent = socket.fromClient;
+        Bytes::iterator found = std::search(sent.begin(), sent.end(), END, END + 4);
+        if (found != sent.end()) {
+            std::string request(sent.begin(), found + 4);
+            sent.erase(sent.begin(), found + 4);
+            respond(socket, queue, request);
+        }
+
+        size_t count = trickle > 0 ? std::min(trickle, queue.size()) : queue.size();
+        socket.toClient.insert(socket.toClient.end(), queue.begin(), queue.begin() + count);
+        queue.erase(queue.begin(), queue.begin() + count);
+    }
+
+    void respond(FakeSocket& socket, std::deque<uint8_t>& queue, const std::string& request) {
+        unsigned first = 0, last = 0;
+        const char* range = strstr(request.c_str(), "Range: bytes=");
+        CHECK(range != nullptr);
+        CHECK(strstr(request.c_str(), "GET /fw.bin HTTP/1.1\r\nHost: fw.example.com\r\n") == request.c_str());
+        if (!range || sscanf(range, "Range: bytes=%u-%u", &first, &last) != 2) return;
+        Range asked = {first, (size_t)last + 1, socket.connection};
+        CHECK(asked.end <= image.size());
+        CHECK(asked.end <= readBack || asked.end - readBack <= aheadLimit);
+        requests.push_back(asked);
+
+        Fault now = requests.size() > faultFrom ? fault : Fault::NONE;
+        if (now == Fault::SILENT) return;
+
+        size_t start = asked.start, end = asked.end, total = image.size();
+        if (now == Fault::WRONG_START) start++;
+        if (now == Fault::WRONG_TOTAL) total++;
+        size_t length = end - start;
+        if (now == Fault::SHORT_BODY) length -= 10;
+        if (now == Fault::LONG_BODY) length += 10;
+        if (now == Fault::CLOSE_EARLY) length /= 2;
+
+        std::string headers;
+        if (now == Fault::WHOLE_FILE) {
+            start = 0;
+            length = image.size();
+            headers = "HTTP/1.1 200 OK\r\n";
+        } else {
+            char line[96];
+            snprintf(line, sizeof(line), "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %u-%u/%u\r\n",
+                     (unsigned)start, (unsigned)(end - 1), (unsigned)total);
+            headers = line;
+        }
+        if (now == Fault::GZIP) headers += "Content-Encoding: gzip\r\n";
+        if (!keepAlive || now == Fault::CLOSE_EARLY) headers += "Connection: close\r\n";
+
+        Bytes body;
+        for (size_t i = start; i < start + length; i++) body.push_back(i < image.size() ? image[i] : 0);
+        if (now == Fault::CLOSE_EARLY) {
+            char line[32];
+            snprintf(line, sizeof(line), "Content-Length: %u\r\n", (unsigned)(end - start));
+            headers += line;
+        } else if (chunked) {
+            headers += "Transfer-Encoding: chunked\r\n";
+            Bytes framed;
+            for (size_t at = 0; at < body.size();) {
+                size_t size = std::min(body.size() - at, (size_t)(1 + rand() % 3000));
+                char line[16];
+                snprintf(line, sizeof(line), "%x\r\n", (unsigned)size);
+                framed.insert(framed.end(), line, line + strlen(line));
+                framed.insert(framed.end(), body.begin() + at, body.begin() + at + size);
+                framed.push_back('\r');
+                framed.push_back('\n');
+                at += size;
+            }
+            static const char LAST[] = "0\r\n\r\n";
+            framed.insert(framed.end(), LAST, LAST + 5);
+            body.swap(framed);
+        } else {
+            char line[32];
+            snprintf(line, sizeof(line), "Content-Length: %u\r\n", (unsigned)length);
+            headers += line;
+        }
+        headers += "\r\n";
+
+        queue.insert(queue.end(), headers.begin(), headers.end());
+        queue.insert(queue.end(), body.begin(), body.end());
+        if (!keepAlive || now == Fault::CLOSE_EARLY) socket.closed = true;
+    }
+};
+
+static RangeServer server;
+
+static void resetServer(size_t imageSize) {
+    server.image.resize(imageSize);
+    for (size_t i = 0; i < imageSize; i++) server.image[i] = (uint8_t)rand();
+    server.keepAlive = true;
+    server.chunked = false;
+    server.trickle = 0;
+    server.fault = Fault::NONE;
+    server.faultFrom = 0;
+    server.readBack = 0;
+    server.aheadLimit = (size_t)-1;
+    server.requests.clear();
+    server.pending.clear();
+    fakeConnections = 0;
+    fakeServer = [](FakeSocket& socket) { server.serve(socket); };
+}
+
+// Polls and reads back until done, an error or `limit` rounds
+static Bytes run(OtaSegmentedDownload& download, size_t start, size_t maxRead, size_t limit = 1000000) {
+    Bytes out;
+    server.readBack = start;
+    for (size_t round = 0; round < limit && !download.isComplete() && !download.hasError(); round++) {
+        download.poll(1 + rand() % 8192);
+        size_t length;
+        const uint8_t* data = download.peek(length);
+        if (data) {
+            size_t take = std::min(length, 1 + rand() % maxRead);
+            out.insert(out.end(), data, data + take);
+            download.consume(take);
+            server.readBack += take;
+        }
+        hostClockMicros() += 100;
+    }
+    return out;
+}
+
+// ============================================================================
+// PLANNING
+// ============================================================================
+
+static void testBlockSizeFor() {
+    CHECK_EQ(OtaSegmentedDownload::blockSizeFor(1, 65536), 65536);
+    CHECK_EQ(OtaSegmentedDownload::blockSizeFor(3, 65536), 20480);     // Rounded down to 4 KB
+    CHECK_EQ(OtaSegmentedDownload::blockSizeFor(8, 1000), 4096);       // At least MIN_BLOCK_SIZE
+    CHECK_EQ(OtaSegmentedDownload::blockSizeFor(0, 8192), 8192);
+}
+
+static void testPlanning() {
+    for (int keepAlive = 0; keepAlive < 2; keepAlive++) {
+        resetServer(100000);
+        server.keepAlive = keepAlive;
+        OtaSegmentedDownload download;
+        CHECK(download.begin("fw.example.com", 443, "/fw.bin", true, 1000, 100000, 8192, 4));
+        CHECK_EQ(download.getLaneCount(), 4);
+        server.aheadLimit = 4 * 8192;
+        Bytes out = run(download, 1000, 100000);
+        CHECK(download.isComplete());
+        CHECK(!download.hasError());
+        CHECK(out == Bytes(server.image.begin() + 1000, server.image.end()));
+
+        // Consecutive blocks from the start offset, each requested once; the
+        // server sees them in the order the lanes' connections come up
+        size_t blocks = (99000 + 8191) / 8192;
+        CHECK_EQ(server.requests.size(), blocks);
+        std::sort(server.requests.begin(), server.requests.end(),
+                  [](const Range& a, const Range& b) { return a.start < b.start; });
+        for (size_t i = 0; i < server.requests.size(); i++) {
+            CHECK_EQ(server.requests[i].start, 1000 + i * 8192);
+            CHECK_EQ(server.requests[i].end, std::min((size_t)100000, 1000 + (i + 1) * 8192));
+        }
+        // Keep-alive: one connection per lane; otherwise one per block
+        CHECK_EQ(fakeConnections, keepAlive ? 4 : (int)blocks);
+        CHECK_EQ(download.getReconnects(), keepAlive ? 0 : blocks - 4);
+    }
+
+    // No more lanes than blocks, nor than MAX_CONNECTIONS
+    resetServer(20000);
+    OtaSegmentedDownload download;
+    CHECK(download.begin("fw.example.com", 443, "/fw.bin", true, 0, 20000, 8192, 6));
+    CHECK_EQ(download.getLaneCount(), 3);
+    CHECK(run(download, 0, 4096) == server.image);
+    CHECK(download.begin("fw.example.com", 443, "/fw.bin", true, 0, 20000, 1000, 50));
+    CHECK_EQ(download.getLaneCount(), OtaSegmentedDownload::MAX_CONNECTIONS);
+    CHECK(run(download, 0, 4096) == server.image);
+
+    // Lanes reduced to the slots that fit in the arena
+    static uint8_t arena[3 * 8192];
+    OtaArena::install(arena, sizeof(arena), &download);
+    resetServer(100000);
+    CHECK(download.begin("fw.example.com", 443, "/fw.bin", true, 0, 100000, 8192, 8));
+    CHECK_EQ(download.getLaneCount(), 3);
+    server.aheadLimit = 3 * 8192;
+    CHECK(run(download, 0, 4096) == server.image);
+    download.end();
+    OtaArena::install(nullptr, 0, nullptr);
+}
+
+// ============================================================================
+// REASSEMBLY
+// ============================================================================
+
+static void testReassembly() {
+    for (int trial = 0; trial < 300; trial++) {
+        size_t imageSize = 1 + rand() % 200000;
+        resetServer(imageSize);
+        server.keepAlive = rand() % 4 != 0;
+        server.chunked = rand() % 3 == 0;
+        server.trickle = rand() % 2 ? 0 : 1 + rand() % 2000;
+        size_t start = rand() % 2 ? 0 : rand() % imageSize;
+        size_t blockSize = rand() % 2 ? 4096 * (1 + rand() % 8) : 1 + rand() % 20000;
+        size_t connections = 1 + rand() % 10;
+
+        OtaSegmentedDownload download;
+        CHECK(download.begin("fw.example.com", 443, "/fw.bin", true, start, imageSize, blockSize, connections));
+        server.aheadLimit = download.getLaneCount() * blockSize;
+        Bytes out = run(download, start, 1 + rand() % 10000);
+        CHECK(download.isComplete());
+        if (download.hasError()) printf("trial %d: %s\n", trial, download.getError());
+        CHECK(out == Bytes(server.image.begin() + start, server.image.end()));
+        CHECK_EQ(server.requests.size(), (imageSize - start + blockSize - 1) / blockSize);
+    }
+}
+
+// The first block's response already parsed by the caller, as after the
+// initial request that discovered the server takes ranges
+static void testFirstClientTakeover() {
+    resetServer(50000);
+    OtaAsyncClient* client = OtaAsyncClient::create();
+    CHECK(client->begin("fw.example.com", 443, true));
+    while (client->poll() == OtaAsyncClient::State::CONNECTING) {}
+    const char REQUEST[] = "GET /fw.bin HTTP/1.1\r\nHost: fw.example.com\r\nRange: bytes=2000-10191\r\n\r\n";
+    CHECK_EQ(client->send((const uint8_t*)REQUEST, strlen(REQUEST)), (int)strlen(REQUEST));
+    OtaHttpParser parser;
+    parser.begin();
+    while (!parser.headersComplete()) {
+        uint8_t c = (uint8_t)client->read();
+        parser.feedHeaders(&c, 1);
+    }
+
+    OtaSegmentedDownload download;
+    CHECK(download.begin("fw.example.com", 443, "/fw.bin", true, 2000, 50000, 8192, 3, client, &parser));
+    CHECK(run(download, 2000, 5000) == Bytes(server.image.begin() + 2000, server.image.end()));
+    // The first block was not requested again
+    CHECK_EQ(server.requests.size(), 6);
+    for (size_t i = 1; i < server.requests.size(); i++) CHECK(server.requests[i].start != 2000);
+}
+
+// ============================================================================
+// REFUSED RESPONSES
+// ============================================================================
+
+static const char* faultError(Fault fault, size_t faultFrom, unsigned long stallMs = 30000) {
+    resetServer(60000);
+    server.fault = fault;
+    server.faultFrom = faultFrom;
+    OtaSegmentedDownload download;
+    download.setTimeouts(5000, 5000, 10000, stallMs);
+    if (!download.begin("fw.example.com", 443, "/fw.bin", true, 0, 60000, 8192, 2)) return download.getError();
+    Bytes out = run(download, 0, 8192, 100000);
+    // Bytes handed out are the file's; none at all from a refused response
+    CHECK(std::equal(out.begin(), out.end(), server.image.begin()));
+    if (fault <= Fault::GZIP) CHECK(out.size() <= faultFrom * 8192);
+    CHECK(!download.isComplete());
+    return download.getError() ? download.getError() : "";
+}
+
+static void testFaults() {
+    for (size_t from = 0; from < 5; from += 4) {
+        CHECK(strcmp(faultError(Fault::WRONG_START, from), "Unexpected segment response") == 0);
+        CHECK(strcmp(faultError(Fault::WHOLE_FILE, from), "Unexpected segment response") == 0);
+        CHECK(strcmp(faultError(Fault::WRONG_TOTAL, from), "Unexpected segment response") == 0);
+        CHECK(strcmp(faultError(Fault::GZIP, from), "Unexpected segment response") == 0);
+        CHECK(strcmp(faultError(Fault::SHORT_BODY, from), "Segment shorter than requested") == 0);
+        CHECK(strcmp(faultError(Fault::LONG_BODY, from), "Segment longer than requested") == 0);
+        CHECK(strcmp(faultError(Fault::CLOSE_EARLY, from), "Segment connection closed") == 0);
+        CHECK(strcmp(faultError(Fault::SILENT, from, 5), "Segment headers timed out") == 0);
+    }
+    CHECK(strcmp(faultError(Fault::REFUSE, 0), "Connection refused") == 0);
+
+    // A body that stops arriving
+    resetServer(60000);
+    server.trickle = 100;
+    OtaSegmentedDownload download;
+    download.setTimeouts(5000, 5000, 10000, 5);
+    CHECK(download.begin("fw.example.com", 443, "/fw.bin", true, 0, 60000, 60000, 1));
+    run(download, 0, 8192, 20);
+    CHECK(!download.hasError() && !download.isComplete());
+    fakeServer = [](FakeSocket&) {};
+    run(download, 0, 8192, 200);
+    CHECK(download.getError() && strcmp(download.getError(), "Segment stalled") == 0);
+
+    // Nothing to fetch, or nowhere to put the host
+    CHECK(!download.begin("fw.example.com", 443, "/fw.bin", true, 60000, 60000, 8192, 1));
+    CHECK(strcmp(download.getError(), "Invalid segment range") == 0);
+    CHECK(!download.begin("fw.example.com", 443, "/fw.bin", true, 0, 60000, 0, 1));
+    std::string longHost(OTA_MAX_HOST_LENGTH + 1, 'h');
+    CHECK(!download.begin(longHost.c_str(), 443, "/fw.bin", true, 0, 60000, 8192, 1));
+    CHECK(strcmp(download.getError(), "Host or path too long") == 0);
+    CHECK(!download.isActive());
+}
+
+int main() {
+    srand(5);
+    testBlockSizeFor();
+    testPlanning();
+    testReassembly();
+    testFirstClientTakeover();
+    testFaults();
+    fakeServer = nullptr;
+    return checkReport("segmented_download");
+}
@@ -0,0 +1,126 @@
+// Sources: src/OtaSha256.cpp src/OtaArena.cpp
+// Libraries: -lcrypto
+// The SOFTWARE backend against the FIPS 180-2 / NIST CAVP known answers, and
+// against the HARDWARE (mbedtls) backend for every length around the padding
+// boundaries and for update() calls split at every offset and misaligned.
+// On the host the mbedtls shim runs on OpenSSL, an independent reference.
+// OFFLOAD cannot start a task here and falls back to HARDWARE.
+
+#include "OtaSha256.h"
+#include "test_check.h"
+#include <string>
+#include <vector>
+
+static std::string hex(const uint8_t* digest) {
+    static const char DIGITS[] = "0123456789abcdef";
+    std::string out;
+    for (size_t i = 0; i < OtaSha256::DIGEST_SIZE; i++) {
+        out += DIGITS[digest[i] >> 4];
+        out += DIGITS[digest[i] & 15];
+    }
+    return out;
+}
+
+// Feeds data in slices of the given sizes, repeated until all is consumed
+static std::string hash(OtaHashBackend backend, const uint8_t* data, size_t length,
+                        const std::vector<size_t>& slices = std::vector<size_t>()) {
+    OtaSha256 sha;
+    sha.begin(backend);
+    size_t pos = 0;
+    for (size_t i = 0; pos < length; i++) {
+        size_t take = slices.empty() ? length : min(slices[i % slices.size()], length - pos);
+        sha.update(data + pos, take);
+        pos += take;
+    }
+    uint8_t digest[OtaSha256::DIGEST_SIZE];
+    CHECK(sha.finish(digest));
+    CHECK(!sha.isActive());
+    return hex(digest);
+}
+
+static std::string hash(OtaHashBackend backend, const std::string& text) {
+    return hash(backend, (const uint8_t*)text.data(), text.size());
+}
+
+static void testKnownAnswers() {
+    static const OtaHashBackend BACKENDS[] = {OtaHashBackend::SOFTWARE, OtaHashBackend::HARDWARE,
+                                              OtaHashBackend::OFFLOAD};
+    std::string million(1000000, 'a');
+    for (OtaHashBackend backend : BACKENDS) {
+        CHECK(hash(backend, "") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        CHECK(hash(backend, "abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        CHECK(hash(backend, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") ==
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        CHECK(hash(backend, "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopq"
+                            "klmnopqrlmnopqrsmnopqrstnopqrstu") ==
+              "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1");
+        CHECK(hash(backend, million) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    }
+
+    // 1M x 'a' in uneven slices that keep the block buffer partly filled
+    std::vector<size_t> slices = {1, 63, 65, 4095, 7};
+    CHECK(hash(OtaHashBackend::SOFTWARE, (const uint8_t*)million.data(), million.size(), slices) ==
+          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+static void testPaddingBoundaries() {
+    std::vector<uint8_t> data(300);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 37 + 11);
+
+    // Every length up to 2 blocks + 8 covers a final block with 55, 56 and 63 bytes
+    int wrong = 0;
+    for (size_t length = 0; length <= 200; length++) {
+        std::string expected = hash(OtaHashBackend::HARDWARE, data.data(), length);
+        if (hash(OtaHashBackend::SOFTWARE, data.data(), length) != expected && wrong++ < 3) {
+            printf("  length %u: whole update differs\n", (unsigned)length);
+        }
+
+        // One split at every offset, from an odd address
+        for (size_t split = 0; split <= length; split++) {
+            OtaSha256 sha;
+            sha.begin(OtaHashBackend::SOFTWARE);
+            sha.update(data.data() + 1, split);
+            sha.update(data.data() + 1 + split, length - split);
+            uint8_t digest[OtaSha256::DIGEST_SIZE];
+            sha.finish(digest);
+            if (hex(digest) != hash(OtaHashBackend::HARDWARE, data.data() + 1, length) && wrong++ < 3) {
+                printf("  length %u split at %u differs\n", (unsigned)length, (unsigned)split);
+            }
+        }
+    }
+    CHECK_EQ(wrong, 0);
+
+    // Byte-at-a-time and block-straddling slices over a longer message
+    std::vector<uint8_t> image(70000);
+    for (size_t i = 0; i < image.size(); i++) image[i] = (uint8_t)((i * 2654435761u) >> 13);
+    std::string expected = hash(OtaHashBackend::HARDWARE, image.data(), image.size());
+    static const size_t SLICES[][3] = {{1, 1, 1}, {55, 56, 57}, {63, 64, 65}, {1460, 1, 4096}};
+    for (const auto& slice : SLICES) {
+        std::vector<size_t> sizes(slice, slice + 3);
+        CHECK(hash(OtaHashBackend::SOFTWARE, image.data() + 3, image.size() - 3, sizes) ==
+              hash(OtaHashBackend::HARDWARE, image.data() + 3, image.size() - 3));
+        CHECK(hash(OtaHashBackend::SOFTWARE, image.data(), image.size(), sizes) == expected);
+    }
+}
+
+static void testLifecycle() {
+    OtaSha256 sha;
+    uint8_t digest[OtaSha256::DIGEST_SIZE];
+    CHECK(!sha.finish(digest));                  // Not begun
+    sha.update((const uint8_t*)"x", 1);          // Ignored
+    CHECK(sha.begin(OtaHashBackend::OFFLOAD));
+    CHECK(sha.getBackend() == OtaHashBackend::HARDWARE);
+    sha.update((const uint8_t*)"abc", 3);
+    CHECK(sha.begin(OtaHashBackend::SOFTWARE));  // Restart drops the earlier input
+    sha.update((const uint8_t*)"abc", 3);
+    CHECK(sha.finish(digest));
+    CHECK(hex(digest) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    CHECK(strcmp(OtaSha256::backendName(OtaHashBackend::OFFLOAD), "offload") == 0);
+}
+
+int main() {
+    testKnownAnswers();
+    testPaddingBoundaries();
+    testLifecycle();
+    return checkReport("sha256");
+}
@@ -0,0 +1,95 @@
+// Sources:
+// OtaSpscQueue with one producer and one consumer thread. Items carry a
+// sequence number and a payload derived from it, so a torn or reordered
+// copy shows up as a mismatch. Run with SANITIZE=thread to check the
+// memory ordering as well.
+
+#include "OtaSpscQueue.h"
+#include "test_check.h"
+#include <stdint.h>
+#include <thread>
+
+struct Item {
+    uint32_t sequence;
+    uint32_t payload[7];
+};
+
+static void fill(Item& item, uint32_t sequence) {
+    item.sequence = sequence;
+    for (uint32_t i = 0; i < 7; i++) item.payload[i] = sequence * 2654435761u + i;
+}
+
+static bool intact(const Item& item) {
+    for (uint32_t i = 0; i < 7; i++) {
+        if (item.payload[i] != item.sequence * 2654435761u + i) return false;
+    }
+    return true;
+}
+
+static void testSingleThread() {
+    OtaSpscQueue<int, 4> queue;
+    int value = 0;
+    CHECK(!queue.pop(value));
+    CHECK_EQ(queue.size(), 0);
+    for (int i = 0; i < 4; i++) CHECK(queue.push(i));
+    CHECK(queue.isFull());
+    CHECK(!queue.push(99));
+    CHECK_EQ(queue.size(), 4);
+
+    // Wrap the indexes a few times
+    for (int i = 4; i < 40; i++) {
+        CHECK(queue.pop(value));
+        CHECK_EQ(value, i - 4);
+        CHECK(queue.push(i));
+    }
+    for (int i = 36; i < 40; i++) {
+        CHECK(queue.pop(value));
+        CHECK_EQ(value, i);
+    }
+    CHECK(!queue.pop(value));
+}
+
+static void testTwoThreads() {
+    static const uint32_t COUNT = 200000;
+    static OtaSpscQueue<Item, 16> queue;
+    uint32_t fullRetries = 0;
+
+    std::thread producer([&fullRetries]() {
+        Item item;
+        for (uint32_t sequence = 0; sequence < COUNT; sequence++) {
+            fill(item, sequence);
+            while (!queue.push(item)) {
+                fullRetries++;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t expected = 0;
+    uint32_t outOfOrder = 0;
+    uint32_t torn = 0;
+    Item item;
+    while (expected < COUNT) {
+        if (!queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (item.sequence != expected) outOfOrder++;
+        if (!intact(item)) torn++;
+        expected = item.sequence + 1;
+    }
+    producer.join();
+
+    CHECK_EQ(outOfOrder, 0);
+    CHECK_EQ(torn, 0);
+    CHECK_EQ(expected, COUNT);
+    CHECK(!queue.pop(item));
+    printf("spsc_queue: %u items, producer found the queue full %u times\n", (unsigned)COUNT,
+           (unsigned)fullRetries);
+}
+
+int main() {
+    testSingleThread();
+    testTwoThreads();
+    return checkReport("spsc_queue");
+}
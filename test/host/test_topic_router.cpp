@@ -0,0 +1,271 @@
+// Sources: src/OtaTopicRouter.cpp src/OtaMqttEngine.cpp
+// OtaTopicRouter: '+' and '#' matching, "$" topics, handlers removed while a
+// message is being dispatched, label space reuse, the table limits, and the
+// broker subscriptions it sends.
+
+#include "OtaTopicRouter.h"
+#include "fake_async_client.h"
+#include "test_check.h"
+#include <string>
+
+struct Recorder {
+    int calls;
+    std::string lastTopic;
+};
+
+static void record(const char* topic, uint8_t*, unsigned int, void* context) {
+    Recorder* recorder = (Recorder*)context;
+    recorder->calls++;
+    recorder->lastTopic = topic;
+}
+
+static size_t send(OtaTopicRouter& router, const char* topic) {
+    uint8_t payload[] = "{}";
+    return router.dispatch(topic, payload, 2);
+}
+
+static void testWildcards() {
+    OtaTopicRouter router;
+    Recorder plus = {0, ""}, hash = {0, ""}, exact = {0, ""}, both = {0, ""}, all = {0, ""}, sys = {0, ""};
+    CHECK(router.subscribe("ota/+/update", record, &plus));
+    CHECK(router.subscribe("ota/#", record, &hash));
+    CHECK(router.subscribe("ota/dev1/update", record, &exact));
+    CHECK(router.subscribe("+/dev1/#", record, &both));
+    CHECK(router.subscribe("#", record, &all));
+
+    CHECK_EQ(send(router, "ota/dev1/update"), 5);
+    CHECK_EQ(send(router, "ota/dev2/update"), 3);           // ota/+/update, ota/#, #
+    CHECK_EQ(send(router, "ota/dev1/update/extra"), 3);     // ota/#, +/dev1/#, #
+    CHECK_EQ(send(router, "ota"), 2);                       // "ota/#" matches its parent
+    CHECK_EQ(send(router, "other/dev1"), 2);                // "+/dev1/#" too
+    CHECK_EQ(send(router, "ota//update"), 3);               // '+' matches an empty level
+    CHECK_EQ(send(router, "otax/dev1/update"), 2);
+    CHECK_EQ(plus.calls, 3);
+    CHECK_EQ(exact.calls, 1);
+    CHECK(plus.lastTopic == "ota//update");
+
+    // A leading wildcard does not match "$" topics; a literal "$" level does
+    CHECK_EQ(send(router, "$SYS/dev1/load"), 0);
+    CHECK(router.subscribe("$SYS/#", record, &sys));
+    CHECK_EQ(send(router, "$SYS/dev1/load"), 1);
+    CHECK_EQ(sys.calls, 1);
+    CHECK_EQ(send(router, "ota/$SYS"), 2);                  // Only the first level is special
+}
+
+static void testFilters() {
+    OtaTopicRouter router;
+    Recorder recorder = {0, ""};
+    CHECK(!router.subscribe(nullptr, record, &recorder));
+    CHECK(!router.subscribe("", record, &recorder));
+    CHECK(!router.subscribe("a/b#", record, &recorder));
+    CHECK(!router.subscribe("a/#/b", record, &recorder));
+    CHECK(!router.subscribe("a+/b", record, &recorder));
+    CHECK(!router.subscribe("a/b", nullptr, &recorder));
+
+    // The same handler and context again is one subscription
+    CHECK(router.subscribe("a/b", record, &recorder));
+    CHECK(router.subscribe("a/b", record, &recorder));
+    CHECK_EQ(send(router, "a/b"), 1);
+    router.unsubscribe("a/b", record, &recorder);
+    CHECK_EQ(send(router, "a/b"), 0);
+    router.unsubscribe("a/b", record, &recorder);           // Unknown: ignored
+    router.unsubscribe("x/y", record, &recorder);
+}
+
+// ============================================================================
+// REMOVAL DURING DISPATCH
+// ============================================================================
+
+struct Remover {
+    OtaTopicRouter* router;
+    const char* filter;         // Removed on the first call
+    void* context;
+    int calls;
+};
+
+static void removeOnCall(const char* topic, uint8_t*, unsigned int, void* context) {
+    Remover* remover = (Remover*)context;
+    if (remover->calls++ == 0) remover->router->unsubscribe(remover->filter, record, remover->context);
+}
+
+static void removeSelf(const char* topic, uint8_t*, unsigned int, void* context) {
+    Remover* remover = (Remover*)context;
+    remover->calls++;
+    remover->router->unsubscribe(remover->filter, removeSelf, remover);
+}
+
+static void testRemovalDuringDispatch() {
+    OtaTopicRouter router;
+    Recorder later = {0, ""}, other = {0, ""};
+    Remover self = {&router, "a/b/c", nullptr, 0};
+    Remover killer = {&router, "a/b/c", &later, 0};
+
+    // killer runs first and removes later, which must not be called then
+    CHECK(router.subscribe("a/b/c", removeOnCall, &killer));
+    CHECK(router.subscribe("a/b/c", removeSelf, &self));
+    CHECK(router.subscribe("a/b/c", record, &later));
+    CHECK(router.subscribe("a/+/c", record, &other));
+    CHECK_EQ(send(router, "a/b/c"), 3);
+    CHECK_EQ(self.calls, 1);
+    CHECK_EQ(later.calls, 0);
+    CHECK_EQ(other.calls, 1);
+    CHECK_EQ(send(router, "a/b/c"), 2);                     // killer and a/+/c
+    CHECK_EQ(self.calls, 1);
+
+    // A handler removing the last handler of its own wildcard node: the node
+    // is only freed after the dispatch, and can be used again
+    OtaTopicRouter second;
+    Remover wildcard = {&second, "x/+", nullptr, 0};
+    Recorder exactY = {0, ""}, fresh = {0, ""};
+    CHECK(second.subscribe("x/+", removeSelf, &wildcard));
+    CHECK(second.subscribe("x/y", record, &exactY));
+    CHECK_EQ(send(second, "x/y"), 2);
+    CHECK_EQ(send(second, "x/y"), 1);
+    CHECK_EQ(wildcard.calls, 1);
+    CHECK(second.subscribe("x/+/d", record, &fresh));
+    CHECK_EQ(send(second, "x/y/d"), 1);
+    CHECK_EQ(fresh.calls, 1);
+    CHECK_EQ(exactY.calls, 2);
+}
+
+// ============================================================================
+// LIMITS
+// ============================================================================
+
+static void testLabelSpace() {
+    OtaTopicRouter router;
+    Recorder first = {0, ""}, second = {0, ""}, third = {0, ""};
+    std::string a = "a/" + std::string(200, 'x');
+    std::string b = "b/" + std::string(200, 'y');
+    std::string c = "c/" + std::string(200, 'z');
+    CHECK(router.subscribe(a.c_str(), record, &first));
+    CHECK(router.subscribe(b.c_str(), record, &second));
+    CHECK(!router.subscribe(c.c_str(), record, &third));    // 603 bytes of labels
+
+    // Removing a closes its gap, so c fits and b is still found
+    router.unsubscribe(a.c_str(), record, &first);
+    CHECK(router.subscribe(c.c_str(), record, &third));
+    CHECK_EQ(send(router, b.c_str()), 1);
+    CHECK_EQ(send(router, c.c_str()), 1);
+    CHECK_EQ(send(router, a.c_str()), 0);
+    CHECK_EQ(second.calls, 1);
+    CHECK_EQ(third.calls, 1);
+
+    // Repeated churn does not leak label space
+    for (int i = 0; i < 20; i++) {
+        std::string d = "d/" + std::string(100, (char)('0' + i % 10));
+        CHECK(router.subscribe(d.c_str(), record, &first));
+        CHECK_EQ(send(router, d.c_str()), 1);
+        router.unsubscribe(d.c_str(), record, &first);
+    }
+    CHECK_EQ(send(router, b.c_str()), 1);
+
+    // A level longer than 255 bytes is refused
+    std::string e(300, 'e');
+    CHECK(!router.subscribe(e.c_str(), record, &first));
+}
+
+static void testNodeLimit() {
+    OtaTopicRouter router;
+    Recorder recorder = {0, ""};
+    char filter[16];
+    // Node 0 is the root: 7 x 4 levels and one more leave two nodes free
+    for (unsigned i = 0; i < 7; i++) {
+        snprintf(filter, sizeof(filter), "n%u/a/b/c", i);
+        CHECK(router.subscribe(filter, record, &recorder));
+    }
+    CHECK(router.subscribe("m", record, &recorder));
+    // Needs three nodes with two free: the two added levels are dropped again
+    CHECK(!router.subscribe("x/y/z", record, &recorder));
+    CHECK(router.subscribe("p", record, &recorder));
+    CHECK(router.subscribe("q", record, &recorder));
+    CHECK(!router.subscribe("r", record, &recorder));
+    CHECK_EQ(send(router, "q"), 1);
+    CHECK_EQ(send(router, "x/y/z"), 0);
+
+    router.unsubscribe("p", record, &recorder);
+    CHECK(router.subscribe("r", record, &recorder));
+}
+
+static void testHandlerLimit() {
+    OtaTopicRouter router;
+    Recorder recorders[OtaTopicRouter::MAX_HANDLERS + 1];
+    for (size_t i = 0; i <= OtaTopicRouter::MAX_HANDLERS; i++) recorders[i] = {0, ""};
+    for (size_t i = 0; i < OtaTopicRouter::MAX_HANDLERS; i++) {
+        CHECK(router.subscribe(i % 2 ? "t/odd" : "t/even", record, &recorders[i]));
+    }
+    Recorder& extra = recorders[OtaTopicRouter::MAX_HANDLERS];
+    CHECK(!router.subscribe("t/odd", record, &extra));
+    CHECK(!router.subscribe("t/new", record, &extra));
+    CHECK_EQ(send(router, "t/odd"), OtaTopicRouter::MAX_HANDLERS / 2);
+    CHECK_EQ(send(router, "t/+"), 0);                       // Wildcards only match in filters
+
+    // Subscription order is call order, and a freed slot is reused
+    router.unsubscribe("t/even", record, &recorders[0]);
+    CHECK(router.subscribe("t/new", record, &extra));
+    CHECK_EQ(send(router, "t/new"), 1);
+    CHECK_EQ(send(router, "t/even"), OtaTopicRouter::MAX_HANDLERS / 2 - 1);
+    CHECK_EQ(recorders[0].calls, 0);
+    CHECK_EQ(recorders[2].calls, 1);
+}
+
+// ============================================================================
+// BROKER SUBSCRIPTIONS
+// ============================================================================
+
+static void testBrokerSubscriptions() {
+    PubSubClient client;
+    OtaTopicRouter router;
+    router.attach(client);
+    Recorder first = {0, ""}, second = {0, ""};
+
+    // Offline: nothing is sent until the connection comes up
+    CHECK(router.subscribe("ota/+/update", record, &first));
+    CHECK(router.subscribe("ota/#", record, &second));
+    CHECK(client.subscribed.empty());
+    CHECK(!router.loop());
+    client.isConnected = true;
+    CHECK(router.loop());
+    CHECK_EQ(client.subscribed.size(), 2);
+    CHECK(std::find(client.subscribed.begin(), client.subscribed.end(), "ota/+/update") != client.subscribed.end());
+    CHECK(std::find(client.subscribed.begin(), client.subscribed.end(), "ota/#") != client.subscribed.end());
+    CHECK(router.loop());
+    CHECK_EQ(client.subscribed.size(), 2);                  // Only on reconnect
+
+    // One broker subscription per filter, whatever the number of handlers
+    client.subscribed.clear();
+    CHECK(router.subscribe("ota/+/update", record, &second));
+    CHECK(client.subscribed.empty());
+    router.unsubscribe("ota/+/update", record, &first);
+    CHECK(client.unsubscribed.empty());
+    router.unsubscribe("ota/+/update", record, &second);
+    CHECK_EQ(client.unsubscribed.size(), 1);
+    CHECK(client.unsubscribed[0] == "ota/+/update");
+
+    // Messages from the client reach the handlers
+    client.deliver("ota/dev1/update", "{}");
+    CHECK_EQ(second.calls, 1);
+    CHECK(second.lastTopic == "ota/dev1/update");
+
+    // After a reconnect only the filters still in use are sent
+    client.subscribed.clear();
+    client.isConnected = false;
+    CHECK(!router.loop());
+    client.isConnected = true;
+    CHECK(router.loop());
+    CHECK_EQ(client.subscribed.size(), 1);
+    CHECK(client.subscribed[0] == "ota/#");
+    CHECK(router.publish("ota/dev1/status", "{}"));
+    CHECK_EQ(client.published.size(), 1);
+}
+
+int main() {
+    testWildcards();
+    testFilters();
+    testRemovalDuringDispatch();
+    testLabelSpace();
+    testNodeLimit();
+    testHandlerLimit();
+    testBrokerSubscriptions();
+    return checkReport("topic_router");
+}
@@ -0,0 +1,256 @@
+// Sources: src/OtaVersion.cpp
+// OtaVersion against the SemVer 2.0.0 spec: the official validation regex
+// decides which strings are versions, and a plain reference implementation
+// of the precedence rules (spec section 11) decides their order. Random
+// versions then check that compare() agrees with it and is a total order:
+// antisymmetric, transitive, and consistent with sorting.
+
+#include "OtaVersion.h"
+#include "test_check.h"
+#include <regex>
+#include <string>
+#include <vector>
+
+// Compile time: OTA_VERSION rejects invalid literals with a static_assert
+static_assert(OtaVersion::parse("1.2.3").isValid(), "plain version");
+static_assert(OtaVersion::parse("1.2.3-rc.1+build.5").getPatch() == 3, "parsed by the compiler");
+static_assert(!OtaVersion::parse("1.2").isValid(), "missing patch");
+static_assert(OTA_VERSION("10.20.30").getMinor() == 20, "version literal");
+
+static const std::regex SEMVER(
+    "^(0|[1-9]\\d*)\\.(0|[1-9]\\d*)\\.(0|[1-9]\\d*)"
+    "(?:-((?:0|[1-9]\\d*|\\d*[a-zA-Z-][0-9a-zA-Z-]*)(?:\\.(?:0|[1-9]\\d*|\\d*[a-zA-Z-][0-9a-zA-Z-]*))*))?"
+    "(?:\\+([0-9a-zA-Z-]+(?:\\.[0-9a-zA-Z-]+)*))?$");
+
+struct Reference {
+    bool valid;
+    unsigned long long core[3];
+    std::vector<std::string> prerelease;
+};
+
+static bool isNumeric(const std::string& identifier) {
+    return identifier.find_first_not_of("0123456789") == std::string::npos;
+}
+
+static Reference reference(const std::string& text) {
+    Reference result = {false, {0, 0, 0}, {}};
+    std::smatch match;
+    if (!std::regex_match(text, match, SEMVER)) return result;
+    for (int i = 0; i < 3; i++) {
+        std::string component = match[i + 1].str();
+        if (component.size() > 7) return result;
+        result.core[i] = std::stoull(component);
+        if (result.core[i] > OtaVersion::MAX_COMPONENT) return result; // The library's documented limit
+    }
+    if (text.size() > OtaVersion::MAX_LENGTH) return result;
+    std::string prerelease = match[4].str();
+    size_t start = 0;
+    while (!prerelease.empty()) {
+        size_t dot = prerelease.find('.', start);
+        result.prerelease.push_back(prerelease.substr(start, dot - start));
+        if (dot == std::string::npos) break;
+        start = dot + 1;
+    }
+    result.valid = true;
+    return result;
+}
+
+// Spec section 11, written out as directly as possible
+static int referenceCompare(const Reference& a, const Reference& b) {
+    if (a.valid != b.valid) return a.valid ? 1 : -1;
+    if (!a.valid) return 0;
+    for (int i = 0; i < 3; i++) {
+        if (a.core[i] != b.core[i]) return a.core[i] < b.core[i] ? -1 : 1;
+    }
+    if (a.prerelease.empty() != b.prerelease.empty()) return a.prerelease.empty() ? 1 : -1;
+    for (size_t i = 0; i < a.prerelease.size() && i < b.prerelease.size(); i++) {
+        const std::string& x = a.prerelease[i];
+        const std::string& y = b.prerelease[i];
+        bool xNumeric = isNumeric(x);
+        bool yNumeric = isNumeric(y);
+        if (xNumeric && yNumeric) {
+            unsigned long long xValue = std::stoull(x);
+            unsigned long long yValue = std::stoull(y);
+            if (xValue != yValue) return xValue < yValue ? -1 : 1;
+        } else if (xNumeric != yNumeric) {
+            return xNumeric ? -1 : 1;
+        } else if (x != y) {
+            return x < y ? -1 : 1;
+        }
+    }
+    if (a.prerelease.size() != b.prerelease.size()) return a.prerelease.size() < b.prerelease.size() ? -1 : 1;
+    return 0;
+}
+
+static int sign(int value) {
+    return value < 0 ? -1 : value > 0 ? 1 : 0;
+}
+
+static void testSpecExamples() {
+    // Spec section 11: each is lower than the next
+    const char* const ORDER[] = {
+        "1.0.0-alpha", "1.0.0-alpha.1", "1.0.0-alpha.beta", "1.0.0-beta", "1.0.0-beta.2",
+        "1.0.0-beta.11", "1.0.0-rc.1", "1.0.0", "2.0.0", "2.1.0", "2.1.1"
+    };
+    const size_t count = sizeof(ORDER) / sizeof(ORDER[0]);
+    for (size_t i = 0; i < count; i++) {
+        OtaVersion a = OtaVersion::parse(ORDER[i]);
+        CHECK(a.isValid());
+        CHECK(a == a);
+        for (size_t j = i + 1; j < count; j++) {
+            OtaVersion b = OtaVersion::parse(ORDER[j]);
+            if (!(a < b) || !(b > a) || a == b) {
+                CHECK(!"spec order");
+                printf("  %s should rank below %s\n", ORDER[i], ORDER[j]);
+            }
+        }
+    }
+
+    // Build metadata is ignored for precedence
+    CHECK(OtaVersion::parse("1.0.0+20130313144700") == OtaVersion::parse("1.0.0+exp.sha.5114f85"));
+    CHECK(OtaVersion::parse("1.0.0-beta+exp.sha.5114f85") == OtaVersion::parse("1.0.0-beta"));
+    // Numeric identifiers compare numerically, below alphanumeric ones
+    CHECK(OtaVersion::parse("1.0.0-2") < OtaVersion::parse("1.0.0-10"));
+    CHECK(OtaVersion::parse("1.0.0-999") < OtaVersion::parse("1.0.0-a"));
+    CHECK(OtaVersion::parse("1.0.0-a-1") > OtaVersion::parse("1.0.0-a"));
+    // Invalid ranks below everything, and equal to other invalid versions
+    CHECK(OtaVersion::parse("banana") < OtaVersion::parse("0.0.0-0"));
+    CHECK(OtaVersion::parse("banana") == OtaVersion::parse("1.0"));
+    CHECK(OtaVersion::parse(nullptr) == OtaVersion());
+
+    OtaVersion version = OtaVersion::parse("1048575.0.7-x.7.z.92+meta");
+    CHECK_EQ(version.getMajor(), 1048575);
+    CHECK_EQ(version.getMinor(), 0);
+    CHECK_EQ(version.getPatch(), 7);
+    CHECK(version.isPrerelease());
+    CHECK(strcmp(version.c_str(), "1048575.0.7-x.7.z.92+meta") == 0);
+}
+
+static void testValidation() {
+    // From the semver.org list of valid and invalid strings, plus library limits
+    const char* const VALID[] = {
+        "0.0.4", "1.2.3", "10.20.30", "1.1.2-prerelease+meta", "1.1.2+meta", "1.1.2+meta-valid", "1.0.0-alpha",
+        "1.0.0-beta", "1.0.0-alpha.beta", "1.0.0-alpha.beta.1", "1.0.0-alpha.1", "1.0.0-alpha0.valid",
+        "1.0.0-alpha.0valid", "1.0.0-alpha-a.b-c-somethinglong+build.1-aef.1-its-okay", "1.0.0-rc.1+build.1",
+        "2.0.0-rc.1+build.123", "1.2.3-beta", "10.2.3-DEV-SNAPSHOT", "1.2.3-SNAPSHOT-123", "2.0.0+build.1848",
+        "2.0.1-alpha.1227", "1.0.0-alpha+beta", "1.2.3----RC-SNAPSHOT.12.9.1--.12+788", "1.2.3----R-S.12.9.1--.12+meta",
+        "1.2.3----RC-SNAPSHOT.12.9.1--.12", "1.0.0+0.build.1-rc.10000aaa-kk-0.1", "1.0.0-0A.is.legal",
+        "1048575.1048575.1048575", "1.0.0+001", "1.0.0-0.0"
+    };
+    const char* const INVALID[] = {
+        "1", "1.2", "1.2.3-0123", "1.2.3-0123.0123", "1.1.2+.123", "+invalid", "-invalid", "-invalid+invalid",
+        "-invalid.01", "alpha", "alpha.beta", "alpha.beta.1", "alpha.1", "alpha+beta", "alpha_beta", "alpha.",
+        "alpha..", "beta", "1.0.0-alpha_beta", "-alpha.", "1.0.0-alpha..", "1.0.0-alpha..1", "1.0.0-alpha...1",
+        "1.0.0-alpha....1", "1.0.0-alpha.....1", "1.0.0-alpha......1", "1.0.0-alpha.......1", "01.1.1", "1.01.1",
+        "1.1.01", "1.2", "1.2.3.DEV", "1.2-SNAPSHOT", "1.2.31.2.3----RC-SNAPSHOT.12.09.1--..12+788", "1.2-RC-SNAPSHOT",
+        "-1.0.3-gamma+b7718", "+justmeta", "9.8.7+meta+meta", "9.8.7-whatever+meta+meta",
+        "99999999999999999999999.999999999999999999.99999999999999999----RC-SNAPSHOT.12.09.1--------------------------------..12",
+        "1048576.0.0", "1.2.3-", "1.2.3+", "1.2.3 ", " 1.2.3", ""
+    };
+    for (const char* text : VALID) {
+        if (!OtaVersion::parse(text).isValid() || !reference(text).valid) {
+            CHECK(!"valid version rejected");
+            printf("  %s\n", text);
+        }
+    }
+    for (const char* text : INVALID) {
+        if (OtaVersion::parse(text).isValid() || reference(text).valid) {
+            CHECK(!"invalid version accepted");
+            printf("  %s\n", text);
+        }
+    }
+    std::string longest = "1.0.0-" + std::string(OtaVersion::MAX_LENGTH - 6, 'a');
+    CHECK(OtaVersion::parse(longest.c_str()).isValid());
+    longest += "a";
+    CHECK(!OtaVersion::parse(longest.c_str()).isValid());
+}
+
+static uint32_t randomState = 7;
+static uint32_t nextRandom(uint32_t range) {
+    randomState = randomState * 1103515245u + 12345u;
+    return (randomState >> 8) % range;
+}
+
+// Versions close enough to each other that their order is decided everywhere:
+// in the core, in pre-release identifiers of either kind, and in their count.
+// One in eight is mutated into something that may or may not be valid.
+static std::string randomVersion() {
+    static const char* const WORDS[] = {"alpha", "beta", "rc", "a", "b", "A", "Z", "x-1", "-", "0a", "1a"};
+    std::string text = std::to_string(nextRandom(3)) + "." + std::to_string(nextRandom(3)) + "." +
+                       std::to_string(nextRandom(3));
+    if (nextRandom(3) > 0) {
+        size_t count = 1 + nextRandom(3);
+        for (size_t i = 0; i < count; i++) {
+            text += i == 0 ? "-" : ".";
+            text += nextRandom(2) ? std::to_string(nextRandom(12)) : WORDS[nextRandom(11)];
+        }
+    }
+    if (nextRandom(4) == 0) text += "+build." + std::to_string(nextRandom(100));
+    if (nextRandom(8) == 0) {
+        static const char MUTATIONS[] = "0.-+_a9";
+        size_t at = nextRandom((uint32_t)text.size() + 1);
+        text.insert(at, 1, MUTATIONS[nextRandom(sizeof(MUTATIONS) - 1)]);
+    }
+    return text;
+}
+
+static void testProperties() {
+    std::vector<std::string> texts;
+    for (int i = 0; i < 600; i++) texts.push_back(randomVersion());
+    std::vector<OtaVersion> versions;
+    std::vector<Reference> references;
+    for (const std::string& text : texts) {
+        versions.push_back(OtaVersion::parse(text.c_str()));
+        references.push_back(reference(text));
+    }
+
+    int validCount = 0;
+    int mismatches = 0;
+    for (size_t i = 0; i < texts.size(); i++) {
+        if (versions[i].isValid() != references[i].valid) {
+            if (mismatches++ < 5) printf("  validity differs for %s\n", texts[i].c_str());
+        }
+        validCount += versions[i].isValid();
+    }
+    CHECK_EQ(mismatches, 0);
+    CHECK(validCount > 400);
+
+    // Agreement with the reference, and antisymmetry
+    mismatches = 0;
+    for (size_t i = 0; i < texts.size(); i++) {
+        for (size_t j = 0; j < texts.size(); j++) {
+            int order = versions[i].compare(versions[j]);
+            if (sign(order) != referenceCompare(references[i], references[j]) ||
+                sign(order) != -sign(versions[j].compare(versions[i]))) {
+                if (mismatches++ < 5) printf("  %s vs %s: %d\n", texts[i].c_str(), texts[j].c_str(), order);
+            }
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+
+    // Transitivity over triples
+    int violations = 0;
+    for (int n = 0; n < 200000; n++) {
+        const OtaVersion& a = versions[nextRandom(600)];
+        const OtaVersion& b = versions[nextRandom(600)];
+        const OtaVersion& c = versions[nextRandom(600)];
+        if (a <= b && b <= c && !(a <= c)) violations++;
+        if (a == b && b == c && a != c) violations++;
+    }
+    CHECK_EQ(violations, 0);
+
+    // Sorted with compare(), neighbours are ordered by the reference too
+    std::vector<size_t> order;
+    for (size_t i = 0; i < versions.size(); i++) order.push_back(i);
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) { return versions[x] < versions[y]; });
+    for (size_t i = 1; i < order.size(); i++) {
+        CHECK(referenceCompare(references[order[i - 1]], references[order[i]]) <= 0);
+    }
+}
+
+int main() {
+    testSpecExamples();
+    testValidation();
+    testProperties();
+    return checkReport("version");
+}
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Builds a CA certificate bundle for OtaCertBundle.
+
+Usage:
+    gen_ca_bundle.py -o data/certs/ca.bundle cacert.pem [more.pem ...]
+    gen_ca_bundle.py -o include/ca_bundle.h --header cacert.pem
+
+Input files are PEM (any number of certificates each) or DER. The output is
+the binary bundle, or with --header a C array for setCABundle(). See
+OtaCertBundle.h for the layout. No third-party modules are needed.
+"""
+
+import argparse
+import base64
+import re
+import struct
+import sys
+
+MAGIC = b"OTCB"
+FORMAT_VERSION = 1
+HEADER = struct.Struct("<4sBBH")
+ENTRY = struct.Struct("<III")
+MAX_CERT_SIZE = 4096  # OtaCertBundle::MAX_CERT_SIZE
+
+PEM_BLOCK = re.compile(rb"-----BEGIN CERTIFICATE-----(.+?)-----END CERTIFICATE-----", re.S)
+
+
+def read_tlv(data, pos):
+    """Returns (start of value, end of value) of the DER element at pos."""
+    length = data[pos + 1]
+    pos += 2
+    if length & 0x80:
+        count = length & 0x7F
+        length = int.from_bytes(data[pos:pos + count], "big")
+        pos += count
+    return pos, pos + length
+
+
+def subject_name(der):
+    """DER of the subject Name, tag and length included, as mbedtls' subject_raw."""
+    cert, _ = read_tlv(der, 0)                   # Certificate
+    pos, _ = read_tlv(der, cert)                 # TBSCertificate
+    if der[pos] == 0xA0:                         # Explicit version
+        pos = read_tlv(der, pos)[1]
+    for _ in range(4):                           # serialNumber, signature, issuer, validity
+        pos = read_tlv(der, pos)[1]
+    return der[pos:read_tlv(der, pos)[1]]
+
+
+def fnv1a(data):
+    value = 2166136261
+    for byte in data:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def load_certificates(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    blocks = PEM_BLOCK.findall(data)
+    if blocks:
+        return [base64.b64decode(b"".join(block.split())) for block in blocks]
+    return [data]
+
+
+def build(certificates):
+    unique = {}
+    for der in certificates:
+        if len(der) > MAX_CERT_SIZE:
+            print("skipping certificate of %d bytes" % len(der), file=sys.stderr)
+            continue
+        unique[der] = fnv1a(subject_name(der))
+    entries = sorted(unique.items(), key=lambda item: (item[1], item[0]))
+
+    offset = HEADER.size + ENTRY.size * len(entries)
+    index = b""
+    body = b""
+    for der, hash_value in entries:
+        index += ENTRY.pack(hash_value, offset + len(body), len(der))
+        body += der
+    return HEADER.pack(MAGIC, FORMAT_VERSION, 0, len(entries)) + index + body, len(entries)
+
+
+def write_header(path, bundle):
+    with open(path, "w") as f:
+        f.write("// Generated by tools/gen_ca_bundle.py\n")
+        f.write("#pragma once\n#include <stdint.h>\n\n")
+        f.write("static const uint8_t CA_BUNDLE[%d] = {\n" % len(bundle))
+        for i in range(0, len(bundle), 16):
+            f.write("    " + ", ".join("0x%02x" % b for b in bundle[i:i + 16]) + ",\n")
+        f.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build an OtaCertBundle CA bundle")
+    parser.add_argument("inputs", nargs="+", help="PEM or DER certificate files")
+    parser.add_argument("-o", "--output", required=True)
+    parser.add_argument("--header", action="store_true", help="write a C array instead of the binary bundle")
+    args = parser.parse_args()
+
+    certificates = []
+    for path in args.inputs:
+        certificates.extend(load_certificates(path))
+    if len(certificates) > 0xFFFF:
+        sys.exit("too many certificates")
+    bundle, count = build(certificates)
+
+    if args.header:
+        write_header(args.output, bundle)
+    else:
+        with open(args.output, "wb") as f:
+            f.write(bundle)
+    print("%d certificates, %d bytes" % (count, len(bundle)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Builds an OTADIFF1 delta patch for OtaDeltaPatcher.
+
+Usage:
+    gen_delta_patch.py old.bin new.bin -o update.patch
+    gen_delta_patch.py --gzip old.bin new.bin -o update.patch.gz
+    gen_delta_patch.py --apply old.bin update.patch -o new.bin
+
+old.bin is the image running on the devices (the base_version build), new.bin
+the image they should end up with. See OtaDeltaPatcher.h for the layout. The
+diff bytes of unchanged code are mostly zero, so the patch itself is about as
+large as the image: publish it with --gzip, served with Content-Encoding: gzip
+(the device decompresses before patching). --apply rebuilds the new image the way the
+device does, to check a patch before publishing it. No third-party modules
+are needed.
+"""
+
+import argparse
+import gzip
+import struct
+import sys
+
+MAGIC = b"OTADIFF1"
+HEADER = struct.Struct("<8sI")
+CONTROL = struct.Struct("<IIi")
+KEY_SIZE = 8            # Bytes hashed to find match candidates
+CANDIDATES = 8          # Old offsets kept per key
+MIN_MATCH = 16          # Shorter matches are sent as extra bytes
+EXTEND_SLACK = 64       # Stop extending a match after this many bytes without gain
+
+
+def index_old(old):
+    index = {}
+    for pos in range(len(old) - KEY_SIZE + 1):
+        entries = index.setdefault(old[pos:pos + KEY_SIZE], [])
+        if len(entries) < CANDIDATES:
+            entries.append(pos)
+    return index
+
+
+def extend(old, new, old_pos, new_pos):
+    """Length of the diff region at old_pos/new_pos, bsdiff style: grows while
+    more than half of the bytes since the start still match."""
+    matched = 0
+    best_score = 0
+    length = 0
+    limit = min(len(old) - old_pos, len(new) - new_pos)
+    i = 0
+    while i < limit and i - length <= EXTEND_SLACK:
+        if old[old_pos + i] == new[new_pos + i]:
+            matched += 1
+        i += 1
+        if matched * 2 - i > best_score * 2 - length:
+            best_score = matched
+            length = i
+    return length
+
+
+def find_match(old, new, index, new_pos, expected):
+    """Best (old offset, length) for new[new_pos:], or None."""
+    candidates = list(index.get(new[new_pos:new_pos + KEY_SIZE], ()))
+    if 0 <= expected < len(old) and expected not in candidates:
+        candidates.append(expected)
+    best = None
+    for old_pos in candidates:
+        length = extend(old, new, old_pos, new_pos)
+        if length >= MIN_MATCH and (best is None or length > best[1]):
+            best = (old_pos, length)
+    return best
+
+
+def diff(old, new):
+    if not new:
+        raise ValueError("new image is empty")
+    index = index_old(old)
+    patch = bytearray(HEADER.pack(MAGIC, len(new)))
+
+    # The current block: its diff region, then extra bytes up to the next match
+    block_old, block_new, block_len = 0, 0, 0
+    scan = 0
+    while scan < len(new):
+        match = find_match(old, new, index, scan, block_old + scan - block_new)
+        if match is None:
+            scan += 1
+            continue
+        old_pos, length = match
+        emit_block(patch, old, new, block_old, block_new, block_len, scan, old_pos - (block_old + block_len))
+        block_old, block_new, block_len = old_pos, scan, length
+        scan += length
+
+    emit_block(patch, old, new, block_old, block_new, block_len, len(new), 0)
+    return bytes(patch)
+
+
+def emit_block(patch, old, new, old_pos, new_pos, length, extra_end, seek):
+    extra = new[new_pos + length:extra_end]
+    patch += CONTROL.pack(length, len(extra), seek)
+    patch += bytes((new[new_pos + i] - old[old_pos + i]) & 0xFF for i in range(length))
+    patch += extra
+
+
+def apply(old, patch):
+    """Reference applier with the checks of OtaDeltaPatcher."""
+    magic, new_size = HEADER.unpack_from(patch, 0)
+    if magic != MAGIC or new_size == 0:
+        raise ValueError("not an OTADIFF1 patch")
+    pos = HEADER.size
+    old_pos = 0
+    new = bytearray()
+    while len(new) < new_size:
+        diff_len, extra_len, seek = CONTROL.unpack_from(patch, pos)
+        pos += CONTROL.size
+        if diff_len + extra_len > new_size - len(new) or old_pos + diff_len > len(old):
+            raise ValueError("control block out of range at offset %d" % (pos - CONTROL.size))
+        new += bytes((old[old_pos + i] + patch[pos + i]) & 0xFF for i in range(diff_len))
+        pos += diff_len
+        new += patch[pos:pos + extra_len]
+        pos += extra_len
+        old_pos += diff_len + seek
+        if not 0 <= old_pos <= len(old):
+            raise ValueError("seek outside old image")
+    if pos != len(patch):
+        raise ValueError("trailing data after patch end")
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("old", help="running image")
+    parser.add_argument("new", help="new image, or the patch with --apply")
+    parser.add_argument("-o", "--output", required=True)
+    parser.add_argument("--apply", action="store_true", help="apply a patch instead of building one")
+    parser.add_argument("--gzip", action="store_true", help="gzip the patch (or read a gzipped one with --apply)")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        data = f.read()
+    try:
+        if args.apply:
+            result = apply(old, gzip.decompress(data) if args.gzip else data)
+        else:
+            result = diff(old, data)
+            if apply(old, result) != data:
+                raise ValueError("patch does not rebuild the new image")
+            if args.gzip:
+                result = gzip.compress(result, 9, mtime=0)
+    except (ValueError, struct.error, OSError) as e:
+        sys.exit("gen_delta_patch: %s" % e)
+
+    with open(args.output, "wb") as f:
+        f.write(result)
+    if not args.apply:
+        print("%s: %d bytes for a %d byte image (%.1f%%)" %
+              (args.output, len(result), len(data), 100.0 * len(result) / len(data)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,226 @@
+#!/usr/bin/env python3
+"""Serves a firmware image to ESP32OtaMqtt devices over MQTT.
+
+Usage:
+    mqtt_chunk_publisher.py --host broker.local --topic ota/fw/1.3.0 firmware.bin
+    mqtt_chunk_publisher.py --host broker.local --port 8883 --tls --cafile ca.pem \\
+        --user ota --password secret --topic ota/fw/1.3.0 --version 1.3.0 firmware.bin
+
+Reference publisher for "mqtt://<topic>" firmware URLs. It subscribes to
+<topic>/req and answers each JSON request
+
+    {"version":"1.3.0","chunk_size":1024,"next":16,"window":8,"missing":[17,19]}
+
+with numbered chunks on <topic>, each "<index u32 LE><total u32 LE><data>".
+Every chunk except the last carries exactly chunk_size bytes. A request
+without "missing" acknowledges the chunks below "next" and asks for the window
+after it; chunks of that window already sent are not sent again. A request
+with "missing" asks for just those chunks. A "next" lower than before means
+the device started over. Devices updating together share the chunks, as they
+all subscribe to <topic>. Speaks MQTT 3.1.1 with QoS 0; no third-party modules
+are needed.
+"""
+
+import argparse
+import json
+import socket
+import ssl
+import struct
+import sys
+import time
+
+CHUNK_HEADER = struct.Struct("<II")
+MAX_CHUNK_SIZE = 0xFFFF     # OtaMqttTransfer::begin() limit
+MAX_WINDOW = 32             # OtaMqttTransfer::MAX_WINDOW
+KEEP_ALIVE = 60
+
+CONNECT, CONNACK, PUBLISH, SUBSCRIBE, SUBACK, PINGREQ, PINGRESP, DISCONNECT = 1, 2, 3, 8, 9, 12, 13, 14
+
+
+class ChunkServer:
+    """The request protocol, without the MQTT connection."""
+
+    def __init__(self, image, version=None):
+        self.image = image
+        self.version = version
+        self.sent_up_to = 0     # Chunks below this went out since the last restart
+        self.acked = 0          # "next" of the last plain request
+        self.chunk_size = 0
+
+    def chunk(self, index, chunk_size, total):
+        data = self.image[index * chunk_size:(index + 1) * chunk_size]
+        return CHUNK_HEADER.pack(index, total) + data
+
+    def handle(self, payload):
+        """Chunks to publish for one request payload; [] for requests to ignore."""
+        try:
+            request = json.loads(payload)
+            chunk_size = int(request["chunk_size"])
+            next_index = int(request["next"])
+            window = min(int(request["window"]), MAX_WINDOW)
+        except (ValueError, KeyError, TypeError):
+            return []
+        if self.version and request.get("version") != self.version:
+            return []
+        if not 0 < chunk_size <= MAX_CHUNK_SIZE or window <= 0 or next_index < 0:
+            return []
+        total = (len(self.image) + chunk_size - 1) // chunk_size
+
+        if chunk_size != self.chunk_size or next_index < self.acked:
+            self.sent_up_to = next_index    # New transfer, or a retry from the start
+        self.chunk_size = chunk_size
+
+        if "missing" in request:
+            try:
+                indexes = [int(i) for i in request["missing"]]
+            except (ValueError, TypeError):
+                return []
+        else:
+            self.acked = next_index
+            start = max(next_index, self.sent_up_to)
+            indexes = range(start, next_index + window)
+        indexes = [i for i in indexes if next_index <= i < min(next_index + window, total)]
+        if indexes:
+            self.sent_up_to = max(self.sent_up_to, max(indexes) + 1)
+        return [self.chunk(i, chunk_size, total) for i in indexes]
+
+
+def encode_length(length):
+    out = bytearray()
+    while True:
+        byte = length % 128
+        length //= 128
+        out.append(byte | (0x80 if length else 0))
+        if not length:
+            return bytes(out)
+
+
+def encode_string(text):
+    data = text.encode()
+    return struct.pack(">H", len(data)) + data
+
+
+class MqttConnection:
+    def __init__(self, sock):
+        self.sock = sock
+        self.buffer = b""
+
+    def send(self, packet_type, flags, body):
+        self.sock.sendall(bytes([(packet_type << 4) | flags]) + encode_length(len(body)) + body)
+
+    def receive(self):
+        """(type, flags, body) of the next packet, None on timeout."""
+        try:
+            while True:
+                packet = self.parse()
+                if packet:
+                    return packet
+                data = self.sock.recv(65536)
+                if not data:
+                    raise ConnectionError("connection closed by broker")
+                self.buffer += data
+        except socket.timeout:
+            return None
+
+    def parse(self):
+        length, multiplier, pos = 0, 1, 1
+        while True:
+            if pos >= len(self.buffer):
+                return None
+            byte = self.buffer[pos]
+            length += (byte & 0x7F) * multiplier
+            multiplier *= 128
+            pos += 1
+            if not byte & 0x80:
+                break
+        if len(self.buffer) < pos + length:
+            return None
+        header = self.buffer[0]
+        body = self.buffer[pos:pos + length]
+        self.buffer = self.buffer[pos + length:]
+        return header >> 4, header & 0x0F, body
+
+    def connect(self, client_id, user, password):
+        flags = 0x02    # Clean session
+        payload = encode_string(client_id)
+        if user:
+            flags |= 0x80
+            payload += encode_string(user)
+            if password:
+                flags |= 0x40
+                payload += encode_string(password)
+        self.send(CONNECT, 0, encode_string("MQTT") + bytes([4, flags]) + struct.pack(">H", KEEP_ALIVE) + payload)
+        packet = self.receive()
+        if not packet or packet[0] != CONNACK or packet[2][1] != 0:
+            raise ConnectionError("broker refused the connection")
+
+    def subscribe(self, topic):
+        self.send(SUBSCRIBE, 2, struct.pack(">H", 1) + encode_string(topic) + b"\x00")
+
+    def publish(self, topic, payload):
+        self.send(PUBLISH, 0, encode_string(topic) + payload)
+
+
+def open_connection(args):
+    sock = socket.create_connection((args.host, args.port), timeout=10)
+    if args.tls:
+        context = ssl.create_default_context(cafile=args.cafile)
+        if args.insecure:
+            context.check_hostname = False
+            context.verify_mode = ssl.CERT_NONE
+        sock = context.wrap_socket(sock, server_hostname=args.host)
+    sock.settimeout(KEEP_ALIVE / 2)
+    connection = MqttConnection(sock)
+    connection.connect(args.client_id, args.user, args.password)
+    return connection
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("image", help="firmware image (or delta patch) to serve")
+    parser.add_argument("--topic", required=True, help="the <topic> of mqtt://<topic>")
+    parser.add_argument("--version", help="only answer requests for this version")
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--tls", action="store_true")
+    parser.add_argument("--cafile", help="CA of the broker certificate (with --tls)")
+    parser.add_argument("--insecure", action="store_true", help="do not verify the broker (with --tls)")
+    parser.add_argument("--user")
+    parser.add_argument("--password")
+    parser.add_argument("--client-id", default="ota-chunk-publisher")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        server = ChunkServer(f.read(), args.version)
+    if not server.image:
+        sys.exit("mqtt_chunk_publisher: image is empty")
+
+    request_topic = args.topic + "/req"
+    connection = None
+    try:
+        connection = open_connection(args)
+        connection.subscribe(request_topic)
+        print("Serving %s (%d bytes) on %s" % (args.image, len(server.image), args.topic))
+        last_ping = time.monotonic()
+        while True:
+            packet = connection.receive()
+            if packet and packet[0] == PUBLISH:
+                body = packet[2]
+                topic_length = struct.unpack_from(">H", body)[0]
+                topic = body[2:2 + topic_length].decode(errors="replace")
+                payload = body[2 + topic_length + (2 if packet[1] & 0x06 else 0):]
+                if topic == request_topic:
+                    for chunk in server.handle(payload):
+                        connection.publish(args.topic, chunk)
+            if time.monotonic() - last_ping > KEEP_ALIVE / 2:
+                connection.send(PINGREQ, 0, b"")
+                last_ping = time.monotonic()
+    except (OSError, ConnectionError) as e:
+        sys.exit("mqtt_chunk_publisher: %s" % e)
+    except KeyboardInterrupt:
+        if connection:
+            connection.send(DISCONNECT, 0, b"")
+
+
+if __name__ == "__main__":
+    main()